@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+
+// counts heap allocations for a chain of eager series operations
+// the same expression is run on heap backed series and on arena backed series inside an ArenaScope
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+
+#include <gregorian.date.policy.hpp>
+#include <numeric.traits.hpp>
+#include <tslib/arena.hpp>
+#include <tslib/tseries.hpp>
+#include <vector.backend.hpp>
+
+using namespace tslib;
+
+static std::atomic<size_t> allocations{0};
+
+void *operator new(size_t n) {
+  ++allocations;
+  if (void *p = std::malloc(n ? n : 1)) { return p; }
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+template <template <typename, typename, typename> class BACKEND>
+using bench_ts = TSeries<long, double, long, BACKEND, GregorianDate, RNT>;
+
+template <template <typename, typename, typename> class BACKEND> bench_ts<BACKEND> make(long nr, long nc, double v) {
+  bench_ts<BACKEND> x(nr, nc);
+  std::iota(x.index_begin(), x.index_end(), 0);
+  std::fill(x.col_begin(0), x.col_end(nc - 1), v);
+  return x;
+}
+
+// one frame of scratch work, only the last value survives
+template <template <typename, typename, typename> class BACKEND>
+double frame(const bench_ts<BACKEND> &x, const bench_ts<BACKEND> &y, const bench_ts<BACKEND> &z) {
+  const bench_ts<BACKEND> r{((x + y) * z - x.lag(1)) / (y + z)};
+  return r.col_begin(0)[0];
+}
+
+int main() {
+  const long NR{1000}, NC{4};
+  const int ITERS{20000};
+
+  std::printf("%8s %8s %10s %14s %14s %10s\n", "backend", "iters", "ms", "allocations", "allocs/iter", "checksum");
+
+  {
+    const auto x = make<VectorBackend>(NR, NC, 1.), y = make<VectorBackend>(NR, NC, 2.), z = make<VectorBackend>(NR, NC, 3.);
+    double sum{0};
+    const size_t before{allocations};
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERS; ++i) { sum += frame(x, y, z); }
+    const auto stop = std::chrono::steady_clock::now();
+    const size_t n{allocations - before};
+    std::printf("%8s %8d %10.1f %14zu %14.2f %10.1f\n", "heap", ITERS,
+                std::chrono::duration<double, std::milli>(stop - start).count(), n, double(n) / ITERS, sum);
+  }
+
+  {
+    const auto x = make<ArenaBackend>(NR, NC, 1.), y = make<ArenaBackend>(NR, NC, 2.), z = make<ArenaBackend>(NR, NC, 3.);
+    double sum{0};
+    const size_t before{allocations};
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERS; ++i) {
+      ArenaScope scope;
+      sum += frame(x, y, z);
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    const size_t n{allocations - before};
+    std::printf("%8s %8d %10.1f %14zu %14.2f %10.1f\n", "arena", ITERS,
+                std::chrono::duration<double, std::milli>(stop - start).count(), n, double(n) / ITERS, sum);
+  }
+  return 0;
+}
@@ -0,0 +1,280 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+
+// throughput of the core series operations over a matrix of shapes
+//  rows x cols x overlap of the two indexes x NA density x value type
+// every case reports the best of several runs as ns per element and the bytes read and written per element
+//
+//  bin/core.bench                       print the table
+//  bin/core.bench --quick               smaller shapes and fewer runs, for a quick look
+//  bin/core.bench --json FILE           also write the results as json, one case per line
+//  bin/core.bench --compare FILE        print the change against a stored run, exit 1 if a case got slower
+//                                       than --tolerance (default 0.25, ie 25%) allows
+// the stored baseline is baseline/core.json, regenerate it with make baseline on the machine you compare on
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gregorian.date.policy.hpp>
+#include <numeric.traits.hpp>
+#include <tslib/intersection.map.hpp>
+#include <tslib/na.hpp>
+#include <tslib/pipeline.hpp>
+#include <tslib/tseries.hpp>
+#include <vector.backend.hpp>
+
+using namespace tslib;
+
+// best of reps wall time in nanoseconds, after one untimed run to warm the caches and the allocator
+// std::cout is silenced while timing so that anything an operation prints doesn't reach the terminal
+template <typename F> double time_ns(F f, int reps) {
+  double best{1e300};
+  std::cout.setstate(std::ios::failbit);
+  f();
+  for (int r = 0; r < reps; ++r) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto stop = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(stop - start).count());
+  }
+  std::cout.clear();
+  return best;
+}
+
+class Case {
+public:
+  std::string op;
+  std::string type;
+  long rows;
+  long cols;
+  double overlap;
+  double na;
+  double ns_per_element;
+  double bytes_per_element;
+
+  // identifies the case in a stored run
+  std::string key() const {
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "%s/%s/%ld/%ld/%.2f/%.2f", op.c_str(), type.c_str(), rows, cols, overlap, na);
+    return buf;
+  }
+};
+
+template <typename T> const char *type_name();
+template <> const char *type_name<double>() { return "double"; }
+template <> const char *type_name<int>() { return "int"; }
+
+template <typename T> T value_at(std::mt19937_64 &rng) { return static_cast<T>(rng() % 1000) + 1; }
+
+// fills a pair of series of the same shape
+// the lhs index is every other day, the rhs index takes the same day for a fraction overlap of the rows and the
+// day after otherwise, so overlap 1 gives identical indexes and anything less needs a full intersection
+template <typename T>
+void fill_pair(double overlap, double na, TSeries<long, T, long, VectorBackend, GregorianDate, RNT> &lhs,
+               TSeries<long, T, long, VectorBackend, GregorianDate, RNT> &rhs) {
+  const long rows{lhs.nrow()}, cols{lhs.ncol()};
+  std::mt19937_64 rng(rows * 31 + cols);
+  std::uniform_real_distribution<double> u(0, 1);
+  for (long i = 0; i < rows; ++i) {
+    lhs.index_begin()[i] = 2 * i;
+    rhs.index_begin()[i] = 2 * i + (u(rng) < overlap ? 0 : 1);
+  }
+  for (long c = 0; c < cols; ++c) {
+    for (long i = 0; i < rows; ++i) {
+      lhs.col_begin(c)[i] = u(rng) < na ? RNT<T>::NA() : value_at<T>(rng);
+      rhs.col_begin(c)[i] = u(rng) < na ? RNT<T>::NA() : value_at<T>(rng);
+    }
+  }
+}
+
+// runs every operation on one cell of the matrix
+template <typename T>
+void run_cell(long rows, long cols, double overlap, double na, int reps, std::vector<Case> &cases) {
+  typedef TSeries<long, T, long, VectorBackend, GregorianDate, RNT> ts;
+  ts lhs(rows, cols), rhs(rows, cols);
+  fill_pair(overlap, na, lhs, rhs);
+  const double elements{static_cast<double>(rows * cols)};
+  const double row_bytes{static_cast<double>(sizeof(long) + cols * sizeof(T))};
+  auto add = [&](const char *op, double ns, double bytes) {
+    cases.push_back(Case{op, type_name<T>(), rows, cols, overlap, na, ns / elements, bytes / elements});
+  };
+
+  // reads both series, writes one row per common index value
+  long matched{0};
+  const double sum_ns{time_ns([&] { matched = (lhs + rhs).nrow(); }, reps)};
+  add("binary_opp", sum_ns, 2 * rows * row_bytes + matched * row_bytes);
+
+  // reads and writes every value in place
+  const double compound_ns{time_ns([&] { lhs += T(1); }, reps)};
+  add("compound", compound_ns, 2 * elements * sizeof(T));
+
+  // the same with validity masks on both sides, the NAs come from the masks instead of the values
+  ts lhs_masked(lhs), rhs_masked(rhs);
+  build_validity(lhs_masked);
+  build_validity(rhs_masked);
+  const double masked_ns{time_ns([&] { matched = (lhs_masked + rhs_masked).nrow(); }, reps)};
+  add("binary_opp_masked", masked_ns, 2 * rows * row_bytes + matched * row_bytes + 3 * elements / 8);
+  const double compound_masked_ns{time_ns([&] { lhs_masked += T(1); }, reps)};
+  add("compound_masked", compound_masked_ns, 2 * elements * sizeof(T) + elements / 8);
+
+  // a copy of all but the first row
+  const double lag_ns{time_ns([&] { matched = lhs.lag_copy(1).nrow(); }, reps)};
+  add("lag_copy", lag_ns, 2 * (rows - 1) * row_bytes);
+
+  // a copy, then the second step and the transform run in place on the temporary
+  if (overlap == 1) {
+    const double chain_ns{time_ns([&] { matched = ((lhs * T(2)) + T(1)).nrow(); }, reps)};
+    add("scalar_chain", chain_ns, 4 * elements * sizeof(T) + rows * sizeof(long));
+    const auto steps(pipeline().scale(2).shift(1).clip(0, 100));
+    const double pipeline_ns{time_ns([&] { matched = lhs.apply(steps).nrow(); }, reps)};
+    add("pipeline", pipeline_ns, 2 * elements * sizeof(T) + rows * sizeof(long));
+  }
+
+  // the shapes below don't depend on every axis, only run them once
+  if (cols == 1 && na == 0 && std::is_same<T, double>::value) {
+    const double map_ns{time_ns(
+        [&] {
+          matched = intersection_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end()).size();
+        },
+        reps)};
+    add("intersection_map", map_ns, 2 * rows * sizeof(long) + matched * 2 * sizeof(size_t));
+  }
+  if (overlap == 1 && rows <= 100000) {
+    std::ostringstream os;
+    const double print_ns{time_ns(
+        [&] {
+          os.str(std::string());
+          os << lhs;
+        },
+        std::min(reps, 3))};
+    add("operator<<", print_ns, rows * row_bytes + static_cast<double>(os.str().size()));
+  }
+}
+
+// a stored run, keyed by Case::key
+std::map<std::string, double> read_json(const char *path) {
+  std::map<std::string, double> res;
+  std::ifstream in(path);
+  if (!in) {
+    std::fprintf(stderr, "can't read %s\n", path);
+    std::exit(2);
+  }
+  // value of "name": in one line as written by write_json
+  auto field = [](const std::string &line, const char *name) {
+    const std::string tag{std::string("\"") + name + "\": "};
+    const size_t p{line.find(tag)};
+    if (p == std::string::npos) { return std::string(); }
+    size_t b{p + tag.size()}, e{b};
+    if (line[b] == '"') { e = line.find('"', ++b); }
+    else { e = line.find_first_of(",}", b); }
+    return line.substr(b, e - b);
+  };
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.find("\"op\"") == std::string::npos) { continue; }
+    Case c{field(line, "op"), field(line, "type"), std::atol(field(line, "rows").c_str()),
+           std::atol(field(line, "cols").c_str()), std::atof(field(line, "overlap").c_str()),
+           std::atof(field(line, "na").c_str()), std::atof(field(line, "ns_per_element").c_str()), 0};
+    res[c.key()] = c.ns_per_element;
+  }
+  return res;
+}
+
+void write_json(const char *path, const std::vector<Case> &cases) {
+  std::FILE *f{std::fopen(path, "w")};
+  if (!f) {
+    std::fprintf(stderr, "can't write %s\n", path);
+    std::exit(2);
+  }
+  std::fprintf(f, "[\n");
+  for (size_t k = 0; k < cases.size(); ++k) {
+    const Case &c{cases[k]};
+    std::fprintf(f,
+                 "  {\"op\": \"%s\", \"type\": \"%s\", \"rows\": %ld, \"cols\": %ld, \"overlap\": %.2f, \"na\": %.2f, "
+                 "\"ns_per_element\": %.4f, \"bytes_per_element\": %.2f}%s\n",
+                 c.op.c_str(), c.type.c_str(), c.rows, c.cols, c.overlap, c.na, c.ns_per_element, c.bytes_per_element,
+                 k + 1 < cases.size() ? "," : "");
+  }
+  std::fprintf(f, "]\n");
+  std::fclose(f);
+}
+
+int main(int argc, char **argv) {
+  bool quick{false};
+  const char *json{nullptr}, *compare{nullptr};
+  double tolerance{0.25};
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--quick")) {
+      quick = true;
+    } else if (!std::strcmp(argv[i], "--json") && i + 1 < argc) {
+      json = argv[++i];
+    } else if (!std::strcmp(argv[i], "--compare") && i + 1 < argc) {
+      compare = argv[++i];
+    } else if (!std::strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+      tolerance = std::atof(argv[++i]);
+    } else {
+      std::fprintf(stderr, "usage: %s [--quick] [--json FILE] [--compare FILE] [--tolerance X]\n", argv[0]);
+      return 2;
+    }
+  }
+  const std::map<std::string, double> baseline(compare ? read_json(compare) : std::map<std::string, double>());
+
+  const std::vector<long> rows(quick ? std::vector<long>{10000} : std::vector<long>{10000, 1000000});
+  const std::vector<long> cols{1, 8};
+  const std::vector<double> overlaps{1.0, 0.5, 0.1};
+  const std::vector<double> nas{0.0, 0.1};
+  const int reps{quick ? 3 : 7};
+
+  std::vector<Case> cases;
+  for (long r : rows) {
+    for (long c : cols) {
+      for (double o : overlaps) {
+        for (double n : nas) {
+          run_cell<double>(r, c, o, n, reps, cases);
+          run_cell<int>(r, c, o, n, reps, cases);
+        }
+      }
+    }
+  }
+
+  bool slower{false};
+  std::printf("%-18s %-7s %9s %5s %8s %6s %12s %12s %10s\n", "op", "type", "rows", "cols", "overlap", "na", "ns/elem",
+              "bytes/elem", compare ? "vs base" : "");
+  for (const Case &c : cases) {
+    char change[32] = "";
+    const auto b = baseline.find(c.key());
+    if (b != baseline.end() && b->second > 0) {
+      const double ratio{c.ns_per_element / b->second};
+      std::snprintf(change, sizeof(change), "%+.1f%%%s", (ratio - 1) * 100, ratio > 1 + tolerance ? " !" : "");
+      slower = slower || ratio > 1 + tolerance;
+    }
+    std::printf("%-18s %-7s %9ld %5ld %8.2f %6.2f %12.3f %12.2f %10s\n", c.op.c_str(), c.type.c_str(), c.rows, c.cols,
+                c.overlap, c.na, c.ns_per_element, c.bytes_per_element, change);
+  }
+  if (json) { write_json(json, cases); }
+  return slower ? 1 : 0;
+}
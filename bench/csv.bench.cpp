@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+
+// text throughput: write_csv against operator<<, and read_csv from a file and from a stream
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include <gregorian.date.policy.hpp>
+#include <numeric.traits.hpp>
+#include <tslib/csv.hpp>
+#include <tslib/tseries.hpp>
+#include <vector.backend.hpp>
+
+using namespace tslib;
+
+typedef TSeries<long, double, long, VectorBackend, GregorianDate, RNT> bench_ts;
+
+template <typename F> double seconds(F f) {
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  const long NR{1000000}, NC{4};
+  const std::string path{"csv.bench.csv"};
+  bench_ts x(NR, NC);
+  std::mt19937_64 gen(1);
+  std::uniform_int_distribution<long> cents(1000, 1000000);
+  for (long i = 0; i < NR; ++i) { x.index_begin()[i] = i; }
+  for (long c = 0; c < NC; ++c) {
+    for (long i = 0; i < NR; ++i) { x.col_begin(c)[i] = static_cast<double>(cents(gen)) / 100; }
+  }
+
+  std::printf("%14s %10s %10s\n", "case", "seconds", "MB/s");
+  auto report = [](const char *name, double secs, double bytes) {
+    std::printf("%14s %10.3f %10.1f\n", name, secs, bytes / secs / 1e6);
+  };
+
+  double bytes{0};
+  const double w{seconds([&] {
+    std::ofstream os(path, std::ios::binary);
+    write_csv(os, x);
+    bytes = static_cast<double>(os.tellp());
+  })};
+  report("write_csv", w, bytes);
+
+  std::stringstream printed;
+  const double p{seconds([&] { printed << x; })};
+  report("operator<<", p, static_cast<double>(printed.str().size()));
+
+  double check{0};
+  const double r{seconds([&] { check += read_csv<bench_ts>(path).col_begin(NC - 1)[NR - 1]; })};
+  report("read_csv file", r, bytes);
+
+  std::ifstream is(path, std::ios::binary);
+  const double s{seconds([&] { check += read_csv<bench_ts>(is).col_begin(NC - 1)[NR - 1]; })};
+  report("read_csv istr", s, bytes);
+
+  std::remove(path.c_str());
+  return check == 2 * x.col_begin(NC - 1)[NR - 1] ? 0 : 1;
+}
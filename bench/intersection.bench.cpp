@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+
+// compares the adaptive intersection_map against the plain two pointer merge
+// a long minute bar style index is intersected with shorter indexes at increasing skew ratios
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <tslib/intersection.map.hpp>
+
+using namespace tslib;
+
+// best of reps wall time in milliseconds
+template <typename F> double time_ms(F f, int reps) {
+  double best{1e300};
+  for (int r = 0; r < reps; ++r) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto stop = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(stop - start).count());
+  }
+  return best;
+}
+
+int main() {
+  const size_t LEN{2000000};
+  const int REPS{5};
+  std::mt19937_64 rng(42);
+
+  // long index with gaps, like minute bars across sessions
+  std::vector<long> x(LEN);
+  long v{0};
+  for (auto &e : x) { e = v += 1 + (rng() % 4 == 0); }
+
+  std::printf("%10s %10s %10s %12s %12s %12s %9s\n", "ratio", "xlen", "ylen", "matches", "linear_ms", "adaptive_ms",
+              "speedup");
+  for (size_t ratio : {1UL, 2UL, 8UL, 32UL, 128UL, 1024UL, 10000UL}) {
+    // every ratio-th element of x plus a shifted copy that won't match, sorted
+    std::vector<long> y;
+    for (size_t i = 0; i < LEN; i += ratio) {
+      y.push_back(x[i]);
+      if (i % 2) { y.push_back(x[i] + 1); }
+    }
+    std::sort(y.begin(), y.end());
+    y.erase(std::unique(y.begin(), y.end()), y.end());
+
+    size_t matches{0};
+    const double linear{time_ms(
+        [&] { matches = linear_intersection_map(x.cbegin(), x.cend(), y.cbegin(), y.cend()).size(); }, REPS)};
+    size_t check{0};
+    const double adaptive{
+        time_ms([&] { check = intersection_map(x.cbegin(), x.cend(), y.cbegin(), y.cend()).size(); }, REPS)};
+    if (check != matches) {
+      std::fprintf(stderr, "mismatch at ratio %zu: %zu vs %zu\n", ratio, check, matches);
+      return 1;
+    }
+    std::printf("%10zu %10zu %10zu %12zu %12.3f %12.3f %8.1fx\n", ratio, x.size(), y.size(), matches, linear, adaptive,
+                linear / adaptive);
+  }
+  return 0;
+}
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+
+// per tick cost of keeping x + y and a rolling mean of it up to date over a long history
+// streaming nodes against recomputing from scratch on every tick
+
+#include <chrono>
+#include <cstdio>
+
+#include <append.backend.hpp>
+#include <gregorian.date.policy.hpp>
+#include <numeric.traits.hpp>
+#include <tslib/rolling.hpp>
+#include <tslib/stream.hpp>
+#include <tslib/tseries.hpp>
+
+using namespace tslib;
+
+typedef TSeries<long, double, long, AppendBackend, GregorianDate, RNT> live_ts;
+typedef AppendBackend<long, double, long> backend;
+
+int main() {
+  const long HISTORY{1000000}, TICKS{2000}, RECOMPUTE{20};
+  live_ts x(backend::create(2)), y(backend::create(2));
+  for (long i = 0; i < HISTORY; ++i) {
+    x.getBackend().append(i, {double(i % 101), double(i % 7)});
+    y.getBackend().append(i, {double(i % 11), double(i % 3)});
+  }
+  live_ts sum(backend::create(2)), mean(backend::create(2));
+  auto sum_node  = stream_binary<PlusFunctor>(x, y);
+  auto mean_node = stream_rolling<RollingMean>(sum, 50);
+  sum_node.update(sum);
+  mean_node.update(mean);
+
+  long t{HISTORY};
+  auto start = std::chrono::steady_clock::now();
+  for (long k = 0; k < TICKS; ++k, ++t) {
+    x.getBackend().append(t, {1., 2.});
+    y.getBackend().append(t, {3., 4.});
+    sum_node.update(sum);
+    mean_node.update(mean);
+  }
+  const double streamed{std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / TICKS};
+
+  double check{0};
+  start = std::chrono::steady_clock::now();
+  for (long k = 0; k < RECOMPUTE; ++k, ++t) {
+    x.getBackend().append(t, {1., 2.});
+    y.getBackend().append(t, {3., 4.});
+    check += rolling_mean(x + y, 50).col_begin(0)[HISTORY];
+  }
+  const double full{std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / RECOMPUTE};
+
+  std::printf("%12s %14s\n", "mode", "us/tick");
+  std::printf("%12s %14.2f\n", "streaming", streamed);
+  std::printf("%12s %14.2f\n", "recompute", full);
+  return check > 0 && mean.nrow() == HISTORY + TICKS ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace tslib {
+
+// rows [first * rows, (first + segs.size()) * rows) of an append backend, row numbers count from the first append
+// segment k holds the index and every column (column major) of rows [k * rows, (k + 1) * rows)
+template <typename IDX, typename T> class AppendTable {
+public:
+  class Segment {
+  public:
+    std::vector<IDX> index;
+    std::vector<T> data;
+    Segment(size_t rows, size_t ncol) : index(rows), data(rows * ncol) {}
+  };
+  size_t first;
+  std::vector<std::shared_ptr<Segment>> segs;
+  AppendTable() : first{0}, segs() {}
+};
+
+// random access iterator over the index (INDEX) or a column of an append backend
+template <typename V, typename IDX, typename T, bool INDEX> class AppendIterator {
+private:
+  template <typename, typename, typename, bool> friend class AppendIterator;
+  typedef AppendTable<IDX, T> table_type;
+  const table_type *table_;
+  size_t col_;
+  size_t pos_;
+  unsigned shift_;
+
+  static V &at(typename table_type::Segment &s, size_t col, size_t rows, size_t o, std::true_type) { return s.index[o]; }
+  static V &at(typename table_type::Segment &s, size_t col, size_t rows, size_t o, std::false_type) {
+    return s.data[col * rows + o];
+  }
+
+public:
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef typename std::remove_const<V>::type value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef V *pointer;
+  typedef V &reference;
+
+  AppendIterator() : table_{nullptr}, col_{0}, pos_{0}, shift_{0} {}
+  AppendIterator(const table_type *table, size_t col, size_t pos, unsigned shift)
+      : table_{table}, col_{col}, pos_{pos}, shift_{shift} {}
+  // mutable to const
+  template <typename U, typename = typename std::enable_if<std::is_same<const U, V>::value>::type>
+  AppendIterator(const AppendIterator<U, IDX, T, INDEX> &it)
+      : table_{it.table_}, col_{it.col_}, pos_{it.pos_}, shift_{it.shift_} {}
+  AppendIterator(const AppendIterator &)            = default;
+  AppendIterator &operator=(const AppendIterator &) = default;
+
+  reference operator*() const {
+    const size_t rows{size_t(1) << shift_};
+    return at(*table_->segs[(pos_ >> shift_) - table_->first], col_, rows, pos_ & (rows - 1),
+              std::integral_constant<bool, INDEX>());
+  }
+  pointer operator->() const { return &**this; }
+  reference operator[](difference_type n) const { return *(*this + n); }
+
+  AppendIterator &operator++() {
+    ++pos_;
+    return *this;
+  }
+  AppendIterator operator++(int) {
+    AppendIterator ans(*this);
+    ++pos_;
+    return ans;
+  }
+  AppendIterator &operator--() {
+    --pos_;
+    return *this;
+  }
+  AppendIterator operator--(int) {
+    AppendIterator ans(*this);
+    --pos_;
+    return ans;
+  }
+  AppendIterator &operator+=(difference_type n) {
+    pos_ = static_cast<size_t>(static_cast<difference_type>(pos_) + n);
+    return *this;
+  }
+  AppendIterator &operator-=(difference_type n) { return *this += -n; }
+  AppendIterator operator+(difference_type n) const { return AppendIterator(*this) += n; }
+  AppendIterator operator-(difference_type n) const { return AppendIterator(*this) -= n; }
+  friend AppendIterator operator+(difference_type n, const AppendIterator &it) { return it + n; }
+  difference_type operator-(const AppendIterator &rhs) const {
+    return static_cast<difference_type>(pos_) - static_cast<difference_type>(rhs.pos_);
+  }
+
+  bool operator==(const AppendIterator &rhs) const { return pos_ == rhs.pos_; }
+  bool operator!=(const AppendIterator &rhs) const { return pos_ != rhs.pos_; }
+  bool operator<(const AppendIterator &rhs) const { return pos_ < rhs.pos_; }
+  bool operator>(const AppendIterator &rhs) const { return pos_ > rhs.pos_; }
+  bool operator<=(const AppendIterator &rhs) const { return pos_ <= rhs.pos_; }
+  bool operator>=(const AppendIterator &rhs) const { return pos_ >= rhs.pos_; }
+};
+
+// template for an append only backend, for series that grow a row at a time
+//
+// rows are stored in segments of a fixed number of rows (a power of two), see AppendTable
+// appending writes the row into the last segment and starts a new segment when it is full, so it costs
+// O(ncol) and nothing stored before moves
+// in ring mode (capacity > 0) only the last capacity rows are kept, segments are dropped off the front once
+// every row in them is older than that
+//
+// one writer, any number of readers
+//  the writer appends, readers take snapshot() (or copy the series) and get the rows published so far
+//  a snapshot shares the segments rather than copying them, and later appends don't change it
+//  a row is published by storing the row count with release semantics after the row is written, and
+//  segments are added and dropped by replacing the segment table, so readers never wait on the writer
+//  appending invalidates iterators of the writer's series, like push_back on a vector
+//  writing to existing rows of the writer's series through its iterators is not safe while readers snapshot it
+// copies and snapshots are copy on write: mutable iterators or an append give them segments of their own first,
+// and the original does the same for mutable iterators once it has been copied
+template <typename IDX, typename T, typename DIM> class AppendBackend {
+private:
+  typedef AppendTable<IDX, T> table_type;
+  typedef typename table_type::Segment segment_type;
+
+  DIM ncol_;
+  unsigned shift_;
+  // rows kept in ring mode, 0 to keep them all
+  size_t capacity_;
+  // replaced whole, through atomic_load and atomic_store, when segments come or go
+  std::shared_ptr<const table_type> table_;
+  // rows [begin_, end_) in row numbers, begin_ is only used by copies (the writer's moves with end_)
+  size_t begin_;
+  std::atomic<size_t> end_;
+  // this backend appends to its segments in place
+  bool owner_;
+  // the segments have been shared with a copy
+  mutable std::atomic<bool> shared_;
+  std::shared_ptr<const std::vector<std::string>> colnames_;
+
+  size_t segment_rows() const { return size_t(1) << shift_; }
+
+  static unsigned log2_ceil(size_t n) {
+    unsigned s{0};
+    while ((size_t(1) << s) < n) { ++s; }
+    return s;
+  }
+
+  std::shared_ptr<segment_type> make_segment() const {
+    return std::make_shared<segment_type>(segment_rows(), static_cast<size_t>(ncol_));
+  }
+
+  // first row of the writer's series when it has end rows
+  size_t first_row(size_t end, const table_type &t) const {
+    const size_t lo{t.first << shift_};
+    return capacity_ && end > capacity_ ? std::max(end - capacity_, lo) : lo;
+  }
+
+  size_t begin_row() const { return owner_ ? first_row(end_.load(std::memory_order_acquire), *table_) : begin_; }
+  size_t end_row() const { return end_.load(std::memory_order_acquire); }
+
+  AppendBackend(DIM ncol, size_t capacity, unsigned shift)
+      : ncol_{ncol}, shift_{shift}, capacity_{capacity}, table_{std::make_shared<table_type>()}, begin_{0}, end_{0},
+        owner_{true}, shared_{false}, colnames_{} {}
+
+  // gives this backend its own segments with the same rows, starting again from row 0
+  void detach() {
+    const size_t b{begin_row()}, e{end_row()};
+    auto t = std::make_shared<table_type>();
+    for (size_t r = b; r < e; r += segment_rows()) { t->segs.push_back(make_segment()); }
+    const size_t rows{segment_rows()};
+    for (size_t r = b; r < e; ++r) {
+      const segment_type &src{*table_->segs[(r >> shift_) - table_->first]};
+      segment_type &dst{*t->segs[(r - b) >> shift_]};
+      const size_t so{r & (rows - 1)}, dso{(r - b) & (rows - 1)};
+      dst.index[dso] = src.index[so];
+      for (size_t c = 0; c < static_cast<size_t>(ncol_); ++c) { dst.data[c * rows + dso] = src.data[c * rows + so]; }
+    }
+    std::atomic_store(&table_, std::shared_ptr<const table_type>(std::move(t)));
+    begin_ = 0;
+    end_.store(e - b, std::memory_order_release);
+    owner_ = true;
+    shared_.store(false);
+  }
+
+  void detach_if_shared() {
+    if (!owner_ || shared_.load()) { detach(); }
+  }
+
+public:
+  typedef AppendIterator<IDX, IDX, T, true> index_iterator;
+  typedef AppendIterator<const IDX, IDX, T, true> const_index_iterator;
+  typedef AppendIterator<const T, IDX, T, false> const_data_iterator;
+  typedef AppendIterator<T, IDX, T, false> data_iterator;
+
+  // no default constructor
+  AppendBackend() = delete;
+  // copies are snapshots of the rows published so far, safe to take on any thread
+  AppendBackend(const AppendBackend &t)
+      : ncol_{t.ncol_}, shift_{t.shift_}, capacity_{t.capacity_}, table_{}, begin_{0}, end_{0}, owner_{false},
+        shared_{true}, colnames_{std::atomic_load(&t.colnames_)} {
+    t.shared_.store(true);
+    // the table first: rows published after it is loaded are whole, and up to the end of its last segment
+    // they are in it, while rows in front of it may have been dropped from newer tables
+    table_ = std::atomic_load(&t.table_);
+    const size_t e{std::min(t.end_row(), (table_->first + table_->segs.size()) << shift_)};
+    begin_ = t.owner_ ? t.first_row(e, *table_) : t.begin_;
+    end_.store(e);
+  }
+  // nrow x ncol zero filled rows, in segments of 4096 rows
+  AppendBackend(DIM nrow, DIM ncol) : AppendBackend(ncol, 0, 12) {
+    auto t = std::make_shared<table_type>();
+    for (size_t r = 0; r < static_cast<size_t>(nrow); r += segment_rows()) { t->segs.push_back(make_segment()); }
+    table_ = std::move(t);
+    end_.store(static_cast<size_t>(nrow));
+  }
+  // no assignment constructor
+  AppendBackend &operator=(const AppendBackend &rhs) = delete;
+  AppendBackend(AppendBackend &&t)
+      : ncol_{t.ncol_}, shift_{t.shift_}, capacity_{t.capacity_}, table_{std::move(t.table_)}, begin_{t.begin_},
+        end_{t.end_.load()}, owner_{t.owner_}, shared_{t.shared_.load()}, colnames_{std::move(t.colnames_)} {}
+
+  // empty series of ncol columns to append to
+  // capacity > 0 keeps only the last capacity rows, segment_rows is rounded up to a power of two
+  static AppendBackend create(DIM ncol, size_t capacity = 0, size_t segment_rows = 4096) {
+    if (segment_rows == 0) { throw std::logic_error("AppendBackend: segments need at least one row"); }
+    return AppendBackend(ncol, capacity, log2_ceil(segment_rows));
+  }
+
+  // a snapshot of the rows published so far, same as a copy
+  AppendBackend snapshot() const { return AppendBackend(*this); }
+
+  // appends a row, values holds one value for each column
+  // the index can't go back in time
+  void append(IDX idx, const T *values) {
+    if (!owner_) { detach(); }
+    const size_t e{end_.load(std::memory_order_relaxed)};
+    if (e > begin_row() && idx < *const_index_iterator(table_.get(), 0, e - 1, shift_)) {
+      throw std::logic_error("AppendBackend: index must not decrease");
+    }
+    const size_t rows{segment_rows()};
+    // a new segment goes into a new table, published before the row in it is
+    if ((e >> shift_) - table_->first == table_->segs.size()) {
+      auto t = std::make_shared<table_type>(*table_);
+      t->segs.push_back(make_segment());
+      std::atomic_store(&table_, std::shared_ptr<const table_type>(std::move(t)));
+    }
+    segment_type &s{*table_->segs[(e >> shift_) - table_->first]};
+    const size_t o{e & (rows - 1)};
+    s.index[o] = idx;
+    for (size_t c = 0; c < static_cast<size_t>(ncol_); ++c) { s.data[c * rows + o] = values[c]; }
+    end_.store(e + 1, std::memory_order_release);
+
+    // in ring mode, drop the segments that are all behind the kept rows
+    if (capacity_ && e + 1 > capacity_) {
+      const size_t keep{(e + 1 - capacity_) >> shift_};
+      if (keep > table_->first) {
+        auto t   = std::make_shared<table_type>();
+        t->first = keep;
+        t->segs.assign(table_->segs.begin() + static_cast<std::ptrdiff_t>(keep - table_->first), table_->segs.end());
+        std::atomic_store(&table_, std::shared_ptr<const table_type>(std::move(t)));
+      }
+    }
+  }
+  void append(IDX idx, std::initializer_list<T> values) {
+    if (values.size() != static_cast<size_t>(ncol_)) { throw std::logic_error("AppendBackend: one value per column"); }
+    append(idx, values.begin());
+  }
+
+  // rows kept in ring mode, 0 when all are kept
+  size_t capacity() const { return capacity_; }
+  // segments held, for tests
+  size_t segments() const { return std::atomic_load(&table_)->segs.size(); }
+
+  DIM nrow() const { return static_cast<DIM>(end_row() - begin_row()); }
+  DIM ncol() const { return ncol_; }
+
+  const_index_iterator index_begin() const { return const_index_iterator(table_.get(), 0, begin_row(), shift_); }
+  index_iterator index_begin() {
+    detach_if_shared();
+    return index_iterator(table_.get(), 0, begin_row(), shift_);
+  }
+  const_index_iterator index_end() const { return const_index_iterator(table_.get(), 0, end_row(), shift_); }
+  index_iterator index_end() {
+    detach_if_shared();
+    return index_iterator(table_.get(), 0, end_row(), shift_);
+  }
+
+  const_data_iterator col_begin(DIM i) const {
+    return const_data_iterator(table_.get(), static_cast<size_t>(i), begin_row(), shift_);
+  }
+  data_iterator col_begin(DIM i) {
+    detach_if_shared();
+    return data_iterator(table_.get(), static_cast<size_t>(i), begin_row(), shift_);
+  }
+  const_data_iterator col_end(DIM i) const {
+    return const_data_iterator(table_.get(), static_cast<size_t>(i), end_row(), shift_);
+  }
+  data_iterator col_end(DIM i) {
+    detach_if_shared();
+    return data_iterator(table_.get(), static_cast<size_t>(i), end_row(), shift_);
+  }
+
+  const std::vector<std::string> getColnames() const {
+    const auto names = std::atomic_load(&colnames_);
+    return names ? *names : std::vector<std::string>();
+  }
+  const DIM getColnamesSize() const {
+    const auto names = std::atomic_load(&colnames_);
+    return names ? static_cast<DIM>(names->size()) : 0;
+  }
+  const bool setColnames(const std::vector<std::string> &names) {
+    if (static_cast<DIM>(names.size()) == ncol_) {
+      std::atomic_store(&colnames_, std::shared_ptr<const std::vector<std::string>>(
+                                        std::make_shared<const std::vector<std::string>>(names)));
+      return true;
+    }
+    return false;
+  }
+};
+
+} // namespace tslib
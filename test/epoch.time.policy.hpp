@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <cstdio>
+#include <iterator>
+#include <string>
+
+#include <tslib/calendar.hpp>
+
+// intraday timestamps: T counts 1 / PER_SECOND seconds since 1970-01-01 00:00:00 UTC
+// the date functions work on the day holding the timestamp, dates before the epoch round down
+template <typename T, long PER_SECOND> class EpochTime {
+private:
+  static constexpr T per_day() { return static_cast<T>(86400) * PER_SECOND; }
+  static const long days(const T x) { return static_cast<long>(tslib::floor_div<T>(x, per_day())); }
+  static const T time_of_day(const T x) { return x - static_cast<T>(days(x)) * per_day(); }
+  static const T on_day(const long d, const T tod) { return static_cast<T>(d) * per_day() + tod; }
+
+public:
+  // static function to convert to a timestamp
+  // throws std::out_of_range for dates that don't exist
+  static const T toDate(const int year, const int month, const int day, const int hour = 0, const int minute = 0,
+                        const int second = 0, const int millisecond = 0) {
+    const T secs{static_cast<T>((hour * 60 + minute) * 60 + second)};
+    return on_day(tslib::checked_days_from_civil(year, month, day),
+                  secs * PER_SECOND + static_cast<T>(millisecond) * PER_SECOND / 1000);
+  }
+  // static function to get a string, eg 1970-Jan-05 09:30:00, with the fraction of a second when there is one
+  // const char format is not used
+  static const std::string toString(const T x, const char *format) {
+    char buf[64];
+    char *out{tslib::format_civil(tslib::civil_from_days(days(x)), buf)};
+    const T tod{time_of_day(x)};
+    const long secs{static_cast<long>(tod / PER_SECOND)};
+    out += std::sprintf(out, " %02ld:%02ld:%02ld", secs / 3600, secs / 60 % 60, secs % 60);
+    const long frac{static_cast<long>(tod % PER_SECOND)};
+    if (frac) {
+      *out++ = '.';
+      for (long p = PER_SECOND / 10; p > 0; p /= 10) { *out++ = static_cast<char>('0' + frac / p % 10); }
+    }
+    return std::string(buf, out);
+  }
+
+  static const int second(const T x) { return static_cast<int>(time_of_day(x) / PER_SECOND % 60); }
+  static const int minute(const T x) { return static_cast<int>(time_of_day(x) / PER_SECOND / 60 % 60); }
+  static const int hour(const T x) { return static_cast<int>(time_of_day(x) / PER_SECOND / 3600); }
+  // return day of week, 0 is sunday
+  static const int dayofweek(const T x) { return tslib::weekday_from_days(days(x)); }
+  static const int dayofmonth(const T x) { return tslib::civil_from_days(days(x)).day; }
+  static const int month(const T x) { return tslib::civil_from_days(days(x)).month; }
+  static const int year(const T x) { return static_cast<int>(tslib::civil_from_days(days(x)).year); }
+  // the last instant of the month, so every timestamp in the month is <= it
+  static const T last_day_of_month(const T x) { return on_day(tslib::last_day_of_month(days(x)) + 1, 0) - 1; }
+  // the calendar moves keep the time of day
+  static const T AddYears(const T x, const int n) { return AddMonths(x, n * 12); }
+  static const T AddMonths(const T x, const int n) { return on_day(tslib::add_months(days(x), n), time_of_day(x)); }
+  static const T AddDays(const T x, const int n) { return x + static_cast<T>(n) * per_day(); }
+  // distance in days, with the fraction
+  static const double daily_distance(const T x, const T y) {
+    return static_cast<double>(x - y) / static_cast<double>(per_day());
+  }
+
+  // splits the dates of the timestamps in [beg, end) into year, month and day arrays with room for the whole range
+  template <typename ITER> static void decompose(ITER beg, ITER end, long *year, int *month, int *day) {
+    for (size_t i = 0; beg != end; ++beg, ++i) {
+      const tslib::CivilDate c{tslib::civil_from_days(days(*beg))};
+      year[i]  = c.year;
+      month[i] = c.month;
+      day[i]   = c.day;
+    }
+  }
+};
+
+// seconds since the epoch
+template <typename T> class EpochSeconds : public EpochTime<T, 1> {};
+// nanoseconds since the epoch
+template <typename T> class EpochNanos : public EpochTime<T, 1000000000> {};
@@ -17,65 +17,58 @@
 
 // cause current source file to be included only once in a single compiliation
 #pragma once
-#include <sstream>
-//#include <boost/date_time/gregorian/gregorian_types.hpp>
-#include <boost/date_time/gregorian/gregorian.hpp>
+#include <iterator>
+#include <string>
+
+#include <tslib/calendar.hpp>
 
 // template class to take in the type
+// RDates are days since 1970-01-01, the calendar arithmetic is in tslib/calendar.hpp
+// results match boost::gregorian, which this policy used to convert through
 template <typename T> class GregorianDate {
 private:
-  // static const boost::gregorian::date fromRDate(const T x) { return boost::gregorian::date(1970,1,1) +
-  // boost::gregorian::date_duration(x); }
-
-  // seems like RDates are ints that use 1970-01-01 as epoch
-
-  // static function to return the boost date
-  // input number of days and it gets you the date since epoch for that number of days
-  static const boost::gregorian::date fromRDate(const T x) {
-    return boost::gregorian::date(1970, 1, 1) + boost::gregorian::days(x);
-  }
-  // static function to return the number of days since epoch after inserting a date
-  static const T toRDate(const boost::gregorian::date x) {
-    return static_cast<int>(boost::gregorian::date_period(boost::gregorian::date(1970, 1, 1), x).length().days());
-  }
+  static const tslib::CivilDate civil(const T x) { return tslib::civil_from_days(static_cast<long>(x)); }
 
 public:
-  // static const T toDate(const char* date, const char* format);
-
-  // static function to convert to days since epoch with inputs from ms
+  // static function to convert to days since epoch, the time of day is ignored
+  // throws std::out_of_range for dates that don't exist
   static const T toDate(const int year, const int month, const int day, const int hour = 0, const int minute = 0,
                         const int second = 0, const int millisecond = 0) {
-    return toRDate(boost::gregorian::date(year, month, day));
+    return static_cast<T>(tslib::checked_days_from_civil(year, month, day));
   }
-  // static function to get a string
-  // inputs number of days since epoch - const char format seems to be useless, does not seem to be doing much
-  // returns the string of the date
+  // static function to get a string, eg 1970-Jan-05
+  // const char format is not used
   static const std::string toString(const T x, const char *format) {
-    std::stringstream ss;
-    ss << fromRDate(x);
-    return ss.str();
+    char buf[32];
+    return std::string(buf, tslib::format_civil(civil(x), buf));
   }
 
   // static functions to return the second, minute, hour all as 0
   static const int second(const T x) { return 0; }
   static const int minute(const T x) { return 0; }
   static const int hour(const T x) { return 0; }
-  // return day of week
-  static const int dayofweek(const T x) { return static_cast<int>(fromRDate(x).day_of_week()); }
+  // return day of week, 0 is sunday
+  static const int dayofweek(const T x) { return tslib::weekday_from_days(static_cast<long>(x)); }
   // return day of month
-  static const int dayofmonth(const T x) { return static_cast<int>(fromRDate(x).day()); }
+  static const int dayofmonth(const T x) { return civil(x).day; }
   // return the month
-  static const int month(const T x) { return static_cast<int>(fromRDate(x).month()); }
+  static const int month(const T x) { return civil(x).month; }
   // return the year
-  static const int year(const T x) { return static_cast<int>(fromRDate(x).year()); }
+  static const int year(const T x) { return static_cast<int>(civil(x).year); }
   //return the last day of the month
-  static const int last_day_of_month(const T x) { return toRDate(fromRDate(x).end_of_month()); }
+  static const int last_day_of_month(const T x) { return static_cast<int>(tslib::last_day_of_month(static_cast<long>(x))); }
   // return the number of days since epoch when providing a date and the number of years to increase by
-  static const T AddYears(const T x, const int n) { return toRDate(fromRDate(x) + boost::gregorian::years(n)); }
-  // return the number of days since epoch when providing a date and the number of months to increase by 
-  static const T AddMonths(const T x, const int n) { return toRDate(fromRDate(x) + boost::gregorian::months(n)); }
+  static const T AddYears(const T x, const int n) { return AddMonths(x, n * 12); }
+  // return the number of days since epoch when providing a date and the number of months to increase by
+  // the last day of a month stays the last day of the month
+  static const T AddMonths(const T x, const int n) { return static_cast<T>(tslib::add_months(static_cast<long>(x), n)); }
   // return the number of days since epoch when providing a date and the number of days to increase by 
-  static const T AddDays(const T x, const int n) { return toRDate(fromRDate(x) + boost::gregorian::days(n)); }
+  static const T AddDays(const T x, const int n) { return x + n; }
   // calculate the number of days between 2 days since epoch
   static const double daily_distance(const T x, const T y) { return x - y; }
+
+  // splits the dates in [beg, end) into year, month and day arrays with room for the whole range
+  template <typename ITER> static void decompose(ITER beg, ITER end, long *year, int *month, int *day) {
+    tslib::civil_from_days(beg, end, year, month, day);
+  }
 };
@@ -0,0 +1,321 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tslib {
+
+// on disk layout of an mmap backend file (version 1)
+//  header, then the index block and one block per column, each block starting on a 64 byte boundary
+//  the colnames go after the last column as (uint32 length, bytes) records
+class MmapHeader {
+public:
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+  // type codes of the index and the values, see mmap_type_code
+  std::uint32_t index_type;
+  std::uint32_t value_type;
+  std::uint64_t nrow;
+  std::uint64_t ncol;
+  std::uint64_t index_offset;
+  std::uint64_t data_offset;
+  // bytes from the start of one column to the start of the next
+  std::uint64_t column_stride;
+  std::uint64_t names_offset;
+  std::uint64_t names_bytes;
+};
+
+// identifies a value type on disk: kind (1 float, 2 signed, 3 unsigned) and size
+template <typename T> std::uint32_t mmap_type_code() {
+  const std::uint32_t kind{std::is_floating_point<T>::value ? 1U : std::is_signed<T>::value ? 2U : 3U};
+  return kind << 8 | static_cast<std::uint32_t>(sizeof(T));
+}
+
+// template for a memory mapped backend
+// the series lives in a mapping, either anonymous (for results) or of a file in the layout above
+// opening a file is O(1) and reads go straight to the mapped pages, nothing is parsed or copied
+template <typename IDX, typename T, typename DIM> class MmapBackend {
+private:
+  static const char *magic() { return "TSLIBMM"; }
+  static const std::uint32_t version{1};
+  static size_t align_up(size_t x) { return (x + 63) / 64 * 64; }
+
+  // start of the mapping and its length
+  char *base_;
+  size_t bytes_;
+  // file behind a shared writable mapping, -1 otherwise
+  int fd_;
+  DIM nrow_;
+  DIM ncol_;
+  size_t stride_;
+  IDX *index_;
+  T *data_;
+  std::vector<std::string> colnames_;
+
+  static void fail(const std::string &what) {
+    throw std::runtime_error("MmapBackend: " + what + ": " + std::strerror(errno));
+  }
+
+  // lays out the blocks for nrow x ncol in a fresh header, returns the size of the data part of the file
+  static size_t layout(MmapHeader &h, DIM nrow, DIM ncol) {
+    std::memset(&h, 0, sizeof(h));
+    std::strncpy(h.magic, magic(), sizeof(h.magic));
+    h.version       = version;
+    h.header_size   = sizeof(MmapHeader);
+    h.index_type    = mmap_type_code<IDX>();
+    h.value_type    = mmap_type_code<T>();
+    h.nrow          = static_cast<std::uint64_t>(nrow);
+    h.ncol          = static_cast<std::uint64_t>(ncol);
+    h.index_offset  = align_up(sizeof(MmapHeader));
+    h.data_offset   = align_up(h.index_offset + h.nrow * sizeof(IDX));
+    h.column_stride = align_up(h.nrow * sizeof(T));
+    h.names_offset  = h.data_offset + h.ncol * h.column_stride;
+    h.names_bytes   = 0;
+    return h.names_offset;
+  }
+
+  // points the accessors at the blocks described by the header at base_
+  void attach() {
+    const MmapHeader &h = header();
+    nrow_   = static_cast<DIM>(h.nrow);
+    ncol_   = static_cast<DIM>(h.ncol);
+    stride_ = h.column_stride / sizeof(T);
+    index_  = reinterpret_cast<IDX *>(base_ + h.index_offset);
+    data_   = reinterpret_cast<T *>(base_ + h.data_offset);
+  }
+
+  MmapHeader &header() const { return *reinterpret_cast<MmapHeader *>(base_); }
+
+  // true when the blocks described by h are 64 byte aligned, in order and inside a file of the given size
+  // written so that no sum or product can overflow, whatever the header holds
+  static bool valid_layout(const MmapHeader &h, size_t bytes) {
+    const std::uint64_t max_dim{static_cast<std::uint64_t>(std::numeric_limits<DIM>::max())};
+    if (h.header_size != sizeof(MmapHeader) || h.nrow > max_dim || h.ncol > max_dim) { return false; }
+    if (h.index_offset % 64 || h.data_offset % 64 || h.column_stride % 64) { return false; }
+    if (h.index_offset < sizeof(MmapHeader) || h.data_offset < h.index_offset) { return false; }
+    // index_offset + nrow * sizeof(IDX) <= data_offset and nrow * sizeof(T) <= column_stride
+    if (h.nrow > (h.data_offset - h.index_offset) / sizeof(IDX) || h.nrow > h.column_stride / sizeof(T)) {
+      return false;
+    }
+    // data_offset + ncol * column_stride <= names_offset <= bytes
+    if (h.names_offset < h.data_offset || h.names_offset > bytes) { return false; }
+    if (h.column_stride && h.ncol > (h.names_offset - h.data_offset) / h.column_stride) { return false; }
+    return h.names_bytes <= bytes - h.names_offset;
+  }
+
+  // writes the colnames after the last column of the file, false if the file could not be written
+  // nothing is allocated and nothing throws, so the destructor can call it
+  bool write_colnames() noexcept {
+    MmapHeader &h = header();
+    if (ftruncate(fd_, static_cast<off_t>(h.names_offset)) != 0) { return false; }
+    // the colnames sit past the mapped blocks, they are written with plain file io
+    off_t pos{static_cast<off_t>(h.names_offset)};
+    for (const auto &n : colnames_) {
+      const std::uint32_t len{static_cast<std::uint32_t>(n.size())};
+      if (pwrite(fd_, &len, sizeof(len), pos) != static_cast<ssize_t>(sizeof(len)) ||
+          pwrite(fd_, n.data(), n.size(), pos + static_cast<off_t>(sizeof(len))) != static_cast<ssize_t>(n.size())) {
+        return false;
+      }
+      pos += static_cast<off_t>(sizeof(len) + n.size());
+    }
+    h.names_bytes = static_cast<std::uint64_t>(pos) - h.names_offset;
+    return msync(base_, std::min<size_t>(bytes_, h.names_offset), MS_SYNC) == 0;
+  }
+
+  MmapBackend(char *base, size_t bytes, int fd)
+      : base_{base}, bytes_{bytes}, fd_{fd}, nrow_{0}, ncol_{0}, stride_{0}, index_{nullptr}, data_{nullptr},
+        colnames_{} {}
+
+  void release() {
+    if (base_) { munmap(base_, bytes_); }
+    if (fd_ >= 0) { close(fd_); }
+    base_ = nullptr;
+    fd_   = -1;
+  }
+
+  // anonymous mapping laid out like a file, used for results and copies
+  static MmapBackend anonymous(DIM nrow, DIM ncol) {
+    MmapHeader h;
+    const size_t bytes{layout(h, nrow, ncol)};
+    void *p{mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+    if (p == MAP_FAILED) { fail("anonymous mmap"); }
+    MmapBackend ans(static_cast<char *>(p), bytes, -1);
+    std::memcpy(p, &h, sizeof(h));
+    ans.attach();
+    return ans;
+  }
+
+public:
+  // iterators are raw pointers into the mapping
+  typedef IDX *index_iterator;
+  typedef const IDX *const_index_iterator;
+  typedef const T *const_data_iterator;
+  typedef T *data_iterator;
+
+  // no default constructor
+  MmapBackend() = delete;
+  // copies go to a private anonymous mapping, they never write to the file of the original
+  MmapBackend(const MmapBackend &t) : MmapBackend(anonymous(t.nrow_, t.ncol_)) {
+    std::memcpy(base_ + header().index_offset, t.index_, static_cast<size_t>(nrow_) * sizeof(IDX));
+    std::memcpy(data_, t.data_, static_cast<size_t>(ncol_) * stride_ * sizeof(T));
+    colnames_ = t.colnames_;
+  }
+  // zero filled nrow x ncol series in anonymous memory
+  MmapBackend(DIM nrow, DIM ncol) : MmapBackend(anonymous(nrow, ncol)) {}
+  // no assignment constructor
+  MmapBackend &operator=(const MmapBackend &rhs) = delete;
+  MmapBackend(MmapBackend &&t)
+      : base_{t.base_}, bytes_{t.bytes_}, fd_{t.fd_}, nrow_{t.nrow_}, ncol_{t.ncol_}, stride_{t.stride_},
+        index_{t.index_}, data_{t.data_}, colnames_(std::move(t.colnames_)) {
+    t.base_ = nullptr;
+    t.fd_   = -1;
+  }
+  ~MmapBackend() {
+    // write the colnames back to a file we are allowed to change
+    // a failure can't be reported from here, call sync() first to get it as an exception
+    if (fd_ >= 0 && index_) { write_colnames(); }
+    release();
+  }
+
+  // maps an existing file
+  // read only opens are mapped copy on write: writes through the iterators stay private to this process
+  // writable opens are shared, writes go to the file
+  static MmapBackend open(const std::string &path, bool writable = false) {
+    const int fd{::open(path.c_str(), writable ? O_RDWR : O_RDONLY)};
+    if (fd < 0) { fail("open " + path); }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(MmapHeader)) {
+      close(fd);
+      fail("not a series file " + path);
+    }
+    const size_t bytes{static_cast<size_t>(st.st_size)};
+    void *p{mmap(nullptr, bytes, PROT_READ | PROT_WRITE, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0)};
+    if (p == MAP_FAILED) {
+      close(fd);
+      fail("mmap " + path);
+    }
+    MmapBackend ans(static_cast<char *>(p), bytes, writable ? fd : -1);
+    if (!writable) { close(fd); }
+
+    const MmapHeader &h = ans.header();
+    if (std::strncmp(h.magic, magic(), sizeof(h.magic)) != 0 || h.version != version) {
+      throw std::runtime_error("MmapBackend: unknown file format " + path);
+    }
+    if (h.index_type != mmap_type_code<IDX>() || h.value_type != mmap_type_code<T>()) {
+      throw std::runtime_error("MmapBackend: index or value type does not match " + path);
+    }
+    if (!valid_layout(h, bytes)) { throw std::runtime_error("MmapBackend: truncated or corrupt file " + path); }
+    ans.attach();
+
+    // colnames are the only thing copied out of the file
+    const char *p_names{ans.base_ + h.names_offset};
+    const char *end{p_names + h.names_bytes};
+    while (p_names + sizeof(std::uint32_t) <= end) {
+      std::uint32_t len;
+      std::memcpy(&len, p_names, sizeof(len));
+      p_names += sizeof(len);
+      if (p_names + len > end) { throw std::runtime_error("MmapBackend: corrupt colnames " + path); }
+      ans.colnames_.emplace_back(p_names, len);
+      p_names += len;
+    }
+    return ans;
+  }
+
+  // creates (or truncates) a file for a zero filled nrow x ncol series and maps it shared,
+  // so a result can be computed straight into it
+  static MmapBackend create(const std::string &path, DIM nrow, DIM ncol) {
+    MmapHeader h;
+    const size_t bytes{layout(h, nrow, ncol)};
+    const int fd{::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)};
+    if (fd < 0) { fail("create " + path); }
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+      close(fd);
+      fail("resize " + path);
+    }
+    void *p{mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)};
+    if (p == MAP_FAILED) {
+      close(fd);
+      fail("mmap " + path);
+    }
+    MmapBackend ans(static_cast<char *>(p), bytes, fd);
+    std::memcpy(p, &h, sizeof(h));
+    ans.attach();
+    return ans;
+  }
+
+  // writes a copy of this series to a new file
+  template <typename B> static MmapBackend create(const std::string &path, const B &src) {
+    MmapBackend ans(create(path, src.nrow(), src.ncol()));
+    std::copy(src.index_begin(), src.index_end(), ans.index_begin());
+    for (DIM i = 0; i < src.ncol(); ++i) { std::copy(src.col_begin(i), src.col_end(i), ans.col_begin(i)); }
+    ans.setColnames(src.getColnames());
+    return ans;
+  }
+
+  // flushes a shared mapping to its file, including the colnames, throws if the file can't be written
+  void sync() {
+    if (fd_ >= 0 && !write_colnames()) { fail("write colnames"); }
+  }
+
+  // calling nrow will get you the number of rows
+  DIM nrow() const { return nrow_; }
+  // get the number of columns
+  DIM ncol() const { return ncol_; }
+
+  // get the beginning and ending iterators of the index
+  const_index_iterator index_begin() const { return index_; }
+  index_iterator index_begin() { return index_; }
+  const_index_iterator index_end() const { return index_ + nrow_; }
+  index_iterator index_end() { return index_ + nrow_; }
+
+  // columns are 64 byte aligned blocks stride_ elements apart
+  const_data_iterator col_begin(DIM i) const { return data_ + static_cast<size_t>(i) * stride_; }
+  data_iterator col_begin(DIM i) { return data_ + static_cast<size_t>(i) * stride_; }
+  const_data_iterator col_end(DIM i) const { return col_begin(i) + nrow_; }
+  data_iterator col_end(DIM i) { return col_begin(i) + nrow_; }
+
+  // get the column names
+  const std::vector<std::string> getColnames() const { return colnames_; }
+  // the the number of column names
+  const DIM getColnamesSize() const { return static_cast<DIM>(colnames_.size()); }
+  // takes in a string vector, makes sure it is equal to the number of columns, and sets the column names
+  // returns true if set, false if not
+  const bool setColnames(const std::vector<std::string> &names) {
+    if (static_cast<DIM>(names.size()) == ncol_) {
+      colnames_ = names;
+      return true;
+    }
+    return false;
+  }
+};
+
+} // namespace tslib
@@ -65,6 +65,22 @@ public:
   static inline bool ISNA(double x) { return std::isnan(x); }
 };
 
+// single precision uses a plain NaN as NA
+template <> class RNT<float> {
+public:
+  static const bool has_NA = true;
+  static inline float NA() { return std::numeric_limits<float>::quiet_NaN(); }
+  static inline bool ISNA(float x) { return std::isnan(x); }
+};
+
+// 64 bit integers use the lowest value as NA, same as int
+template <> class RNT<long> {
+public:
+  static const bool has_NA = true;
+  static inline long NA() { return std::numeric_limits<long>::min(); }
+  static inline bool ISNA(long x) { return x == std::numeric_limits<long>::min(); }
+};
+
 // generic template for class
 template <> class RNT<int> {
 public:
@@ -75,3 +91,12 @@ public:
   // will check if a value is NA 
   static inline bool ISNA(int x) { return x == std::numeric_limits<int>::min() ? true : false; }
 };
+
+// for values that never hold NA: has_NA is false, so the NA tests in binary operations compile away
+// NA() only fills rows that have no value at all (eg unmatched rows of an outer join) and gives a zero
+template <typename T> class NoNA {
+public:
+  static const bool has_NA = false;
+  static inline T NA() { return T(); }
+  static inline bool ISNA(T) { return false; }
+};
@@ -0,0 +1,160 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2008  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace tslib {
+
+// random access iterator over every stride-th element from base, a column of a row major matrix
+// V is the value type, const for the const iterators
+// it counts positions rather than moving a pointer, so the end of a column doesn't point past the storage
+template <typename V> class StridedIterator {
+private:
+  template <typename> friend class StridedIterator;
+  V *base_;
+  std::ptrdiff_t pos_;
+  std::ptrdiff_t stride_;
+
+public:
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef typename std::remove_const<V>::type value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef V *pointer;
+  typedef V &reference;
+
+  StridedIterator() : base_{nullptr}, pos_{0}, stride_{1} {}
+  StridedIterator(V *base, std::ptrdiff_t pos, std::ptrdiff_t stride) : base_{base}, pos_{pos}, stride_{stride} {}
+  // mutable to const
+  template <typename U, typename = typename std::enable_if<std::is_same<const U, V>::value>::type>
+  StridedIterator(const StridedIterator<U> &it) : base_{it.base_}, pos_{it.pos_}, stride_{it.stride_} {}
+  StridedIterator(const StridedIterator &)            = default;
+  StridedIterator &operator=(const StridedIterator &) = default;
+
+  reference operator*() const { return base_[pos_ * stride_]; }
+  pointer operator->() const { return &**this; }
+  reference operator[](difference_type n) const { return base_[(pos_ + n) * stride_]; }
+
+  StridedIterator &operator++() {
+    ++pos_;
+    return *this;
+  }
+  StridedIterator operator++(int) {
+    StridedIterator ans(*this);
+    ++pos_;
+    return ans;
+  }
+  StridedIterator &operator--() {
+    --pos_;
+    return *this;
+  }
+  StridedIterator operator--(int) {
+    StridedIterator ans(*this);
+    --pos_;
+    return ans;
+  }
+  StridedIterator &operator+=(difference_type n) {
+    pos_ += n;
+    return *this;
+  }
+  StridedIterator &operator-=(difference_type n) { return *this += -n; }
+  StridedIterator operator+(difference_type n) const { return StridedIterator(*this) += n; }
+  StridedIterator operator-(difference_type n) const { return StridedIterator(*this) -= n; }
+  friend StridedIterator operator+(difference_type n, const StridedIterator &it) { return it + n; }
+  difference_type operator-(const StridedIterator &rhs) const { return pos_ - rhs.pos_; }
+
+  bool operator==(const StridedIterator &rhs) const { return pos_ == rhs.pos_; }
+  bool operator!=(const StridedIterator &rhs) const { return pos_ != rhs.pos_; }
+  bool operator<(const StridedIterator &rhs) const { return pos_ < rhs.pos_; }
+  bool operator>(const StridedIterator &rhs) const { return pos_ > rhs.pos_; }
+  bool operator<=(const StridedIterator &rhs) const { return pos_ <= rhs.pos_; }
+  bool operator>=(const StridedIterator &rhs) const { return pos_ >= rhs.pos_; }
+};
+
+// template for a row major backend
+//
+// the values of a row are next to each other, so code that works across the columns of one date (ranking a
+// cross section, reducing a row, printing) reads memory in order instead of touching a cache line per column
+// columns are still there for everything else, through strided iterators, but column at a time operations
+// are faster on the column major VectorBackend, see tslib/layout.hpp to convert between the two
+// row_begin(i) and row_end(i) give the values of row i as a plain range
+template <typename IDX, typename T, typename DIM> class RowMajorBackend {
+private:
+  DIM nrow_;
+  DIM ncol_;
+  std::vector<IDX> index_;
+  // row i is data_[i * ncol_, (i + 1) * ncol_)
+  std::vector<T> data_;
+  // colnames, null when there are none
+  std::shared_ptr<const std::vector<std::string>> colnames_;
+
+  std::ptrdiff_t stride() const { return static_cast<std::ptrdiff_t>(ncol_); }
+
+public:
+  typedef typename std::vector<IDX>::iterator index_iterator;
+  typedef typename std::vector<IDX>::const_iterator const_index_iterator;
+  typedef StridedIterator<T> data_iterator;
+  typedef StridedIterator<const T> const_data_iterator;
+  typedef T *row_iterator;
+  typedef const T *const_row_iterator;
+
+  RowMajorBackend() = delete;
+  RowMajorBackend(const RowMajorBackend &t)
+      : nrow_{t.nrow_}, ncol_{t.ncol_}, index_{t.index_}, data_{t.data_}, colnames_{t.colnames_} {}
+  RowMajorBackend(DIM nrow, DIM ncol)
+      : nrow_{nrow}, ncol_{ncol}, index_(static_cast<size_t>(nrow)),
+        data_(static_cast<size_t>(nrow) * static_cast<size_t>(ncol)), colnames_{} {}
+  RowMajorBackend &operator=(const RowMajorBackend &rhs) = delete;
+  RowMajorBackend(RowMajorBackend &&)                    = default;
+
+  DIM nrow() const { return nrow_; }
+  DIM ncol() const { return ncol_; }
+
+  const_index_iterator index_begin() const { return index_.cbegin(); }
+  index_iterator index_begin() { return index_.begin(); }
+  const_index_iterator index_end() const { return index_.cend(); }
+  index_iterator index_end() { return index_.end(); }
+
+  // column i starts at element i and steps over a whole row
+  const_data_iterator col_begin(DIM i) const { return const_data_iterator(data_.data() + i, 0, stride()); }
+  data_iterator col_begin(DIM i) { return data_iterator(data_.data() + i, 0, stride()); }
+  const_data_iterator col_end(DIM i) const { return const_data_iterator(data_.data() + i, nrow_, stride()); }
+  data_iterator col_end(DIM i) { return data_iterator(data_.data() + i, nrow_, stride()); }
+
+  // the values of row i, one per column
+  const_row_iterator row_begin(DIM i) const { return data_.data() + static_cast<size_t>(i) * ncol_; }
+  row_iterator row_begin(DIM i) { return data_.data() + static_cast<size_t>(i) * ncol_; }
+  const_row_iterator row_end(DIM i) const { return row_begin(i) + ncol_; }
+  row_iterator row_end(DIM i) { return row_begin(i) + ncol_; }
+
+  const std::vector<std::string> getColnames() const { return colnames_ ? *colnames_ : std::vector<std::string>(); }
+  const DIM getColnamesSize() const { return colnames_ ? static_cast<DIM>(colnames_->size()) : 0; }
+  const bool setColnames(const std::vector<std::string> &names) {
+    if (static_cast<DIM>(names.size()) == ncol_) {
+      colnames_ = std::make_shared<const std::vector<std::string>>(names);
+      return true;
+    }
+    return false;
+  }
+};
+
+} // namespace tslib
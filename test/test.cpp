@@ -18,10 +18,34 @@
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
+#include <append.backend.hpp>
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <epoch.time.policy.hpp>
+
+#include <fstream>
+#include <functional>
 #include <gregorian.date.policy.hpp>
 #include <iostream>
+#include <mmap.backend.hpp>
 #include <numeric.traits.hpp>
 #include <numeric>
+#include <rowmajor.backend.hpp>
+#include <random>
+#include <thread>
+#include <tslib/arena.hpp>
+#include <tslib/cross.section.hpp>
+#include <tslib/csv.hpp>
+#include <tslib/execution.hpp>
+#include <tslib/expression.hpp>
+#include <tslib/instrument.hpp>
+#include <tslib/join.hpp>
+#include <tslib/layout.hpp>
+#include <tslib/pipeline.hpp>
+#include <tslib/na.hpp>
+#include <tslib/resample.hpp>
+#include <tslib/rolling.hpp>
+#include <tslib/serialize.hpp>
+#include <tslib/stream.hpp>
 #include <tslib/tseries.hpp>
 #include <vector.backend.hpp>
 #include <vector>
@@ -81,3 +105,2143 @@ TEST_CASE("Constructors.") {
     std::cout << (x + y) << std::endl;
   }
 }
+
+TEST_CASE("SIMD kernels.") {
+  const simd::ISA widest{simd::detect_isa()};
+  const size_t NR{37};
+
+  SECTION("double binary and compound ops agree on every isa") {
+    for (int isa = 0; isa <= static_cast<int>(widest); ++isa) {
+      simd::set_isa(static_cast<simd::ISA>(isa));
+      LDL_ts x(NR, 2), y(NR, 2);
+      std::iota(x.index_begin(), x.index_end(), 0);
+      std::iota(y.index_begin(), y.index_end(), 0);
+      std::iota(x.col_begin(0), x.col_end(1), 1);
+      std::iota(y.col_begin(0), y.col_end(1), 100);
+      x.col_begin(1)[5] = RNT<double>::NA();
+      y.col_begin(0)[30] = RNT<double>::NA();
+
+      LDL_ts z{x * y};
+      REQUIRE(z.nrow() == NR);
+      for (size_t i = 0; i < NR; ++i) {
+        for (long c = 0; c < 2; ++c) {
+          const double xv{x.col_begin(c)[i]}, yv{y.col_begin(c)[i]}, zv{z.col_begin(c)[i]};
+          if (RNT<double>::ISNA(xv) || RNT<double>::ISNA(yv)) {
+            REQUIRE(RNT<double>::ISNA(zv));
+          } else {
+            REQUIRE(zv == xv * yv);
+          }
+        }
+      }
+      x -= 1.;
+      REQUIRE(x.col_begin(0)[0] == 0.);
+      REQUIRE(RNT<double>::ISNA(x.col_begin(1)[5]));
+    }
+    simd::set_isa(widest);
+  }
+
+  SECTION("int64 sentinel NA is blended back in") {
+    typedef TSeries<long, long, long, VectorBackend, GregorianDate, RNT> LLL_ts;
+    for (int isa = 0; isa <= static_cast<int>(widest); ++isa) {
+      simd::set_isa(static_cast<simd::ISA>(isa));
+      LLL_ts x(NR, 1), y(NR, 1);
+      std::iota(x.index_begin(), x.index_end(), 0);
+      // y is offset by 3 rows so the rowmap is shifted but still contiguous
+      std::iota(y.index_begin(), y.index_end(), 3);
+      std::iota(x.col_begin(0), x.col_end(0), 1);
+      std::iota(y.col_begin(0), y.col_end(0), 1);
+      x.col_begin(0)[10] = RNT<long>::NA();
+      for (auto z : {x + y, x - y, x * y}) {
+        REQUIRE(z.nrow() == NR - 3);
+        REQUIRE(z.index_begin()[0] == 3);
+        REQUIRE(RNT<long>::ISNA(z.col_begin(0)[7]));
+        REQUIRE_FALSE(RNT<long>::ISNA(z.col_begin(0)[8]));
+      }
+      LLL_ts z{x + y};
+      REQUIRE(z.col_begin(0)[0] == 5);
+      x *= 2L;
+      REQUIRE(x.col_begin(0)[0] == 2);
+      REQUIRE(RNT<long>::ISNA(x.col_begin(0)[10]));
+    }
+    simd::set_isa(widest);
+  }
+}
+
+TEST_CASE("Alignment.") {
+  std::vector<long> a{1, 2, 3, 4, 5, 6}, b{3, 4, 5}, c{2, 4, 6};
+
+  SECTION("classify") {
+    AlignmentInfo same(classify_alignment(a.begin(), a.end(), a.begin(), a.end()));
+    REQUIRE(same.kind == Alignment::identical);
+    REQUIRE(same.length == a.size());
+
+    AlignmentInfo sub(classify_alignment(a.begin(), a.end(), b.begin(), b.end()));
+    REQUIRE(sub.kind == Alignment::offset);
+    REQUIRE(sub.x_offset == 2);
+    REQUIRE(sub.y_offset == 0);
+    REQUIRE(sub.length == 3);
+
+    AlignmentInfo rsub(classify_alignment(b.begin(), b.end(), a.begin(), a.end()));
+    REQUIRE(rsub.kind == Alignment::offset);
+    REQUIRE(rsub.x_offset == 0);
+    REQUIRE(rsub.y_offset == 2);
+
+    REQUIRE(classify_alignment(a.begin(), a.end(), c.begin(), c.end()).kind == Alignment::general);
+  }
+
+  SECTION("fast paths match the rowmap path") {
+    LDL_ts x(a.size(), 2), y(b.size(), 1), z(c.size(), 2);
+    std::copy(a.begin(), a.end(), x.index_begin());
+    std::copy(b.begin(), b.end(), y.index_begin());
+    std::copy(c.begin(), c.end(), z.index_begin());
+    std::iota(x.col_begin(0), x.col_end(1), 0);
+    std::iota(y.col_begin(0), y.col_end(0), 100);
+    std::iota(z.col_begin(0), z.col_end(1), 1000);
+
+    // offset with a single column broadcast against both columns of x
+    LDL_ts xy{x + y};
+    REQUIRE(xy.nrow() == 3);
+    REQUIRE(xy.ncol() == 2);
+    REQUIRE(std::equal(b.begin(), b.end(), xy.index_begin()));
+    REQUIRE(xy.col_begin(0)[0] == 2 + 100);
+    REQUIRE(xy.col_begin(1)[2] == 10 + 102);
+
+    // general merge
+    LDL_ts xz{x - z};
+    REQUIRE(xz.nrow() == 3);
+    REQUIRE(xz.col_begin(1)[1] == 9 - 1004);
+
+    // identical
+    LDL_ts xx{x * x};
+    REQUIRE(xx.nrow() == x.nrow());
+    REQUIRE(xx.col_begin(1)[5] == 11 * 11);
+  }
+}
+
+TEST_CASE("Intersection.") {
+  // sorted indexes with occasional duplicates, x dense and y sampled every `step` rows
+  auto make_index = [](size_t len, long step, long start) {
+    std::vector<long> res(len);
+    long v{start};
+    for (size_t i = 0; i < len; ++i) {
+      res[i] = v;
+      if (i % 7 != 3) { v += step; }
+    }
+    return res;
+  };
+
+  for (long step : {1L, 2L, 3L, 50L, 1000L}) {
+    const std::vector<long> x{make_index(5000, 1, 0)};
+    const std::vector<long> y{make_index(5000 / step + 3, step, 5)};
+    const auto expected(linear_intersection_map(x.begin(), x.end(), y.begin(), y.end()));
+    REQUIRE(intersection_map(x.begin(), x.end(), y.begin(), y.end()) == expected);
+    REQUIRE(intersection_map(y.begin(), y.end(), x.begin(), x.end()) ==
+            linear_intersection_map(y.begin(), y.end(), x.begin(), x.end()));
+
+    const IntersectionIndex soa(intersection_index(x.begin(), x.end(), y.begin(), y.end()));
+    std::vector<std::pair<size_t, size_t>> zipped;
+    for (size_t k = 0; k < soa.size(); ++k) { zipped.emplace_back(soa.x[k], soa.y[k]); }
+    REQUIRE(zipped == expected);
+  }
+}
+
+TEST_CASE("N-ary alignment.") {
+  size_t NR{40};
+  LDL_ts a(NR, 2), b(NR, 2), c(NR, 1);
+  std::iota(a.index_begin(), a.index_end(), 0);
+  int n{0};
+  std::generate(b.index_begin(), b.index_end(), [&n] { return n += 2; });
+  n = 0;
+  std::generate(c.index_begin(), c.index_end(), [&n] { return n += 3; });
+  std::iota(a.col_begin(0), a.col_end(1), 1);
+  std::iota(b.col_begin(0), b.col_end(1), 100);
+  std::iota(c.col_begin(0), c.col_end(0), 1000);
+  b.col_begin(1)[8] = RNT<double>::NA();
+
+  SECTION("multi_intersection_map") {
+    typedef LDL_ts::const_index_iterator iter;
+    const std::vector<std::pair<iter, iter>> ranges{std::make_pair(a.index_begin(), a.index_end()),
+                                                    std::make_pair(b.index_begin(), b.index_end()),
+                                                    std::make_pair(c.index_begin(), c.index_end())};
+    const MultiIntersection rows(multi_intersection_map(ranges));
+    // multiples of 6 below 40
+    REQUIRE(rows.size() == 6);
+    REQUIRE(a.index_begin()[rows.rows[0][2]] == 18);
+    REQUIRE(b.index_begin()[rows.rows[1][2]] == 18);
+    REQUIRE(c.index_begin()[rows.rows[2][2]] == 18);
+    REQUIRE_FALSE(rows.contiguous(0));
+  }
+
+  SECTION("nary_opp matches chained binary ops") {
+    LDL_ts chained{(a + b) * c};
+    LDL_ts fused{nary_opp([](double x, double y, double z) { return (x + y) * z; }, a, b, c)};
+    REQUIRE(fused.nrow() == chained.nrow());
+    REQUIRE(fused.ncol() == 2);
+    REQUIRE(std::equal(fused.index_begin(), fused.index_end(), chained.index_begin()));
+    for (long col = 0; col < 2; ++col) {
+      for (long i = 0; i < fused.nrow(); ++i) {
+        const double f{fused.col_begin(col)[i]}, ch{chained.col_begin(col)[i]};
+        REQUIRE((RNT<double>::ISNA(f) ? RNT<double>::ISNA(ch) : f == ch));
+      }
+    }
+
+    const std::vector<const LDL_ts *> series{&a, &b, &c};
+    LDL_ts summed{nary_opp(
+        [](const double *v, size_t k) { return std::accumulate(v, v + k, 0.); }, series)};
+    LDL_ts summed_chained{(a + b) + c};
+    REQUIRE(summed.nrow() == summed_chained.nrow());
+    REQUIRE(summed.col_begin(0)[1] == summed_chained.col_begin(0)[1]);
+    REQUIRE(RNT<double>::ISNA(summed.col_begin(1)[2]));
+  }
+}
+
+TEST_CASE("Expression templates.") {
+  size_t NR{30};
+  LDL_ts x(NR, 2), y(NR, 2), z(NR, 2), w(NR, 1);
+  std::iota(x.index_begin(), x.index_end(), 0);
+  std::iota(y.index_begin(), y.index_end(), 0);
+  int n{0};
+  std::generate(z.index_begin(), z.index_end(), [&n] { return n += 2; });
+  std::iota(w.index_begin(), w.index_end(), 5);
+  std::iota(x.col_begin(0), x.col_end(1), 1);
+  std::iota(y.col_begin(0), y.col_end(1), 3);
+  std::iota(z.col_begin(0), z.col_end(1), 7);
+  std::iota(w.col_begin(0), w.col_end(0), 2);
+  y.col_begin(0)[12] = RNT<double>::NA();
+
+  auto same = [](const LDL_ts &a, const LDL_ts &b) {
+    if (a.nrow() != b.nrow() || a.ncol() != b.ncol()) { return false; }
+    if (!std::equal(a.index_begin(), a.index_end(), b.index_begin())) { return false; }
+    for (long c = 0; c < a.ncol(); ++c) {
+      for (long i = 0; i < a.nrow(); ++i) {
+        const double av{a.col_begin(c)[i]}, bv{b.col_begin(c)[i]};
+        if (RNT<double>::ISNA(av) != RNT<double>::ISNA(bv) || (!RNT<double>::ISNA(av) && av != bv)) { return false; }
+      }
+    }
+    return true;
+  };
+
+  SECTION("fused result matches eager operators") {
+    LDL_ts eager{(x - y) / (y + z) * w};
+    LDL_ts fused = (lazy(x) - y) / (lazy(y) + z) * w;
+    REQUIRE(fused.nrow() == 12);
+    REQUIRE(same(eager, fused));
+  }
+
+  SECTION("identical indexes and scalars") {
+    LDL_ts eager{x * y};
+    eager += 1.;
+    LDL_ts fused = lazy(x) * y + 1.;
+    REQUIRE(same(eager, fused));
+    REQUIRE(RNT<double>::ISNA(fused.col_begin(0)[12]));
+  }
+}
+
+TEST_CASE("Rolling windows.") {
+  const long NR{200}, W{20};
+  LDL_ts x(NR, 2);
+  // gaps in the index so calendar and row windows differ
+  long d{0};
+  std::generate(x.index_begin(), x.index_end(), [&d] { return d += (d % 5 == 4) ? 3 : 1; });
+  double v{1};
+  std::generate(x.col_begin(0), x.col_end(1), [&v] { return v = std::fmod(v * 7.3 + 1.1, 97.) - 40.; });
+  for (long i = 3; i < NR; i += 17) { x.col_begin(1)[i] = RNT<double>::NA(); }
+
+  // naive statistics over rows [lo, hi] skipping NA
+  auto naive = [&](long col, long lo, long hi, int stat) {
+    std::vector<double> vals;
+    for (long j = lo; j <= hi; ++j) {
+      if (!RNT<double>::ISNA(x.col_begin(col)[j])) { vals.push_back(x.col_begin(col)[j]); }
+    }
+    const double sum{std::accumulate(vals.begin(), vals.end(), 0.)};
+    const double mean{sum / vals.size()};
+    double ss{0};
+    for (double e : vals) { ss += (e - mean) * (e - mean); }
+    switch (stat) {
+    case 0: return mean;
+    case 1: return std::sqrt(ss / (vals.size() - 1));
+    case 2: return *std::min_element(vals.begin(), vals.end());
+    default: return *std::max_element(vals.begin(), vals.end());
+    }
+  };
+
+  SECTION("row windows") {
+    const LDL_ts mean{rolling_mean(x, W)}, sd{rolling_sd(x, W)}, mn{rolling_min(x, W)}, mx{rolling_max(x, W)};
+    REQUIRE(mean.nrow() == NR);
+    REQUIRE(RNT<double>::ISNA(mean.col_begin(0)[W - 2]));
+    for (long col = 0; col < 2; ++col) {
+      for (long i = W - 1; i < NR; ++i) {
+        if (RNT<double>::ISNA(mean.col_begin(col)[i])) {
+          // a window containing an NA has fewer than W values
+          REQUIRE(col == 1);
+          continue;
+        }
+        REQUIRE(mean.col_begin(col)[i] == Approx(naive(col, i - W + 1, i, 0)));
+        REQUIRE(sd.col_begin(col)[i] == Approx(naive(col, i - W + 1, i, 1)));
+        REQUIRE(mn.col_begin(col)[i] == naive(col, i - W + 1, i, 2));
+        REQUIRE(mx.col_begin(col)[i] == naive(col, i - W + 1, i, 3));
+      }
+    }
+  }
+
+  SECTION("calendar windows") {
+    const LDL_ts mean{rolling_calendar<RollingMean>(x, 10.)};
+    for (long i = 0; i < NR; ++i) {
+      long lo{i};
+      while (lo > 0 && x.index_begin()[i] - x.index_begin()[lo - 1] < 10) { --lo; }
+      REQUIRE(mean.col_begin(1)[i] == Approx(naive(1, lo, i, 0)));
+    }
+  }
+}
+
+TEST_CASE("Execution policies.") {
+  auto same = [](const LDL_ts &a, const LDL_ts &b) {
+    return a.nrow() == b.nrow() && a.ncol() == b.ncol() && std::equal(a.index_begin(), a.index_end(), b.index_begin()) &&
+           std::equal(a.col_begin(0), a.col_end(a.ncol() - 1), b.col_begin(0),
+                      [](double x, double y) { return x == y || (RNT<double>::ISNA(x) && RNT<double>::ISNA(y)); });
+  };
+  ThreadPoolPolicy pool(4);
+  WorkStealingPolicy stealing(3);
+
+  SECTION("parallel_for runs every task once and rethrows") {
+    for (ExecutionPolicy *policy : std::vector<ExecutionPolicy *>{&pool, &stealing}) {
+      std::vector<int> hits(1000, 0);
+      policy->parallel_for(hits.size(), [&hits](size_t i) { ++hits[i]; });
+      REQUIRE(std::all_of(hits.begin(), hits.end(), [](int h) { return h == 1; }));
+      REQUIRE_THROWS(policy->parallel_for(10, [](size_t i) {
+        if (i == 7) { throw std::runtime_error("task failed"); }
+      }));
+    }
+  }
+
+  // one wide and one tall series, so both the column split and the row split are used
+  for (auto dims : {std::make_pair(500L, 300L), std::make_pair(100000L, 2L)}) {
+    LDL_ts x(dims.first, dims.second), y(dims.first, dims.second);
+    std::iota(x.index_begin(), x.index_end(), 0);
+    std::iota(y.index_begin(), y.index_end(), 1);
+    std::iota(x.col_begin(0), x.col_end(dims.second - 1), 1);
+    std::iota(y.col_begin(0), y.col_end(dims.second - 1), 7);
+    x.col_begin(0)[42] = RNT<double>::NA();
+
+    const LDL_ts sum{binary_opp<PlusFunctor>(x, y, sequential_execution())};
+    const LDL_ts lagged{x.lag_copy(3, sequential_execution())};
+    const LDL_ts rolled{rolling<RollingMean>(x, RowWindow(5), 5, sequential_execution())};
+    for (ExecutionPolicy *policy : std::vector<ExecutionPolicy *>{&pool, &stealing}) {
+      REQUIRE(same(sum, binary_opp<PlusFunctor>(x, y, *policy)));
+      REQUIRE(same(lagged, x.lag_copy(3, *policy)));
+      REQUIRE(same(rolled, rolling<RollingMean>(x, RowWindow(5), 5, *policy)));
+
+      LDL_ts scaled{x};
+      {
+        ExecutionScope scope(*policy);
+        scaled *= 2.;
+      }
+      REQUIRE(scaled.col_begin(dims.second - 1)[dims.first - 1] == 2 * x.col_begin(dims.second - 1)[dims.first - 1]);
+      REQUIRE(RNT<double>::ISNA(scaled.col_begin(0)[42]));
+    }
+  }
+}
+
+TEST_CASE("Mmap backend.") {
+  typedef TSeries<long, double, long, MmapBackend, GregorianDate, RNT> mmap_ts;
+  const std::string path{"mmap.backend.test.bin"};
+  const long NR{1000}, NC{3};
+
+  {
+    mmap_ts out(MmapBackend<long, double, long>::create(path, NR, NC));
+    std::iota(out.index_begin(), out.index_end(), 100);
+    for (long c = 0; c < NC; ++c) { std::iota(out.col_begin(c), out.col_end(c), c * 10000.); }
+    out.col_begin(1)[5] = RNT<double>::NA();
+    REQUIRE(out.setColnames({"a", "b", "c"}));
+    // columns start on 64 byte boundaries
+    REQUIRE(reinterpret_cast<uintptr_t>(&*out.col_begin(2)) % 64 == 0);
+  }
+
+  mmap_ts in(MmapBackend<long, double, long>::open(path));
+  REQUIRE(in.nrow() == NR);
+  REQUIRE(in.ncol() == NC);
+  REQUIRE(in.getColnames() == std::vector<std::string>({"a", "b", "c"}));
+  REQUIRE(in.index_begin()[0] == 100);
+  REQUIRE(in.col_begin(2)[999] == 20999.);
+  REQUIRE(RNT<double>::ISNA(in.col_begin(1)[5]));
+
+  // results of operations on mapped series go to anonymous mappings
+  mmap_ts doubled{in + in};
+  REQUIRE(doubled.col_begin(2)[1] == 2 * 20001.);
+  mmap_ts copy{in};
+  copy *= 0.;
+  REQUIRE(in.col_begin(2)[1] == 20001.);
+
+  // a read only open maps copy on write, the file keeps its values
+  in.col_begin(0)[0] = -1.;
+  mmap_ts again(MmapBackend<long, double, long>::open(path));
+  REQUIRE(again.col_begin(0)[0] == 0.);
+
+  REQUIRE_THROWS((TSeries<long, long, long, MmapBackend, GregorianDate, RNT>(MmapBackend<long, long, long>::open(path))));
+
+  // a truncated or corrupt header throws instead of mapping past the end of the file
+  std::string file;
+  {
+    std::ifstream f(path, std::ios::binary);
+    file.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  }
+  const std::string bad_path{"mmap.backend.corrupt.bin"};
+  auto reopen = [&](const MmapHeader &h, size_t bytes) {
+    std::string bad(file.substr(0, bytes));
+    std::memcpy(&bad[0], &h, sizeof(h));
+    {
+      std::ofstream f(bad_path, std::ios::binary | std::ios::trunc);
+      f.write(bad.data(), static_cast<std::streamsize>(bad.size()));
+    }
+    return mmap_ts(MmapBackend<long, double, long>::open(bad_path));
+  };
+  MmapHeader h;
+  std::memcpy(&h, file.data(), sizeof(h));
+  REQUIRE(reopen(h, file.size()).col_begin(2)[999] == 20999.);
+  REQUIRE_THROWS_AS(reopen(h, h.data_offset + 100), std::runtime_error);
+  REQUIRE_THROWS_AS(reopen(h, sizeof(MmapHeader) + 8), std::runtime_error);
+  const std::vector<std::function<void(MmapHeader &)>> edits{
+      [](MmapHeader &e) { ++e.nrow; },
+      [](MmapHeader &e) { e.nrow = std::uint64_t(1) << 61; },
+      [](MmapHeader &e) { ++e.ncol; },
+      [](MmapHeader &e) { e.ncol = ~std::uint64_t(0) / e.column_stride + 2; },
+      [](MmapHeader &e) { e.column_stride = 0; },
+      [](MmapHeader &e) { e.data_offset += 8; },
+      [](MmapHeader &e) { e.index_offset = 0; },
+      [](MmapHeader &e) { e.header_size = 16; },
+      [](MmapHeader &e) { e.names_offset = e.data_offset; },
+      [](MmapHeader &e) { e.names_bytes = ~std::uint64_t(0); }};
+  for (const auto &edit : edits) {
+    MmapHeader e{h};
+    edit(e);
+    REQUIRE_THROWS_AS(reopen(e, file.size()), std::runtime_error);
+  }
+  std::remove(bad_path.c_str());
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Views.") {
+  const long NR{20}, NC{3};
+  LDL_ts x(NR, NC);
+  std::iota(x.index_begin(), x.index_end(), 100);
+  for (long c = 0; c < NC; ++c) { std::iota(x.col_begin(c), x.col_end(c), c * 100.); }
+  REQUIRE(x.setColnames({"a", "b", "c"}));
+
+  SECTION("lag") {
+    const auto v = x.lag(2);
+    REQUIRE(v.nrow() == NR - 2);
+    REQUIRE(v.index_begin()[0] == 102);
+    REQUIRE(v.col_begin(1)[0] == 100.);
+    // the view reads the source in place
+    REQUIRE(&*v.col_begin(0) == &*x.col_begin(0));
+    // and matches the copying version
+    const LDL_ts copy{x.lag_copy(2)};
+    REQUIRE(std::equal(copy.index_begin(), copy.index_end(), v.index_begin()));
+    REQUIRE(std::equal(copy.col_begin(2), copy.col_end(2), v.col_begin(2)));
+    // lags compose
+    const auto vv = v.lag(3);
+    REQUIRE(vv.index_begin()[0] == 105);
+    REQUIRE(vv.col_begin(0)[0] == 0.);
+    REQUIRE_THROWS(x.lag(NR));
+    // a temporary gives an owning series
+    const LDL_ts owned{LDL_ts(x).lag(2)};
+    REQUIRE(owned.index_begin()[0] == 102);
+  }
+
+  SECTION("window") {
+    const auto w = x.window(105, 109);
+    REQUIRE(w.nrow() == 5);
+    REQUIRE(w.index_begin()[0] == 105);
+    REQUIRE(w.col_begin(0)[0] == 5.);
+    REQUIRE(x.window(50, 60).nrow() == 0);
+    REQUIRE(x.window(110, 500).nrow() == 10);
+    REQUIRE(x.lag(1).window(105, 106).col_begin(0)[0] == 4.);
+  }
+
+  SECTION("columns") {
+    const auto c = x.columns(1, 2);
+    REQUIRE(c.ncol() == 2);
+    REQUIRE(c.getColnames() == std::vector<std::string>({"b", "c"}));
+    REQUIRE(c.col_begin(1)[3] == 203.);
+    const auto p = x.columns({2, 0});
+    REQUIRE(p.getColnames() == std::vector<std::string>({"c", "a"}));
+    REQUIRE(p.columns(1, 1).col_begin(0)[3] == 3.);
+    REQUIRE_THROWS(x.columns(2, 2));
+    const LDL_ts owned(p);
+    REQUIRE(owned.ncol() == 2);
+    REQUIRE(owned.col_begin(0)[0] == 200.);
+  }
+
+  SECTION("operators") {
+    // x - lag(x) aligns on the index, the view is not copied first
+    const LDL_ts diff{x - x.lag(1)};
+    REQUIRE(diff.nrow() == NR - 1);
+    REQUIRE(diff.index_begin()[0] == 101);
+    for (long c = 0; c < NC; ++c) {
+      REQUIRE(std::all_of(diff.col_begin(c), diff.col_end(c), [](double d) { return d == 1.; }));
+    }
+    const LDL_ts sum{x.window(100, 104) + x.window(102, 110).columns(0, 1)};
+    REQUIRE(sum.nrow() == 3);
+    REQUIRE(sum.col_begin(2)[0] == 202. + 2.);
+    const LDL_ts fused = lazy(x.lag(1)) * 2. + x;
+    REQUIRE(fused.col_begin(0)[0] == 1.);
+  }
+}
+
+TEST_CASE("Arena allocator.") {
+  typedef TSeries<long, double, long, ArenaBackend, GregorianDate, RNT> arena_ts;
+  static_assert(is_contiguous_iterator<arena_ts::data_iterator>::value, "arena columns are contiguous");
+
+  SECTION("arena") {
+    MonotonicArena arena(1024);
+    const auto m = arena.mark();
+    void *a = arena.allocate(10, 1);
+    void *b = arena.allocate(8, 64);
+    REQUIRE(reinterpret_cast<uintptr_t>(b) % 64 == 0);
+    REQUIRE(static_cast<char *>(b) >= static_cast<char *>(a) + 10);
+    // bigger than a chunk gets a chunk of its own
+    arena.allocate(4096, 8);
+    REQUIRE(arena.chunks() == 2);
+    // rewinding keeps the chunks, the next pass reuses them
+    arena.rewind(m);
+    REQUIRE(arena.allocate(10, 1) == a);
+    arena.allocate(4096, 8);
+    REQUIRE(arena.chunks() == 2);
+    arena.release();
+    REQUIRE(arena.chunks() == 0);
+  }
+
+  SECTION("scope") {
+    const long NR{100}, NC{2};
+    REQUIRE(current_arena() == nullptr);
+    std::unique_ptr<LDL_ts> kept;
+    {
+      ArenaScope scope;
+      REQUIRE(current_arena() == &thread_arena());
+      arena_ts x(NR, NC), y(NR, NC);
+      std::iota(x.index_begin(), x.index_end(), 0);
+      std::iota(y.index_begin(), y.index_end(), 0);
+      std::iota(x.col_begin(0), x.col_end(NC - 1), 1.);
+      std::fill(y.col_begin(0), y.col_end(NC - 1), 2.);
+      // the arena holds the columns
+      REQUIRE(thread_arena().bytes_allocated() >= 2 * NR * NC * sizeof(double));
+      const arena_ts z{(x + y) * y};
+      REQUIRE(z.col_begin(1)[0] == (NR + 1 + 2.) * 2.);
+      // copying the backend moves the result out of the arena
+      kept.reset(new LDL_ts(VectorBackend<long, double, long>(z.getBackend())));
+    }
+    REQUIRE(current_arena() == nullptr);
+    REQUIRE(kept->nrow() == NR);
+    REQUIRE(kept->col_begin(0)[NR - 1] == (NR + 2.) * 2.);
+    // outside a scope the arena backend is on the heap
+    const size_t before{thread_arena().bytes_allocated()};
+    arena_ts h(NR, NC);
+    REQUIRE(thread_arena().bytes_allocated() == before);
+  }
+
+  SECTION("copies outside the scope") {
+    // a copy made after the scope ends has its index on the heap too, reusing the arena doesn't touch it
+    const long NR{100};
+    std::unique_ptr<arena_ts> inner;
+    {
+      ArenaScope scope;
+      inner.reset(new arena_ts(NR, 1));
+      std::iota(inner->index_begin(), inner->index_end(), 0);
+      std::iota(inner->col_begin(0), inner->col_end(0), 0.);
+    }
+    const arena_ts outside(*inner);
+    inner.reset();
+    {
+      ArenaScope scope;
+      arena_ts reuse(NR, 1);
+      std::fill(reuse.index_begin(), reuse.index_end(), -7);
+      std::fill(reuse.col_begin(0), reuse.col_end(0), -7.);
+      REQUIRE(outside.index_begin()[5] == 5);
+      REQUIRE(outside.col_begin(0)[5] == 5.);
+    }
+  }
+}
+
+TEST_CASE("Shared index.") {
+  const long NR{50}, NC{2};
+  LDL_ts x(NR, NC);
+  std::iota(x.index_begin(), x.index_end(), 0);
+  std::iota(x.col_begin(0), x.col_end(NC - 1), 1.);
+  REQUIRE(x.setColnames({"a", "b"}));
+  const LDL_ts &cx = x;
+  // address of the first element of the index
+  auto index_of = [](const LDL_ts &s) { return &*s.index_begin(); };
+
+  // copies share the index until one of them is written to
+  LDL_ts y(x);
+  REQUIRE(index_of(y) == index_of(cx));
+  REQUIRE(y.getColnames() == x.getColnames());
+  std::iota(y.index_begin(), y.index_end(), 1000);
+  REQUIRE(index_of(y) != index_of(cx));
+  REQUIRE(cx.index_begin()[0] == 0);
+  REQUIRE(y.index_begin()[0] == 1000);
+
+  // results on the same index, or a block of it, share it
+  const LDL_ts z(x);
+  const LDL_ts sum{z + z};
+  REQUIRE(index_of(sum) == index_of(cx));
+  REQUIRE(sum.getColnames() == x.getColnames());
+  const LDL_ts diff{z - z.lag(1)};
+  REQUIRE(index_of(diff) == index_of(cx) + 1);
+  REQUIRE(diff.nrow() == NR - 1);
+  REQUIRE(diff.col_begin(0)[0] == 1.);
+  const LDL_ts mean{rolling_mean(z, 3)};
+  REQUIRE(index_of(mean) == index_of(cx));
+
+  // writing to a shared index leaves the others alone
+  LDL_ts w(sum);
+  w.index_begin()[0] = -1;
+  REQUIRE(cx.index_begin()[0] == 0);
+  REQUIRE(sum.index_begin()[0] == 0);
+
+  // identical storage is recognised without comparing
+  const auto a = classify_alignment(cx.index_begin(), cx.index_end(), sum.index_begin(), sum.index_end());
+  REQUIRE(a.kind == Alignment::identical);
+  REQUIRE(a.length == static_cast<size_t>(NR));
+}
+
+TEST_CASE("Resampling.") {
+  typedef GregorianDate<long> DP;
+  // every calendar day of 2015, the value is the day of the year
+  const long first{DP::toDate(2015, 1, 1)}, NR{365};
+  LDL_ts x(NR, 2);
+  std::iota(x.index_begin(), x.index_end(), first);
+  std::iota(x.col_begin(0), x.col_end(0), 1.);
+  std::fill(x.col_begin(1), x.col_end(1), 1.);
+  REQUIRE(x.setColnames({"a", "b"}));
+  // no values at all in march for the second column
+  std::fill(x.col_begin(1) + 59, x.col_begin(1) + 90, RNT<double>::NA());
+
+  SECTION("monthly") {
+    const LDL_ts last{resample<LastReducer>(x, Monthly())};
+    REQUIRE(last.nrow() == 12);
+    REQUIRE(last.index_begin()[0] == DP::toDate(2015, 1, 31));
+    REQUIRE(last.index_begin()[1] == DP::toDate(2015, 2, 28));
+    REQUIRE(last.col_begin(0)[1] == 59.);
+    REQUIRE(last.getColnames() == x.getColnames());
+    const LDL_ts sum{resample<SumReducer>(x, Monthly())};
+    REQUIRE(sum.col_begin(0)[0] == 31. * 32. / 2.);
+    REQUIRE(sum.col_begin(1)[1] == 28.);
+    REQUIRE(RNT<double>::ISNA(sum.col_begin(1)[2]));
+    const LDL_ts first_day{resample<FirstReducer>(x, Monthly())};
+    REQUIRE(first_day.col_begin(0)[11] == 335.);
+    const LDL_ts mean{resample<MeanReducer>(x, Monthly())};
+    REQUIRE(mean.col_begin(0)[0] == 16.);
+  }
+
+  SECTION("quarterly and yearly") {
+    const LDL_ts q{resample<LastReducer>(x, Quarterly())};
+    REQUIRE(q.nrow() == 4);
+    REQUIRE(q.index_begin()[0] == DP::toDate(2015, 3, 31));
+    REQUIRE(q.index_begin()[3] == DP::toDate(2015, 12, 31));
+    REQUIRE(q.col_begin(0)[1] == 181.);
+    const LDL_ts y{resample<SumReducer>(x, Yearly())};
+    REQUIRE(y.nrow() == 1);
+    REQUIRE(y.col_begin(1)[0] == 365. - 31.);
+  }
+
+  SECTION("weekly") {
+    // 2015-01-01 is a thursday, the first week ending on sunday has 4 days
+    const LDL_ts w{resample<SumReducer>(x, Weekly())};
+    REQUIRE(w.index_begin()[0] == DP::toDate(2015, 1, 4));
+    REQUIRE(w.col_begin(1)[0] == 4.);
+    REQUIRE(w.col_begin(1)[1] == 7.);
+    REQUIRE(w.nrow() == 53);
+    // weeks ending on friday
+    const LDL_ts f{resample<SumReducer>(x, Weekly(5))};
+    REQUIRE(f.index_begin()[0] == DP::toDate(2015, 1, 2));
+  }
+
+  SECTION("intraday weekly") {
+    // 14 days of rows 6 hours apart from monday 2015-01-05 make two weeks ending on sunday
+    typedef EpochSeconds<long> ES;
+    typedef TSeries<long, double, long, VectorBackend, EpochSeconds, RNT> intraday_ts;
+    intraday_ts s(14 * 4, 1);
+    for (long i = 0; i < s.nrow(); ++i) { s.index_begin()[i] = ES::toDate(2015, 1, 5) + i * 6 * 3600; }
+    std::fill(s.col_begin(0), s.col_end(0), 1.);
+    const intraday_ts w{resample<SumReducer>(s, Weekly())};
+    REQUIRE(w.nrow() == 2);
+    REQUIRE(w.col_begin(0)[0] == 28.);
+    REQUIRE(w.index_begin()[0] == ES::toDate(2015, 1, 11, 18));
+    // a week ends at the last second of its last day
+    REQUIRE(Weekly().end<ES>(ES::toDate(2015, 1, 7, 12)) == ES::toDate(2015, 1, 12) - 1);
+    REQUIRE(Weekly(3).end<ES>(ES::toDate(2015, 1, 7, 12)) == ES::toDate(2015, 1, 8) - 1);
+    REQUIRE(Weekly().end<EpochNanos<long>>(EpochNanos<long>::toDate(2015, 1, 11, 23, 59, 59, 999) + 999999) ==
+            EpochNanos<long>::toDate(2015, 1, 12) - 1);
+  }
+
+  SECTION("ohlc") {
+    x.col_begin(0)[3] = 100.;
+    x.col_begin(0)[4] = -1.;
+    const LDL_ts bars{to_period(x, Monthly())};
+    REQUIRE(bars.ncol() == 8);
+    REQUIRE(bars.getColnames()[0] == "a.Open");
+    REQUIRE(bars.getColnames()[7] == "b.Close");
+    REQUIRE(bars.col_begin(0)[0] == 1.);
+    REQUIRE(bars.col_begin(1)[0] == 100.);
+    REQUIRE(bars.col_begin(2)[0] == -1.);
+    REQUIRE(bars.col_begin(3)[0] == 31.);
+    REQUIRE(RNT<double>::ISNA(bars.col_begin(4)[2]));
+  }
+
+  SECTION("sparse index") {
+    // only a few rows, with a gap of several months
+    LDL_ts s(4, 1);
+    s.index_begin()[0] = DP::toDate(2015, 1, 5);
+    s.index_begin()[1] = DP::toDate(2015, 1, 30);
+    s.index_begin()[2] = DP::toDate(2015, 6, 1);
+    s.index_begin()[3] = DP::toDate(2016, 2, 29);
+    std::iota(s.col_begin(0), s.col_end(0), 1.);
+    const LDL_ts m{resample<SumReducer>(s, Monthly())};
+    REQUIRE(m.nrow() == 3);
+    REQUIRE(m.col_begin(0)[0] == 3.);
+    REQUIRE(m.index_begin()[2] == DP::toDate(2016, 2, 29));
+    REQUIRE(resample<SumReducer>(LDL_ts(0, 1), Monthly()).nrow() == 0);
+  }
+}
+
+TEST_CASE("Date policies.") {
+  typedef GregorianDate<long> DP;
+  static_assert(days_from_civil(1970, 1, 1) == 0, "epoch");
+  static_assert(civil_from_days(31).month == 2, "february");
+  static_assert(weekday_from_days(0) == 4, "1970-01-01 is a thursday");
+
+  SECTION("matches boost") {
+    const boost::gregorian::date epoch(1970, 1, 1);
+    auto check = [&](long x) {
+      const boost::gregorian::date d{epoch + boost::gregorian::days(x)};
+      REQUIRE(DP::year(x) == d.year());
+      REQUIRE(DP::month(x) == d.month());
+      REQUIRE(DP::dayofmonth(x) == d.day());
+      REQUIRE(DP::dayofweek(x) == d.day_of_week());
+      REQUIRE(DP::last_day_of_month(x) == (d.end_of_month() - epoch).days());
+      REQUIRE(DP::toDate(d.year(), d.month(), d.day()) == x);
+      for (int n : {-25, -13, -1, 1, 2, 11, 12, 49}) {
+        REQUIRE(DP::AddMonths(x, n) == (d + boost::gregorian::months(n) - epoch).days());
+      }
+      REQUIRE(DP::AddYears(x, 1) == (d + boost::gregorian::years(1) - epoch).days());
+      std::stringstream ss;
+      ss << d;
+      REQUIRE(DP::toString(x, "") == ss.str());
+    };
+    // every day from 1899 to 2101, and a sparse sample of the rest of boost's range
+    for (long x = DP::toDate(1899, 1, 1); x <= DP::toDate(2101, 12, 31); ++x) { check(x); }
+    for (long x = DP::toDate(1403, 1, 1); x <= DP::toDate(9990, 1, 1); x += 997) { check(x); }
+    REQUIRE_THROWS_AS(DP::toDate(2015, 2, 29), std::out_of_range);
+    REQUIRE_THROWS_AS(DP::toDate(2015, 13, 1), std::out_of_range);
+  }
+
+  SECTION("batch") {
+    std::vector<long> idx{DP::toDate(2015, 1, 31), DP::toDate(2016, 2, 29), DP::toDate(1969, 12, 31)};
+    std::vector<long> y(3);
+    std::vector<int> m(3), d(3);
+    DP::decompose(idx.begin(), idx.end(), y.data(), m.data(), d.data());
+    REQUIRE(y == std::vector<long>({2015, 2016, 1969}));
+    REQUIRE(m == std::vector<int>({1, 2, 12}));
+    REQUIRE(d == std::vector<int>({31, 29, 31}));
+  }
+
+  SECTION("intraday") {
+    typedef EpochSeconds<long> ES;
+    typedef EpochNanos<long> EN;
+    const long t{ES::toDate(2015, 3, 31, 9, 30, 15)};
+    REQUIRE(ES::toString(t, "") == "2015-Mar-31 09:30:15");
+    REQUIRE(ES::hour(t) == 9);
+    REQUIRE(ES::minute(t) == 30);
+    REQUIRE(ES::second(t) == 15);
+    REQUIRE(ES::dayofweek(t) == 2);
+    REQUIRE(ES::AddMonths(t, 1) == ES::toDate(2015, 4, 30, 9, 30, 15));
+    REQUIRE(ES::last_day_of_month(t) == ES::toDate(2015, 3, 31, 23, 59, 59));
+    REQUIRE(ES::daily_distance(ES::AddDays(t, 2), t) == 2.);
+    // before the epoch the date rounds down
+    const long b{ES::toDate(1969, 12, 31, 23, 0, 0)};
+    REQUIRE(b == -3600);
+    REQUIRE(ES::dayofmonth(b) == 31);
+    REQUIRE(ES::hour(b) == 23);
+    const long n{EN::toDate(2015, 1, 2, 16, 0, 0, 250) + 7};
+    REQUIRE(EN::toString(n, "") == "2015-Jan-02 16:00:00.250000007");
+    REQUIRE(EN::year(n) == 2015);
+
+    // a bar every 3 days and 2 hours, resampled to months
+    typedef TSeries<long, double, long, VectorBackend, EpochSeconds, RNT> intraday_ts;
+    intraday_ts x(360, 1);
+    for (long i = 0; i < x.nrow(); ++i) { x.index_begin()[i] = ES::toDate(2015, 1, 30, 10, 0, 0) + i * 3 * 86400 + i * 7200; }
+    std::fill(x.col_begin(0), x.col_end(0), 1.);
+    long months{0}, rows{0};
+    for (long i = 0; i < x.nrow(); ++i) {
+      if (i == 0 || ES::month(x.index_begin()[i]) != ES::month(x.index_begin()[i - 1])) { ++months; }
+    }
+    const intraday_ts m{resample<SumReducer>(x, Monthly())};
+    REQUIRE(m.nrow() == months);
+    REQUIRE(m.col_begin(0)[0] == 1.);
+    for (long p = 0; p < m.nrow(); ++p) { rows += static_cast<long>(m.col_begin(0)[p]); }
+    REQUIRE(rows == x.nrow());
+    REQUIRE(ES::month(m.index_begin()[1]) == 2);
+  }
+}
+
+TEST_CASE("Serialization.") {
+  typedef TSeries<long, long, long, VectorBackend, GregorianDate, RNT> LLL_ts;
+  const long NR{500}, NC{3};
+  LDL_ts x(NR, NC);
+  for (long i = 0; i < NR; ++i) { x.index_begin()[i] = 16000 + i + (i / 5) * 2; }
+  for (long c = 0; c < NC; ++c) {
+    for (long i = 0; i < NR; ++i) { x.col_begin(c)[i] = 100. + c + 0.25 * ((i * 7 + c) % 13); }
+  }
+  x.col_begin(1)[0]      = RNT<double>::NA();
+  x.col_begin(1)[17]     = RNT<double>::NA();
+  x.col_begin(2)[NR - 1] = RNT<double>::NA();
+  REQUIRE(x.setColnames({"open", "mid", "close"}));
+
+  auto same = [](const LDL_ts &a, const LDL_ts &b) {
+    REQUIRE(a.nrow() == b.nrow());
+    REQUIRE(a.ncol() == b.ncol());
+    REQUIRE(std::equal(a.index_begin(), a.index_end(), b.index_begin()));
+    for (long c = 0; c < a.ncol(); ++c) {
+      for (long i = 0; i < a.nrow(); ++i) {
+        const double u{a.col_begin(c)[i]}, v{b.col_begin(c)[i]};
+        REQUIRE((RNT<double>::ISNA(u) ? RNT<double>::ISNA(v) : u == v));
+      }
+    }
+    REQUIRE(a.getColnames() == b.getColnames());
+  };
+
+  SECTION("every codec") {
+    size_t raw_size{0};
+    for (Codec idx : {Codec::raw, Codec::delta, Codec::gorilla}) {
+      for (Codec val : {Codec::raw, Codec::delta, Codec::gorilla}) {
+        for (bool bitmap : {false, true}) {
+          SaveOptions opts;
+          opts.index     = idx;
+          opts.values    = val;
+          opts.na_bitmap = bitmap;
+          std::stringstream ss;
+          save(ss, x, opts);
+          if (idx == Codec::raw && val == Codec::raw && !bitmap) { raw_size = ss.str().size(); }
+          same(x, load<LDL_ts>(ss));
+        }
+      }
+    }
+    std::stringstream ss;
+    save(ss, x, SaveOptions::compressed());
+    REQUIRE(ss.str().size() < raw_size / 2);
+  }
+
+  SECTION("integers and per column codecs") {
+    LLL_ts y(NR, 2);
+    std::iota(y.index_begin(), y.index_end(), 0);
+    for (long i = 0; i < NR; ++i) {
+      y.col_begin(0)[i] = i * i - 1000;
+      y.col_begin(1)[i] = i % 3 ? std::numeric_limits<long>::max() - i : RNT<long>::NA();
+    }
+    SaveOptions opts;
+    opts.index     = Codec::delta;
+    opts.columns   = {Codec::delta, Codec::raw};
+    opts.na_bitmap = true;
+    std::stringstream ss;
+    save(ss, y, opts);
+    const LLL_ts z{load<LLL_ts>(ss)};
+    REQUIRE(std::equal(y.index_begin(), y.index_end(), z.index_begin()));
+    REQUIRE(std::equal(y.col_begin(0), y.col_end(1), z.col_begin(0)));
+    REQUIRE(!z.hasColnames());
+    opts.columns = {Codec::delta};
+    REQUIRE_THROWS_AS(save(ss, y, opts), std::logic_error);
+  }
+
+  SECTION("empty and file") {
+    const std::string path{"serialize.test.bin"};
+    save(path, LDL_ts(0, 2), SaveOptions::compressed());
+    const LDL_ts e{load<LDL_ts>(path)};
+    REQUIRE(e.nrow() == 0);
+    REQUIRE(e.ncol() == 2);
+    save(path, x);
+    same(x, load<LDL_ts>(path));
+    std::remove(path.c_str());
+  }
+
+  SECTION("bad input") {
+    std::stringstream ss;
+    save(ss, x, SaveOptions::compressed());
+    const std::string good{ss.str()};
+    for (size_t pos : {size_t(2), size_t(40), good.size() / 2, good.size() - 1}) {
+      std::string bad{good};
+      bad[pos] = static_cast<char>(bad[pos] ^ 0x10);
+      std::stringstream in(bad);
+      REQUIRE_THROWS_AS(load<LDL_ts>(in), std::runtime_error);
+    }
+    // a corrupt colname count or length is refused before anything is allocated for it
+    for (size_t pos : {size_t(31), size_t(35)}) {
+      std::string bad{good};
+      bad[pos] = static_cast<char>(0xFF);
+      std::stringstream in(bad);
+      REQUIRE_THROWS_AS(load<LDL_ts>(in), std::runtime_error);
+    }
+    std::stringstream truncated(good.substr(0, good.size() - 3));
+    REQUIRE_THROWS_AS(load<LDL_ts>(truncated), std::runtime_error);
+    std::stringstream wrong(good);
+    REQUIRE_THROWS_AS(load<LLL_ts>(wrong), std::runtime_error);
+  }
+}
+
+TEST_CASE("CSV.") {
+  typedef GregorianDate<long> DP;
+  typedef TSeries<long, long, long, VectorBackend, GregorianDate, RNT> LLL_ts;
+
+  SECTION("parse") {
+    const std::string text{"date,\"a\",\"b,c\"\r\n"
+                           "2015-01-02,1.5,-2.5E+2\r\n"
+                           "2015/01/05, 0.1 ,NA\r\n"
+                           "2015-01-06 16:30:00,,1e-3\r\n"
+                           "\r\n"};
+    CsvOptions opts;
+    for (size_t chunk : {size_t(1 << 20), size_t(8)}) {
+      opts.chunk_size = chunk;
+      std::stringstream ss(text);
+      const LDL_ts x{read_csv<LDL_ts>(ss, opts)};
+      REQUIRE(x.nrow() == 3);
+      REQUIRE(x.ncol() == 2);
+      REQUIRE(x.getColnames() == std::vector<std::string>({"a", "b,c"}));
+      REQUIRE(x.index_begin()[0] == DP::toDate(2015, 1, 2));
+      REQUIRE(x.index_begin()[1] == DP::toDate(2015, 1, 5));
+      REQUIRE(x.index_begin()[2] == DP::toDate(2015, 1, 6));
+      REQUIRE(x.col_begin(0)[0] == 1.5);
+      REQUIRE(x.col_begin(0)[1] == 0.1);
+      REQUIRE(RNT<double>::ISNA(x.col_begin(0)[2]));
+      REQUIRE(x.col_begin(1)[0] == -250.);
+      REQUIRE(RNT<double>::ISNA(x.col_begin(1)[1]));
+      REQUIRE(x.col_begin(1)[2] == 1e-3);
+    }
+
+    // intraday index, no header, no final newline
+    typedef TSeries<long, long, long, VectorBackend, EpochNanos, RNT> nanos_ts;
+    opts.header = false;
+    std::stringstream ss("2015-01-02T09:30:00.25;7\n2015-01-02 09:30:01;-9223372036854775807");
+    opts.delimiter = ';';
+    const nanos_ts n{read_csv<nanos_ts>(ss, opts)};
+    REQUIRE(n.nrow() == 2);
+    REQUIRE(!n.hasColnames());
+    REQUIRE(n.index_begin()[0] == EpochNanos<long>::toDate(2015, 1, 2, 9, 30, 0, 250));
+    REQUIRE(n.col_begin(0)[1] == -9223372036854775807L);
+  }
+
+  SECTION("errors") {
+    auto fails = [](const std::string &text) {
+      std::stringstream ss(text);
+      REQUIRE_THROWS_AS(read_csv<LDL_ts>(ss), std::runtime_error);
+    };
+    fails("index,a\n2015-01-02,1,2\n");
+    fails("index,a,b\n2015-01-02,1\n");
+    fails("index,a\n2015-02-30,1\n");
+    fails("index,a\n2015-01-02,1.2.3\n");
+    fails("index,a\n2015-01-02,1e\n");
+    std::stringstream ss("index,a\n2015-01-02,1\n2015-01-03,x\n");
+    try {
+      read_csv<LDL_ts>(ss);
+      FAIL();
+    } catch (const std::runtime_error &e) { REQUIRE(std::string(e.what()) == "read_csv: line 3: bad value 'x'"); }
+    std::stringstream big("index,a\n2015-01-02,9223372036854775808\n");
+    REQUIRE_THROWS_AS(read_csv<LLL_ts>(big), std::runtime_error);
+  }
+
+  SECTION("numbers match strtod") {
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<long> mant(0, 99999999999L);
+    std::uniform_int_distribution<int> dec(0, 12), ex(-30, 30);
+    char buf[64];
+    for (int i = 0; i < 20000; ++i) {
+      const long m{mant(gen)};
+      const int d{dec(gen)};
+      const int len{i % 3 ? std::sprintf(buf, "%ld.%0*ld", m / 1000, 3, m % 1000)
+                          : std::sprintf(buf, "%ld.%de%d", m, d, ex(gen))};
+      double v;
+      REQUIRE(detail::csv_parse(buf, buf + len, v));
+      REQUIRE(v == std::strtod(buf, nullptr));
+    }
+  }
+
+  SECTION("round trip") {
+    std::mt19937_64 gen(7);
+    std::uniform_real_distribution<double> u(-1e6, 1e6);
+    const long NR{2000}, NC{3};
+    LDL_ts x(NR, NC);
+    for (long i = 0; i < NR; ++i) { x.index_begin()[i] = DP::toDate(1999, 12, 31) + i; }
+    for (long i = 0; i < NR; ++i) {
+      x.col_begin(0)[i] = u(gen);
+      x.col_begin(1)[i] = std::round(u(gen) * 100) / 100;
+      x.col_begin(2)[i] = i % 7 ? std::ldexp(u(gen), static_cast<int>(i % 600) - 300) : RNT<double>::NA();
+    }
+    x.col_begin(1)[3] = std::numeric_limits<double>::infinity();
+    x.col_begin(1)[4] = -0.;
+    REQUIRE(x.setColnames({"x", "cents", "wide"}));
+
+    std::stringstream ss;
+    write_csv(ss, x);
+    REQUIRE(ss.str().compare(0, 30, "index,x,cents,wide\n1999-12-31,") == 0);
+    const LDL_ts y{read_csv<LDL_ts>(ss)};
+    REQUIRE(y.getColnames() == x.getColnames());
+    REQUIRE(std::equal(x.index_begin(), x.index_end(), y.index_begin()));
+    for (long c = 0; c < NC; ++c) {
+      for (long i = 0; i < NR; ++i) {
+        const double a{x.col_begin(c)[i]}, b{y.col_begin(c)[i]};
+        REQUIRE((RNT<double>::ISNA(a) ? RNT<double>::ISNA(b) : a == b && std::signbit(a) == std::signbit(b)));
+      }
+    }
+    // prices come out as written
+    REQUIRE(ss.str().find(",-0,") != std::string::npos);
+
+    const std::string path{"csv.test.csv"};
+    CsvOptions opts;
+    opts.digits     = 2;
+    opts.chunk_size = 100;
+    write_csv(path, x, opts);
+    const LDL_ts z{read_csv<LDL_ts>(path, opts)};
+    REQUIRE(z.nrow() == NR);
+    REQUIRE(std::equal(x.col_begin(1) + 5, x.col_end(1), z.col_begin(1) + 5));
+    REQUIRE(std::abs(z.col_begin(0)[9] - x.col_begin(0)[9]) <= 0.005);
+    std::remove(path.c_str());
+  }
+
+  SECTION("sub-second round trip") {
+    typedef EpochNanos<long> EN;
+    typedef TSeries<long, long, long, VectorBackend, EpochNanos, RNT> nanos_ts;
+    const long t{EN::toDate(2015, 1, 2, 9, 30, 0)};
+    const std::vector<long> stamps{EN::toDate(1969, 12, 31, 23, 59, 59) + 5, t, t + 250000000, t + 7, t + 123456789};
+    nanos_ts n(static_cast<long>(stamps.size()), 1);
+    std::copy(stamps.begin(), stamps.end(), n.index_begin());
+    std::iota(n.col_begin(0), n.col_end(0), 0);
+    CsvOptions opts;
+    opts.index = IndexFormat::datetime;
+    std::stringstream ss;
+    write_csv(ss, n, opts);
+    REQUIRE(ss.str().find("\n2015-01-02 09:30:00,1\n2015-01-02 09:30:00.25,2\n") != std::string::npos);
+    REQUIRE(ss.str().find("1969-12-31 23:59:59.000000005,0") != std::string::npos);
+    REQUIRE(ss.str().find("09:30:00.123456789,4") != std::string::npos);
+    const nanos_ts back{read_csv<nanos_ts>(ss, opts)};
+    REQUIRE(std::equal(n.index_begin(), n.index_end(), back.index_begin(), back.index_end()));
+
+    // an index in seconds keeps whole seconds and reads the decimals it can't hold as 0
+    typedef TSeries<long, long, long, VectorBackend, EpochSeconds, RNT> seconds_ts;
+    std::stringstream in(ss.str()), secs;
+    write_csv(secs, read_csv<seconds_ts>(in, opts), opts);
+    REQUIRE(secs.str().find("09:30:00,2\n") != std::string::npos);
+    REQUIRE(secs.str().find('.') == std::string::npos);
+  }
+}
+
+TEST_CASE("Append backend.") {
+  typedef TSeries<long, double, long, AppendBackend, GregorianDate, RNT> live_ts;
+  typedef AppendBackend<long, double, long> backend;
+
+  SECTION("append") {
+    live_ts x(backend::create(2, 0, 4));
+    REQUIRE(x.setColnames({"bid", "ask"}));
+    for (long i = 0; i < 10; ++i) { x.getBackend().append(100 + i, {double(i), double(-i)}); }
+    REQUIRE(x.nrow() == 10);
+    REQUIRE(x.getBackend().segments() == 3);
+    REQUIRE(x.index_begin()[9] == 109);
+    REQUIRE(x.col_begin(1)[6] == -6.);
+    REQUIRE(std::accumulate(x.col_begin(0), x.col_end(0), 0.) == 45.);
+    REQUIRE_THROWS_AS(x.getBackend().append(99, {0., 0.}), std::logic_error);
+    REQUIRE_THROWS_AS(x.getBackend().append(200, {0.}), std::logic_error);
+
+    // operations and views work across segments
+    const live_ts sum{x + x.lag(1)};
+    REQUIRE(sum.nrow() == 9);
+    REQUIRE(sum.col_begin(0)[0] == 1.);
+    REQUIRE(sum.col_begin(0)[8] == 17.);
+    REQUIRE(x.window(103, 105).nrow() == 3);
+  }
+
+  SECTION("snapshots") {
+    live_ts x(backend::create(1, 0, 4));
+    for (long i = 0; i < 6; ++i) { x.getBackend().append(i, {double(i)}); }
+    const live_ts snap(x.getBackend().snapshot());
+    live_ts copy(x);
+    for (long i = 6; i < 20; ++i) { x.getBackend().append(i, {double(i)}); }
+    REQUIRE(snap.nrow() == 6);
+    REQUIRE(copy.nrow() == 6);
+    REQUIRE(snap.col_begin(0)[5] == 5.);
+
+    // copy on write, both ways
+    copy *= 10.;
+    REQUIRE(copy.col_begin(0)[5] == 50.);
+    REQUIRE(x.col_begin(0)[5] == 5.);
+    x *= 2.;
+    REQUIRE(x.col_begin(0)[19] == 38.);
+    REQUIRE(snap.col_begin(0)[5] == 5.);
+    copy.getBackend().append(6, {60.});
+    REQUIRE(copy.nrow() == 7);
+    REQUIRE(x.nrow() == 20);
+    REQUIRE(x.col_begin(0)[6] == 12.);
+  }
+
+  SECTION("ring") {
+    live_ts x(backend::create(1, 10, 4));
+    for (long i = 0; i < 100; ++i) {
+      x.getBackend().append(i, {double(i)});
+      REQUIRE(x.nrow() == std::min(i + 1, 10L));
+      REQUIRE(x.getBackend().segments() <= 4);
+    }
+    REQUIRE(x.index_begin()[0] == 90);
+    REQUIRE(x.col_begin(0)[9] == 99.);
+    const live_ts snap{x};
+    x.getBackend().append(100, {100.});
+    REQUIRE(snap.index_begin()[0] == 90);
+    REQUIRE(x.index_begin()[0] == 91);
+  }
+
+  SECTION("one writer, many readers") {
+    for (size_t capacity : {size_t(0), size_t(1000)}) {
+      live_ts x(backend::create(2, capacity, 64));
+      const long N{100000};
+      std::atomic<bool> done{false};
+      std::vector<std::thread> readers;
+      std::atomic<long> snapshots{0}, bad{0};
+      for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&] {
+          long last{0};
+          while (!done || snapshots == 0) {
+            const live_ts s(x.getBackend().snapshot());
+            const long n{s.nrow()};
+            if (n == 0) { continue; }
+            // rows are whole and in order: index i holds i and -i
+            const long first{s.index_begin()[0]};
+            bool ok{capacity ? n <= static_cast<long>(capacity) : first == 0 && n >= last};
+            for (long i = 0; i < n; i += 97) {
+              ok = ok && s.index_begin()[i] == first + i && s.col_begin(0)[i] == first + i && s.col_begin(1)[i] == -(first + i);
+            }
+            ok = ok && s.col_begin(1)[n - 1] == -(first + n - 1);
+            if (!ok) { ++bad; }
+            last = first + n;
+            ++snapshots;
+          }
+        });
+      }
+      for (long i = 0; i < N; ++i) { x.getBackend().append(i, {double(i), double(-i)}); }
+      done = true;
+      for (auto &t : readers) { t.join(); }
+      REQUIRE(bad == 0);
+      REQUIRE(snapshots > 0);
+      REQUIRE(x.nrow() == (capacity ? static_cast<long>(capacity) : N));
+    }
+  }
+}
+
+TEST_CASE("Streaming.") {
+  typedef TSeries<long, double, long, AppendBackend, GregorianDate, RNT> live_ts;
+  typedef AppendBackend<long, double, long> backend;
+  // same bits, NAs included
+  auto identical = [](const live_ts &a, const live_ts &b) {
+    REQUIRE(a.nrow() == b.nrow());
+    REQUIRE(a.ncol() == b.ncol());
+    REQUIRE(std::equal(a.index_begin(), a.index_end(), b.index_begin()));
+    for (long c = 0; c < a.ncol(); ++c) {
+      for (long i = 0; i < a.nrow(); ++i) {
+        const double u{a.col_begin(c)[i]}, v{b.col_begin(c)[i]};
+        REQUIRE(std::memcmp(&u, &v, sizeof(double)) == 0);
+      }
+    }
+  };
+
+  std::mt19937_64 gen(3);
+  std::uniform_real_distribution<double> u(-1, 1);
+  std::uniform_int_distribution<int> gap(1, 3), batch(0, 7);
+  live_ts x(backend::create(2)), y(backend::create(1));
+  REQUIRE(x.setColnames({"a", "b"}));
+  live_ts sum(backend::create(2)), lagged(backend::create(2)), sd(backend::create(2)), lo(backend::create(2)),
+      cal(backend::create(2)), chained(backend::create(2));
+  auto sum_node     = stream_binary<PlusFunctor>(x, y);
+  auto lag_node     = stream_lag(x, 3);
+  auto sd_node      = stream_rolling<RollingSd>(x, 5);
+  auto min_node     = stream_rolling<RollingMin>(x, 4);
+  auto cal_node     = stream_rolling_calendar<RollingMean>(x, 7., 2);
+  auto chained_node = stream_rolling<RollingSum>(sum, 6);
+
+  long tx{100}, ty{100};
+  for (int step = 0; step < 200; ++step) {
+    for (int k = batch(gen); k > 0; --k) {
+      tx += gap(gen);
+      x.getBackend().append(tx, {k == 3 ? RNT<double>::NA() : u(gen), u(gen) * 1e6});
+    }
+    for (int k = batch(gen); k > 0; --k) {
+      ty += gap(gen);
+      y.getBackend().append(ty, {step % 17 == 0 ? RNT<double>::NA() : u(gen)});
+    }
+    sum_node.update(sum);
+    lag_node.update(lagged);
+    sd_node.update(sd);
+    min_node.update(lo);
+    cal_node.update(cal);
+    chained_node.update(chained);
+  }
+  REQUIRE(sum.nrow() > 100);
+  REQUIRE(sum.getColnames() == x.getColnames());
+  REQUIRE(sum_node.update(sum) == 0);
+
+  // the same as computing everything again
+  const live_ts full_sum{x + y};
+  identical(sum, full_sum);
+  identical(lagged, x.lag_copy(3));
+  identical(sd, rolling_sd(x, 5));
+  identical(lo, rolling_min(x, 4));
+  identical(cal, rolling_calendar<RollingMean>(x, 7., 2));
+  identical(chained, rolling_sum(full_sum, 6));
+
+  SECTION("output width") {
+    // an output wider or narrower than the node is refused before anything is appended
+    live_ts wide(backend::create(3)), narrow(backend::create(1));
+    REQUIRE_THROWS_AS(stream_binary<PlusFunctor>(x, y).update(wide), std::logic_error);
+    REQUIRE_THROWS_AS(stream_lag(x, 1).update(narrow), std::logic_error);
+    REQUIRE_THROWS_AS(stream_rolling<RollingMean>(x, 3).update(wide), std::logic_error);
+    REQUIRE(wide.nrow() == 0);
+    REQUIRE(narrow.nrow() == 0);
+  }
+
+  SECTION("ring inputs") {
+    live_ts r(backend::create(1, 20, 8)), out(backend::create(1)), all(backend::create(1));
+    auto node = stream_rolling<RollingMean>(r, 10);
+    for (long i = 0; i < 100; ++i) {
+      r.getBackend().append(i, {double(i % 13)});
+      all.getBackend().append(i, {double(i % 13)});
+      node.update(out);
+    }
+    identical(out, rolling_mean(all, 10));
+
+    // a lag longer than the ring
+    live_ts lag_out(backend::create(1));
+    auto far = stream_lag(r, 30);
+    REQUIRE(far.update(lag_out) == 0);
+    REQUIRE_THROWS_AS(
+        [&] {
+          for (long i = 100; i < 200; ++i) {
+            r.getBackend().append(i, {0.});
+            far.update(lag_out);
+          }
+        }(),
+        std::logic_error);
+  }
+}
+
+TEST_CASE("Joins.") {
+  std::mt19937_64 gen(11);
+  // strictly increasing index with gaps drawn from [1, max_gap]
+  auto make_index = [&gen](size_t n, int max_gap) {
+    std::uniform_int_distribution<int> gap(1, max_gap);
+    std::vector<long> v(n);
+    long t{0};
+    for (auto &x : v) { x = t += gap(gen); }
+    return v;
+  };
+
+  SECTION("join maps") {
+    // dense against dense, and dense against sparse in both orders so the gallops run
+    const std::vector<std::pair<size_t, int>> shapes{{500, 3}, {2000, 1}, {40, 120}, {0, 1}};
+    for (auto xs : shapes) {
+      for (auto ys : shapes) {
+        const std::vector<long> x(make_index(xs.first, xs.second)), y(make_index(ys.first, ys.second));
+        for (long tol : {-1L, 0L, 5L, 200L}) {
+          for (auto dir : {AsofDirection::backward, AsofDirection::forward}) {
+            const auto m(tol < 0 ? asof_map(x.begin(), x.end(), y.begin(), y.end(), dir)
+                                 : asof_map(x.begin(), x.end(), y.begin(), y.end(), dir, tol));
+            REQUIRE(m.size() == x.size());
+            for (size_t i = 0; i < x.size(); ++i) {
+              size_t expected{no_match};
+              if (dir == AsofDirection::backward) {
+                const auto p(std::upper_bound(y.begin(), y.end(), x[i]));
+                if (p != y.begin() && (tol < 0 || x[i] - p[-1] <= tol)) { expected = p - 1 - y.begin(); }
+              } else {
+                const auto p(std::lower_bound(y.begin(), y.end(), x[i]));
+                if (p != y.end() && (tol < 0 || *p - x[i] <= tol)) { expected = p - y.begin(); }
+              }
+              REQUIRE(m[i].first == i);
+              REQUIRE(m[i].second == expected);
+            }
+          }
+        }
+
+        const auto left(left_join_map(x.begin(), x.end(), y.begin(), y.end()));
+        REQUIRE(left.size() == x.size());
+        for (size_t i = 0; i < x.size(); ++i) {
+          const auto p(std::lower_bound(y.begin(), y.end(), x[i]));
+          REQUIRE(left[i].second == (p != y.end() && *p == x[i] ? static_cast<size_t>(p - y.begin()) : no_match));
+        }
+
+        const auto outer(outer_join_map(x.begin(), x.end(), y.begin(), y.end()));
+        std::vector<long> all;
+        std::set_union(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(all));
+        REQUIRE(outer.size() == all.size());
+        for (size_t k = 0; k < outer.size(); ++k) {
+          REQUIRE((outer[k].first != no_match || outer[k].second != no_match));
+          if (outer[k].first != no_match) { REQUIRE(x[outer[k].first] == all[k]); }
+          if (outer[k].second != no_match) { REQUIRE(y[outer[k].second] == all[k]); }
+        }
+      }
+    }
+  }
+
+  SECTION("series") {
+    // daily prices against month end fundamentals
+    const long jan31{GregorianDate<long>::toDate(2020, 1, 31)}, feb29{GregorianDate<long>::toDate(2020, 2, 29)};
+    LDL_ts daily(70, 2), monthly(2, 1);
+    std::iota(daily.index_begin(), daily.index_end(), jan31 - 5);
+    std::iota(daily.col_begin(0), daily.col_end(0), 1);
+    std::fill(daily.col_begin(1), daily.col_end(1), 2.0);
+    daily.col_begin(1)[10] = RNT<double>::NA();
+    REQUIRE(daily.setColnames({"px", "px2"}));
+    monthly.index_begin()[0] = jan31;
+    monthly.index_begin()[1] = feb29;
+    monthly.col_begin(0)[0]  = 10;
+    monthly.col_begin(0)[1]  = 20;
+    REQUIRE(monthly.setColnames({"eps"}));
+
+    const LDL_ts carried(asof_align(daily, monthly));
+    REQUIRE(carried.nrow() == daily.nrow());
+    REQUIRE(carried.ncol() == 1);
+    REQUIRE(carried.getColnames() == std::vector<std::string>{"eps"});
+    REQUIRE(std::equal(daily.index_begin(), daily.index_end(), carried.index_begin()));
+    for (long i = 0; i < daily.nrow(); ++i) {
+      const long d{daily.index_begin()[i]};
+      const double v{carried.col_begin(0)[i]};
+      if (d < jan31) {
+        REQUIRE(RNT<double>::ISNA(v));
+      } else {
+        REQUIRE(v == (d < feb29 ? 10 : 20));
+      }
+    }
+
+    // a month old at most, the rows past the end of march are stale
+    const LDL_ts ratio(asof_opp<DivideFunctor>(daily, monthly, AsofDirection::backward, 30L));
+    REQUIRE(ratio.nrow() == daily.nrow());
+    REQUIRE(ratio.ncol() == 2);
+    REQUIRE(ratio.getColnames() == daily.getColnames());
+    for (long i = 0; i < daily.nrow(); ++i) {
+      const long d{daily.index_begin()[i]};
+      const bool stale{d < jan31 || d > feb29 + 30};
+      REQUIRE(RNT<double>::ISNA(ratio.col_begin(0)[i]) == stale);
+      REQUIRE(RNT<double>::ISNA(ratio.col_begin(1)[i]) == (stale || i == 10));
+      if (!stale) { REQUIRE(ratio.col_begin(0)[i] == daily.col_begin(0)[i] / (d < feb29 ? 10 : 20)); }
+    }
+
+    // the forward direction takes the next month end
+    const LDL_ts ahead(asof_align(daily, monthly, AsofDirection::forward));
+    REQUIRE(ahead.col_begin(0)[0] == 10);
+    REQUIRE(ahead.col_begin(0)[6] == 20);
+    REQUIRE(RNT<double>::ISNA(ahead.col_begin(0)[daily.nrow() - 1]));
+
+    // left and outer joins
+    const LDL_ts left(join_opp<PlusFunctor>(daily, monthly, JoinType::left));
+    REQUIRE(left.nrow() == daily.nrow());
+    REQUIRE(left.col_begin(0)[5] == 6 + 10);
+    REQUIRE(RNT<double>::ISNA(left.col_begin(0)[4]));
+    LDL_ts other(3, 1);
+    other.index_begin()[0] = jan31 - 10;
+    other.index_begin()[1] = jan31;
+    other.index_begin()[2] = jan31 + 100;
+    std::fill(other.col_begin(0), other.col_end(0), 1.0);
+    const LDL_ts outer(join_opp<MinusFunctor>(daily, other, JoinType::outer));
+    REQUIRE(outer.nrow() == daily.nrow() + 2);
+    REQUIRE(outer.index_begin()[0] == jan31 - 10);
+    REQUIRE(outer.index_begin()[outer.nrow() - 1] == jan31 + 100);
+    REQUIRE(std::is_sorted(outer.index_begin(), outer.index_end()));
+    REQUIRE(outer.col_begin(0)[6] == 6 - 1);
+    REQUIRE(RNT<double>::ISNA(outer.col_begin(0)[0]));
+
+    // inner is binary_opp
+    const LDL_ts inner(join_opp<MinusFunctor>(daily, other, JoinType::inner));
+    const LDL_ts expected(binary_opp<MinusFunctor>(daily, other));
+    REQUIRE(inner.nrow() == expected.nrow());
+    REQUIRE(std::equal(inner.index_begin(), inner.index_end(), expected.index_begin()));
+    REQUIRE(std::equal(inner.col_begin(0), inner.col_end(0), expected.col_begin(0)));
+
+    // views read in place
+    const LDL_ts tail(asof_align(daily.view().lag(0), monthly.view()));
+    REQUIRE(tail.nrow() == daily.nrow());
+
+    LDL_ts three(2, 3);
+    REQUIRE_THROWS_AS(join_opp<PlusFunctor>(daily, three, JoinType::outer), std::logic_error);
+  }
+}
+
+TEST_CASE("Instrumentation.") {
+  instrument::Registry &registry{instrument::Registry::global()};
+  registry.reset();
+  registry.set_tracing(true, 2);
+
+  // misaligned indexes take the general rowmap path, which used to print every pair
+  LDL_ts x(6, 2), y(4, 1);
+  const long idx_x[] = {1, 2, 3, 5, 8, 9}, idx_y[] = {2, 3, 4, 9};
+  std::copy(std::begin(idx_x), std::end(idx_x), x.index_begin());
+  std::copy(std::begin(idx_y), std::end(idx_y), y.index_begin());
+  std::fill(x.col_begin(0), x.col_end(1), 1.0);
+  std::fill(y.col_begin(0), y.col_end(0), 2.0);
+  y.col_begin(0)[1] = RNT<double>::NA();
+
+  std::ostringstream captured;
+  std::streambuf *old{std::cout.rdbuf(captured.rdbuf())};
+  const LDL_ts z(x + y);
+  std::cout.rdbuf(old);
+  REQUIRE(captured.str().empty());
+  REQUIRE(z.nrow() == 3);
+
+  const auto stats(registry.stats());
+  if (instrument::enabled) {
+    const instrument::OpStats s{stats.at("binary_opp")};
+    REQUIRE(s.calls == 1);
+    REQUIRE(s.rows_in == 10);
+    REQUIRE(s.matches == 3);
+    REQUIRE(s.rows_out == 3);
+    REQUIRE(s.na_out == 2);
+    REQUIRE(s.bytes_allocated == 3 * (sizeof(long) + 2 * sizeof(double)));
+    REQUIRE(registry.trace().size() == 1);
+  } else {
+    REQUIRE(stats.empty());
+    REQUIRE(registry.trace().empty());
+  }
+
+  // the dumps, from counters recorded by hand
+  registry.reset();
+  instrument::OpStats s;
+  s.calls    = 2;
+  s.rows_in  = 100;
+  s.rows_out = 40;
+  s.nanos    = 1500;
+  registry.record("binary_opp", s, std::chrono::steady_clock::now());
+  registry.record("binary_opp", s, std::chrono::steady_clock::now());
+  registry.record("rolling", s, std::chrono::steady_clock::now());
+  REQUIRE(registry.stats().at("binary_opp").rows_in == 200);
+  REQUIRE(registry.to_json() ==
+          "{\"binary_opp\": {\"calls\": 4, \"rows_in\": 200, \"rows_out\": 80, \"matches\": 0, \"bytes_allocated\": 0, "
+          "\"na_out\": 0, \"seconds\": 0.000003000}, \"rolling\": {\"calls\": 2, \"rows_in\": 100, \"rows_out\": 40, "
+          "\"matches\": 0, \"bytes_allocated\": 0, \"na_out\": 0, \"seconds\": 0.000001500}}");
+  const std::string prom(registry.to_prometheus());
+  REQUIRE(prom.find("# TYPE tslib_op_calls_total counter\ntslib_op_calls_total{op=\"binary_opp\"} 4\n"
+                    "tslib_op_calls_total{op=\"rolling\"} 2\n") != std::string::npos);
+  REQUIRE(prom.find("tslib_op_seconds_total{op=\"rolling\"} 0.000001500\n") != std::string::npos);
+  // tracing stops at the limit
+  REQUIRE(registry.trace().size() == 2);
+  REQUIRE(registry.trace_json().find("{\"name\": \"binary_opp\", \"ph\": \"X\"") != std::string::npos);
+
+  registry.set_tracing(false);
+  registry.reset();
+  REQUIRE(registry.to_json() == "{}");
+}
+
+TEST_CASE("Validity masks.") {
+  std::mt19937_64 gen(5);
+  std::uniform_real_distribution<double> u(0, 1);
+
+  SECTION("mask") {
+    for (size_t n : {0UL, 1UL, 63UL, 64UL, 65UL, 200UL, 1000UL}) {
+      std::vector<bool> bits(n);
+      for (size_t i = 0; i < n; ++i) { bits[i] = u(gen) < 0.7; }
+      // long valid runs so that whole words are valid
+      for (size_t i = n / 4; i < n / 2; ++i) { bits[i] = true; }
+      std::vector<double> vals(n);
+      for (size_t i = 0; i < n; ++i) { vals[i] = bits[i] ? 1.0 : RNT<double>::NA(); }
+      const ValidityMask m(ValidityMask::from_values(vals.begin(), n, [](double x) { return RNT<double>::ISNA(x); }));
+      REQUIRE(m.size() == n);
+      REQUIRE(m.count() == static_cast<size_t>(std::count(bits.begin(), bits.end(), true)));
+      REQUIRE(m.na_count() == n - m.count());
+      for (size_t i = 0; i < n; ++i) { REQUIRE(m.test(i) == bits[i]); }
+
+      for (size_t off : {0UL, 1UL, 37UL, 64UL, 100UL}) {
+        if (off > n) { continue; }
+        const ValidityMask sl(m.slice(off, n - off));
+        REQUIRE(sl.size() == n - off);
+        for (size_t i = 0; i < sl.size(); ++i) { REQUIRE(sl.test(i) == bits[off + i]); }
+        REQUIRE(sl.count() == static_cast<size_t>(std::count(bits.begin() + off, bits.end(), true)));
+      }
+
+      // blocks cover every row once, in order, with the right kind
+      size_t next{0};
+      m.blocks(
+          [&](size_t b, size_t e) {
+            REQUIRE(b == next);
+            for (size_t i = b; i < e; ++i) { REQUIRE(bits[i]); }
+            next = e;
+          },
+          [&](size_t b, size_t e) {
+            REQUIRE(b == next);
+            for (size_t i = b; i < e; ++i) { REQUIRE(!bits[i]); }
+            next = e;
+          },
+          [&](size_t b, size_t e, std::uint64_t word) {
+            REQUIRE(b == next);
+            for (size_t i = b; i < e; ++i) { REQUIRE(((word >> (i - b)) & 1) == bits[i]); }
+            next = e;
+          });
+      REQUIRE(next == n);
+
+      std::vector<size_t> valid;
+      m.for_each_valid([&valid](size_t i) { valid.push_back(i); });
+      REQUIRE(valid.size() == m.count());
+      for (size_t i : valid) { REQUIRE(bits[i]); }
+      REQUIRE(std::is_sorted(valid.begin(), valid.end()));
+    }
+  }
+
+  SECTION("binary_opp") {
+    // same results with and without masks, for identical, offset and general alignments and a broadcast column
+    const long N{300};
+    LDL_ts x(N, 3), y(N, 3), sub(N - 70, 3), sparse(N / 2, 1);
+    std::iota(x.index_begin(), x.index_end(), 0);
+    std::iota(y.index_begin(), y.index_end(), 0);
+    std::iota(sub.index_begin(), sub.index_end(), 50);
+    for (long i = 0; i < sparse.nrow(); ++i) { sparse.index_begin()[i] = 2 * i + 1; }
+    for (LDL_ts *s : {&x, &y, &sub, &sparse}) {
+      for (long c = 0; c < s->ncol(); ++c) {
+        for (long i = 0; i < s->nrow(); ++i) { s->col_begin(c)[i] = u(gen) < 0.1 ? RNT<double>::NA() : u(gen); }
+      }
+    }
+    // a column with no NAs and one that is all NA
+    std::fill(x.col_begin(1), x.col_end(1), 2.0);
+    std::fill(y.col_begin(2), y.col_end(2), RNT<double>::NA());
+
+    const std::vector<std::pair<const LDL_ts *, const LDL_ts *>> pairs{{&x, &y}, {&x, &sub}, {&sub, &x}, {&x, &sparse}};
+    for (auto p : pairs) {
+      const LDL_ts plain(*p.first * *p.second);
+      LDL_ts a(*p.first), b(*p.second);
+      REQUIRE(build_validity(a));
+      REQUIRE(build_validity(b));
+      const LDL_ts masked(a * b);
+      REQUIRE(masked.getBackend().hasValidity());
+      REQUIRE(masked.nrow() == plain.nrow());
+      REQUIRE(std::equal(masked.index_begin(), masked.index_end(), plain.index_begin()));
+      for (long c = 0; c < plain.ncol(); ++c) {
+        for (long i = 0; i < plain.nrow(); ++i) {
+          const double v{plain.col_begin(c)[i]}, w{masked.col_begin(c)[i]};
+          REQUIRE(RNT<double>::ISNA(v) == RNT<double>::ISNA(w));
+          REQUIRE(masked.getBackend().validity(c).test(static_cast<size_t>(i)) == !RNT<double>::ISNA(v));
+          if (!RNT<double>::ISNA(v)) { REQUIRE(v == w); }
+        }
+      }
+      REQUIRE(na_count(masked) == na_count(plain));
+    }
+
+    // only one side masked, the other side gets masks built from its NAs, views included
+    for (auto p : pairs) {
+      LDL_ts a(*p.first), b(*p.second);
+      REQUIRE(build_validity(a));
+      REQUIRE(build_validity(b));
+      const LDL_ts plain(*p.first * *p.second), plain_lag(binary_opp<MultiplyFunctor>(*p.first, p.second->lag(1)));
+      const std::vector<std::pair<LDL_ts, const LDL_ts *>> results{{a * *p.second, &plain},
+                                                                   {*p.first * b, &plain},
+                                                                   {binary_opp<MultiplyFunctor>(a, p.second->lag(1)),
+                                                                    &plain_lag}};
+      for (const auto &r : results) {
+        REQUIRE(r.first.getBackend().hasValidity());
+        REQUIRE(r.first.nrow() == r.second->nrow());
+        for (long c = 0; c < r.first.ncol(); ++c) {
+          for (long i = 0; i < r.first.nrow(); ++i) {
+            const double v{r.second->col_begin(c)[i]}, w{r.first.col_begin(c)[i]};
+            REQUIRE(r.first.getBackend().validity(c).test(static_cast<size_t>(i)) == !RNT<double>::ISNA(v));
+            if (!RNT<double>::ISNA(v)) { REQUIRE(v == w); }
+          }
+        }
+        REQUIRE(na_count(r.first) == na_count(*r.second));
+      }
+    }
+  }
+
+  SECTION("int sentinel") {
+    // with a mask the lowest int is a value like any other
+    typedef TSeries<long, int, long, VectorBackend, GregorianDate, RNT> int_ts;
+    int_ts x(130, 1), y(130, 1);
+    std::iota(x.index_begin(), x.index_end(), 0);
+    std::iota(y.index_begin(), y.index_end(), 0);
+    std::fill(x.col_begin(0), x.col_end(0), std::numeric_limits<int>::min());
+    std::fill(y.col_begin(0), y.col_end(0), 1);
+    y.col_begin(0)[100] = RNT<int>::NA();
+    REQUIRE(build_validity(y));
+    std::vector<ValidityMask> all_valid{ValidityMask(130)};
+    REQUIRE(x.getBackend().setValidity(std::move(all_valid)));
+    REQUIRE(na_count(x) == 0);
+
+    const int_ts z(x + y);
+    REQUIRE(z.col_begin(0)[0] == std::numeric_limits<int>::min() + 1);
+    REQUIRE(na_count(z) == 1);
+    REQUIRE(!z.getBackend().validity(0).test(100));
+
+    // the unmasked side doesn't bring the sentinel back
+    y.getBackend().setValidity(std::vector<ValidityMask>());
+    REQUIRE(!y.getBackend().hasValidity());
+    const int_ts one_sided(x + y);
+    REQUIRE(one_sided.col_begin(0)[0] == std::numeric_limits<int>::min() + 1);
+    REQUIRE(na_count(one_sided) == 1);
+    const int_ts lagged(binary_opp<PlusFunctor>(x, y.lag(1)));
+    REQUIRE(lagged.col_begin(0)[0] == std::numeric_limits<int>::min() + 1);
+    REQUIRE(na_count(lagged) == 1);
+    REQUIRE(!lagged.getBackend().validity(0).test(100));
+    REQUIRE(na_count(int_ts(x) + y) == 1);
+
+    x += 2;
+    REQUIRE(x.col_begin(0)[129] == std::numeric_limits<int>::min() + 2);
+    y *= 3;
+    REQUIRE(y.col_begin(0)[0] == 3);
+    REQUIRE(y.col_begin(0)[100] == RNT<int>::NA());
+
+    // wrong sizes are refused
+    std::vector<ValidityMask> short_masks{ValidityMask(10)};
+    REQUIRE(!x.getBackend().setValidity(std::move(short_masks)));
+  }
+
+  SECTION("masks outside binary_opp") {
+    // {lowest int, 5, 7} with row 2 masked: every path keeps the lowest int and leaves row 2 NA
+    typedef TSeries<long, int, long, VectorBackend, GregorianDate, RNT> int_ts;
+    const int lowest{std::numeric_limits<int>::min()};
+    int_ts a(3, 1), ones(3, 1);
+    std::iota(a.index_begin(), a.index_end(), 0);
+    std::iota(ones.index_begin(), ones.index_end(), 0);
+    const std::vector<int> av{lowest, 5, 7};
+    std::copy(av.begin(), av.end(), a.col_begin(0));
+    std::fill(ones.col_begin(0), ones.col_end(0), 1);
+    std::vector<ValidityMask> masks{ValidityMask(3)};
+    masks[0].set(2, false);
+    REQUIRE(set_validity(a, std::move(masks)));
+    // the masked row holds NA as well
+    REQUIRE(RNT<int>::ISNA(a.col_begin(0)[2]));
+
+    const auto check = [&](const int_ts &s, int first) {
+      REQUIRE(s.nrow() == 3);
+      REQUIRE(s.getBackend().hasValidity());
+      REQUIRE(s.col_begin(0)[0] == first);
+      REQUIRE(s.getBackend().validity(0).test(0));
+      REQUIRE(RNT<int>::ISNA(s.col_begin(0)[2]));
+      REQUIRE(!s.getBackend().validity(0).test(2));
+      REQUIRE(na_count(s) == 1);
+    };
+    check(int_ts(a.window(0, 2)), lowest);
+    check(int_ts(a).window(0, 2), lowest);
+    check(a.lag_copy(0), lowest);
+    check(a - a.lag(0), 0);
+    check(join_opp<PlusFunctor>(a, ones, JoinType::inner), lowest + 1);
+    check(join_opp<PlusFunctor>(ones, a.view(), JoinType::left), lowest + 1);
+    check(asof_align(ones, a), lowest);
+
+    // views read the rows of the source mask they cover
+    REQUIRE(na_count(a.window(1, 2)) == 1);
+    REQUIRE(column_validity(a.window(1, 2), 0).test(0));
+    REQUIRE(!column_validity(a.window(1, 2), 0).test(1));
+    REQUIRE(na_omit(a.view()).nrow() == 2);
+
+    const auto rolled = rolling<RollingSum>(a, RowWindow(2), 1);
+    REQUIRE(rolled.col_begin(0)[0] == static_cast<double>(lowest));
+    REQUIRE(rolled.col_begin(0)[2] == 5);
+    const auto means = row_mean(a);
+    REQUIRE(means.col_begin(0)[0] == static_cast<double>(lowest));
+    REQUIRE(RNT<double>::ISNA(means.col_begin(0)[2]));
+
+    for (const SaveOptions &opts : {SaveOptions(), SaveOptions::compressed()}) {
+      std::stringstream ss;
+      save(ss, a, opts);
+      check(load<int_ts>(ss), lowest);
+    }
+
+    CsvOptions copts;
+    copts.index = IndexFormat::number;
+    std::stringstream csv;
+    write_csv(csv, a, copts);
+    REQUIRE(csv.str() == "index,\n0," + std::to_string(lowest) + "\n1,5\n2,NA\n");
+  }
+
+  SECTION("NaN results") {
+    // 0 / 0 is NA with or without masks, through a block of valid rows and a block with an NA in it
+    for (const double last : {2.0, RNT<double>::NA()}) {
+      LDL_ts x(3, 1);
+      std::iota(x.index_begin(), x.index_end(), 0);
+      const std::vector<double> xv{0, 1, last};
+      std::copy(xv.begin(), xv.end(), x.col_begin(0));
+      LDL_ts m(x);
+      REQUIRE(build_validity(m));
+      const size_t nas{RNT<double>::ISNA(last) ? size_t(2) : size_t(1)};
+      for (const LDL_ts *s : {&x, &m}) {
+        const LDL_ts q(*s / *s);
+        REQUIRE(RNT<double>::ISNA(q.col_begin(0)[0]));
+        REQUIRE(na_count(q) == nas);
+        REQUIRE(na_omit(q).nrow() == static_cast<long>(3 - nas));
+
+        LDL_ts d(*s);
+        d /= 0.0;
+        REQUIRE(RNT<double>::ISNA(d.col_begin(0)[0]));
+        REQUIRE(na_count(d) == nas);
+      }
+      REQUIRE(!(m / m).getBackend().validity(0).test(0));
+      REQUIRE((m / m).getBackend().validity(0).test(1));
+    }
+  }
+
+  SECTION("na_omit and fill_na") {
+    LDL_ts x(200, 2);
+    std::iota(x.index_begin(), x.index_end(), 0);
+    for (long c = 0; c < 2; ++c) {
+      for (long i = 0; i < 200; ++i) { x.col_begin(c)[i] = u(gen) < 0.2 ? RNT<double>::NA() : double(i * 2 + c); }
+    }
+    REQUIRE(x.setColnames({"a", "b"}));
+    LDL_ts m(x);
+    REQUIRE(build_validity(m));
+
+    for (const LDL_ts *s : {&x, &m}) {
+      const LDL_ts kept(na_omit(*s));
+      REQUIRE(kept.getColnames() == x.getColnames());
+      long expected{0};
+      for (long i = 0; i < 200; ++i) {
+        if (RNT<double>::ISNA(x.col_begin(0)[i]) || RNT<double>::ISNA(x.col_begin(1)[i])) { continue; }
+        REQUIRE(kept.index_begin()[expected] == i);
+        REQUIRE(kept.col_begin(1)[expected] == x.col_begin(1)[i]);
+        ++expected;
+      }
+      REQUIRE(kept.nrow() == expected);
+      REQUIRE(na_count(kept) == 0);
+      REQUIRE(kept.getBackend().hasValidity() == (s == &m));
+
+      const LDL_ts filled(fill_na(*s, -1.0));
+      REQUIRE(na_count(filled) == 0);
+      for (long c = 0; c < 2; ++c) {
+        for (long i = 0; i < 200; ++i) {
+          const double v{x.col_begin(c)[i]};
+          REQUIRE(filled.col_begin(c)[i] == (RNT<double>::ISNA(v) ? -1.0 : v));
+        }
+      }
+    }
+    REQUIRE(na_count(m) == na_count(x));
+  }
+}
+
+TEST_CASE("Row major backend.") {
+  typedef TSeries<long, double, long, RowMajorBackend, GregorianDate, RNT> row_ts;
+  std::mt19937_64 gen(9);
+  std::uniform_real_distribution<double> u(0, 1);
+  const long NR{1000}, NC{7};
+  LDL_ts x(NR, NC), y(NR / 2, NC);
+  std::iota(x.index_begin(), x.index_end(), 0);
+  for (long i = 0; i < y.nrow(); ++i) { y.index_begin()[i] = 3 * i; }
+  for (LDL_ts *s : {&x, &y}) {
+    for (long c = 0; c < NC; ++c) {
+      for (long i = 0; i < s->nrow(); ++i) { s->col_begin(c)[i] = u(gen) < 0.05 ? RNT<double>::NA() : u(gen); }
+    }
+  }
+  REQUIRE(x.setColnames({"a", "b", "c", "d", "e", "f", "g"}));
+
+  // same values on both layouts
+  auto same = [](const auto &a, const auto &b) {
+    REQUIRE(a.nrow() == b.nrow());
+    REQUIRE(a.ncol() == b.ncol());
+    REQUIRE(a.getColnames() == b.getColnames());
+    REQUIRE(std::equal(a.index_begin(), a.index_end(), b.index_begin()));
+    for (long c = 0; c < a.ncol(); ++c) {
+      for (long i = 0; i < a.nrow(); ++i) {
+        const double v{a.col_begin(c)[i]}, w{b.col_begin(c)[i]};
+        REQUIRE(std::memcmp(&v, &w, sizeof(double)) == 0);
+      }
+    }
+  };
+
+  const row_ts rx(relayout<RowMajorBackend>(x)), ry(relayout<RowMajorBackend>(y));
+  same(rx, x);
+  same(relayout<VectorBackend>(rx), x);
+
+  // rows are contiguous
+  for (long i = 0; i < NR; i += 97) {
+    const double *row{rx.getBackend().row_begin(i)};
+    REQUIRE(rx.getBackend().row_end(i) - row == NC);
+    for (long c = 0; c < NC; ++c) { REQUIRE(std::memcmp(row + c, &x.col_begin(c)[i], sizeof(double)) == 0); }
+  }
+  // columns are strided
+  const auto col{rx.col_begin(3)};
+  REQUIRE(rx.col_end(3) - col == NR);
+  REQUIRE(std::distance(col, rx.col_end(3)) == NR);
+  REQUIRE(&col[1] - &col[0] == NC);
+
+  // the operations on columns give the same results
+  same(rx * ry, x * y);
+  same(row_ts(rx.lag(2)), LDL_ts(x.lag(2)));
+  same(rolling_mean(rx, 5), rolling_mean(x, 5));
+  row_ts scaled(rx);
+  scaled *= 2.0;
+  LDL_ts scaled_x(x);
+  scaled_x *= 2.0;
+  same(scaled, scaled_x);
+
+  std::ostringstream a, b;
+  a << rx;
+  b << x;
+  REQUIRE(a.str() == b.str());
+
+  const auto r(rx.getRow(10));
+  for (long c = 0; c < NC; ++c) { REQUIRE(std::memcmp(&*r[c], &x.col_begin(c)[10], sizeof(double)) == 0); }
+
+  const row_ts empty(0, 3);
+  REQUIRE(empty.col_begin(2) == empty.col_end(2));
+}
+
+TEST_CASE("Cross sections.") {
+  typedef TSeries<long, double, long, RowMajorBackend, GregorianDate, RNT> row_ts;
+  typedef TSeries<long, int, long, VectorBackend, GregorianDate, RNT> int_ts;
+  std::mt19937_64 gen(23);
+  std::uniform_int_distribution<int> u(0, 40);
+  const long NR{3000}, NC{40};
+  LDL_ts x(NR, NC);
+  int_ts xi(NR, NC);
+  std::iota(x.index_begin(), x.index_end(), 0);
+  std::iota(xi.index_begin(), xi.index_end(), 0);
+  // few distinct values so rows have ties, row 0 is all NA and row 1 has a single value
+  for (long c = 0; c < NC; ++c) {
+    for (long i = 0; i < NR; ++i) {
+      const int v{u(gen)};
+      const bool na{i == 0 || (i == 1 && c) || v < 4};
+      x.col_begin(c)[i] = na ? RNT<double>::NA() : v / 4.0;
+      xi.col_begin(c)[i] = na ? RNT<int>::NA() : v;
+    }
+  }
+
+  // the values of row i that are not NA
+  auto row = [&](long i) {
+    std::vector<double> v;
+    for (long c = 0; c < NC; ++c) {
+      if (!RNT<double>::ISNA(x.col_begin(c)[i])) { v.push_back(x.col_begin(c)[i]); }
+    }
+    return v;
+  };
+  auto close = [](double a, double b) {
+    return (RNT<double>::ISNA(a) && RNT<double>::ISNA(b)) || std::fabs(a - b) < 1e-9;
+  };
+
+  const auto sum(row_sum(x)), mean(row_mean(x)), sd(row_sd(x));
+  const auto rank(row_rank(x)), demean(row_demean(x)), z(row_zscore(x));
+  REQUIRE(sum.ncol() == 1);
+  REQUIRE(rank.ncol() == NC);
+  REQUIRE(std::equal(x.index_begin(), x.index_end(), z.index_begin()));
+  for (long i = 0; i < NR; ++i) {
+    const std::vector<double> v(row(i));
+    const double n(v.size()), s{std::accumulate(v.begin(), v.end(), 0.0)}, m{v.empty() ? RNT<double>::NA() : s / n};
+    double ss{0};
+    for (double e : v) { ss += (e - m) * (e - m); }
+    const double d{v.size() < 2 ? RNT<double>::NA() : std::sqrt(ss / (n - 1))};
+    REQUIRE(close(sum.col_begin(0)[i], s));
+    REQUIRE(close(mean.col_begin(0)[i], m));
+    REQUIRE(close(sd.col_begin(0)[i], d));
+    for (long c = 0; c < NC; ++c) {
+      const double e{x.col_begin(c)[i]};
+      if (RNT<double>::ISNA(e)) {
+        REQUIRE(RNT<double>::ISNA(rank.col_begin(c)[i]));
+        REQUIRE(RNT<double>::ISNA(demean.col_begin(c)[i]));
+        REQUIRE(RNT<double>::ISNA(z.col_begin(c)[i]));
+        continue;
+      }
+      const double below(std::count_if(v.begin(), v.end(), [e](double y) { return y < e; }));
+      const double ties(std::count(v.begin(), v.end(), e));
+      REQUIRE(rank.col_begin(c)[i] == below + (ties + 1) / 2);
+      REQUIRE(close(demean.col_begin(c)[i], e - m));
+      REQUIRE(close(z.col_begin(c)[i], d > 0 ? (e - m) / d : RNT<double>::NA()));
+    }
+  }
+  REQUIRE(sum.col_begin(0)[0] == 0);
+  REQUIRE(RNT<double>::ISNA(mean.col_begin(0)[0]));
+  REQUIRE(RNT<double>::ISNA(sd.col_begin(0)[1]));
+  REQUIRE(RNT<double>::ISNA(z.col_begin(0)[1]));
+  REQUIRE(rank.col_begin(0)[1] == 1);
+
+  // same results whatever the layout, value type or policy
+  auto same = [&](const auto &a, const auto &b) {
+    REQUIRE(a.nrow() == b.nrow());
+    REQUIRE(a.ncol() == b.ncol());
+    for (long c = 0; c < a.ncol(); ++c) {
+      for (long i = 0; i < a.nrow(); ++i) { REQUIRE(close(a.col_begin(c)[i], b.col_begin(c)[i])); }
+    }
+  };
+  const row_ts rx(relayout<RowMajorBackend>(x));
+  same(row_sd(rx), sd);
+  same(row_rank(rx), rank);
+  same(row_zscore(rx), z);
+  same(row_zscore(xi), z);
+  same(row_rank(xi), rank);
+  ThreadPoolPolicy pool(4);
+  same(row_zscore(x, pool), z);
+  same(row_sum(rx, pool), sum);
+  same(row_demean(x.lag(1)), LDL_ts(demean.lag(1)));
+}
+
+TEST_CASE("Specialized kernels.") {
+  typedef TSeries<long, int, long, VectorBackend, GregorianDate, RNT> int_ts;
+  std::mt19937_64 gen(31);
+  std::uniform_int_distribution<int> u(-50, 50);
+  const long NR{5000};
+
+  // mixed value types take the raw loops, a single column is used against every column of the other side
+  for (long nc : {1, 2, 3, 4, 5, 9}) {
+    LDL_ts x(NR, nc);
+    int_ts y(NR, 1), ya(NR - 10, nc);
+    std::iota(x.index_begin(), x.index_end(), 0);
+    for (long i = 0; i < NR; ++i) { y.index_begin()[i] = 2 * i; }
+    std::iota(ya.index_begin(), ya.index_end(), 5);
+    for (long c = 0; c < nc; ++c) {
+      for (long i = 0; i < NR; ++i) { x.col_begin(c)[i] = u(gen) < -45 ? RNT<double>::NA() : u(gen); }
+      for (long i = 0; i < ya.nrow(); ++i) { ya.col_begin(c)[i] = u(gen) < -45 ? RNT<int>::NA() : u(gen); }
+    }
+    for (long i = 0; i < NR; ++i) { y.col_begin(0)[i] = u(gen) < -45 ? RNT<int>::NA() : u(gen); }
+
+    ThreadPoolPolicy pool(4);
+    for (ExecutionPolicy *policy : {&default_execution(), static_cast<ExecutionPolicy *>(&pool)}) {
+      // general alignment: every other row of x matches
+      const auto z(binary_opp<PlusFunctor>(y, x, *policy));
+      REQUIRE(z.nrow() == NR / 2);
+      REQUIRE(z.ncol() == nc);
+      for (long c = 0; c < nc; ++c) {
+        for (long k = 0; k < z.nrow(); ++k) {
+          const int a{y.col_begin(0)[k]};
+          const double b{x.col_begin(c)[2 * k]};
+          if (RNT<int>::ISNA(a) || RNT<double>::ISNA(b)) {
+            REQUIRE(RNT<double>::ISNA(z.col_begin(c)[k]));
+          } else {
+            REQUIRE(z.col_begin(c)[k] == a + b);
+          }
+        }
+      }
+      // sub-range alignment: ya is a block of the rows of x
+      const auto w(binary_opp<MultiplyFunctor>(ya, x, *policy));
+      REQUIRE(w.nrow() == ya.nrow());
+      for (long c = 0; c < nc; ++c) {
+        for (long k = 0; k < w.nrow(); ++k) {
+          const int a{ya.col_begin(c)[k]};
+          const double b{x.col_begin(c)[k + 5]};
+          if (RNT<int>::ISNA(a) || RNT<double>::ISNA(b)) {
+            REQUIRE(RNT<double>::ISNA(w.col_begin(c)[k]));
+          } else {
+            REQUIRE(w.col_begin(c)[k] == a * b);
+          }
+        }
+      }
+    }
+  }
+
+  SECTION("values without NA") {
+    typedef TSeries<long, long, long, VectorBackend, GregorianDate, NoNA> plain_ts;
+    const long lowest{std::numeric_limits<long>::min()};
+    plain_ts a(6, 2), b(4, 2);
+    std::iota(a.index_begin(), a.index_end(), 0);
+    std::iota(b.index_begin(), b.index_end(), 1);
+    for (long c = 0; c < 2; ++c) {
+      for (long i = 0; i < 6; ++i) { a.col_begin(c)[i] = i == 2 ? lowest : i; }
+      for (long i = 0; i < 4; ++i) { b.col_begin(c)[i] = c; }
+    }
+    // the lowest long is an ordinary value, and zero is not taken for NA either
+    const auto sum(a + b);
+    REQUIRE(sum.nrow() == 4);
+    REQUIRE(sum.col_begin(0)[0] == 1);
+    REQUIRE(sum.col_begin(0)[1] == lowest);
+    REQUIRE(sum.col_begin(1)[1] == lowest + 1);
+    a.col_begin(0)[2] = a.col_begin(1)[2] = 2;
+    a *= 2;
+    REQUIRE(a.col_begin(0)[1] == 2);
+    REQUIRE(a.col_begin(0)[0] == 0);
+
+    plain_ts odd(3, 1);
+    odd.index_begin()[0] = 1;
+    odd.index_begin()[1] = 3;
+    odd.index_begin()[2] = 5;
+    std::fill(odd.col_begin(0), odd.col_end(0), 0);
+    const auto prod(binary_opp<MinusFunctor>(a, odd));
+    REQUIRE(prod.nrow() == 3);
+    REQUIRE(prod.col_begin(1)[0] == 2);
+    REQUIRE(prod.col_begin(1)[1] == 6);
+    REQUIRE(prod.col_begin(1)[2] == 10);
+  }
+}
+
+TEST_CASE("Rvalue operators and pipelines.") {
+  typedef TSeries<long, int, long, VectorBackend, GregorianDate, RNT> int_ts;
+  std::mt19937_64 gen(41);
+  std::uniform_real_distribution<double> u(-1, 3);
+  const long NR{2000}, NC{3};
+  LDL_ts x(NR, NC), y(NR, NC), block(NR / 2, NC), sparse(NR / 3, NC);
+  std::iota(x.index_begin(), x.index_end(), 0);
+  std::iota(y.index_begin(), y.index_end(), 0);
+  std::iota(block.index_begin(), block.index_end(), 100);
+  for (long i = 0; i < sparse.nrow(); ++i) { sparse.index_begin()[i] = 3 * i; }
+  for (LDL_ts *s : {&x, &y, &block, &sparse}) {
+    for (long c = 0; c < NC; ++c) {
+      for (long i = 0; i < s->nrow(); ++i) { s->col_begin(c)[i] = u(gen) < -0.8 ? RNT<double>::NA() : u(gen); }
+    }
+  }
+  REQUIRE(y.setColnames({"a", "b", "c"}));
+
+  auto same = [](const LDL_ts &a, const LDL_ts &b) {
+    REQUIRE(a.nrow() == b.nrow());
+    REQUIRE(a.ncol() == b.ncol());
+    REQUIRE(std::equal(a.index_begin(), a.index_end(), b.index_begin()));
+    for (long c = 0; c < a.ncol(); ++c) {
+      for (long i = 0; i < a.nrow(); ++i) {
+        const double v{a.col_begin(c)[i]}, w{b.col_begin(c)[i]};
+        REQUIRE(((RNT<double>::ISNA(v) && RNT<double>::ISNA(w)) || std::fabs(v - w) < 1e-12));
+      }
+    }
+  };
+  auto data = [](const LDL_ts &a) { return &*a.col_begin(0); };
+
+  SECTION("compound and scalar operators") {
+    LDL_ts z(x);
+    static_assert(std::is_same<decltype(z += 1), LDL_ts &>::value, "compound operators return the series");
+    REQUIRE(&(z *= 2.0) == &z);
+    LDL_ts twice(x * 2.0);
+    same(twice, z);
+    const double *p{data(twice)};
+    const LDL_ts moved((std::move(twice) - 1.0) / 4.0);
+    REQUIRE(data(moved) == p);
+    for (long i = 0; i < NR; ++i) {
+      const double v{x.col_begin(1)[i]}, w{moved.col_begin(1)[i]};
+      REQUIRE((RNT<double>::ISNA(v) ? RNT<double>::ISNA(w) : w == (v * 2 - 1) / 4));
+    }
+  }
+
+  SECTION("rvalue series operands reuse their storage") {
+    // (x * 2) + y: the temporary is written in place and keeps the colnames of y
+    LDL_ts t(x * 2.0);
+    const double *p{data(t)};
+    const LDL_ts lhs(std::move(t) + y);
+    REQUIRE(data(lhs) == p);
+    same(lhs, (x * 2.0) + LDL_ts(y));
+    REQUIRE(lhs.getColnames() == y.getColnames());
+
+    // rvalue on the right keeps the operand order
+    LDL_ts r(x);
+    const double *q{data(r)};
+    const LDL_ts rhs(y / std::move(r));
+    REQUIRE(data(rhs) == q);
+    same(rhs, binary_opp<DivideFunctor>(y, x));
+
+    // a block of the other index starting at its first row also works in place
+    LDL_ts b(block);
+    const double *pb{data(b)};
+    const LDL_ts sub(std::move(b) - x);
+    REQUIRE(data(sub) == pb);
+    same(sub, binary_opp<MinusFunctor>(block, x));
+
+    // otherwise a new series, with the same values binary_opp gives
+    same(LDL_ts(x) * sparse, binary_opp<MultiplyFunctor>(x, sparse));
+    same(LDL_ts(x) * LDL_ts(sparse), binary_opp<MultiplyFunctor>(x, sparse));
+    same(x - LDL_ts(block), binary_opp<MinusFunctor>(x, block));
+    same(LDL_ts(x.columns(0, 1)) + y, binary_opp<PlusFunctor>(LDL_ts(x.columns(0, 1)), y));
+
+    // chains allocate once
+    LDL_ts first(x * y);
+    const double *pf{data(first)};
+    const LDL_ts chain((((std::move(first) + y) * 0.5) - x).log());
+    REQUIRE(data(chain) == pf);
+    const LDL_ts e1(binary_opp<MultiplyFunctor>(x, y));
+    LDL_ts e2(binary_opp<PlusFunctor>(e1, y));
+    e2 *= 0.5;
+    const LDL_ts e3(binary_opp<MinusFunctor>(e2, x));
+    same(chain, e3.log());
+  }
+
+  SECTION("integer series") {
+    int_ts a(5, 1), b(5, 1);
+    std::iota(a.index_begin(), a.index_end(), 0);
+    std::iota(b.index_begin(), b.index_end(), 0);
+    const int na{RNT<int>::NA()};
+    const std::vector<int> av{1, na, 3, 4, 5}, bv{10, 20, na, 40, 50};
+    std::copy(av.begin(), av.end(), a.col_begin(0));
+    std::copy(bv.begin(), bv.end(), b.col_begin(0));
+    const int_ts c(int_ts(a) - b);
+    const std::vector<int> expected{-9, na, na, -36, -45};
+    REQUIRE(std::equal(c.col_begin(0), c.col_end(0), expected.begin()));
+    const int_ts d(a - int_ts(b));
+    REQUIRE(std::equal(d.col_begin(0), d.col_end(0), expected.begin()));
+    const int_ts e((a * 3) + 1);
+    REQUIRE(e.col_begin(0)[0] == 4);
+    REQUIRE(e.col_begin(0)[1] == na);
+  }
+
+  SECTION("pipelines") {
+    const auto p(pipeline().scale(2).shift(1).log().clip(-1, 1.5));
+    const LDL_ts z(x.apply(p));
+    for (long c = 0; c < NC; ++c) {
+      for (long i = 0; i < NR; ++i) {
+        const double v{x.col_begin(c)[i]}, w{z.col_begin(c)[i]};
+        if (RNT<double>::ISNA(v) || v * 2 + 1 <= 0) {
+          REQUIRE(RNT<double>::ISNA(w));
+        } else {
+          REQUIRE(w == std::min(std::max(std::log(v * 2 + 1), -1.0), 1.5));
+        }
+      }
+    }
+    // on an rvalue the values are transformed in place
+    LDL_ts t(x);
+    const double *q{data(t)};
+    const LDL_ts in_place(std::move(t).apply(p));
+    REQUIRE(data(in_place) == q);
+    same(in_place, z);
+    same(LDL_ts(x).apply(pipeline()), x);
+    same(x.apply(pipeline().then([](double v) { return v * v; })), binary_opp<MultiplyFunctor>(x, x));
+    REQUIRE_THROWS_AS(pipeline().clip(1, 0), std::logic_error);
+
+    // masks follow the NAs a transform makes
+    LDL_ts masked(x);
+    REQUIRE(build_validity(masked));
+    const LDL_ts logged(std::move(masked).log());
+    REQUIRE(logged.getBackend().hasValidity());
+    const auto nans = std::count_if(logged.col_begin(0), logged.col_end(0), [](double v) { return std::isnan(v); });
+    REQUIRE(na_count(logged, 0) == static_cast<size_t>(nans));
+    REQUIRE(na_count(logged, 0) > na_count(x, 0));
+  }
+
+  SECTION("masked transforms") {
+    // the mask decides which rows are NA, the lowest int is a value
+    typedef TSeries<long, int, long, VectorBackend, GregorianDate, RNT> int_ts;
+    int_ts a(3, 1);
+    std::iota(a.index_begin(), a.index_end(), 0);
+    const std::vector<int> av{std::numeric_limits<int>::min(), 5, 7};
+    std::copy(av.begin(), av.end(), a.col_begin(0));
+    std::vector<ValidityMask> masks{ValidityMask(3)};
+    masks[0].set(2, false);
+    REQUIRE(set_validity(a, std::move(masks)));
+
+    const int_ts b(a.apply([](int v) { return v + 1; }));
+    REQUIRE(b.col_begin(0)[0] == std::numeric_limits<int>::min() + 1);
+    REQUIRE(b.col_begin(0)[1] == 6);
+    REQUIRE(RNT<int>::ISNA(b.col_begin(0)[2]));
+    REQUIRE(b.getBackend().validity(0).test(0));
+    REQUIRE(!b.getBackend().validity(0).test(2));
+    REQUIRE(na_count(b) == 1);
+
+    // a NaN result clears the row from the mask
+    const int_ts c(std::move(a).apply([](int v) { return v == 5 ? std::nan("") : v + 1.0; }));
+    REQUIRE(RNT<int>::ISNA(c.col_begin(0)[1]));
+    REQUIRE(!c.getBackend().validity(0).test(1));
+    REQUIRE(RNT<int>::ISNA(c.col_begin(0)[2]));
+    REQUIRE(na_count(c) == 2);
+  }
+
+  SECTION("log of values that are not positive") {
+    LDL_ts d(3, 1);
+    std::iota(d.index_begin(), d.index_end(), 0);
+    const std::vector<double> dv{0, -1, std::exp(1.0)};
+    std::copy(dv.begin(), dv.end(), d.col_begin(0));
+    for (const LDL_ts &l : {d.log(), d.apply(pipeline().log())}) {
+      REQUIRE(RNT<double>::ISNA(l.col_begin(0)[0]));
+      REQUIRE(RNT<double>::ISNA(l.col_begin(0)[1]));
+      REQUIRE(std::fabs(l.col_begin(0)[2] - 1) < 1e-12);
+    }
+
+    typedef TSeries<long, int, long, VectorBackend, GregorianDate, RNT> int_ts;
+    int_ts a(4, 1);
+    std::iota(a.index_begin(), a.index_end(), 0);
+    const std::vector<int> av{0, -3, 1, 1000};
+    std::copy(av.begin(), av.end(), a.col_begin(0));
+    const int_ts plain(a.log());
+    REQUIRE(std::count_if(plain.col_begin(0), plain.col_end(0), RNT<int>::ISNA) == 2);
+    REQUIRE(plain.col_begin(0)[2] == 0);
+    REQUIRE(plain.col_begin(0)[3] == 6);
+    REQUIRE(build_validity(a));
+    const int_ts masked(a.log());
+    REQUIRE(!masked.getBackend().validity(0).test(0));
+    REQUIRE(!masked.getBackend().validity(0).test(1));
+    REQUIRE(masked.getBackend().validity(0).test(3));
+    REQUIRE(na_count(masked) == 2);
+  }
+}
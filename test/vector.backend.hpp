@@ -17,60 +17,126 @@
 #pragma once
 
 #include <iterator>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include <tslib/arena.hpp>
+#include <tslib/validity.hpp>
+
 namespace tslib {
 
 // template for vector backend
-template <typename IDX, typename T, typename DIM> class VectorBackend {
+// Alloc is the allocator template used for the index and the data
+//
+// the index and the colnames are immutable shared storage: copies of a backend, and backends made on the
+// index of another one, point at the same index until one of them asks for a mutable index iterator
+template <typename IDX, typename T, typename DIM, template <typename> class Alloc> class BasicVectorBackend {
 private:
+  template <typename, typename, typename, template <typename> class> friend class BasicVectorBackend;
+  typedef std::vector<IDX, Alloc<IDX>> index_vector;
+
   // DIM is the type of the ncol value
   DIM ncol_;
   // IDX will represent the type of the index vector 
-  // index is number of rows
   // i believe the index refers to the dates
-  std::vector<IDX> index_;
+  // shared between backends, this one uses rows [index_offset_, index_offset_ + nrow_) of it
+  std::shared_ptr<index_vector> index_;
+  size_t index_offset_;
+  DIM nrow_;
   // T will represent the type of data
   // will contain all the data
-  std::vector<T> data_;
-  // colnames will be represented by strings
-  std::vector<std::string> colnames_;
+  std::vector<T, Alloc<T>> data_;
+  // colnames will be represented by strings, null when there are none
+  std::shared_ptr<const std::vector<std::string>> colnames_;
+  // one validity mask per column (see tslib/validity.hpp), empty when the values carry their own NAs
+  std::vector<ValidityMask> validity_;
 
   // Gets you the value in the ith vector to the right of the matrix
   // col major offset 
-  size_t column_offset(DIM i) const { return static_cast<size_t>(i) * index_.size(); }
+  size_t column_offset(DIM i) const { return static_cast<size_t>(i) * static_cast<size_t>(nrow_); }
+
+  // the index storage lives in the same place as the data (see ArenaAllocator)
+  static std::shared_ptr<index_vector> make_index(size_t nrow) {
+    return std::allocate_shared<index_vector>(Alloc<index_vector>(), nrow);
+  }
+  template <typename ITER> static std::shared_ptr<index_vector> make_index(ITER beg, ITER end) {
+    return std::allocate_shared<index_vector>(Alloc<index_vector>(), beg, end);
+  }
+
+  // copies can share the index only when their data goes where the original's is, with std::allocator
+  // other allocators choose where a copy lives (an ArenaAllocator copy made outside its scope goes to the heap),
+  // so the index is copied with the allocator the data copy gets
+  static const bool copies_share_index = std::is_same<Alloc<IDX>, std::allocator<IDX>>::value;
+  static std::shared_ptr<index_vector> copy_index(const BasicVectorBackend &t) {
+    if (copies_share_index) { return t.index_; }
+    typedef std::allocator_traits<Alloc<IDX>> traits;
+    const Alloc<IDX> a(traits::select_on_container_copy_construction(t.index_->get_allocator()));
+    return std::allocate_shared<index_vector>(Alloc<index_vector>(a), t.index_begin(), t.index_end(), a);
+  }
+
+  // copy on write, called before handing out a mutable index iterator
+  void detach_index() {
+    if (index_.use_count() > 1) {
+      index_        = make_index(index_->cbegin() + index_offset_, index_->cbegin() + index_offset_ + nrow_);
+      index_offset_ = 0;
+    }
+  }
 
 public:
   // define iterators for the index and the data vectors
-  typedef typename std::vector<IDX>::iterator index_iterator;
-  typedef typename std::vector<IDX>::const_iterator const_index_iterator;
+  typedef typename index_vector::iterator index_iterator;
+  typedef typename index_vector::const_iterator const_index_iterator;
 
-  typedef typename std::vector<T>::const_iterator const_data_iterator;
-  typedef typename std::vector<T>::iterator data_iterator;
+  typedef typename std::vector<T, Alloc<T>>::const_iterator const_data_iterator;
+  typedef typename std::vector<T, Alloc<T>>::iterator data_iterator;
 
   // no default constructor
-  VectorBackend() = delete;
-  // copy constructor copies the ncol, index vector, data vector, and column names
-  VectorBackend(const VectorBackend &t) : ncol_{t.ncol_}, index_{t.index_}, data_{t.data_}, colnames_{t.colnames_} {}
+  BasicVectorBackend() = delete;
+  // copy constructor copies the ncol and the data vector, the column names are shared and so is the index
+  // unless the allocator places copies elsewhere (see copy_index)
+  BasicVectorBackend(const BasicVectorBackend &t)
+      : ncol_{t.ncol_}, index_{copy_index(t)}, index_offset_{copies_share_index ? t.index_offset_ : 0},
+        nrow_{t.nrow_}, data_{t.data_},
+        colnames_{t.colnames_}, validity_{t.validity_} {}
   // if dimensions given for the nrow and col, set the ncol, set index as having the number of elements in the index, and the data vector
   // having the same amount of elements as nrow*ncol (or number of elements in the matrix), set colnames to nothing
-  VectorBackend(DIM nrow, DIM ncol) : ncol_{ncol}, index_(nrow), data_(nrow * ncol), colnames_{} {}
+  BasicVectorBackend(DIM nrow, DIM ncol)
+      : ncol_{ncol}, index_(make_index(nrow)), index_offset_{0}, nrow_{nrow}, data_(nrow * ncol), colnames_{},
+        validity_{} {}
+  // backend of ncol columns on rows [offset, offset + nrow) of the index of src, which is shared rather than copied
+  template <typename U>
+  BasicVectorBackend(const BasicVectorBackend<IDX, U, DIM, Alloc> &src, size_t offset, DIM nrow, DIM ncol)
+      : ncol_{ncol}, index_{src.index_}, index_offset_{src.index_offset_ + offset}, nrow_{nrow},
+        data_(static_cast<size_t>(nrow) * ncol), colnames_{}, validity_{} {}
+  // copies a backend that uses a different allocator, eg to keep a result computed in an arena
+  template <template <typename> class A>
+  explicit BasicVectorBackend(const BasicVectorBackend<IDX, T, DIM, A> &t)
+      : ncol_{t.ncol_}, index_(make_index(t.index_begin(), t.index_end())), index_offset_{0}, nrow_{t.nrow_},
+        data_(t.data_.begin(), t.data_.end()), colnames_{t.colnames_}, validity_{t.validity_} {}
   // no assignment constructor
-  VectorBackend &operator=(const VectorBackend &rhs) = delete;
+  BasicVectorBackend &operator=(const BasicVectorBackend &rhs) = delete;
   // default move constructor
-  VectorBackend(VectorBackend &&)                    = default;
+  BasicVectorBackend(BasicVectorBackend &&)          = default;
 
-  // calling nrow will get you the size of the index vector
-  DIM nrow() const { return static_cast<DIM>(index_.size()); }
+  // the number of rows in the index
+  DIM nrow() const { return nrow_; }
   // get the number of columns in the vector
   DIM ncol() const { return ncol_; }
 
-  // get the beginning and ending iterators of the index and the 
-  const_index_iterator index_begin() const { return index_.begin(); }
-  index_iterator index_begin() { return index_.begin(); }
-  const_index_iterator index_end() const { return index_.end(); }
-  index_iterator index_end() { return index_.end(); }
+  // get the beginning and ending iterators of the index
+  // the mutable ones give this backend its own copy of the index first if it is shared
+  const_index_iterator index_begin() const { return index_->cbegin() + index_offset_; }
+  index_iterator index_begin() {
+    detach_index();
+    return index_->begin() + index_offset_;
+  }
+  const_index_iterator index_end() const { return index_begin() + nrow_; }
+  index_iterator index_end() {
+    detach_index();
+    return index_->begin() + index_offset_ + nrow_;
+  }
 
   // return the iterators for each colum as if it was its own vector
   const_data_iterator col_begin(DIM i) const { return data_.begin() + column_offset(i); } // head of column
@@ -79,18 +145,52 @@ public:
   data_iterator col_end(DIM i) { return data_.begin() + column_offset(i + 1L); }
  
   // get the column names
-  const std::vector<std::string> getColnames() const { return colnames_; }
+  const std::vector<std::string> getColnames() const {
+    return colnames_ ? *colnames_ : std::vector<std::string>();
+  }
   // the the number of column names
-  const DIM getColnamesSize() const { return static_cast<DIM>(colnames_.size()); }
+  const DIM getColnamesSize() const { return colnames_ ? static_cast<DIM>(colnames_->size()) : 0; }
   // takes in a string vector, makes sure it is equal to the number of columns, and sets the column names
   // returns true if set, false if not
   const bool setColnames(const std::vector<std::string> &names) {
     if (static_cast<DIM>(names.size()) == ncol_) {
-      colnames_ = names;
+      colnames_ = std::make_shared<const std::vector<std::string>>(names);
+      return true;
+    }
+    return false;
+  }
+  // validity masks
+  // a column with a mask is NA exactly where its bit is clear, the operations that know about masks read it
+  // instead of testing the values against the NA sentinel, so an int column can hold its lowest value
+  // writes through col_begin don't update the masks, set them again after changing values by hand
+  // the rows a mask clears must hold NA as well, tslib::set_validity writes it there before storing the masks
+  bool hasValidity() const { return !validity_.empty(); }
+  const ValidityMask &validity(DIM i) const { return validity_[static_cast<size_t>(i)]; }
+  ValidityMask &validity(DIM i) { return validity_[static_cast<size_t>(i)]; }
+  // takes one mask of nrow rows per column, or none to drop them, returns false if the sizes don't fit
+  const bool setValidity(std::vector<ValidityMask> &&masks) {
+    if (!masks.empty() && static_cast<DIM>(masks.size()) != ncol_) { return false; }
+    for (const auto &m : masks) {
+      if (m.size() != static_cast<size_t>(nrow_)) { return false; }
+    }
+    validity_ = std::move(masks);
+    return true;
+  }
+  // shares the column names of another backend
+  template <typename U> const bool shareColnames(const BasicVectorBackend<IDX, U, DIM, Alloc> &src) {
+    if (src.getColnamesSize() == ncol_) {
+      colnames_ = src.colnames_;
       return true;
     }
     return false;
   }
 };
 
+// the usual backend, on the heap
+template <typename IDX, typename T, typename DIM> using VectorBackend = BasicVectorBackend<IDX, T, DIM, std::allocator>;
+
+// backend for scratch series, allocates from the arena of the enclosing ArenaScope (see tslib/arena.hpp)
+// a series made inside a scope must not outlive it, copy its backend into a VectorBackend to keep it
+template <typename IDX, typename T, typename DIM> using ArenaBackend = BasicVectorBackend<IDX, T, DIM, ArenaAllocator>;
+
 } // namespace tslib
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace tslib {
+
+// monotonic arena for short lived scratch series
+//
+// allocation bumps a pointer through a list of chunks, deallocation does nothing
+// memory comes back all at once, either by rewinding to a mark or by release()
+// chunks are kept across rewinds so a loop of scratch frames stops calling malloc after the first pass
+// an arena is not thread safe, each thread scopes its own (see ArenaScope)
+class MonotonicArena {
+public:
+  // position in the arena, everything allocated after it is freed by rewind
+  struct Mark {
+    size_t chunk;
+    size_t used;
+  };
+
+private:
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  size_t chunk_size_;
+  std::vector<Chunk> chunks_;
+  // chunk being filled and the bytes used in it
+  size_t current_;
+  size_t used_;
+  // bytes handed out since the last release, for tests and benchmarks
+  size_t bytes_allocated_;
+
+  // moves on to the next chunk that fits bytes, reusing chunks left by a rewind
+  void next_chunk(size_t bytes) {
+    const size_t next{chunks_.empty() ? 0 : current_ + 1};
+    if (next < chunks_.size() && chunks_[next].size >= bytes) {
+      current_ = next;
+    } else {
+      const size_t size{std::max(chunk_size_, bytes)};
+      Chunk c{std::unique_ptr<char[]>(new char[size]), size};
+      chunks_.insert(chunks_.begin() + next, std::move(c));
+      current_ = next;
+    }
+    used_ = 0;
+  }
+
+public:
+  explicit MonotonicArena(size_t chunk_size = 1 << 20)
+      : chunk_size_{chunk_size}, chunks_(), current_{0}, used_{0}, bytes_allocated_{0} {}
+  MonotonicArena(const MonotonicArena &) = delete;
+  MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+  void *allocate(size_t bytes, size_t align) {
+    // worst case padding is align - 1 bytes
+    const size_t need{bytes + align - 1};
+    if (chunks_.empty() || used_ + need > chunks_[current_].size) { next_chunk(need); }
+    char *base{chunks_[current_].data.get()};
+    const uintptr_t p{reinterpret_cast<uintptr_t>(base + used_)};
+    const uintptr_t aligned{(p + align - 1) & ~static_cast<uintptr_t>(align - 1)};
+    used_ = static_cast<size_t>(aligned - reinterpret_cast<uintptr_t>(base)) + bytes;
+    bytes_allocated_ += bytes;
+    return reinterpret_cast<void *>(aligned);
+  }
+
+  Mark mark() const { return Mark{current_, used_}; }
+  // frees everything allocated after m, the chunks stay for reuse
+  void rewind(Mark m) {
+    current_ = m.chunk;
+    used_    = m.used;
+  }
+  // gives all the chunks back to the system
+  void release() {
+    chunks_.clear();
+    current_         = 0;
+    used_            = 0;
+    bytes_allocated_ = 0;
+  }
+
+  size_t bytes_allocated() const { return bytes_allocated_; }
+  size_t chunks() const { return chunks_.size(); }
+};
+
+namespace detail {
+inline MonotonicArena *&current_arena() {
+  static thread_local MonotonicArena *arena{nullptr};
+  return arena;
+}
+} // namespace detail
+
+// arena of the calling thread's innermost ArenaScope, or nullptr outside of any scope
+inline MonotonicArena *current_arena() { return detail::current_arena(); }
+
+// per thread arena used by ArenaScope when it isn't given one
+inline MonotonicArena &thread_arena() {
+  static thread_local MonotonicArena arena;
+  return arena;
+}
+
+// scratch frame: ArenaAllocators created on this thread until the scope ends allocate from the arena
+// when the scope ends everything allocated inside it is freed in one go, so nothing allocated in the
+// frame may outlive it, copy results out (a copy made outside the scope goes to the heap)
+class ArenaScope {
+private:
+  MonotonicArena *previous_;
+  MonotonicArena &arena_;
+  MonotonicArena::Mark mark_;
+
+public:
+  explicit ArenaScope(MonotonicArena &arena = thread_arena())
+      : previous_{detail::current_arena()}, arena_(arena), mark_(arena.mark()) {
+    detail::current_arena() = &arena_;
+  }
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+  ~ArenaScope() {
+    detail::current_arena() = previous_;
+    arena_.rewind(mark_);
+  }
+};
+
+// standard allocator over the current arena
+// the arena is picked up when the allocator is made, outside any ArenaScope it falls back to the heap
+template <typename T> class ArenaAllocator {
+private:
+  template <typename U> friend class ArenaAllocator;
+  MonotonicArena *arena_;
+
+public:
+  typedef T value_type;
+
+  ArenaAllocator() noexcept : arena_{current_arena()} {}
+  template <typename U> ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena_{other.arena_} {}
+
+  T *allocate(size_t n) {
+    if (arena_) { return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T))); }
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t) noexcept {
+    if (!arena_) { ::operator delete(p); }
+  }
+
+  // copies of a container go to the arena that is current where the copy is made
+  ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+  MonotonicArena *arena() const { return arena_; }
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &other) const { return arena_ == other.arena_; }
+  template <typename U> bool operator!=(const ArenaAllocator<U> &other) const { return arena_ != other.arena_; }
+};
+
+} // namespace tslib
@@ -0,0 +1,135 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+
+namespace tslib {
+
+// proleptic gregorian calendar arithmetic on days since 1970-01-01
+//
+// conversions use the era based algorithms from Howard Hinnant's chrono date library: years are counted
+// from march so the leap day is the last day of the year, and a 400 year era has a fixed length
+// there are no tables and no branches besides the sign of the era, so they vectorize and are constexpr
+
+class CivilDate {
+public:
+  long year;
+  int month;
+  int day;
+};
+
+constexpr bool is_leap_year(long y) { return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0); }
+
+constexpr int days_in_month(long y, int m) {
+  return m == 2 ? (is_leap_year(y) ? 29 : 28) : (m == 4 || m == 6 || m == 9 || m == 11 ? 30 : 31);
+}
+
+// days since 1970-01-01 of y-m-d
+constexpr long days_from_civil(long y, int m, int d) {
+  y -= m <= 2;
+  const long era{(y >= 0 ? y : y - 399) / 400};
+  const long yoe{y - era * 400};                                // [0, 399]
+  const long doy{(153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1}; // [0, 365]
+  const long doe{yoe * 365 + yoe / 4 - yoe / 100 + doy};          // [0, 146096]
+  return era * 146097 + doe - 719468;
+}
+
+// y-m-d of days since 1970-01-01
+constexpr CivilDate civil_from_days(long z) {
+  z += 719468;
+  const long era{(z >= 0 ? z : z - 146096) / 146097};
+  const long doe{z - era * 146097};                                       // [0, 146096]
+  const long yoe{(doe - doe / 1460 + doe / 36524 - doe / 146096) / 365}; // [0, 399]
+  const long doy{doe - (365 * yoe + yoe / 4 - yoe / 100)};               // [0, 365]
+  const long mp{(5 * doy + 2) / 153};                                    // [0, 11], from march
+  const int d{static_cast<int>(doy - (153 * mp + 2) / 5 + 1)};
+  const int m{static_cast<int>(mp < 10 ? mp + 3 : mp - 9)};
+  return CivilDate{yoe + era * 400 + (m <= 2), m, d};
+}
+
+// day of the week, 0 is sunday
+constexpr int weekday_from_days(long z) { return static_cast<int>(z >= -4 ? (z + 4) % 7 : (z + 5) % 7 + 6); }
+
+// days since 1970-01-01 of y-m-d, throws for days that don't exist
+inline long checked_days_from_civil(long y, int m, int d) {
+  if (m < 1 || m > 12) { throw std::out_of_range("Month number is out of range 1..12"); }
+  if (d < 1 || d > days_in_month(y, m)) { throw std::out_of_range("Day of month is not valid for year"); }
+  return days_from_civil(y, m, d);
+}
+
+// the date n months after z
+// like boost::gregorian::months, the last day of a month goes to the last day of the new month and other
+// days are clamped to the end of the new month
+constexpr long add_months(long z, long n) {
+  const CivilDate c{civil_from_days(z)};
+  const long months{c.year * 12 + (c.month - 1) + n};
+  const long y{months >= 0 ? months / 12 : (months - 11) / 12};
+  const int m{static_cast<int>(months - y * 12) + 1};
+  const int last{days_in_month(y, m)};
+  const int d{c.day == days_in_month(c.year, c.month) || c.day > last ? last : c.day};
+  return days_from_civil(y, m, d);
+}
+
+// the last day of the month holding z
+constexpr long last_day_of_month(long z) {
+  const CivilDate c{civil_from_days(z)};
+  return z + (days_in_month(c.year, c.month) - c.day);
+}
+
+// splits the days in [beg, end) into year, month and day arrays with room for the whole range
+// a plain loop over the conversion, which the compiler can vectorize
+template <typename ITER> void civil_from_days(ITER beg, ITER end, long *year, int *month, int *day) {
+  const size_t n{static_cast<size_t>(std::distance(beg, end))};
+  for (size_t i = 0; i < n; ++i, ++beg) {
+    const CivilDate c{civil_from_days(static_cast<long>(*beg))};
+    year[i]  = c.year;
+    month[i] = c.month;
+    day[i]   = c.day;
+  }
+}
+
+// writes yyyy-Mon-dd, the format of boost's date operator<<, to out and returns one past the last character
+// out needs room for 11 characters plus any digits of years past 9999
+inline char *format_civil(const CivilDate &c, char *out) {
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  long y{c.year};
+  if (y < 0) {
+    *out++ = '-';
+    y      = -y;
+  }
+  char digits[24];
+  int nd{0};
+  do {
+    digits[nd++] = static_cast<char>('0' + y % 10);
+    y /= 10;
+  } while (y);
+  for (int pad = nd; pad < 4; ++pad) { *out++ = '0'; }
+  while (nd) { *out++ = digits[--nd]; }
+  *out++ = '-';
+  for (int k = 0; k < 3; ++k) { *out++ = months[(c.month - 1) * 3 + k]; }
+  *out++ = '-';
+  *out++ = static_cast<char>('0' + c.day / 10);
+  *out++ = static_cast<char>('0' + c.day % 10);
+  return out;
+}
+
+// floor division, the day of a timestamp before the epoch is the day before
+template <typename T> constexpr T floor_div(T x, T y) { return x / y - ((x % y != 0) && ((x < 0) != (y < 0))); }
+
+} // namespace tslib
@@ -0,0 +1,259 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <tslib/execution.hpp>
+#include <tslib/instrument.hpp>
+#include <tslib/layout.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// cross-sectional operations: statistics across the columns of each row
+//
+// the rows are worked on in tiles small enough to stay in cache: a tile is copied into a row major buffer of
+// doubles reading every column in order (or whole rows, when the backend gives them with row_begin), the row
+// kernels run on the contiguous rows of the buffer, and results of the same shape are copied back the same way
+// NA values are NaN in the buffer and are skipped by every kernel
+
+namespace detail {
+
+// true when the backend of S gives contiguous rows with row_begin
+template <typename S> class has_rows {
+private:
+  template <typename T>
+  static auto test(int) -> decltype(std::declval<const T &>().getBackend().row_begin(0), std::true_type());
+  template <typename> static std::false_type test(long);
+
+public:
+  static const bool value = decltype(test<S>(0))::value;
+};
+
+template <typename S> using rows_of = std::integral_constant<bool, has_rows<S>::value>;
+
+inline double row_na() { return std::numeric_limits<double>::quiet_NaN(); }
+
+// copies rows [r0, r1) of ts into buf, one row after another
+// the NAs are the rows masks clear when there are masks (one per column), the NA values otherwise
+template <typename TS>
+void gather_rows(const TS &ts, const std::vector<ValidityMask> &masks, size_t r0, size_t r1, double *buf,
+                 std::false_type) {
+  const size_t ncol{static_cast<size_t>(ts.ncol())};
+  for (size_t c = 0; c < ncol; ++c) {
+    auto src = ts.col_begin(static_cast<decltype(ts.ncol())>(c));
+    std::advance(src, r0);
+    double *out{buf + c};
+    for (size_t r = r0; r < r1; ++r, ++src, out += ncol) {
+      const bool na{masks.empty() ? series_traits<TS>::ISNA(*src) : !masks[c].test(r)};
+      *out = na ? row_na() : static_cast<double>(*src);
+    }
+  }
+}
+// backends with rows don't keep masks
+template <typename TS>
+void gather_rows(const TS &ts, const std::vector<ValidityMask> &, size_t r0, size_t r1, double *buf,
+                 std::true_type) {
+  for (size_t r = r0; r < r1; ++r) {
+    const auto row = ts.getBackend().row_begin(static_cast<decltype(ts.nrow())>(r));
+    const auto row_end = ts.getBackend().row_end(static_cast<decltype(ts.nrow())>(r));
+    buf = std::transform(row, row_end, buf, [](typename TS::value_type x) {
+      return series_traits<TS>::ISNA(x) ? row_na() : static_cast<double>(x);
+    });
+  }
+}
+
+// copies buf back into rows [r0, r1) of res
+template <typename RES> void scatter_rows(RES &res, size_t r0, size_t r1, const double *buf, std::false_type) {
+  const size_t ncol{static_cast<size_t>(res.ncol())};
+  for (size_t c = 0; c < ncol; ++c) {
+    auto dst = res.col_begin(static_cast<decltype(res.ncol())>(c));
+    std::advance(dst, r0);
+    const double *in{buf + c};
+    for (size_t r = r0; r < r1; ++r, ++dst, in += ncol) {
+      *dst = std::isnan(*in) ? series_traits<RES>::template NA<double>() : *in;
+    }
+  }
+}
+template <typename RES> void scatter_rows(RES &res, size_t r0, size_t r1, const double *buf, std::true_type) {
+  const size_t ncol{static_cast<size_t>(res.ncol())};
+  for (size_t r = r0; r < r1; ++r, buf += ncol) {
+    std::transform(buf, buf + ncol, res.getBackend().row_begin(static_cast<decltype(res.nrow())>(r)),
+                   [](double x) { return std::isnan(x) ? series_traits<RES>::template NA<double>() : x; });
+  }
+}
+
+// runs f(r0, r1, buf) on every tile of rows of ts, with the tile gathered in buf
+// the tiles are shared out with the given execution policy
+template <typename TS, typename F> void for_each_row_tile(const TS &ts, ExecutionPolicy &policy, const F &f) {
+  const size_t nrow{static_cast<size_t>(ts.nrow())}, ncol{static_cast<size_t>(ts.ncol())};
+  const size_t tile{layout_tile_rows(ncol, sizeof(double))};
+  const size_t ntiles{(nrow + tile - 1) / tile};
+  const std::vector<ValidityMask> masks(has_validity(ts) ? operand_masks(ts) : std::vector<ValidityMask>());
+  policy_for(policy, nrow * ncol).parallel_for(ntiles, [&](size_t t) {
+    const size_t r0{t * tile}, r1{std::min(nrow, r0 + tile)};
+    std::vector<double> buf((r1 - r0) * ncol);
+    gather_rows(ts, masks, r0, r1, buf.data(), rows_of<TS>());
+    f(r0, r1, buf.data());
+  });
+}
+
+// count, sum, mean and sum of squared deviations of the values of a row, in two passes
+struct RowMoments {
+  size_t n;
+  double sum;
+  double mean;
+  double m2;
+};
+
+inline RowMoments row_moments(const double *x, size_t ncol) {
+  RowMoments m{0, 0, 0, 0};
+  for (size_t c = 0; c < ncol; ++c) {
+    if (!std::isnan(x[c])) {
+      m.sum += x[c];
+      ++m.n;
+    }
+  }
+  if (m.n == 0) { return m; }
+  m.mean = m.sum / static_cast<double>(m.n);
+  for (size_t c = 0; c < ncol; ++c) {
+    if (!std::isnan(x[c])) { m.m2 += (x[c] - m.mean) * (x[c] - m.mean); }
+  }
+  return m;
+}
+
+inline double row_sd(const RowMoments &m) {
+  return m.n < 2 ? row_na() : std::sqrt(m.m2 / static_cast<double>(m.n - 1));
+}
+
+// ranks of the values of a row, from 1, ties get the mean of their ranks
+// order is scratch space with room for the row
+inline void rank_row(double *x, size_t ncol, std::vector<size_t> &order) {
+  order.clear();
+  for (size_t c = 0; c < ncol; ++c) {
+    if (!std::isnan(x[c])) { order.push_back(c); }
+  }
+  std::sort(order.begin(), order.end(), [x](size_t a, size_t b) { return x[a] < x[b]; });
+  for (size_t lo = 0; lo < order.size();) {
+    size_t hi{lo + 1};
+    while (hi < order.size() && x[order[hi]] == x[order[lo]]) { ++hi; }
+    const double rank{static_cast<double>(lo + hi + 1) / 2};
+    for (; lo < hi; ++lo) { x[order[lo]] = rank; }
+  }
+}
+
+// one column series on the index of ts with f(row, ncol) for each row, NaN results are NA
+template <typename TS, typename F> auto row_reduce(const TS &ts, const char *op, const F &f, ExecutionPolicy &policy) {
+  typedef typename series_traits<TS>::template rebind<double> result_type;
+  instrument::Scope scope(op);
+  scope.rows_in(static_cast<size_t>(ts.nrow()));
+  result_type res(on_index<result_type>(ts, 0, ts.nrow(), static_cast<decltype(ts.ncol())>(1)));
+  const size_t ncol{static_cast<size_t>(ts.ncol())};
+  for_each_row_tile(ts, policy, [&](size_t r0, size_t r1, const double *buf) {
+    auto dst = res.col_begin(0);
+    std::advance(dst, r0);
+    for (size_t r = r0; r < r1; ++r, ++dst, buf += ncol) {
+      const double v{f(buf, ncol)};
+      *dst = std::isnan(v) ? series_traits<result_type>::template NA<double>() : v;
+    }
+  });
+  record_result(scope, res);
+  return res;
+}
+
+// series of the shape of ts with f(tile, nrows, ncol) applied to the row major tiles in place
+template <typename TS, typename F>
+auto row_transform(const TS &ts, const char *op, const F &f, ExecutionPolicy &policy) {
+  typedef typename series_traits<TS>::template rebind<double> result_type;
+  instrument::Scope scope(op);
+  scope.rows_in(static_cast<size_t>(ts.nrow()));
+  result_type res(on_index<result_type>(ts, 0, ts.nrow(), ts.ncol()));
+  copy_colnames(res, ts);
+  const size_t ncol{static_cast<size_t>(ts.ncol())};
+  for_each_row_tile(ts, policy, [&](size_t r0, size_t r1, double *buf) {
+    f(buf, r1 - r0, ncol);
+    scatter_rows(res, r0, r1, buf, rows_of<result_type>());
+  });
+  record_result(scope, res);
+  return res;
+}
+
+} // namespace detail
+
+// sum of the non-NA values of each row, 0 when there are none
+template <typename TS> auto row_sum(const TS &ts, ExecutionPolicy &policy = default_execution()) {
+  return detail::row_reduce(ts, "row_sum", [](const double *x, size_t ncol) {
+    double sum{0};
+    for (size_t c = 0; c < ncol; ++c) { sum += std::isnan(x[c]) ? 0 : x[c]; }
+    return sum;
+  }, policy);
+}
+
+// mean of the non-NA values of each row, NA when there are none
+template <typename TS> auto row_mean(const TS &ts, ExecutionPolicy &policy = default_execution()) {
+  return detail::row_reduce(ts, "row_mean", [](const double *x, size_t ncol) {
+    const detail::RowMoments m{detail::row_moments(x, ncol)};
+    return m.n ? m.mean : detail::row_na();
+  }, policy);
+}
+
+// sample standard deviation of the non-NA values of each row, NA with fewer than two
+template <typename TS> auto row_sd(const TS &ts, ExecutionPolicy &policy = default_execution()) {
+  return detail::row_reduce(ts, "row_sd", [](const double *x, size_t ncol) {
+    return detail::row_sd(detail::row_moments(x, ncol));
+  }, policy);
+}
+
+// rank of each value within its row, from 1 for the smallest, ties get the mean of their ranks and NA stays NA
+template <typename TS> auto row_rank(const TS &ts, ExecutionPolicy &policy = default_execution()) {
+  return detail::row_transform(ts, "row_rank", [](double *tile, size_t nrows, size_t ncol) {
+    std::vector<size_t> order;
+    order.reserve(ncol);
+    for (size_t r = 0; r < nrows; ++r) { detail::rank_row(tile + r * ncol, ncol, order); }
+  }, policy);
+}
+
+// each value less the mean of its row
+template <typename TS> auto row_demean(const TS &ts, ExecutionPolicy &policy = default_execution()) {
+  return detail::row_transform(ts, "row_demean", [](double *tile, size_t nrows, size_t ncol) {
+    for (double *x = tile; x != tile + nrows * ncol; x += ncol) {
+      const double mean{detail::row_moments(x, ncol).mean};
+      for (size_t c = 0; c < ncol; ++c) { x[c] -= mean; }
+    }
+  }, policy);
+}
+
+// each value less the mean of its row, over the standard deviation of its row
+// rows with fewer than two values or no spread are all NA
+template <typename TS> auto row_zscore(const TS &ts, ExecutionPolicy &policy = default_execution()) {
+  return detail::row_transform(ts, "row_zscore", [](double *tile, size_t nrows, size_t ncol) {
+    for (double *x = tile; x != tile + nrows * ncol; x += ncol) {
+      const detail::RowMoments m{detail::row_moments(x, ncol)};
+      const double sd{detail::row_sd(m)};
+      const double scale{sd > 0 ? 1 / sd : detail::row_na()};
+      for (size_t c = 0; c < ncol; ++c) { x[c] = (x[c] - m.mean) * scale; }
+    }
+  }, policy);
+}
+
+} // namespace tslib
@@ -0,0 +1,648 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <tslib/calendar.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// csv input and output
+//
+// one row per line: the index, then a field for every column, with an optional header line of colnames
+// the reader takes the input in large chunks and parses the fields where they lie, no strings per line or cell
+//  numbers: decimals with at most 2^53 as mantissa and a power of ten up to 22 are read exactly with the
+//  fast path of Clinger's algorithm (one multiply or divide), which covers prices and the like, longer ones go to strtod
+//  dates: yyyy-mm-dd or yyyy/mm/dd, then optionally ' ' or 'T' and hh:mm[:ss[.f]] with up to 9 decimals of a second,
+//  through DatePolicy::toDate
+//  from a file the rows are counted first, so the series is allocated once and filled in place
+// the writer formats into a buffer and hands the stream large writes, no iostream formatting or locales
+//  doubles get the fewest decimals (up to 15) that read back to the same value, or %.17g when there are none
+//  a datetime index gets the decimals of a second the index holds, only when they are not all zero
+// strtod and %g follow the C locale, which is what a program has unless it calls setlocale
+
+enum class IndexFormat { date, datetime, number };
+
+class CsvOptions {
+public:
+  char delimiter;
+  // first line holds the colnames
+  bool header;
+  // dates, dates with the time of day, or plain numbers
+  IndexFormat index;
+  // field written for NA, empty fields are read as NA too
+  std::string na;
+  // fixed decimals for floating point values, -1 for the shortest that reads back exactly
+  int digits;
+  // bytes read at a time
+  size_t chunk_size;
+
+  CsvOptions()
+      : delimiter{','}, header{true}, index{IndexFormat::date}, na("NA"), digits{-1}, chunk_size{1 << 22} {}
+};
+
+namespace detail {
+
+const double csv_pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+// largest mantissa a double holds exactly
+const double csv_exact_limit{9007199254740992.0};
+
+inline bool csv_digit(char c) { return static_cast<unsigned>(c - '0') < 10; }
+
+inline std::runtime_error csv_error(size_t line, const std::string &what) {
+  return std::runtime_error("read_csv: line " + std::to_string(line) + ": " + what);
+}
+
+// strips blanks and a pair of surrounding quotes
+inline void csv_trim(const char *&b, const char *&e) {
+  while (b != e && *b == ' ') { ++b; }
+  while (e != b && e[-1] == ' ') { --e; }
+  if (e - b >= 2 && *b == '"' && e[-1] == '"') {
+    ++b;
+    --e;
+  }
+}
+
+// strtod over [b, e), for the numbers the fast path can't do exactly
+inline bool csv_strtod(const char *b, const char *e, double &out) {
+  const size_t n{static_cast<size_t>(e - b)};
+  char local[64];
+  std::string big;
+  char *s{local};
+  if (n < sizeof(local)) {
+    std::memcpy(local, b, n);
+    local[n] = '\0';
+  } else {
+    big.assign(b, e);
+    s = &big[0];
+  }
+  char *end;
+  out = std::strtod(s, &end);
+  return n && end == s + n;
+}
+
+// decimal number filling all of [b, e)
+inline bool csv_parse(const char *b, const char *e, double &out) {
+  const char *p{b};
+  bool neg{false};
+  if (p != e && (*p == '-' || *p == '+')) { neg = *p++ == '-'; }
+  // up to 19 significant digits fit in m, any more push it past the exact limit and on to strtod
+  uint64_t m{0};
+  int digits{0}, exp{0};
+  bool any{false};
+  for (; p != e && csv_digit(*p); ++p, any = true) {
+    if (digits < 19) {
+      m = m * 10 + static_cast<uint64_t>(*p - '0');
+      digits += m != 0;
+    } else {
+      ++exp;
+    }
+  }
+  if (p != e && *p == '.') {
+    for (++p; p != e && csv_digit(*p); ++p, any = true) {
+      if (digits < 19) {
+        m = m * 10 + static_cast<uint64_t>(*p - '0');
+        digits += m != 0;
+        --exp;
+      }
+    }
+  }
+  // inf, nan and hex floats
+  if (!any) { return csv_strtod(b, e, out); }
+  if (p != e && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool eneg{false};
+    if (p != e && (*p == '-' || *p == '+')) { eneg = *p++ == '-'; }
+    if (p == e || !csv_digit(*p)) { return false; }
+    int x{0};
+    for (; p != e && csv_digit(*p); ++p) {
+      if (x < 100000) { x = x * 10 + (*p - '0'); }
+    }
+    exp += eneg ? -x : x;
+  }
+  if (p != e) { return false; }
+  if (m <= (uint64_t(1) << 53) && exp >= -22 && exp <= 22) {
+    const double v{exp < 0 ? static_cast<double>(m) / csv_pow10[-exp] : static_cast<double>(m) * csv_pow10[exp]};
+    out = neg ? -v : v;
+    return true;
+  }
+  return csv_strtod(b, e, out);
+}
+
+template <typename T> bool csv_parse_value(const char *b, const char *e, T &out, std::true_type) {
+  double v;
+  if (!csv_parse(b, e, v)) { return false; }
+  out = static_cast<T>(v);
+  return true;
+}
+
+template <typename T> bool csv_parse_value(const char *b, const char *e, T &out, std::false_type) {
+  const char *p{b};
+  bool neg{false};
+  if (p != e && (*p == '-' || *p == '+')) { neg = *p++ == '-'; }
+  if (p == e || (neg && !std::is_signed<T>::value)) { return false; }
+  const uint64_t limit{neg ? static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1
+                           : static_cast<uint64_t>(std::numeric_limits<T>::max())};
+  uint64_t v{0};
+  for (; p != e; ++p) {
+    if (!csv_digit(*p)) { return false; }
+    const uint64_t d{static_cast<uint64_t>(*p - '0')};
+    if (v > (limit - d) / 10) { return false; }
+    v = v * 10 + d;
+  }
+  out = neg ? static_cast<T>(-static_cast<int64_t>(v - 1) - 1) : static_cast<T>(v);
+  return true;
+}
+
+template <typename T> bool csv_parse_value(const char *b, const char *e, T &out) {
+  return csv_parse_value(b, e, out, std::is_floating_point<T>());
+}
+
+// at most max_digits digits, at least one
+inline bool csv_int(const char *&p, const char *e, int max_digits, long &v) {
+  const char *s{p};
+  v = 0;
+  while (p != e && p - s < max_digits && csv_digit(*p)) { v = v * 10 + (*p++ - '0'); }
+  return p != s;
+}
+
+// index units in one second under DP, 0 when DP has no time of day
+template <typename DP> auto csv_per_second() { return DP::toDate(1970, 1, 1, 0, 0, 1) - DP::toDate(1970, 1, 1); }
+
+template <typename DP, typename IDX> bool csv_parse_date(const char *b, const char *e, IDX &out) {
+  const char *p{b};
+  long y, mo, d, h{0}, mi{0}, s{0}, frac{0}, frac_scale{1};
+  if (!csv_int(p, e, 9, y) || p == e || (*p != '-' && *p != '/')) { return false; }
+  const char sep{*p++};
+  if (!csv_int(p, e, 2, mo) || p == e || *p++ != sep || !csv_int(p, e, 2, d)) { return false; }
+  if (p != e) {
+    if (*p != ' ' && *p != 'T') { return false; }
+    ++p;
+    if (!csv_int(p, e, 2, h) || p == e || *p++ != ':' || !csv_int(p, e, 2, mi)) { return false; }
+    if (p != e && *p == ':') {
+      ++p;
+      if (!csv_int(p, e, 2, s)) { return false; }
+      if (p != e && *p == '.') {
+        const char *f{++p};
+        if (!csv_int(p, e, 9, frac)) { return false; }
+        for (long n = p - f; n > 0; --n) { frac_scale *= 10; }
+      }
+    }
+    if (p != e) { return false; }
+  }
+  if (mo < 1 || mo > 12 || d < 1 || d > days_in_month(y, static_cast<int>(mo)) || h > 23 || mi > 59 || s > 59) {
+    return false;
+  }
+  out = DP::toDate(static_cast<int>(y), static_cast<int>(mo), static_cast<int>(d), static_cast<int>(h),
+                   static_cast<int>(mi), static_cast<int>(s));
+  // the fraction of a second in index units, as far as the index resolves it
+  if (frac) { out += static_cast<IDX>(frac * csv_per_second<DP>() / frac_scale); }
+  return true;
+}
+
+// splits a header line, fields may be quoted with "" for a quote inside them
+inline std::vector<std::string> csv_split(const char *b, const char *e, char delimiter) {
+  std::vector<std::string> fields(1);
+  bool quoted{false};
+  for (const char *p = b; p != e; ++p) {
+    if (quoted) {
+      if (*p != '"') {
+        fields.back() += *p;
+      } else if (p + 1 != e && p[1] == '"') {
+        fields.back() += *++p;
+      } else {
+        quoted = false;
+      }
+    } else if (*p == '"') {
+      quoted = true;
+    } else if (*p == delimiter) {
+      fields.emplace_back();
+    } else if (*p != ' ') {
+      fields.back() += *p;
+    }
+  }
+  return fields;
+}
+
+// calls f(b, e, line) for every line of is that isn't blank, without its line ending
+// is is read chunk bytes at a time, a line longer than that grows the buffer
+template <typename F> void csv_lines(std::istream &is, size_t chunk, F f) {
+  std::vector<char> buf(std::max<size_t>(chunk, 64));
+  size_t have{0}, line{0};
+  auto emit = [&](const char *b, const char *e) {
+    ++line;
+    if (e != b && e[-1] == '\r') { --e; }
+    if (b != e) { f(b, e, line); }
+  };
+  for (;;) {
+    if (have == buf.size()) { buf.resize(buf.size() * 2); }
+    is.read(buf.data() + have, static_cast<std::streamsize>(buf.size() - have));
+    const size_t got{static_cast<size_t>(is.gcount())};
+    const char *p{buf.data()}, *end{buf.data() + have + got};
+    if (got == 0) {
+      if (p != end) { emit(p, end); }
+      return;
+    }
+    for (const char *nl; (nl = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p))));
+         p = nl + 1) {
+      emit(p, nl);
+    }
+    have = static_cast<size_t>(end - p);
+    std::memmove(buf.data(), p, have);
+  }
+}
+
+// column count and colnames, from the first line
+class CsvShape {
+public:
+  size_t ncol;
+  std::vector<std::string> names;
+};
+
+inline CsvShape csv_shape(const char *b, const char *e, const CsvOptions &opts) {
+  std::vector<std::string> fields(csv_split(b, e, opts.delimiter));
+  CsvShape shape{fields.size() - 1, std::vector<std::string>()};
+  if (opts.header && std::any_of(fields.begin() + 1, fields.end(), [](const std::string &s) { return !s.empty(); })) {
+    shape.names.assign(fields.begin() + 1, fields.end());
+  }
+  return shape;
+}
+
+template <typename TS> class CsvParser {
+private:
+  typedef typename TS::value_type V;
+  typedef typename std::iterator_traits<typename TS::const_index_iterator>::value_type IDX;
+  typedef typename series_traits<TS>::date_policy DP;
+  const CsvOptions &opts_;
+  size_t ncol_;
+
+  bool parse_index(const char *b, const char *e, IDX &idx) const {
+    if (opts_.index == IndexFormat::number) { return csv_parse_value(b, e, idx); }
+    return csv_parse_date<DP>(b, e, idx);
+  }
+
+public:
+  CsvParser(const CsvOptions &opts, size_t ncol) : opts_(opts), ncol_{ncol} {}
+
+  // the index and ncol values of one line
+  void parse(const char *b, const char *e, size_t line, IDX &idx, V *vals) const {
+    const char *f{b};
+    for (size_t c = 0; c <= ncol_; ++c) {
+      const char *fe{static_cast<const char *>(std::memchr(f, opts_.delimiter, static_cast<size_t>(e - f)))};
+      if (c < ncol_ ? !fe : fe != nullptr) { throw csv_error(line, "expected " + std::to_string(ncol_ + 1) + " fields"); }
+      if (!fe) { fe = e; }
+      const char *tb{f}, *te{fe};
+      csv_trim(tb, te);
+      if (c == 0) {
+        if (!parse_index(tb, te, idx)) { throw csv_error(line, "bad index '" + std::string(tb, te) + "'"); }
+      } else if (tb == te || (static_cast<size_t>(te - tb) == opts_.na.size() &&
+                              std::equal(tb, te, opts_.na.begin()))) {
+        vals[c - 1] = series_traits<TS>::template NA<V>();
+      } else if (!csv_parse_value(tb, te, vals[c - 1])) {
+        throw csv_error(line, "bad value '" + std::string(tb, te) + "'");
+      }
+      f = fe + 1;
+    }
+  }
+};
+
+// output buffer that reaches the stream in large writes
+class CsvBuffer {
+private:
+  std::ostream &os_;
+  std::vector<char> buf_;
+  size_t used_;
+
+public:
+  explicit CsvBuffer(std::ostream &os, size_t size = 1 << 16) : os_(os), buf_(size), used_{0} {}
+  CsvBuffer(const CsvBuffer &) = delete;
+  CsvBuffer &operator=(const CsvBuffer &) = delete;
+  ~CsvBuffer() { flush(); }
+
+  // room for n more characters, commit the end of what was written
+  char *reserve(size_t n) {
+    if (buf_.size() - used_ < n) {
+      flush();
+      if (buf_.size() < n) { buf_.resize(n); }
+    }
+    return buf_.data() + used_;
+  }
+  void commit(char *end) { used_ = static_cast<size_t>(end - buf_.data()); }
+  void put(char c) {
+    *reserve(1) = c;
+    ++used_;
+  }
+  void put(const std::string &s) {
+    std::memcpy(reserve(s.size()), s.data(), s.size());
+    used_ += s.size();
+  }
+  void flush() {
+    os_.write(buf_.data(), static_cast<std::streamsize>(used_));
+    used_ = 0;
+  }
+};
+
+inline char *csv_format_uint(char *out, uint64_t v) {
+  char digits[20];
+  int n{0};
+  do {
+    digits[n++] = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (n) { *out++ = digits[--n]; }
+  return out;
+}
+
+// m / 10^k in decimal
+inline char *csv_format_fixed(char *out, uint64_t m, int k) {
+  char digits[24];
+  int n{0};
+  do {
+    digits[n++] = static_cast<char>('0' + m % 10);
+    m /= 10;
+  } while (m || n <= k);
+  while (n > k) { *out++ = digits[--n]; }
+  if (k) {
+    *out++ = '.';
+    while (n) { *out++ = digits[--n]; }
+  }
+  return out;
+}
+
+// the k digits of f, zero padded on the left, without the trailing zeros
+inline char *csv_format_fraction(char *out, uint64_t f, int k) {
+  for (; k > 0 && f % 10 == 0; --k) { f /= 10; }
+  for (int n = k - 1; n >= 0; --n, f /= 10) { out[n] = static_cast<char>('0' + f % 10); }
+  return out + k;
+}
+
+// characters csv_format can write for a value
+inline size_t csv_room(const CsvOptions &opts) {
+  return std::max<size_t>(opts.na.size(), opts.digits >= 0 ? 320 + static_cast<size_t>(opts.digits) : 32);
+}
+
+template <typename T> char *csv_format(char *out, T x, int digits, std::true_type) {
+  const double v{static_cast<double>(x)};
+  if (std::isnan(v)) { return std::copy_n("NaN", 3, out); }
+  if (std::isinf(v)) { return v < 0 ? std::copy_n("-Inf", 4, out) : std::copy_n("Inf", 3, out); }
+  double a{v};
+  if (std::signbit(v)) {
+    *out++ = '-';
+    a      = -v;
+  }
+  if (digits >= 0) {
+    if (digits <= 22) {
+      const double m{std::round(a * csv_pow10[digits])};
+      if (m < csv_exact_limit) { return csv_format_fixed(out, static_cast<uint64_t>(m), digits); }
+    }
+    return out + std::sprintf(out, "%.*f", digits, a);
+  }
+  // m / 10^k is exactly what the reader computes for the decimal, so the check guarantees the round trip
+  for (int k = 0; k <= 15; ++k) {
+    const double m{a * csv_pow10[k]};
+    if (m >= csv_exact_limit) { break; }
+    if (m == std::floor(m) && m / csv_pow10[k] == a) { return csv_format_fixed(out, static_cast<uint64_t>(m), k); }
+  }
+  return out + std::snprintf(out, 32, "%.17g", a);
+}
+
+template <typename T> char *csv_format(char *out, T x, int, std::false_type) {
+  if (x < 0) {
+    *out++ = '-';
+    return csv_format_uint(out, uint64_t(0) - static_cast<uint64_t>(x));
+  }
+  return csv_format_uint(out, static_cast<uint64_t>(x));
+}
+
+template <typename T> char *csv_format(char *out, T x, int digits) {
+  return csv_format(out, x, digits, std::is_floating_point<T>());
+}
+
+inline char *csv_two_digits(char *out, int v) {
+  *out++ = static_cast<char>('0' + v / 10);
+  *out++ = static_cast<char>('0' + v % 10);
+  return out;
+}
+
+inline void csv_put_name(CsvBuffer &out, const std::string &name, char delimiter) {
+  if (name.find_first_of(std::string{delimiter, '"', '\n', '\r'}) == std::string::npos) {
+    out.put(name);
+    return;
+  }
+  out.put('"');
+  for (char c : name) {
+    if (c == '"') { out.put('"'); }
+    out.put(c);
+  }
+  out.put('"');
+}
+
+} // namespace detail
+
+// reads a series from a csv stream in one pass, rows are gathered in a buffer and copied into the series at the end
+template <typename TS> TS read_csv(std::istream &is, const CsvOptions &opts = CsvOptions()) {
+  typedef typename TS::value_type V;
+  typedef typename std::iterator_traits<typename TS::const_index_iterator>::value_type IDX;
+  typedef decltype(std::declval<TS>().ncol()) DIM;
+
+  bool started{false};
+  detail::CsvShape shape{0, std::vector<std::string>()};
+  std::vector<IDX> index;
+  std::vector<V> cells;
+  detail::csv_lines(is, opts.chunk_size, [&](const char *b, const char *e, size_t line) {
+    if (!started) {
+      started = true;
+      shape   = detail::csv_shape(b, e, opts);
+      if (opts.header) { return; }
+    }
+    index.emplace_back();
+    cells.resize(cells.size() + shape.ncol);
+    detail::CsvParser<TS>(opts, shape.ncol).parse(b, e, line, index.back(), cells.data() + cells.size() - shape.ncol);
+  });
+
+  const size_t nrow{index.size()}, ncol{shape.ncol};
+  TS ts(static_cast<DIM>(nrow), static_cast<DIM>(ncol));
+  std::copy(index.begin(), index.end(), ts.index_begin());
+  for (size_t c = 0; c < ncol; ++c) {
+    auto col = ts.col_begin(static_cast<DIM>(c));
+    for (size_t r = 0; r < nrow; ++r) { col[r] = cells[r * ncol + c]; }
+  }
+  if (!shape.names.empty()) { ts.setColnames(shape.names); }
+  return ts;
+}
+
+// reads a series from a csv file in two passes, the first counts the rows and the second parses into the series
+template <typename TS> TS read_csv(const std::string &path, const CsvOptions &opts = CsvOptions()) {
+  typedef typename TS::value_type V;
+  typedef decltype(std::declval<TS>().ncol()) DIM;
+
+  std::ifstream is(path, std::ios::binary);
+  if (!is) { throw std::runtime_error("read_csv: can't open " + path); }
+  bool started{false};
+  detail::CsvShape shape{0, std::vector<std::string>()};
+  size_t nrow{0};
+  detail::csv_lines(is, opts.chunk_size, [&](const char *b, const char *e, size_t) {
+    if (!started) {
+      started = true;
+      shape   = detail::csv_shape(b, e, opts);
+      if (opts.header) { return; }
+    }
+    ++nrow;
+  });
+  is.clear();
+  is.seekg(0);
+
+  const size_t ncol{shape.ncol};
+  TS ts(static_cast<DIM>(nrow), static_cast<DIM>(ncol));
+  const detail::CsvParser<TS> parser(opts, ncol);
+  auto idx = ts.index_begin();
+  std::vector<decltype(ts.col_begin(0))> cols;
+  for (size_t c = 0; c < ncol; ++c) { cols.push_back(ts.col_begin(static_cast<DIM>(c))); }
+  std::vector<V> row(ncol);
+  size_t r{0};
+  bool skip{opts.header};
+  detail::csv_lines(is, opts.chunk_size, [&](const char *b, const char *e, size_t line) {
+    if (skip) {
+      skip = false;
+      return;
+    }
+    if (r == nrow) { throw detail::csv_error(line, "file changed while reading"); }
+    parser.parse(b, e, line, idx[r], row.data());
+    for (size_t c = 0; c < ncol; ++c) { cols[c][r] = row[c]; }
+    ++r;
+  });
+  if (r != nrow) { throw std::runtime_error("read_csv: file changed while reading " + path); }
+  if (!shape.names.empty()) { ts.setColnames(shape.names); }
+  return ts;
+}
+
+// writes ts as csv, the header line names the index column "index"
+template <typename TS> void write_csv(std::ostream &os, const TS &ts, const CsvOptions &opts = CsvOptions()) {
+  typedef typename TS::value_type V;
+  typedef typename series_traits<TS>::date_policy DP;
+  typedef decltype(ts.ncol()) DIM;
+  const size_t nrow{static_cast<size_t>(ts.nrow())}, ncol{static_cast<size_t>(ts.ncol())};
+
+  {
+    detail::CsvBuffer out(os);
+    if (opts.header) {
+      const std::vector<std::string> names(ts.getColnames());
+      out.put(std::string("index"));
+      for (size_t c = 0; c < ncol; ++c) {
+        out.put(opts.delimiter);
+        if (c < names.size()) { detail::csv_put_name(out, names[c], opts.delimiter); }
+      }
+      out.put('\n');
+    }
+
+    std::vector<decltype(ts.col_begin(0))> cols;
+    for (size_t c = 0; c < ncol; ++c) { cols.push_back(ts.col_begin(static_cast<DIM>(c))); }
+    // a masked series writes NA where its masks say so, whatever value the row holds
+    const std::vector<ValidityMask> masks(detail::has_validity(ts) ? detail::operand_masks(ts)
+                                                                   : std::vector<ValidityMask>());
+    const size_t room{detail::csv_room(opts) + 1};
+    // a datetime index is at most 10 + 6 + 9 + 10 characters (year, date, time of day, fraction)
+    const size_t index_room{std::max<size_t>(room, 40)};
+    // sub-second stamps get as many decimals as the index resolves, without trailing zeros
+    const auto per_second = detail::csv_per_second<DP>();
+    int frac_digits{0};
+    for (auto u = per_second; u > 1; u /= 10) { ++frac_digits; }
+    // dates are split up a block at a time
+    const size_t block{1024};
+    std::vector<long> years(block);
+    std::vector<int> months(block), days(block);
+    const auto idx = ts.index_begin();
+    for (size_t r0 = 0; r0 < nrow; r0 += block) {
+      const size_t n{std::min(block, nrow - r0)};
+      if (opts.index != IndexFormat::number) {
+        DP::decompose(idx + r0, idx + r0 + n, years.data(), months.data(), days.data());
+      }
+      for (size_t i = 0; i < n; ++i) {
+        const size_t r{r0 + i};
+        char *p{out.reserve(index_room)};
+        if (opts.index == IndexFormat::number) {
+          p = detail::csv_format(p, idx[r], opts.digits);
+        } else {
+          long y{years[i]};
+          if (y < 0) {
+            *p++ = '-';
+            y    = -y;
+          }
+          for (long w = 1000; w > y && w > 1; w /= 10) { *p++ = '0'; }
+          p    = detail::csv_format_uint(p, static_cast<uint64_t>(y));
+          *p++ = '-';
+          p    = detail::csv_two_digits(p, months[i]);
+          *p++ = '-';
+          p    = detail::csv_two_digits(p, days[i]);
+          if (opts.index == IndexFormat::datetime) {
+            const int h{DP::hour(idx[r])}, mi{DP::minute(idx[r])}, sec{DP::second(idx[r])};
+            *p++ = ' ';
+            p    = detail::csv_two_digits(p, h);
+            *p++ = ':';
+            p    = detail::csv_two_digits(p, mi);
+            *p++ = ':';
+            p    = detail::csv_two_digits(p, sec);
+            if (frac_digits) {
+              const auto frac = idx[r] - DP::toDate(static_cast<int>(years[i]), months[i], days[i], h, mi, sec);
+              if (frac > 0) {
+                *p++ = '.';
+                p    = detail::csv_format_fraction(p, static_cast<uint64_t>(frac), frac_digits);
+              }
+            }
+          }
+        }
+        out.commit(p);
+        for (size_t c = 0; c < ncol; ++c) {
+          p      = out.reserve(room);
+          *p++   = opts.delimiter;
+          const V x{cols[c][r]};
+          if (masks.empty() ? series_traits<TS>::ISNA(x) : !masks[c].test(r)) {
+            p = std::copy(opts.na.begin(), opts.na.end(), p);
+          } else {
+            p = detail::csv_format(p, x, opts.digits);
+          }
+          out.commit(p);
+        }
+        out.put('\n');
+      }
+    }
+  }
+  if (!os) { throw std::runtime_error("write_csv: write failed"); }
+}
+
+template <typename TS> void write_csv(const std::string &path, const TS &ts, const CsvOptions &opts = CsvOptions()) {
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os) { throw std::runtime_error("write_csv: can't open " + path); }
+  write_csv(os, ts, opts);
+}
+
+} // namespace tslib
@@ -0,0 +1,337 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tslib {
+
+// execution policies decide how the independent pieces of a series operation are run
+// operations split their work with for_each_block and hand the pieces to a policy
+//  SequentialPolicy: runs everything on the calling thread
+//  ThreadPoolPolicy: fixed set of threads sharing one task queue
+//  WorkStealingPolicy: one task queue per thread, idle threads steal from the others
+// the calling thread always helps run its own tasks, so nested parallel_for calls can't deadlock
+class ExecutionPolicy {
+public:
+  virtual ~ExecutionPolicy() {}
+  // number of threads that can run tasks at the same time
+  virtual size_t concurrency() const = 0;
+  // runs f(i) for every i in [0, n) and returns when they have all finished
+  // the first exception thrown by a task is rethrown here
+  virtual void parallel_for(size_t n, const std::function<void(size_t)> &f) = 0;
+};
+
+class SequentialPolicy : public ExecutionPolicy {
+public:
+  size_t concurrency() const { return 1; }
+  void parallel_for(size_t n, const std::function<void(size_t)> &f) {
+    for (size_t i = 0; i < n; ++i) { f(i); }
+  }
+};
+
+namespace detail {
+
+// completion state of one parallel_for call
+class TaskBatch {
+private:
+  std::mutex m_;
+  std::condition_variable done_;
+  size_t remaining_;
+  std::exception_ptr error_;
+
+public:
+  explicit TaskBatch(size_t n) : m_(), done_(), remaining_{n}, error_() {}
+  TaskBatch(const TaskBatch &) = delete;
+  TaskBatch &operator=(const TaskBatch &) = delete;
+
+  // wraps task i of f so that it reports back to the batch
+  std::function<void()> task(const std::function<void(size_t)> &f, size_t i, const std::shared_ptr<TaskBatch> &self) {
+    return [&f, i, self]() {
+      std::exception_ptr error;
+      try {
+        f(i);
+      } catch (...) { error = std::current_exception(); }
+      std::lock_guard<std::mutex> lock(self->m_);
+      if (error && !self->error_) { self->error_ = error; }
+      if (--self->remaining_ == 0) { self->done_.notify_all(); }
+    };
+  }
+  bool finished() {
+    std::lock_guard<std::mutex> lock(m_);
+    return remaining_ == 0;
+  }
+  void wait() {
+    std::unique_lock<std::mutex> lock(m_);
+    done_.wait(lock, [this] { return remaining_ == 0; });
+  }
+  void rethrow() {
+    if (error_) { std::rethrow_exception(error_); }
+  }
+};
+
+inline size_t default_threads() { return std::max(1U, std::thread::hardware_concurrency()); }
+
+} // namespace detail
+
+class ThreadPoolPolicy : public ExecutionPolicy {
+private:
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex m_;
+  std::condition_variable ready_;
+  bool stop_;
+
+  // runs one queued task on the calling thread, false if the queue was empty
+  bool run_one() {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      if (tasks_.empty()) { return false; }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+    return true;
+  }
+
+  void work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_);
+        ready_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (tasks_.empty()) { return; }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+public:
+  // the calling thread also runs tasks, so nthreads - 1 workers are started
+  explicit ThreadPoolPolicy(size_t nthreads = detail::default_threads())
+      : workers_(), tasks_(), m_(), ready_(), stop_{false} {
+    for (size_t i = 1; i < nthreads; ++i) { workers_.emplace_back([this] { work(); }); }
+  }
+  ThreadPoolPolicy(const ThreadPoolPolicy &) = delete;
+  ThreadPoolPolicy &operator=(const ThreadPoolPolicy &) = delete;
+  ~ThreadPoolPolicy() {
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      stop_ = true;
+    }
+    ready_.notify_all();
+    for (auto &w : workers_) { w.join(); }
+  }
+
+  size_t concurrency() const { return workers_.size() + 1; }
+
+  void parallel_for(size_t n, const std::function<void(size_t)> &f) {
+    if (n <= 1 || workers_.empty()) { return SequentialPolicy().parallel_for(n, f); }
+    auto batch = std::make_shared<detail::TaskBatch>(n);
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      for (size_t i = 0; i < n; ++i) { tasks_.push_back(batch->task(f, i, batch)); }
+    }
+    ready_.notify_all();
+    // help until the queue is drained, then wait for the tasks still running elsewhere
+    while (!batch->finished()) {
+      if (!run_one()) { batch->wait(); }
+    }
+    batch->rethrow();
+  }
+};
+
+class WorkStealingPolicy : public ExecutionPolicy {
+private:
+  class Queue {
+  public:
+    Queue() : m(), tasks() {}
+    std::mutex m;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // one queue per worker plus one for the calling threads
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::mutex idle_m_;
+  std::condition_variable idle_;
+  size_t pending_;
+  bool stop_;
+
+  // owners take from the back of their own queue, thieves from the front of someone else's
+  bool take(size_t self, std::function<void()> &task) {
+    const size_t nq{queues_.size()};
+    for (size_t k = 0; k < nq; ++k) {
+      Queue &q = *queues_[(self + k) % nq];
+      std::lock_guard<std::mutex> lock(q.m);
+      if (q.tasks.empty()) { continue; }
+      if (k == 0) {
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+      } else {
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+      }
+      std::lock_guard<std::mutex> idle_lock(idle_m_);
+      --pending_;
+      return true;
+    }
+    return false;
+  }
+
+  void work(size_t self) {
+    std::function<void()> task;
+    while (true) {
+      if (take(self, task)) {
+        task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(idle_m_);
+      idle_.wait(lock, [this] { return stop_ || pending_ > 0; });
+      if (stop_ && pending_ == 0) { return; }
+    }
+  }
+
+public:
+  explicit WorkStealingPolicy(size_t nthreads = detail::default_threads())
+      : queues_(), workers_(), idle_m_(), idle_(), pending_{0}, stop_{false} {
+    for (size_t i = 0; i < std::max<size_t>(nthreads, 1); ++i) { queues_.emplace_back(new Queue()); }
+    for (size_t i = 1; i < nthreads; ++i) { workers_.emplace_back([this, i] { work(i); }); }
+  }
+  WorkStealingPolicy(const WorkStealingPolicy &) = delete;
+  WorkStealingPolicy &operator=(const WorkStealingPolicy &) = delete;
+  ~WorkStealingPolicy() {
+    {
+      std::lock_guard<std::mutex> lock(idle_m_);
+      stop_ = true;
+    }
+    idle_.notify_all();
+    for (auto &w : workers_) { w.join(); }
+  }
+
+  size_t concurrency() const { return workers_.size() + 1; }
+
+  void parallel_for(size_t n, const std::function<void(size_t)> &f) {
+    if (n <= 1 || workers_.empty()) { return SequentialPolicy().parallel_for(n, f); }
+    auto batch = std::make_shared<detail::TaskBatch>(n);
+    // counted before they are queued so the count never runs below the number of queued tasks
+    {
+      std::lock_guard<std::mutex> lock(idle_m_);
+      pending_ += n;
+    }
+    // deal contiguous ranges of tasks to the queues so neighbouring pieces of work stay on one thread
+    const size_t nq{queues_.size()};
+    for (size_t q = 0; q < nq; ++q) {
+      std::lock_guard<std::mutex> lock(queues_[q]->m);
+      // pushed in reverse so the owner, taking from the back, runs its range in order
+      for (size_t i = (q + 1) * n / nq; i-- > q * n / nq;) { queues_[q]->tasks.push_back(batch->task(f, i, batch)); }
+    }
+    idle_.notify_all();
+    std::function<void()> task;
+    while (!batch->finished()) {
+      if (take(0, task)) {
+        task();
+      } else {
+        batch->wait();
+      }
+    }
+    batch->rethrow();
+  }
+};
+
+inline SequentialPolicy &sequential_execution() {
+  static SequentialPolicy policy;
+  return policy;
+}
+
+namespace detail {
+inline ExecutionPolicy *&current_execution() {
+  static thread_local ExecutionPolicy *policy{nullptr};
+  return policy;
+}
+} // namespace detail
+
+// policy used by operations that aren't given one explicitly (including the operators)
+inline ExecutionPolicy &default_execution() {
+  ExecutionPolicy *policy{detail::current_execution()};
+  return policy ? *policy : sequential_execution();
+}
+
+// makes policy the default for the calling thread until the scope ends
+class ExecutionScope {
+private:
+  ExecutionPolicy *previous_;
+
+public:
+  explicit ExecutionScope(ExecutionPolicy &policy) : previous_{detail::current_execution()} {
+    detail::current_execution() = &policy;
+  }
+  ExecutionScope(const ExecutionScope &) = delete;
+  ExecutionScope &operator=(const ExecutionScope &) = delete;
+  ~ExecutionScope() { detail::current_execution() = previous_; }
+};
+
+// below this many elements an operation isn't worth splitting
+const size_t min_parallel_elements{1 << 15};
+
+// the policy to use for an operation touching this many elements: small ones stay on the calling thread
+inline ExecutionPolicy &policy_for(ExecutionPolicy &policy, size_t elements) {
+  return elements < min_parallel_elements ? sequential_execution() : policy;
+}
+
+// splits an nrow x ncol operation into tasks and runs f(col, row_begin, row_end) on each
+// wide series are split by groups of whole columns, tall narrow ones by blocks of rows within a column
+// row blocks are whole cache lines long, and each task writes one contiguous stretch, so neighbouring tasks
+// share at most the single line at their common boundary
+template <typename F>
+void for_each_block(ExecutionPolicy &policy, size_t nrow, size_t ncol, size_t elem_size, const F &f) {
+  const size_t threads{policy.concurrency()};
+  if (threads <= 1 || nrow * ncol < min_parallel_elements) {
+    for (size_t c = 0; c < ncol; ++c) { f(c, size_t(0), nrow); }
+    return;
+  }
+  // a few tasks per thread so that uneven tasks balance out
+  const size_t target{threads * 4};
+  if (ncol >= threads) {
+    const size_t ntasks{std::min(ncol, target)};
+    policy.parallel_for(ntasks, [&](size_t t) {
+      for (size_t c = t * ncol / ntasks; c < (t + 1) * ncol / ntasks; ++c) { f(c, size_t(0), nrow); }
+    });
+    return;
+  }
+  const size_t line{std::max<size_t>(1, 64 / elem_size)};
+  const size_t per_col{(target + ncol - 1) / ncol};
+  const size_t block{((nrow + per_col - 1) / per_col + line - 1) / line * line};
+  const size_t nblocks{(nrow + block - 1) / block};
+  policy.parallel_for(ncol * nblocks, [&](size_t t) {
+    const size_t b{t % nblocks};
+    f(t / nblocks, b * block, std::min(nrow, (b + 1) * block));
+  });
+}
+
+} // namespace tslib
@@ -0,0 +1,279 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <tslib/functors.hpp>
+#include <tslib/intersection.map.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// expression templates for series arithmetic
+//
+// lazy(x) wraps a series so that +, -, * and / build an expression tree instead of computing anything
+// evaluating the tree aligns all the series in it with one multi-way intersection, then runs a single
+// fused loop per column into the result, which is the only allocation
+//
+//   LDL_ts r = (lazy(x) - y) / (lazy(y) + z) * w;
+//
+// the tree holds references to the series, so it has to be evaluated before they go away
+
+// leaf of the tree, reads one series through its row map
+template <typename TS> class LeafExpr {
+private:
+  typedef typename TS::const_data_iterator const_data_iterator;
+  const TS &ts_;
+  // rows of the series used for the k-th output row, either through a row map or as a plain offset
+  const size_t *rows_;
+  size_t offset_;
+  const_data_iterator col_;
+
+public:
+  typedef typename TS::value_type value_type;
+  // a series that carries the index, backend and traits of the result
+  typedef TS proto_type;
+
+  explicit LeafExpr(const TS &ts) : ts_(ts), rows_{nullptr}, offset_{0}, col_{ts.col_begin(0)} {}
+  LeafExpr(const LeafExpr &) = default;
+
+  // calls f on every series in the tree, left to right
+  template <typename F> void visit(F &f) const { f(ts_); }
+  // hands each leaf its row map or offset, leaf counts the leaves already bound
+  void bind(const std::vector<const size_t *> &rows, const std::vector<size_t> &offsets, size_t &leaf) {
+    rows_   = rows[leaf];
+    offset_ = offsets[leaf];
+    ++leaf;
+  }
+  // move to column nc of the result, single column series are broadcast
+  template <typename DIM> void column(DIM nc) { col_ = ts_.col_begin(ts_.ncol() == 1 ? 0 : nc); }
+  // value for output row k, sets na if it is NA
+  value_type value(size_t k, bool &na) const {
+    const value_type v{rows_ ? col_[rows_[k]] : col_[offset_ + k]};
+    na = na || series_traits<TS>::ISNA(v);
+    return v;
+  }
+};
+
+// scalar operand
+template <typename S> class ScalarExpr {
+private:
+  S s_;
+
+public:
+  typedef S value_type;
+  typedef void proto_type;
+
+  explicit ScalarExpr(S s) : s_(s) {}
+
+  template <typename F> void visit(F &) const {}
+  void bind(const std::vector<const size_t *> &, const std::vector<size_t> &, size_t &) {}
+  template <typename DIM> void column(DIM) {}
+  value_type value(size_t, bool &) const { return s_; }
+};
+
+template <typename E> class is_expr {
+public:
+  static const bool value = false;
+};
+template <typename TS> class is_expr<LeafExpr<TS>> {
+public:
+  static const bool value = true;
+};
+template <typename S> class is_expr<ScalarExpr<S>> {
+public:
+  static const bool value = true;
+};
+
+template <typename E> auto evaluate(const E &expr);
+
+// interior node, applies one of the functors in functors.hpp to its two subtrees
+template <template <typename, typename> class Pred, typename L, typename R> class BinaryExpr {
+private:
+  L lhs_;
+  R rhs_;
+  // the functors have non-const call operators
+  mutable Pred<typename L::value_type, typename R::value_type> pred_;
+
+public:
+  typedef typename Pred<typename L::value_type, typename R::value_type>::RT value_type;
+  typedef typename std::conditional<std::is_void<typename L::proto_type>::value, typename R::proto_type,
+                                    typename L::proto_type>::type proto_type;
+  typedef typename series_traits<proto_type>::template rebind<value_type> result_type;
+
+  BinaryExpr(const L &lhs, const R &rhs) : lhs_(lhs), rhs_(rhs), pred_() {}
+
+  template <typename F> void visit(F &f) const {
+    lhs_.visit(f);
+    rhs_.visit(f);
+  }
+  void bind(const std::vector<const size_t *> &rows, const std::vector<size_t> &offsets, size_t &leaf) {
+    lhs_.bind(rows, offsets, leaf);
+    rhs_.bind(rows, offsets, leaf);
+  }
+  template <typename DIM> void column(DIM nc) {
+    lhs_.column(nc);
+    rhs_.column(nc);
+  }
+  // stops at the first NA so the functor never sees one
+  value_type value(size_t k, bool &na) const {
+    const auto l = lhs_.value(k, na);
+    if (na) { return value_type(); }
+    const auto r = rhs_.value(k, na);
+    if (na) { return value_type(); }
+    return pred_(l, r);
+  }
+
+  // evaluates the tree when it is assigned to a series
+  operator result_type() const { return evaluate(*this); }
+};
+
+template <template <typename, typename> class Pred, typename L, typename R> class is_expr<BinaryExpr<Pred, L, R>> {
+public:
+  static const bool value = true;
+};
+
+// starts an expression from a series
+template <typename TS> typename std::enable_if<series_traits<TS>::value, LeafExpr<TS>>::type lazy(const TS &ts) {
+  return LeafExpr<TS>(ts);
+}
+
+namespace detail {
+
+// turns an operand of an expression operator into a tree node
+template <typename E> typename std::enable_if<is_expr<E>::value, E>::type as_expr(const E &e) { return e; }
+template <typename TS> typename std::enable_if<series_traits<TS>::value, LeafExpr<TS>>::type as_expr(const TS &ts) {
+  return LeafExpr<TS>(ts);
+}
+template <typename S> typename std::enable_if<std::is_arithmetic<S>::value, ScalarExpr<S>>::type as_expr(const S &s) {
+  return ScalarExpr<S>(s);
+}
+
+// the operators only kick in when at least one side is already an expression
+template <typename L, typename R> class expr_operands {
+private:
+  template <typename T> using operand = std::integral_constant<bool, is_expr<T>::value || series_traits<T>::value ||
+                                                                         std::is_arithmetic<T>::value>;
+
+public:
+  static const bool value = (is_expr<L>::value || is_expr<R>::value) && operand<L>::value && operand<R>::value;
+};
+
+template <template <typename, typename> class Pred, typename L, typename R>
+BinaryExpr<Pred, decltype(as_expr(std::declval<L>())), decltype(as_expr(std::declval<R>()))>
+make_binary_expr(const L &lhs, const R &rhs) {
+  return BinaryExpr<Pred, decltype(as_expr(lhs)), decltype(as_expr(rhs))>(as_expr(lhs), as_expr(rhs));
+}
+
+} // namespace detail
+
+template <typename L, typename R, typename = typename std::enable_if<detail::expr_operands<L, R>::value>::type>
+auto operator+(const L &lhs, const R &rhs) {
+  return detail::make_binary_expr<PlusFunctor>(lhs, rhs);
+}
+
+template <typename L, typename R, typename = typename std::enable_if<detail::expr_operands<L, R>::value>::type>
+auto operator-(const L &lhs, const R &rhs) {
+  return detail::make_binary_expr<MinusFunctor>(lhs, rhs);
+}
+
+template <typename L, typename R, typename = typename std::enable_if<detail::expr_operands<L, R>::value>::type>
+auto operator*(const L &lhs, const R &rhs) {
+  return detail::make_binary_expr<MultiplyFunctor>(lhs, rhs);
+}
+
+template <typename L, typename R, typename = typename std::enable_if<detail::expr_operands<L, R>::value>::type>
+auto operator/(const L &lhs, const R &rhs) {
+  return detail::make_binary_expr<DivideFunctor>(lhs, rhs);
+}
+
+// runs the expression: one alignment of all the series in it, one result allocation, one pass per column
+template <typename E> auto evaluate(const E &expr) {
+  typedef typename E::result_type result_type;
+  typedef typename E::proto_type::const_index_iterator index_iterator;
+
+  // local copy, binding and moving across columns updates the leaves
+  E e(expr);
+
+  std::vector<std::pair<index_iterator, index_iterator>> ranges;
+  std::vector<std::vector<std::string>> names;
+  size_t ncol{0};
+  auto collect = [&](const auto &ts) {
+    ranges.push_back(std::make_pair(ts.index_begin(), ts.index_end()));
+    names.push_back(ts.getColnames());
+    ncol = std::max(ncol, static_cast<size_t>(ts.ncol()));
+  };
+  e.visit(collect);
+  auto check = [ncol](const auto &ts) {
+    if (static_cast<size_t>(ts.ncol()) != ncol && ts.ncol() != 1) {
+      throw std::logic_error("Number of colums must match. or one time series must be a single column.");
+    }
+  };
+  e.visit(check);
+
+  // the usual case is every series on the same index, which needs no alignment at all
+  const size_t nleaves{ranges.size()};
+  bool identical{true};
+  for (size_t i = 1; i < nleaves && identical; ++i) {
+    identical = classify_alignment(ranges[0].first, ranges[0].second, ranges[i].first, ranges[i].second).kind ==
+                Alignment::identical;
+  }
+
+  MultiIntersection rows;
+  std::vector<const size_t *> row_ptrs(nleaves, nullptr);
+  std::vector<size_t> offsets(nleaves, 0);
+  size_t nrow{static_cast<size_t>(std::distance(ranges[0].first, ranges[0].second))};
+  if (!identical) {
+    rows = multi_intersection_map(ranges);
+    nrow = rows.size();
+    for (size_t i = 0; i < nleaves; ++i) {
+      // contiguous blocks are read with an offset instead of through the row map
+      if (rows.contiguous(i)) {
+        offsets[i] = nrow ? rows.rows[i].front() : 0;
+      } else {
+        row_ptrs[i] = rows.rows[i].data();
+      }
+    }
+  }
+  size_t leaf{0};
+  e.bind(row_ptrs, offsets, leaf);
+
+  result_type res(nrow, ncol);
+  for (const auto &n : names) {
+    if (res.setColnames(n)) { break; }
+  }
+  auto idx{res.index_begin()};
+  for (size_t k = 0; k < nrow; ++k, ++idx) { *idx = ranges[0].first[row_ptrs[0] ? row_ptrs[0][k] : offsets[0] + k]; }
+
+  typedef typename E::value_type RV;
+  for (size_t nc = 0; nc < ncol; ++nc) {
+    e.column(nc);
+    auto res_col{res.col_begin(nc)};
+    for (size_t k = 0; k < nrow; ++k, ++res_col) {
+      bool na{false};
+      const RV v{e.value(k, na)};
+      *res_col = na ? series_traits<result_type>::template NA<RV>() : v;
+    }
+  }
+  return res;
+}
+
+} // namespace tslib
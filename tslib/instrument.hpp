@@ -0,0 +1,253 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tslib {
+namespace instrument {
+
+// per operation counters for the hot paths (binary_opp, nary_opp, joins, rolling, resample)
+//
+// built with TSLIB_INSTRUMENT defined, every call of an instrumented operation adds its counters to the global
+// Registry when it returns: rows in and out, index matches, bytes allocated for the result, NAs written, wall time
+// without it Scope is empty and every call on it compiles away, and the extra work that only feeds the counters
+// (eg counting NAs) is skipped behind the constant enabled
+// the registry is there in both builds, so code that dumps it doesn't need the flag
+// TSLIB_INSTRUMENT changes the inline functions of the library, every translation unit of a program has to agree
+#ifdef TSLIB_INSTRUMENT
+const bool enabled{true};
+#else
+const bool enabled{false};
+#endif
+
+class OpStats {
+public:
+  std::uint64_t calls;
+  std::uint64_t rows_in;
+  std::uint64_t rows_out;
+  // rows paired by the index alignment (intersection or join map)
+  std::uint64_t matches;
+  std::uint64_t bytes_allocated;
+  std::uint64_t na_out;
+  std::uint64_t nanos;
+
+  OpStats() : calls{0}, rows_in{0}, rows_out{0}, matches{0}, bytes_allocated{0}, na_out{0}, nanos{0} {}
+  OpStats &operator+=(const OpStats &s) {
+    calls += s.calls;
+    rows_in += s.rows_in;
+    rows_out += s.rows_out;
+    matches += s.matches;
+    bytes_allocated += s.bytes_allocated;
+    na_out += s.na_out;
+    nanos += s.nanos;
+    return *this;
+  }
+};
+
+// one call of an operation, times in nanoseconds since the registry was created
+class TraceEvent {
+public:
+  std::string op;
+  std::uint64_t thread;
+  std::uint64_t start;
+  std::uint64_t duration;
+};
+
+class Registry {
+private:
+  typedef std::chrono::steady_clock clock;
+  mutable std::mutex mutex_;
+  std::map<std::string, OpStats> ops_;
+  bool tracing_;
+  size_t max_events_;
+  std::vector<TraceEvent> events_;
+  const clock::time_point epoch_;
+
+  static std::string escape(const std::string &s) {
+    std::string res;
+    for (char c : s) {
+      if (c == '"' || c == '\\') { res += '\\'; }
+      res += c;
+    }
+    return res;
+  }
+
+public:
+  Registry() : mutex_{}, ops_{}, tracing_{false}, max_events_{0}, events_{}, epoch_{clock::now()} {}
+  Registry(const Registry &) = delete;
+  Registry &operator=(const Registry &) = delete;
+
+  // the registry instrumented operations record into
+  static Registry &global() {
+    static Registry registry;
+    return registry;
+  }
+
+  // adds one call of op, started at start
+  void record(const char *op, const OpStats &stats, clock::time_point start) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ops_[op] += stats;
+    if (tracing_ && events_.size() < max_events_) {
+      const auto since{std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch_).count()};
+      events_.push_back(TraceEvent{op, std::hash<std::thread::id>()(std::this_thread::get_id()),
+                                   static_cast<std::uint64_t>(since), stats.nanos});
+    }
+  }
+
+  // keeps a trace event for every call from now on, up to max_events of them
+  void set_tracing(bool on, size_t max_events = size_t(1) << 16) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracing_    = on;
+    max_events_ = max_events;
+  }
+
+  std::map<std::string, OpStats> stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ops_;
+  }
+
+  std::vector<TraceEvent> trace() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+  }
+
+  // drops the counters and the trace events
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ops_.clear();
+    events_.clear();
+  }
+
+  // {"op": {"calls": n, ...}, ...}
+  std::string to_json() const {
+    const std::map<std::string, OpStats> ops(stats());
+    std::string res{"{"};
+    char buf[512];
+    for (const auto &op : ops) {
+      const OpStats &s{op.second};
+      std::snprintf(buf, sizeof(buf),
+                    "%s\"%s\": {\"calls\": %llu, \"rows_in\": %llu, \"rows_out\": %llu, \"matches\": %llu, "
+                    "\"bytes_allocated\": %llu, \"na_out\": %llu, \"seconds\": %.9f}",
+                    res.size() > 1 ? ", " : "", escape(op.first).c_str(), static_cast<unsigned long long>(s.calls),
+                    static_cast<unsigned long long>(s.rows_in), static_cast<unsigned long long>(s.rows_out),
+                    static_cast<unsigned long long>(s.matches), static_cast<unsigned long long>(s.bytes_allocated),
+                    static_cast<unsigned long long>(s.na_out), static_cast<double>(s.nanos) * 1e-9);
+      res += buf;
+    }
+    return res + "}";
+  }
+
+  // prometheus text exposition format, one counter family per field labelled by op
+  std::string to_prometheus() const {
+    const std::map<std::string, OpStats> ops(stats());
+    struct Field {
+      const char *name;
+      const char *help;
+      std::uint64_t OpStats::*member;
+    };
+    const Field fields[] = {{"calls", "Calls of the operation.", &OpStats::calls},
+                            {"rows_in", "Rows read by the operation.", &OpStats::rows_in},
+                            {"rows_out", "Rows written by the operation.", &OpStats::rows_out},
+                            {"matches", "Rows paired by index alignment.", &OpStats::matches},
+                            {"bytes_allocated", "Bytes allocated for results.", &OpStats::bytes_allocated},
+                            {"na_out", "NA values written.", &OpStats::na_out}};
+    std::string res;
+    char buf[256];
+    for (const Field &f : fields) {
+      std::snprintf(buf, sizeof(buf), "# HELP tslib_op_%s_total %s\n# TYPE tslib_op_%s_total counter\n", f.name, f.help,
+                    f.name);
+      res += buf;
+      for (const auto &op : ops) {
+        std::snprintf(buf, sizeof(buf), "tslib_op_%s_total{op=\"%s\"} %llu\n", f.name, escape(op.first).c_str(),
+                      static_cast<unsigned long long>(op.second.*f.member));
+        res += buf;
+      }
+    }
+    res += "# HELP tslib_op_seconds_total Wall time spent in the operation.\n# TYPE tslib_op_seconds_total counter\n";
+    for (const auto &op : ops) {
+      std::snprintf(buf, sizeof(buf), "tslib_op_seconds_total{op=\"%s\"} %.9f\n", escape(op.first).c_str(),
+                    static_cast<double>(op.second.nanos) * 1e-9);
+      res += buf;
+    }
+    return res;
+  }
+
+  // the trace events in chrome's trace event format, times in microseconds
+  std::string trace_json() const {
+    const std::vector<TraceEvent> events(trace());
+    std::string res{"{\"traceEvents\": ["};
+    char buf[256];
+    for (size_t k = 0; k < events.size(); ++k) {
+      const TraceEvent &e{events[k]};
+      std::snprintf(buf, sizeof(buf),
+                    "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %llu, \"ts\": %.3f, \"dur\": %.3f}",
+                    k ? ", " : "", escape(e.op).c_str(), static_cast<unsigned long long>(e.thread % 1000000),
+                    static_cast<double>(e.start) * 1e-3, static_cast<double>(e.duration) * 1e-3);
+      res += buf;
+    }
+    return res + "]}";
+  }
+};
+
+// counters of one call of an operation, added to the global registry when the scope ends
+#ifdef TSLIB_INSTRUMENT
+class Scope {
+private:
+  const char *op_;
+  OpStats stats_;
+  std::chrono::steady_clock::time_point start_;
+
+public:
+  explicit Scope(const char *op) : op_{op}, stats_{}, start_{std::chrono::steady_clock::now()} { stats_.calls = 1; }
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  ~Scope() {
+    stats_.nanos = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+    Registry::global().record(op_, stats_, start_);
+  }
+  void rows_in(size_t n) { stats_.rows_in += n; }
+  void rows_out(size_t n) { stats_.rows_out += n; }
+  void matches(size_t n) { stats_.matches += n; }
+  void bytes_allocated(size_t n) { stats_.bytes_allocated += n; }
+  void na_out(size_t n) { stats_.na_out += n; }
+};
+#else
+class Scope {
+public:
+  explicit Scope(const char *) {}
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  void rows_in(size_t) {}
+  void rows_out(size_t) {}
+  void matches(size_t) {}
+  void bytes_allocated(size_t) {}
+  void na_out(size_t) {}
+};
+#endif
+
+} // namespace instrument
+} // namespace tslib
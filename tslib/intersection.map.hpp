@@ -16,14 +16,21 @@
 ///////////////////////////////////////////////////////////////////////////
 #pragma once
 #include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
 #include <utility>
 #include <vector>
 
+#include <tslib/iterator.traits.hpp>
+#include <tslib/simd.kernels.hpp>
+
 namespace tslib {
 
 // templated function that takes in 4 iterators (2 begins and 2 ends) of time series' indices
 // finds the locations in the 2 vectors that intersect
-template <typename T> std::vector<std::pair<size_t, size_t>> intersection_map(T xbeg, T xend, T ybeg, T yend) {
+// plain two pointer merge, kept as the reference implementation for intersection_map
+template <typename T> std::vector<std::pair<size_t, size_t>> linear_intersection_map(T xbeg, T xend, T ybeg, T yend) {
   // max size of intersection is the smaller of the two series
   typename std::iterator_traits<T>::difference_type max_size{
       std::min(std::distance(xbeg, xend), std::distance(ybeg, yend))};
@@ -53,4 +60,417 @@ template <typename T> std::vector<std::pair<size_t, size_t>> intersection_map(T
   return res;
 }
 
+namespace detail {
+
+// once one index is this many times longer than the other, intersecting gallops through the long one
+const size_t gallop_ratio{32};
+
+// first position in [p, end) that is not less than v, found by walking forward from p
+// cheap when the answer is close to p, which is the common case in a merge of similar length indexes
+template <typename R, typename T> R scan_lower_bound(R p, R end, const T &v) {
+  while (p != end && *p < v) { ++p; }
+  return p;
+}
+
+#ifdef TSLIB_SIMD_X86
+// compares a block of the index against v at once, the lanes less than v are a prefix because the index is sorted
+TSLIB_TARGET_AVX2 inline const std::int64_t *scan_lower_bound_avx2(const std::int64_t *p, const std::int64_t *end,
+                                                                   std::int64_t v) {
+  const __m256i vv = _mm256_set1_epi64x(v);
+  for (; end - p >= 4; p += 4) {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const int lt    = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vv, x)));
+    if (lt != 0xF) { return p + __builtin_popcount(lt); }
+  }
+  return scan_lower_bound(p, end, v);
+}
+
+TSLIB_TARGET_AVX2 inline const std::int32_t *scan_lower_bound_avx2(const std::int32_t *p, const std::int32_t *end,
+                                                                   std::int32_t v) {
+  const __m256i vv = _mm256_set1_epi32(v);
+  for (; end - p >= 8; p += 8) {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const int lt    = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vv, x)));
+    if (lt != 0xFF) { return p + __builtin_popcount(lt); }
+  }
+  return scan_lower_bound(p, end, v);
+}
+#endif
+
+inline const std::int64_t *scan_lower_bound(const std::int64_t *p, const std::int64_t *end, const std::int64_t &v) {
+  // most steps in a merge only move one element, don't pay for a vector load on those
+  if (p == end || !(*p < v)) { return p; }
+#ifdef TSLIB_SIMD_X86
+  if (simd::active_isa() >= simd::ISA::avx2) { return scan_lower_bound_avx2(p + 1, end, v); }
+#endif
+  return scan_lower_bound<const std::int64_t *, std::int64_t>(p + 1, end, v);
+}
+
+inline const std::int32_t *scan_lower_bound(const std::int32_t *p, const std::int32_t *end, const std::int32_t &v) {
+  if (p == end || !(*p < v)) { return p; }
+#ifdef TSLIB_SIMD_X86
+  if (simd::active_isa() >= simd::ISA::avx2) { return scan_lower_bound_avx2(p + 1, end, v); }
+#endif
+  return scan_lower_bound<const std::int32_t *, std::int32_t>(p + 1, end, v);
+}
+
+// first position in [p, end) that is not less than v, found by exponential search from p then a binary search
+// costs O(log distance) instead of O(distance)
+template <typename R, typename T> R gallop_lower_bound(R p, R end, const T &v) {
+  const size_t n{static_cast<size_t>(end - p)};
+  if (n == 0 || !(*p < v)) { return p; }
+  // p[lo] is always less than v
+  size_t lo{0}, hi{1};
+  while (hi < n && p[hi] < v) {
+    lo = hi;
+    hi *= 2;
+  }
+  return std::lower_bound(p + lo + 1, p + std::min(hi, n), v);
+}
+
+// first position in [p, end) where pred is false, pred must hold on a prefix of the range
+// same exponential then binary search as gallop_lower_bound
+template <typename R, typename P> R gallop_partition(R p, R end, P pred) {
+  const size_t n{static_cast<size_t>(end - p)};
+  if (n == 0 || !pred(*p)) { return p; }
+  // pred(p[lo]) always holds
+  size_t lo{0}, hi{1};
+  while (hi < n && pred(p[hi])) {
+    lo = hi;
+    hi *= 2;
+  }
+  return std::partition_point(p + lo + 1, p + std::min(hi, n), pred);
+}
+
+// first position in [p, end) that is greater than v
+template <typename R, typename T> R gallop_upper_bound(R p, R end, const T &v) {
+  return gallop_partition(p, end, [&v](const T &x) { return !(v < x); });
+}
+
+// walks the short index and gallops through the long one
+// emit(short position, long position) is called for every match
+template <typename R, typename F> void gallop_intersect(R sbeg, R send, R lbeg, R lend, F emit) {
+  R lp{lbeg};
+  for (R sp = sbeg; sp != send; ++sp) {
+    lp = gallop_lower_bound(lp, lend, *sp);
+    if (lp == lend) { return; }
+    if (!(*sp < *lp)) {
+      emit(static_cast<size_t>(sp - sbeg), static_cast<size_t>(lp - lbeg));
+      ++lp;
+    }
+  }
+}
+
+// adaptive intersection over random access ranges, emit(x position, y position) is called for every match
+// gallops through the longer index when the lengths are far apart, otherwise merges with block scans
+template <typename R, typename F> void intersect(R xbeg, R xend, R ybeg, R yend, F emit) {
+  const size_t xlen{static_cast<size_t>(xend - xbeg)}, ylen{static_cast<size_t>(yend - ybeg)};
+  if (xlen == 0 || ylen == 0) { return; }
+
+  if (xlen / ylen >= gallop_ratio) {
+    gallop_intersect(ybeg, yend, xbeg, xend, [&emit](size_t y, size_t x) { emit(x, y); });
+  } else if (ylen / xlen >= gallop_ratio) {
+    gallop_intersect(xbeg, xend, ybeg, yend, emit);
+  } else {
+    R xp{xbeg}, yp{ybeg};
+    while (xp != xend && yp != yend) {
+      if (*xp < *yp) {
+        xp = scan_lower_bound(xp, xend, *yp);
+      } else if (*yp < *xp) {
+        yp = scan_lower_bound(yp, yend, *xp);
+      } else {
+        emit(static_cast<size_t>(xp - xbeg), static_cast<size_t>(yp - ybeg));
+        ++xp;
+        ++yp;
+      }
+    }
+  }
+}
+
+// runs intersect over raw pointers when the index is contiguous so the simd scans apply
+template <typename T, typename F> void intersect(T xbeg, T xend, T ybeg, T yend, F emit, std::true_type) {
+  typedef const typename std::iterator_traits<T>::value_type *pointer;
+  if (xbeg == xend || ybeg == yend) { return; }
+  const pointer xp{to_pointer(xbeg)}, yp{to_pointer(ybeg)};
+  intersect(xp, xp + (xend - xbeg), yp, yp + (yend - ybeg), emit);
+}
+
+template <typename T, typename F> void intersect(T xbeg, T xend, T ybeg, T yend, F emit, std::false_type) {
+  intersect(xbeg, xend, ybeg, yend, emit);
+}
+
+} // namespace detail
+
+// finds the locations in the 2 sorted indexes that intersect
+// returns pairs of (position in x, position in y), same result as linear_intersection_map
+template <typename T> std::vector<std::pair<size_t, size_t>> intersection_map(T xbeg, T xend, T ybeg, T yend) {
+  // max size of intersection is the smaller of the two series
+  std::vector<std::pair<size_t, size_t>> res;
+  res.reserve(std::min(std::distance(xbeg, xend), std::distance(ybeg, yend)));
+  detail::intersect(xbeg, xend, ybeg, yend, [&res](size_t x, size_t y) { res.emplace_back(x, y); },
+                    std::integral_constant<bool, is_contiguous_iterator<T>::value>());
+  return res;
+}
+
+// structure of arrays version of the rowmap
+// x[k] and y[k] are the positions of the k-th common index value, so a consumer can gather each side as one stream
+class IntersectionIndex {
+public:
+  IntersectionIndex() : x{}, y{} {}
+  std::vector<size_t> x;
+  std::vector<size_t> y;
+  size_t size() const { return x.size(); }
+};
+
+// same as intersection_map but returns the positions as two separate vectors
+template <typename T> IntersectionIndex intersection_index(T xbeg, T xend, T ybeg, T yend) {
+  IntersectionIndex res;
+  const size_t max_size{static_cast<size_t>(std::min(std::distance(xbeg, xend), std::distance(ybeg, yend)))};
+  res.x.reserve(max_size);
+  res.y.reserve(max_size);
+  detail::intersect(xbeg, xend, ybeg, yend,
+                    [&res](size_t x, size_t y) {
+                      res.x.push_back(x);
+                      res.y.push_back(y);
+                    },
+                    std::integral_constant<bool, is_contiguous_iterator<T>::value>());
+  return res;
+}
+
+// positions of the values common to k sorted indexes
+// rows[i][k] is the position of the k-th common value in index i
+class MultiIntersection {
+public:
+  MultiIntersection() : rows{} {}
+  std::vector<std::vector<size_t>> rows;
+  // number of common values
+  size_t size() const { return rows.empty() ? 0 : rows[0].size(); }
+  // true when the common values are a contiguous block of index i, so it can be read as a plain stream
+  bool contiguous(size_t i) const { return size() == 0 || rows[i].back() - rows[i].front() + 1 == size(); }
+};
+
+// intersects k sorted indexes at once, given as (begin, end) pairs
+// leapfrog join: every index gallops to the current candidate value, which only ever increases,
+// so each index is searched once in total instead of once per pairwise merge
+// like intersection_map, a match consumes one row of every index
+template <typename T> MultiIntersection multi_intersection_map(const std::vector<std::pair<T, T>> &ranges) {
+  MultiIntersection res;
+  const size_t k{ranges.size()};
+  res.rows.resize(k);
+  if (k == 0) { return res; }
+
+  std::vector<T> cur(k);
+  size_t max_size{static_cast<size_t>(std::distance(ranges[0].first, ranges[0].second))};
+  for (size_t i = 0; i < k; ++i) {
+    cur[i]   = ranges[i].first;
+    max_size = std::min(max_size, static_cast<size_t>(std::distance(ranges[i].first, ranges[i].second)));
+  }
+  for (auto &r : res.rows) { r.reserve(max_size); }
+  if (max_size == 0) { return res; }
+
+  auto candidate = *cur[0];
+  while (true) {
+    // move every index up to the candidate until they all agree on it
+    bool agree{false};
+    while (!agree) {
+      agree = true;
+      for (size_t i = 0; i < k; ++i) {
+        cur[i] = detail::gallop_lower_bound(cur[i], ranges[i].second, candidate);
+        if (cur[i] == ranges[i].second) { return res; }
+        if (candidate < *cur[i]) {
+          candidate = *cur[i];
+          agree     = false;
+        }
+      }
+    }
+    for (size_t i = 0; i < k; ++i) {
+      res.rows[i].push_back(static_cast<size_t>(std::distance(ranges[i].first, cur[i])));
+      ++cur[i];
+    }
+    if (cur[0] == ranges[0].second) { return res; }
+    candidate = *cur[0];
+  }
+}
+
+// how the rows of two sorted indexes line up
+//  identical: both indexes are the same
+//  offset: one index is a contiguous sub-range of the other
+//  general: anything else, needs a full intersection_map
+enum class Alignment { identical, offset, general };
+
+// result of classify_alignment
+// for identical and offset alignments the common rows are x[x_offset, x_offset + length) and y[y_offset, y_offset + length)
+class AlignmentInfo {
+public:
+  Alignment kind;
+  size_t x_offset;
+  size_t y_offset;
+  size_t length;
+};
+
+// works out whether two sorted indexes can be aligned without building a rowmap
+// costs one binary search and one streaming compare of the shorter index
+template <typename T> AlignmentInfo classify_alignment(T xbeg, T xend, T ybeg, T yend) {
+  const size_t xlen{static_cast<size_t>(std::distance(xbeg, xend))};
+  const size_t ylen{static_cast<size_t>(std::distance(ybeg, yend))};
+  // nothing to intersect
+  if (xlen == 0 || ylen == 0) { return AlignmentInfo{Alignment::offset, 0, 0, 0}; }
+  // both read the same storage, eg two series sharing one index, no need to compare
+  if (xlen == ylen && std::addressof(*xbeg) == std::addressof(*ybeg)) {
+    return AlignmentInfo{Alignment::identical, 0, 0, xlen};
+  }
+
+  if (xlen <= ylen) {
+    // look for x as a block inside y
+    const T pos{std::lower_bound(ybeg, yend, *xbeg)};
+    const size_t off{static_cast<size_t>(std::distance(ybeg, pos))};
+    if (ylen - off >= xlen && std::equal(xbeg, xend, pos)) {
+      return AlignmentInfo{xlen == ylen ? Alignment::identical : Alignment::offset, 0, off, xlen};
+    }
+  } else {
+    // look for y as a block inside x
+    const T pos{std::lower_bound(xbeg, xend, *ybeg)};
+    const size_t off{static_cast<size_t>(std::distance(xbeg, pos))};
+    if (xlen - off >= ylen && std::equal(ybeg, yend, pos)) { return AlignmentInfo{Alignment::offset, off, 0, ylen}; }
+  }
+  return AlignmentInfo{Alignment::general, 0, 0, 0};
+}
+
+// splits a rowmap into stretches where both sides advance one row at a time
+// returns pairs of (position in the rowmap, length of the stretch)
+inline std::vector<std::pair<size_t, size_t>> contiguous_runs(const std::vector<std::pair<size_t, size_t>> &rowmap) {
+  std::vector<std::pair<size_t, size_t>> res;
+  size_t start{0};
+  for (size_t k = 1; k <= rowmap.size(); ++k) {
+    // close the stretch at the end of the map or when either side skips a row
+    if (k == rowmap.size() || rowmap[k].first != rowmap[k - 1].first + 1 ||
+        rowmap[k].second != rowmap[k - 1].second + 1) {
+      res.push_back(std::make_pair(start, k - start));
+      start = k;
+    }
+  }
+  return res;
+}
+
+// position used in a join map for a row that has no partner on the other side
+const size_t no_match{static_cast<size_t>(-1)};
+
+// which rhs row an as-of join takes for a lhs row
+//  backward: the last rhs row at or before it
+//  forward: the first rhs row at or after it
+enum class AsofDirection { backward, forward };
+
+namespace detail {
+
+// walks the lhs index in runs of rows that share the same as-of rhs row
+// emit(from, to, y) is called for the lhs rows [from, to), y is no_match for rows with nothing in range
+// both sides gallop, so a sparse rhs costs one search per rhs row and a sparse lhs one search per lhs row
+// rows further than tol from their rhs row are no_match when limited is set
+template <typename R, typename T, typename F>
+void asof_runs(R xbeg, R xend, R ybeg, R yend, const T &tol, bool limited, AsofDirection dir, F emit) {
+  const size_t xlen{static_cast<size_t>(xend - xbeg)};
+  if (ybeg == yend) {
+    emit(size_t(0), xlen, no_match);
+    return;
+  }
+  R xp{xbeg}, yp{ybeg};
+  if (dir == AsofDirection::backward) {
+    // rows before the first rhs value have nothing to look back to
+    xp = gallop_lower_bound(xbeg, xend, *ybeg);
+    emit(size_t(0), static_cast<size_t>(xp - xbeg), no_match);
+    while (xp != xend) {
+      // last of the rhs rows at or before *xp, *yp is never past *xp here so the search moves forward
+      yp = gallop_upper_bound(yp, yend, *xp) - 1;
+      const R ynext{yp + 1};
+      // the following lhs rows up to the next rhs value look back to the same row
+      const R xn{ynext == yend ? xend : gallop_lower_bound(xp, xend, *ynext)};
+      const T y{*yp};
+      const R fresh{limited ? gallop_partition(xp, xn, [&](const T &x) { return !(tol < x - y); }) : xn};
+      emit(static_cast<size_t>(xp - xbeg), static_cast<size_t>(fresh - xbeg), static_cast<size_t>(yp - ybeg));
+      emit(static_cast<size_t>(fresh - xbeg), static_cast<size_t>(xn - xbeg), no_match);
+      xp = xn;
+    }
+  } else {
+    while (xp != xend) {
+      // first of the rhs rows at or after *xp
+      yp = gallop_lower_bound(yp, yend, *xp);
+      if (yp == yend) {
+        emit(static_cast<size_t>(xp - xbeg), xlen, no_match);
+        return;
+      }
+      const T y{*yp};
+      // every lhs row up to y looks ahead to the same row, the ones too far ahead of it come first
+      const R xn{gallop_upper_bound(xp, xend, y)};
+      const R fresh{limited ? gallop_partition(xp, xn, [&](const T &x) { return tol < y - x; }) : xp};
+      emit(static_cast<size_t>(xp - xbeg), static_cast<size_t>(fresh - xbeg), no_match);
+      emit(static_cast<size_t>(fresh - xbeg), static_cast<size_t>(xn - xbeg), static_cast<size_t>(yp - ybeg));
+      xp = xn;
+    }
+  }
+}
+
+} // namespace detail
+
+namespace detail {
+template <typename T>
+std::vector<std::pair<size_t, size_t>> asof_map(T xbeg, T xend, T ybeg, T yend, AsofDirection dir,
+                                                const typename std::iterator_traits<T>::value_type &tol, bool limited) {
+  std::vector<std::pair<size_t, size_t>> res(static_cast<size_t>(std::distance(xbeg, xend)));
+  asof_runs(xbeg, xend, ybeg, yend, tol, limited, dir, [&res](size_t from, size_t to, size_t y) {
+    for (size_t k = from; k < to; ++k) { res[k] = std::make_pair(k, y); }
+  });
+  return res;
+}
+} // namespace detail
+
+// as-of join map, one pair (position in x, position in y) for every row of x in order
+// the y position is the as-of row of the other index, or no_match
+template <typename T>
+std::vector<std::pair<size_t, size_t>> asof_map(T xbeg, T xend, T ybeg, T yend,
+                                                AsofDirection dir = AsofDirection::backward) {
+  return detail::asof_map(xbeg, xend, ybeg, yend, dir, typename std::iterator_traits<T>::value_type(), false);
+}
+
+// same thing with a limit on how far apart the two index values may be, rows past it are no_match
+template <typename T>
+std::vector<std::pair<size_t, size_t>> asof_map(T xbeg, T xend, T ybeg, T yend, AsofDirection dir,
+                                                const typename std::iterator_traits<T>::value_type &max_staleness) {
+  return detail::asof_map(xbeg, xend, ybeg, yend, dir, max_staleness, true);
+}
+
+// left join map, one pair (position in x, position in y) for every row of x in order
+// the y position is the matching row of the other index, or no_match
+template <typename T> std::vector<std::pair<size_t, size_t>> left_join_map(T xbeg, T xend, T ybeg, T yend) {
+  const size_t xlen{static_cast<size_t>(std::distance(xbeg, xend))};
+  std::vector<std::pair<size_t, size_t>> res;
+  res.reserve(xlen);
+  for (size_t k = 0; k < xlen; ++k) { res.emplace_back(k, no_match); }
+  detail::intersect(xbeg, xend, ybeg, yend, [&res](size_t x, size_t y) { res[x].second = y; },
+                    std::integral_constant<bool, is_contiguous_iterator<T>::value>());
+  return res;
+}
+
+// outer join map, one pair (position in x, position in y) for every value of either index in order
+// a value only in one index has no_match for the other side, a match consumes one row of each as in intersection_map
+// runs of rows that are only on one side are found with a gallop
+template <typename T> std::vector<std::pair<size_t, size_t>> outer_join_map(T xbeg, T xend, T ybeg, T yend) {
+  std::vector<std::pair<size_t, size_t>> res;
+  res.reserve(static_cast<size_t>(std::max(std::distance(xbeg, xend), std::distance(ybeg, yend))));
+  T xp{xbeg}, yp{ybeg};
+  while (xp != xend || yp != yend) {
+    if (yp == yend || (xp != xend && *xp < *yp)) {
+      const T xn{yp == yend ? xend : detail::gallop_lower_bound(xp, xend, *yp)};
+      for (; xp != xn; ++xp) { res.emplace_back(static_cast<size_t>(std::distance(xbeg, xp)), no_match); }
+    } else if (xp == xend || *yp < *xp) {
+      const T yn{xp == xend ? yend : detail::gallop_lower_bound(yp, yend, *xp)};
+      for (; yp != yn; ++yp) { res.emplace_back(no_match, static_cast<size_t>(std::distance(ybeg, yp))); }
+    } else {
+      res.emplace_back(static_cast<size_t>(std::distance(xbeg, xp)), static_cast<size_t>(std::distance(ybeg, yp)));
+      ++xp;
+      ++yp;
+    }
+  }
+  return res;
+}
+
 } // namespace tslib
@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <tslib/arena.hpp>
+
+namespace tslib {
+
+// trait that tells whether an iterator walks contiguous memory, so that loops can drop to raw pointers
+// raw pointers and std::vector iterators are contiguous, backends with other storage can specialize this
+template <typename T> class is_contiguous_iterator {
+private:
+  typedef typename std::iterator_traits<T>::value_type value_type;
+  // iterators of a vector with allocator A
+  template <typename A>
+  using vector_iterator = std::integral_constant<bool, std::is_same<T, typename std::vector<value_type, A>::iterator>::value ||
+                                                           std::is_same<T, typename std::vector<value_type, A>::const_iterator>::value>;
+
+public:
+  static const bool value = std::is_pointer<T>::value ||
+                            (!std::is_same<value_type, bool>::value &&
+                             (vector_iterator<std::allocator<value_type>>::value ||
+                              vector_iterator<ArenaAllocator<value_type>>::value));
+};
+
+// pointer to the element an iterator refers to
+// only valid for contiguous iterators that are dereferenceable (ie not an end iterator)
+template <typename T> auto to_pointer(T iter) -> decltype(std::addressof(*iter)) { return std::addressof(*iter); }
+
+} // namespace tslib
@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <tslib/execution.hpp>
+#include <tslib/functors.hpp>
+#include <tslib/instrument.hpp>
+#include <tslib/intersection.map.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// alignments that keep the rows binary_opp's exact intersection drops
+//
+// every join builds a map of (lhs row, rhs row) pairs in one pass over the two indexes (see intersection.map.hpp)
+// and fills the result from it, the functors from functors.hpp combine the rows both sides have
+// a result row with no partner on one side, or an NA on either side, is NA
+//  inner: rows whose index is in both series, same result as binary_opp
+//  left: every row of lhs
+//  outer: every row of either series, indexed by whichever side has it
+// as-of joins keep every row of lhs and pair it with the nearest rhs row before (or after) it instead of an exact
+// match, optionally no further away than a staleness limit given in index units (days for the date policies)
+enum class JoinType { inner, left, outer };
+
+namespace detail {
+
+// result series of Pred over lhs and rhs, with the colnames binary_opp would give it
+template <template <typename, typename> class Pred, typename L, typename R>
+auto join_result(const L &lhs, const R &rhs, size_t nrow) {
+  typedef typename Pred<typename L::value_type, typename R::value_type>::RT RT;
+  typedef typename series_traits<L>::template rebind<RT> result_type;
+  if (lhs.ncol() != rhs.ncol() && lhs.ncol() != 1 && rhs.ncol() != 1) {
+    throw std::logic_error("Number of colums must match. or one time series must be a single column.");
+  }
+  result_type res(static_cast<decltype(lhs.nrow())>(nrow), std::max(lhs.ncol(), rhs.ncol()));
+  if (lhs.getColnamesSize() >= rhs.getColnamesSize()) {
+    copy_colnames(res, lhs);
+  } else if (rhs.hasColnames()) {
+    copy_colnames(res, rhs);
+  }
+  return res;
+}
+
+// masks of the ncol columns of a join result, a row is valid where both sides have a row and both mark it valid
+template <typename L, typename R>
+std::vector<ValidityMask> join_masks(const L &lhs, const R &rhs, size_t ncol,
+                                     const std::vector<std::pair<size_t, size_t>> &rowmap) {
+  const std::vector<ValidityMask> lhs_masks(operand_masks(lhs)), rhs_masks(operand_masks(rhs));
+  std::vector<ValidityMask> res;
+  for (size_t c = 0; c < ncol; ++c) {
+    const ValidityMask &l{lhs_masks[lhs.ncol() == 1 ? 0 : c]}, &r{rhs_masks[rhs.ncol() == 1 ? 0 : c]};
+    ValidityMask m(rowmap.size(), false);
+    for (size_t k = 0; k < rowmap.size(); ++k) {
+      const auto p(rowmap[k]);
+      m.set(k, p.first != no_match && p.second != no_match && l.test(p.first) && r.test(p.second));
+    }
+    res.push_back(std::move(m));
+  }
+  return res;
+}
+
+// fills the index and columns of res from a join map
+// when either side keeps validity masks res gets the masks from join_masks and only their valid rows call Pred
+template <template <typename, typename> class Pred, typename L, typename R, typename RES>
+void join_fill(const L &lhs, const R &rhs, RES &res, const std::vector<std::pair<size_t, size_t>> &rowmap,
+               ExecutionPolicy &policy) {
+  typedef typename L::value_type U;
+  typedef typename R::value_type V;
+  typedef typename RES::value_type RV;
+
+  auto idx{res.index_begin()};
+  const auto lhs_idx{lhs.index_begin()};
+  const auto rhs_idx{rhs.index_begin()};
+  for (auto m : rowmap) {
+    *idx = m.first != no_match ? lhs_idx[m.first] : rhs_idx[m.second];
+    ++idx;
+  }
+
+  const size_t ncol{static_cast<size_t>(res.ncol())};
+  const bool masked{keeps_masks<RES>::value && (has_validity(lhs) || has_validity(rhs))};
+  std::vector<ValidityMask> masks;
+  if (masked) { masks = join_masks(lhs, rhs, ncol, rowmap); }
+  for_each_block(policy, rowmap.size(), ncol, sizeof(RV), [&](size_t c, size_t r0, size_t r1) {
+    Pred<U, V> pred;
+    const auto nc = static_cast<decltype(res.ncol())>(c);
+    const auto lhs_col{lhs.col_begin(lhs.ncol() == 1 ? 0 : nc)};
+    const auto rhs_col{rhs.col_begin(rhs.ncol() == 1 ? 0 : nc)};
+    auto res_col{res.col_begin(nc)};
+    std::advance(res_col, r0);
+    for (size_t k = r0; k < r1; ++k, ++res_col) {
+      const auto m(rowmap[k]);
+      if (masked ? !masks[c].test(k) : m.first == no_match || m.second == no_match) {
+        *res_col = series_traits<RES>::template NA<RV>();
+        continue;
+      }
+      const U lhs_val{lhs_col[m.first]};
+      const V rhs_val{rhs_col[m.second]};
+      *res_col = !masked && (series_traits<L>::ISNA(lhs_val) || series_traits<R>::ISNA(rhs_val))
+                     ? series_traits<RES>::template NA<RV>()
+                     : pred(lhs_val, rhs_val);
+    }
+  });
+  if (masked) { set_series_masks(res, std::move(masks)); }
+}
+
+// the rhs rows of a join map on the lhs index, NA where there is no rhs row
+// a masked rhs gives a masked result, valid where the rhs row exists and is valid
+template <typename L, typename R>
+auto join_gather(const L &lhs, const R &rhs, const std::vector<std::pair<size_t, size_t>> &rowmap,
+                 ExecutionPolicy &policy) {
+  typedef typename R::value_type V;
+  typedef typename series_traits<R>::template rebind<V> result_type;
+  result_type res(lhs.nrow(), rhs.ncol());
+  copy_colnames(res, rhs);
+  std::copy(lhs.index_begin(), lhs.index_end(), res.index_begin());
+  const size_t ncol{static_cast<size_t>(res.ncol())};
+  const bool masked{keeps_masks<result_type>::value && has_validity(rhs)};
+  std::vector<ValidityMask> masks;
+  for (size_t c = 0; masked && c < ncol; ++c) {
+    const ValidityMask src(column_validity(rhs, c));
+    ValidityMask m(rowmap.size(), false);
+    for (size_t k = 0; k < rowmap.size(); ++k) { m.set(k, rowmap[k].second != no_match && src.test(rowmap[k].second)); }
+    masks.push_back(std::move(m));
+  }
+  for_each_block(policy, rowmap.size(), ncol, sizeof(V), [&](size_t c, size_t r0, size_t r1) {
+    const auto nc = static_cast<decltype(res.ncol())>(c);
+    const auto rhs_col{rhs.col_begin(nc)};
+    auto res_col{res.col_begin(nc)};
+    std::advance(res_col, r0);
+    for (size_t k = r0; k < r1; ++k, ++res_col) {
+      const size_t y{rowmap[k].second};
+      *res_col = y == no_match || (masked && !masks[c].test(k)) ? series_traits<R>::template NA<V>() : rhs_col[y];
+    }
+  });
+  if (masked) { set_series_masks(res, std::move(masks)); }
+  return res;
+}
+
+// counters of one join, the matches are the rows with both sides
+template <typename L, typename R, typename RES>
+void record_join(instrument::Scope &scope, const L &lhs, const R &rhs,
+                 const std::vector<std::pair<size_t, size_t>> &rowmap, const RES &res) {
+  scope.rows_in(static_cast<size_t>(lhs.nrow() + rhs.nrow()));
+  if (instrument::enabled) {
+    const auto both = [](const std::pair<size_t, size_t> &m) { return m.first != no_match && m.second != no_match; };
+    scope.matches(static_cast<size_t>(std::count_if(rowmap.begin(), rowmap.end(), both)));
+  }
+  record_result(scope, res);
+}
+
+template <typename TS>
+using join_index_t = typename std::iterator_traits<typename TS::const_index_iterator>::value_type;
+
+} // namespace detail
+
+// Pred applied to lhs and rhs aligned by the given join
+template <template <typename, typename> class Pred, typename L, typename R>
+auto join_opp(const L &lhs, const R &rhs, JoinType how, ExecutionPolicy &policy = default_execution()) {
+  instrument::Scope scope("join_opp");
+  const std::vector<std::pair<size_t, size_t>> rowmap(
+      how == JoinType::inner
+          ? intersection_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end())
+          : how == JoinType::left
+                ? left_join_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end())
+                : outer_join_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end()));
+  auto res(detail::join_result<Pred>(lhs, rhs, rowmap.size()));
+  detail::join_fill<Pred>(lhs, rhs, res, rowmap, policy);
+  detail::record_join(scope, lhs, rhs, rowmap, res);
+  return res;
+}
+
+// Pred applied to every row of lhs and its as-of row of rhs
+template <template <typename, typename> class Pred, typename L, typename R>
+auto asof_opp(const L &lhs, const R &rhs, AsofDirection dir = AsofDirection::backward,
+              ExecutionPolicy &policy = default_execution()) {
+  instrument::Scope scope("asof_opp");
+  const std::vector<std::pair<size_t, size_t>> rowmap(
+      asof_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end(), dir));
+  auto res(detail::join_result<Pred>(lhs, rhs, rowmap.size()));
+  detail::join_fill<Pred>(lhs, rhs, res, rowmap, policy);
+  detail::record_join(scope, lhs, rhs, rowmap, res);
+  return res;
+}
+
+// same thing, rows whose as-of row is more than max_staleness away give NA
+template <template <typename, typename> class Pred, typename L, typename R>
+auto asof_opp(const L &lhs, const R &rhs, AsofDirection dir, const detail::join_index_t<L> &max_staleness,
+              ExecutionPolicy &policy = default_execution()) {
+  instrument::Scope scope("asof_opp");
+  const std::vector<std::pair<size_t, size_t>> rowmap(
+      asof_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end(), dir, max_staleness));
+  auto res(detail::join_result<Pred>(lhs, rhs, rowmap.size()));
+  detail::join_fill<Pred>(lhs, rhs, res, rowmap, policy);
+  detail::record_join(scope, lhs, rhs, rowmap, res);
+  return res;
+}
+
+// the values of rhs carried onto the index of lhs, eg monthly fundamentals on a daily price index
+// rows of lhs with no as-of row in rhs are NA
+template <typename L, typename R>
+auto asof_align(const L &lhs, const R &rhs, AsofDirection dir = AsofDirection::backward,
+                ExecutionPolicy &policy = default_execution()) {
+  instrument::Scope scope("asof_align");
+  const std::vector<std::pair<size_t, size_t>> rowmap(
+      asof_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end(), dir));
+  auto res(detail::join_gather(lhs, rhs, rowmap, policy));
+  detail::record_join(scope, lhs, rhs, rowmap, res);
+  return res;
+}
+
+template <typename L, typename R>
+auto asof_align(const L &lhs, const R &rhs, AsofDirection dir, const detail::join_index_t<L> &max_staleness,
+                ExecutionPolicy &policy = default_execution()) {
+  instrument::Scope scope("asof_align");
+  const std::vector<std::pair<size_t, size_t>> rowmap(
+      asof_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end(), dir, max_staleness));
+  auto res(detail::join_gather(lhs, rhs, rowmap, policy));
+  detail::record_join(scope, lhs, rhs, rowmap, res);
+  return res;
+}
+
+} // namespace tslib
@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+#include <tslib/execution.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// copies of a series on another backend, eg between the column major VectorBackend and a row major backend
+//
+// a transpose read one column at a time writes across every row of the other layout, so the copy goes in tiles
+// of rows small enough to stay in cache: within a tile each column is read in order and the rows written are
+// the same few cache lines for every column
+
+namespace detail {
+// rows per tile, so that a tile of every column is about 32KB
+inline size_t layout_tile_rows(size_t ncol, size_t elem_size) {
+  const size_t tile_bytes{size_t(1) << 15};
+  return std::max<size_t>(8, tile_bytes / std::max<size_t>(1, ncol * elem_size));
+}
+} // namespace detail
+
+// ts on backend B, with the same index, values and colnames
+// the tiles are shared out with the given execution policy
+template <template <typename, typename, typename> class B, typename TS>
+auto relayout(const TS &ts, ExecutionPolicy &policy = default_execution()) {
+  typedef typename series_traits<TS>::template rebind_backend<B> result_type;
+  typedef typename TS::value_type V;
+  const size_t nrow{static_cast<size_t>(ts.nrow())}, ncol{static_cast<size_t>(ts.ncol())};
+  result_type res(ts.nrow(), ts.ncol());
+  std::copy(ts.index_begin(), ts.index_end(), res.index_begin());
+  res.setColnames(ts.getColnames());
+
+  const size_t tile{detail::layout_tile_rows(ncol, sizeof(V))};
+  const size_t ntiles{(nrow + tile - 1) / tile};
+  policy_for(policy, nrow * ncol).parallel_for(ntiles, [&](size_t t) {
+    const size_t r0{t * tile}, r1{std::min(nrow, r0 + tile)};
+    for (size_t c = 0; c < ncol; ++c) {
+      const auto nc = static_cast<decltype(ts.ncol())>(c);
+      auto src{ts.col_begin(nc)};
+      auto dst{res.col_begin(nc)};
+      std::advance(src, r0);
+      std::advance(dst, r0);
+      std::copy_n(src, r1 - r0, dst);
+    }
+  });
+  return res;
+}
+
+} // namespace tslib
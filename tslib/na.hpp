@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <tslib/tseries.hpp>
+#include <tslib/validity.hpp>
+
+namespace tslib {
+
+// NA handling through validity masks (see tslib/validity.hpp)
+// every function here works on any series, the columns without a stored mask get one built from their values
+// column_validity, the mask of a single column, is in tslib/tseries.hpp so binary_opp can use it
+
+// builds the masks of every column from its NA values and stores them in the backend
+// returns false if the backend can't keep masks
+template <typename TS> bool build_validity(TS &ts) {
+  std::vector<ValidityMask> masks;
+  for (size_t c = 0; c < static_cast<size_t>(ts.ncol()); ++c) {
+    const auto nc = static_cast<decltype(ts.ncol())>(c);
+    masks.push_back(ValidityMask::from_values(
+        ts.col_begin(nc), static_cast<size_t>(ts.nrow()),
+        [](const typename TS::value_type x) { return series_traits<TS>::ISNA(x); }));
+  }
+  return detail::set_series_masks(ts, std::move(masks));
+}
+
+// gives ts the masks and writes the NA value into every row they clear
+// a masked row then always holds NA, so code that only reads the values sees the same NAs as the masks
+// takes one mask of nrow rows per column, or none to drop them, returns false, leaving ts untouched, if the
+// sizes don't fit or the backend can't keep masks
+template <typename TS> bool set_validity(TS &ts, std::vector<ValidityMask> &&masks) {
+  typedef typename TS::value_type V;
+  if (!detail::keeps_masks<TS>::value) { return false; }
+  if (!masks.empty() && masks.size() != static_cast<size_t>(ts.ncol())) { return false; }
+  for (const auto &m : masks) {
+    if (m.size() != static_cast<size_t>(ts.nrow())) { return false; }
+  }
+  const V na{series_traits<TS>::template NA<V>()};
+  for (size_t c = 0; c < masks.size(); ++c) {
+    const auto col{ts.col_begin(static_cast<decltype(ts.ncol())>(c))};
+    masks[c].blocks([](size_t, size_t) {}, [&](size_t b, size_t e) { std::fill(col + b, col + e, na); },
+                    [&](size_t b, size_t e, std::uint64_t word) {
+                      for (size_t k = b; k < e; ++k) {
+                        if (!((word >> (k - b)) & 1)) { col[k] = na; }
+                      }
+                    });
+  }
+  return detail::set_series_masks(ts, std::move(masks));
+}
+
+// number of NAs in column c, a popcount when the column has a mask
+template <typename TS> size_t na_count(const TS &ts, size_t c) {
+  if (const ValidityMask *m = detail::series_mask(ts, c)) { return m->na_count(); }
+  if (detail::has_validity(ts)) { return column_validity(ts, c).na_count(); }
+  const auto nc = static_cast<decltype(ts.ncol())>(c);
+  return static_cast<size_t>(std::count_if(ts.col_begin(nc), ts.col_end(nc), [](const typename TS::value_type x) {
+    return series_traits<TS>::ISNA(x);
+  }));
+}
+
+// number of NAs in the whole series
+template <typename TS> size_t na_count(const TS &ts) {
+  size_t n{0};
+  for (size_t c = 0; c < static_cast<size_t>(ts.ncol()); ++c) { n += na_count(ts, c); }
+  return n;
+}
+
+// the rows of ts with no NA in any column
+// the rows kept are found a word at a time from the AND of the column masks
+template <typename TS> auto na_omit(const TS &ts) {
+  typedef typename TS::value_type V;
+  typedef typename series_traits<TS>::template rebind<V> result_type;
+  const size_t ncol{static_cast<size_t>(ts.ncol())};
+  ValidityMask keep(static_cast<size_t>(ts.nrow()));
+  for (size_t c = 0; c < ncol; ++c) { keep &= column_validity(ts, c); }
+
+  std::vector<size_t> rows;
+  rows.reserve(keep.count());
+  keep.for_each_valid([&rows](size_t i) { rows.push_back(i); });
+
+  result_type res(static_cast<decltype(ts.nrow())>(rows.size()), ts.ncol());
+  detail::copy_colnames(res, ts);
+  const auto src_idx{ts.index_begin()};
+  auto idx{res.index_begin()};
+  for (size_t i : rows) { *idx++ = src_idx[i]; }
+  for (size_t c = 0; c < ncol; ++c) {
+    const auto nc = static_cast<decltype(ts.ncol())>(c);
+    const auto src{ts.col_begin(nc)};
+    auto dst{res.col_begin(nc)};
+    for (size_t i : rows) { *dst++ = src[i]; }
+  }
+  // what is left is all valid, keep it that way for a masked series
+  if (detail::has_validity(ts)) {
+    detail::set_series_masks(res, std::vector<ValidityMask>(ncol, ValidityMask(rows.size())));
+  }
+  return res;
+}
+
+// ts with every NA replaced by value
+// runs of valid rows are copied and runs of NAs filled without looking at the values
+template <typename TS> auto fill_na(const TS &ts, const typename TS::value_type &value) {
+  typedef typename TS::value_type V;
+  typedef typename series_traits<TS>::template rebind<V> result_type;
+  const size_t nrow{static_cast<size_t>(ts.nrow())}, ncol{static_cast<size_t>(ts.ncol())};
+  result_type res(detail::on_index<result_type>(ts, 0, ts.nrow(), ts.ncol()));
+  detail::copy_colnames(res, ts);
+  for (size_t c = 0; c < ncol; ++c) {
+    const auto nc = static_cast<decltype(ts.ncol())>(c);
+    const auto src{ts.col_begin(nc)};
+    const auto dst{res.col_begin(nc)};
+    column_validity(ts, c).blocks([&](size_t b, size_t e) { std::copy(src + b, src + e, dst + b); },
+                                  [&](size_t b, size_t e) { std::fill(dst + b, dst + e, value); },
+                                  [&](size_t b, size_t e, std::uint64_t word) {
+                                    for (size_t k = b; k < e; ++k) { dst[k] = (word >> (k - b)) & 1 ? src[k] : value; }
+                                  });
+  }
+  if (detail::has_validity(ts)) {
+    detail::set_series_masks(res, std::vector<ValidityMask>(ncol, ValidityMask(nrow)));
+  }
+  return res;
+}
+
+} // namespace tslib
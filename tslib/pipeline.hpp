@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace tslib {
+
+// batched elementwise transforms
+//
+// pipeline() starts an empty chain and every step gives a longer one, the steps are composed at compile time
+// so TSeries::apply runs the whole chain on each value in one pass over the columns
+//
+//   LDL_ts z = x.apply(pipeline().scale(2).shift(1).log().clip(-5, 5));
+//
+// the values go through the chain as doubles and NA values are skipped, a chain that gives NaN makes the value NA
+// (the steps below carry a NaN through to the end)
+
+namespace detail {
+
+class IdentityStep {
+public:
+  double operator()(double x) const { return x; }
+};
+
+template <typename F, typename G> class ThenStep {
+private:
+  F f_;
+  G g_;
+
+public:
+  ThenStep(const F &f, const G &g) : f_(f), g_(g) {}
+  double operator()(double x) const { return g_(f_(x)); }
+};
+
+class ScaleStep {
+private:
+  double a_;
+
+public:
+  explicit ScaleStep(double a) : a_{a} {}
+  double operator()(double x) const { return x * a_; }
+};
+
+class ShiftStep {
+private:
+  double b_;
+
+public:
+  explicit ShiftStep(double b) : b_{b} {}
+  double operator()(double x) const { return x + b_; }
+};
+
+class LogStep {
+public:
+  double operator()(double x) const { return x > 0 ? std::log(x) : std::numeric_limits<double>::quiet_NaN(); }
+};
+
+class ClipStep {
+private:
+  double lo_;
+  double hi_;
+
+public:
+  ClipStep(double lo, double hi) : lo_{lo}, hi_{hi} {
+    if (!(lo <= hi)) { throw std::logic_error("clip: lower bound above upper bound."); }
+  }
+  double operator()(double x) const { return std::min(std::max(x, lo_), hi_); }
+};
+
+} // namespace detail
+
+template <typename F> class Pipeline {
+private:
+  F f_;
+
+public:
+  explicit Pipeline(const F &f) : f_(f) {}
+  double operator()(double x) const { return f_(x); }
+
+  // the chain followed by g, any callable taking and returning a double
+  template <typename G> Pipeline<detail::ThenStep<F, G>> then(const G &g) const {
+    return Pipeline<detail::ThenStep<F, G>>(detail::ThenStep<F, G>(f_, g));
+  }
+  // x * a
+  auto scale(double a) const { return then(detail::ScaleStep(a)); }
+  // x + b
+  auto shift(double b) const { return then(detail::ShiftStep(b)); }
+  // natural log, NA for values that are not positive
+  auto log() const { return then(detail::LogStep()); }
+  // x limited to [lo, hi]
+  auto clip(double lo, double hi) const { return then(detail::ClipStep(lo, hi)); }
+};
+
+// the empty chain
+inline Pipeline<detail::IdentityStep> pipeline() { return Pipeline<detail::IdentityStep>(detail::IdentityStep()); }
+
+} // namespace tslib
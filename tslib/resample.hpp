@@ -0,0 +1,273 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <tslib/execution.hpp>
+#include <tslib/instrument.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// aggregation to a lower frequency
+//
+// rows are grouped into calendar periods in one pass over the index: the date policy is asked for the
+// last date of a period once, when its first row is seen, and the following rows are plain comparisons
+// each period becomes one row of the result, indexed by the last row of the period that was observed
+//
+// periods provide end<DP>(x): the last index value of the period holding x, under date policy DP
+// reducers see the non-NA values of one column in one period
+//  reset(): start a new period
+//  push(x): add a value
+//  count(): number of values pushed
+//  value(k): output k of the period, there are width outputs for every input column
+//  name(k): suffix for the colname of output k, only used when width > 1
+// a period with no values gives NA
+
+// weeks ending on last_day (0 is sunday, as in boost's day_of_week)
+class Weekly {
+private:
+  int last_day_;
+
+public:
+  explicit Weekly(int last_day = 0) : last_day_{last_day} {}
+  // the last instant of the next last_day, the day after it less one unit of the index
+  template <typename DP, typename IDX> IDX end(IDX x) const {
+    const IDX day{DP::AddDays(x, (last_day_ - DP::dayofweek(x) + 7) % 7)};
+    return static_cast<IDX>(DP::AddDays(DP::toDate(DP::year(day), DP::month(day), DP::dayofmonth(day)), 1) - 1);
+  }
+};
+
+class Monthly {
+public:
+  template <typename DP, typename IDX> IDX end(IDX x) const { return static_cast<IDX>(DP::last_day_of_month(x)); }
+};
+
+class Quarterly {
+public:
+  template <typename DP, typename IDX> IDX end(IDX x) const {
+    const int last_month{((DP::month(x) - 1) / 3 + 1) * 3};
+    return static_cast<IDX>(DP::last_day_of_month(DP::toDate(DP::year(x), last_month, 1)));
+  }
+};
+
+class Yearly {
+public:
+  template <typename DP, typename IDX> IDX end(IDX x) const {
+    return static_cast<IDX>(DP::last_day_of_month(DP::toDate(DP::year(x), 12, 1)));
+  }
+};
+
+template <typename T> class FirstReducer {
+private:
+  T first_;
+  size_t n_;
+
+public:
+  typedef T result_type;
+  static const size_t width = 1;
+
+  FirstReducer() : first_(), n_{0} {}
+  void reset() { n_ = 0; }
+  void push(T x) {
+    if (n_++ == 0) { first_ = x; }
+  }
+  size_t count() const { return n_; }
+  result_type value(size_t) const { return first_; }
+  static std::string name(size_t) { return ""; }
+};
+
+template <typename T> class LastReducer {
+private:
+  T last_;
+  size_t n_;
+
+public:
+  typedef T result_type;
+  static const size_t width = 1;
+
+  LastReducer() : last_(), n_{0} {}
+  void reset() { n_ = 0; }
+  void push(T x) {
+    last_ = x;
+    ++n_;
+  }
+  size_t count() const { return n_; }
+  result_type value(size_t) const { return last_; }
+  static std::string name(size_t) { return ""; }
+};
+
+template <typename T> class SumReducer {
+private:
+  double sum_;
+  size_t n_;
+
+public:
+  typedef double result_type;
+  static const size_t width = 1;
+
+  SumReducer() : sum_{0}, n_{0} {}
+  void reset() {
+    sum_ = 0;
+    n_   = 0;
+  }
+  void push(T x) {
+    sum_ += static_cast<double>(x);
+    ++n_;
+  }
+  size_t count() const { return n_; }
+  result_type value(size_t) const { return sum_; }
+  static std::string name(size_t) { return ""; }
+};
+
+template <typename T> class MeanReducer {
+private:
+  SumReducer<T> sum_;
+
+public:
+  typedef double result_type;
+  static const size_t width = 1;
+
+  MeanReducer() : sum_() {}
+  void reset() { sum_.reset(); }
+  void push(T x) { sum_.push(x); }
+  size_t count() const { return sum_.count(); }
+  result_type value(size_t) const { return sum_.value(0) / static_cast<double>(sum_.count()); }
+  static std::string name(size_t) { return ""; }
+};
+
+// open, high, low and close of every column
+template <typename T> class OHLCReducer {
+private:
+  T open_, high_, low_, close_;
+  size_t n_;
+
+public:
+  typedef T result_type;
+  static const size_t width = 4;
+
+  OHLCReducer() : open_(), high_(), low_(), close_(), n_{0} {}
+  void reset() { n_ = 0; }
+  void push(T x) {
+    if (n_++ == 0) {
+      open_ = high_ = low_ = x;
+    } else {
+      high_ = std::max(high_, x);
+      low_  = std::min(low_, x);
+    }
+    close_ = x;
+  }
+  size_t count() const { return n_; }
+  result_type value(size_t k) const {
+    switch (k) {
+    case 0: return open_;
+    case 1: return high_;
+    case 2: return low_;
+    default: return close_;
+    }
+  }
+  static std::string name(size_t k) {
+    const char *names[] = {"Open", "High", "Low", "Close"};
+    return names[k];
+  }
+};
+
+// row positions where each period of the index ends (one past its last row)
+template <typename DP, typename ITER, typename PERIOD>
+std::vector<size_t> period_ends(ITER beg, ITER end, const PERIOD &period) {
+  typedef typename std::iterator_traits<ITER>::value_type IDX;
+  std::vector<size_t> ends;
+  size_t row{0};
+  IDX boundary{};
+  for (ITER it = beg; it != end; ++it, ++row) {
+    if (row == 0 || *it > boundary) {
+      if (row) { ends.push_back(row); }
+      boundary = period.template end<DP>(*it);
+    }
+  }
+  if (row) { ends.push_back(row); }
+  return ends;
+}
+
+// reduces every column of ts over the periods of its index
+// input column c gives output columns [c * width, (c + 1) * width) of the result
+// the NAs left out of a series with validity masks are the rows its masks clear
+// columns are run with the given execution policy
+template <template <typename> class RED, typename TS, typename PERIOD>
+auto resample(const TS &ts, const PERIOD &period, ExecutionPolicy &policy = default_execution()) {
+  typedef typename TS::value_type V;
+  typedef typename RED<V>::result_type RT;
+  typedef typename series_traits<TS>::template rebind<RT> result_type;
+  typedef typename series_traits<TS>::date_policy DP;
+  const size_t width{RED<V>::width};
+
+  instrument::Scope scope("resample");
+  scope.rows_in(static_cast<size_t>(ts.nrow()));
+  const std::vector<size_t> ends(period_ends<DP>(ts.index_begin(), ts.index_end(), period));
+  const size_t nper{ends.size()};
+  const size_t ncol{static_cast<size_t>(ts.ncol())};
+  result_type res(static_cast<decltype(ts.nrow())>(nper), static_cast<decltype(ts.ncol())>(ncol * width));
+
+  auto idx{res.index_begin()};
+  const auto src_idx{ts.index_begin()};
+  for (size_t p = 0; p < nper; ++p, ++idx) { *idx = src_idx[ends[p] - 1]; }
+
+  if (width == 1) {
+    res.setColnames(ts.getColnames());
+  } else if (ts.hasColnames()) {
+    const std::vector<std::string> names(ts.getColnames());
+    std::vector<std::string> res_names;
+    for (const auto &n : names) {
+      for (size_t k = 0; k < width; ++k) { res_names.push_back(n + "." + RED<V>::name(k)); }
+    }
+    res.setColnames(res_names);
+  }
+
+  const bool masked{detail::has_validity(ts)};
+  policy_for(policy, static_cast<size_t>(ts.nrow()) * ncol).parallel_for(ncol, [&](size_t c) {
+    RED<V> red;
+    const auto src = ts.col_begin(static_cast<decltype(ts.ncol())>(c));
+    const ValidityMask valid(masked ? column_validity(ts, c) : ValidityMask());
+    std::vector<decltype(res.col_begin(0))> dst;
+    for (size_t k = 0; k < width; ++k) { dst.push_back(res.col_begin(static_cast<decltype(res.ncol())>(c * width + k))); }
+    size_t row{0};
+    for (size_t p = 0; p < nper; ++p) {
+      red.reset();
+      for (; row < ends[p]; ++row) {
+        const V x{src[row]};
+        if (masked ? valid.test(row) : !series_traits<TS>::ISNA(x)) { red.push(x); }
+      }
+      for (size_t k = 0; k < width; ++k) {
+        dst[k][p] = red.count() ? red.value(k) : series_traits<TS>::template NA<RT>();
+      }
+    }
+  });
+  detail::record_result(scope, res);
+  return res;
+}
+
+// open, high, low, close bars over the periods of the index
+template <typename TS, typename PERIOD>
+auto to_period(const TS &ts, const PERIOD &period, ExecutionPolicy &policy = default_execution()) {
+  return resample<OHLCReducer>(ts, period, policy);
+}
+
+} // namespace tslib
@@ -0,0 +1,258 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <tslib/execution.hpp>
+#include <tslib/instrument.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// rolling window computations
+//
+// each accumulator keeps the state of one window and is updated incrementally as rows enter and leave it,
+// so a full pass over a column is O(nrow) whatever the window length
+//  push(pos, x): row pos with value x enters the window
+//  pop(pos, x): row pos with value x leaves the window, rows leave in the order they entered
+//  count(): number of values in the window
+//  value(): the statistic for the current window
+// NA values never reach the accumulators, min_count is the number of values the statistic needs to exist
+
+// window sum with Neumaier compensation, so adding and removing values doesn't accumulate rounding error
+template <typename T> class RollingSum {
+private:
+  double sum_;
+  double comp_;
+  size_t n_;
+
+  void add(double x) {
+    const double t{sum_ + x};
+    comp_ += std::fabs(sum_) >= std::fabs(x) ? (sum_ - t) + x : (x - t) + sum_;
+    sum_ = t;
+  }
+
+public:
+  typedef double result_type;
+  static const size_t min_count = 1;
+
+  RollingSum() : sum_{0}, comp_{0}, n_{0} {}
+  void push(size_t, T x) {
+    add(static_cast<double>(x));
+    ++n_;
+  }
+  void pop(size_t, T x) {
+    add(-static_cast<double>(x));
+    // restart from exact zero once the window is empty
+    if (--n_ == 0) { sum_ = comp_ = 0; }
+  }
+  size_t count() const { return n_; }
+  result_type value() const { return sum_ + comp_; }
+};
+
+template <typename T> class RollingMean {
+private:
+  RollingSum<T> sum_;
+
+public:
+  typedef double result_type;
+  static const size_t min_count = 1;
+
+  RollingMean() : sum_() {}
+  void push(size_t pos, T x) { sum_.push(pos, x); }
+  void pop(size_t pos, T x) { sum_.pop(pos, x); }
+  size_t count() const { return sum_.count(); }
+  result_type value() const { return sum_.value() / static_cast<double>(sum_.count()); }
+};
+
+// sample variance with Welford's update, and its inverse when a value leaves the window
+template <typename T> class RollingVar {
+private:
+  double mean_;
+  double m2_;
+  size_t n_;
+
+public:
+  typedef double result_type;
+  static const size_t min_count = 2;
+
+  RollingVar() : mean_{0}, m2_{0}, n_{0} {}
+  void push(size_t, T x) {
+    const double d{static_cast<double>(x) - mean_};
+    mean_ += d / static_cast<double>(++n_);
+    m2_ += d * (static_cast<double>(x) - mean_);
+  }
+  void pop(size_t, T x) {
+    if (--n_ == 0) {
+      mean_ = m2_ = 0;
+      return;
+    }
+    const double d{static_cast<double>(x) - mean_};
+    mean_ -= d / static_cast<double>(n_);
+    m2_ -= d * (static_cast<double>(x) - mean_);
+  }
+  size_t count() const { return n_; }
+  // rounding can leave a tiny negative sum of squares behind, clamp it
+  result_type value() const { return std::max(m2_, 0.0) / static_cast<double>(n_ - 1); }
+};
+
+template <typename T> class RollingSd {
+private:
+  RollingVar<T> var_;
+
+public:
+  typedef double result_type;
+  static const size_t min_count = 2;
+
+  RollingSd() : var_() {}
+  void push(size_t pos, T x) { var_.push(pos, x); }
+  void pop(size_t pos, T x) { var_.pop(pos, x); }
+  size_t count() const { return var_.count(); }
+  result_type value() const { return std::sqrt(var_.value()); }
+};
+
+// window extreme with a monotonic deque: candidates are kept in order of position with values
+// strictly improving towards the back, so the front is always the answer and every row enters and leaves once
+template <typename T, typename Better> class RollingExtreme {
+private:
+  std::deque<std::pair<size_t, T>> q_;
+  size_t n_;
+
+public:
+  typedef T result_type;
+  static const size_t min_count = 1;
+
+  RollingExtreme() : q_(), n_{0} {}
+  void push(size_t pos, T x) {
+    while (!q_.empty() && !Better()(q_.back().second, x)) { q_.pop_back(); }
+    q_.emplace_back(pos, x);
+    ++n_;
+  }
+  void pop(size_t pos, T) {
+    if (!q_.empty() && q_.front().first == pos) { q_.pop_front(); }
+    --n_;
+  }
+  size_t count() const { return n_; }
+  result_type value() const { return q_.front().second; }
+};
+
+template <typename T> class RollingMin : public RollingExtreme<T, std::less<T>> {};
+template <typename T> class RollingMax : public RollingExtreme<T, std::greater<T>> {};
+
+// window of the last n rows, including the current one
+class RowWindow {
+private:
+  size_t n_;
+
+public:
+  explicit RowWindow(size_t n) : n_{n} {
+    if (n == 0) { throw std::logic_error("rolling: window must hold at least one row."); }
+  }
+  // first row of the window ending at row i
+  size_t start(size_t i) const { return i + 1 >= n_ ? i + 1 - n_ : 0; }
+};
+
+// window of the rows less than span apart from the current one, measured with DatePolicy::daily_distance
+// the window starts are the same for every column, so they are worked out once
+class CalendarWindow {
+private:
+  std::vector<size_t> starts_;
+
+public:
+  template <typename TS> CalendarWindow(const TS &ts, double span) : starts_(ts.nrow()) {
+    if (!(span > 0)) { throw std::logic_error("rolling: calendar window span must be positive."); }
+    const auto idx = ts.index_begin();
+    size_t lo{0};
+    for (size_t i = 0; i < starts_.size(); ++i) {
+      while (series_traits<TS>::daily_distance(idx[i], idx[lo]) >= span) { ++lo; }
+      starts_[i] = lo;
+    }
+  }
+  size_t start(size_t i) const { return starts_[i]; }
+};
+
+// applies accumulator ACC over the given windows of every column of ts
+// rows whose window has fewer than min_periods non-NA values (or fewer than ACC needs) are NA
+// the NAs of a series with validity masks are the rows its masks clear
+// columns are run with the given execution policy
+template <template <typename> class ACC, typename TS, typename WINDOW>
+auto rolling(const TS &ts, const WINDOW &window, size_t min_periods, ExecutionPolicy &policy = default_execution()) {
+  typedef typename TS::value_type V;
+  typedef typename ACC<V>::result_type RT;
+  typedef typename series_traits<TS>::template rebind<RT> result_type;
+
+  instrument::Scope scope("rolling");
+  const size_t nrow{static_cast<size_t>(ts.nrow())};
+  scope.rows_in(nrow);
+  const size_t min_count{ACC<V>::min_count};
+  const size_t need{std::max(min_periods, min_count)};
+  // the result is on the index of ts
+  result_type res(detail::on_index<result_type>(ts, 0, ts.nrow(), ts.ncol()));
+  detail::copy_colnames(res, ts);
+
+  // columns are independent, each one is a single sequential pass
+  const size_t ncol{static_cast<size_t>(ts.ncol())};
+  const bool masked{detail::has_validity(ts)};
+  policy_for(policy, nrow * ncol).parallel_for(ncol, [&](size_t c) {
+    const auto nc = static_cast<decltype(ts.ncol())>(c);
+    ACC<V> acc;
+    const auto src = ts.col_begin(nc);
+    auto dst = res.col_begin(nc);
+    const ValidityMask valid(masked ? column_validity(ts, c) : ValidityMask());
+    const auto isna = [&](size_t r, V x) { return masked ? !valid.test(r) : series_traits<TS>::ISNA(x); };
+    size_t lo{0};
+    for (size_t i = 0; i < nrow; ++i, ++dst) {
+      const V x{src[i]};
+      if (!isna(i, x)) { acc.push(i, x); }
+      for (const size_t start = window.start(i); lo < start; ++lo) {
+        const V old{src[lo]};
+        if (!isna(lo, old)) { acc.pop(lo, old); }
+      }
+      *dst = acc.count() >= need ? acc.value() : series_traits<TS>::template NA<RT>();
+    }
+  });
+  detail::record_result(scope, res);
+  return res;
+}
+
+// rolling over the last n rows, NA until the window is full
+template <template <typename> class ACC, typename TS> auto rolling(const TS &ts, size_t n) {
+  return rolling<ACC>(ts, RowWindow(n), n);
+}
+
+// rolling over the rows less than span days back, NA until min_periods values are available
+template <template <typename> class ACC, typename TS>
+auto rolling_calendar(const TS &ts, double span, size_t min_periods = 1) {
+  return rolling<ACC>(ts, CalendarWindow(ts, span), min_periods);
+}
+
+// shorthands for the usual row window statistics
+template <typename TS> auto rolling_sum(const TS &ts, size_t n) { return rolling<RollingSum>(ts, n); }
+template <typename TS> auto rolling_mean(const TS &ts, size_t n) { return rolling<RollingMean>(ts, n); }
+template <typename TS> auto rolling_var(const TS &ts, size_t n) { return rolling<RollingVar>(ts, n); }
+template <typename TS> auto rolling_sd(const TS &ts, size_t n) { return rolling<RollingSd>(ts, n); }
+template <typename TS> auto rolling_min(const TS &ts, size_t n) { return rolling<RollingMin>(ts, n); }
+template <typename TS> auto rolling_max(const TS &ts, size_t n) { return rolling<RollingMax>(ts, n); }
+
+} // namespace tslib
@@ -0,0 +1,586 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <tslib/iterator.traits.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// binary columnar format for series
+//
+//  header: magic "TSLB", format version, index and value type codes, header flags, nrow, ncol, colnames,
+//  crc32 of the header
+//  then a block for the index and one for each column:
+//   codec, flags, number of encoded values, payload length, crc32 of the payload, payload
+// with the na bitmap flag the payload starts with one bit per row (set for NA), and only the other rows are encoded
+// a series with validity masks is saved with the masked header flag and an NA bitmap for every column, taken from
+// its masks, loading it gives the masks back when the backend can keep them
+// numbers are little endian, as on the machines this runs on
+//
+// codecs
+//  raw: the values as they are in memory, saving and loading are one write and one read of the column
+//  delta: zigzag varints of the differences of the differences, for integer indexes and integer values
+//  gorilla: each double xor the previous one, stored as its meaningful bits (Pelkonen et al, VLDB 2015)
+// a codec that doesn't apply to the type of a block falls back to raw
+
+enum class Codec : uint8_t { raw = 0, delta = 1, gorilla = 2 };
+
+class SaveOptions {
+public:
+  Codec index;
+  Codec values;
+  // codec for each column, overrides values when it isn't empty
+  std::vector<Codec> columns;
+  // store NAs as a bitmap rather than as values
+  bool na_bitmap;
+
+  SaveOptions() : index{Codec::raw}, values{Codec::raw}, columns(), na_bitmap{false} {}
+
+  // delta index, gorilla values and an NA bitmap
+  static SaveOptions compressed() {
+    SaveOptions opts;
+    opts.index     = Codec::delta;
+    opts.values    = Codec::gorilla;
+    opts.na_bitmap = true;
+    return opts;
+  }
+};
+
+namespace detail {
+
+const char serial_magic[4] = {'T', 'S', 'L', 'B'};
+const uint32_t serial_version{1};
+const uint8_t na_bitmap_flag{1};
+const uint16_t masked_flag{1};
+// most bytes of colnames a header can hold, so a corrupt length can't ask for gigabytes before the checksum is seen
+const size_t max_colname_bytes{size_t(1) << 24};
+
+// crc32 (ieee), crc is the checksum of the bytes before data so it can be run over pieces
+inline uint32_t crc32(const void *data, size_t n, uint32_t crc = 0) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> t(256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c{i};
+      for (int k = 0; k < 8; ++k) { c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1; }
+      t[i] = c;
+    }
+    return t;
+  }();
+  const uint8_t *p{static_cast<const uint8_t *>(data)};
+  crc = ~crc;
+  for (size_t i = 0; i < n; ++i) { crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8); }
+  return ~crc;
+}
+
+// size and kind of an arithmetic type, stored so that a file is only loaded into the types it was saved from
+template <typename T> uint8_t serial_type_code() {
+  static_assert(std::is_arithmetic<T>::value, "only arithmetic indexes and values can be serialized");
+  return static_cast<uint8_t>((std::is_floating_point<T>::value ? 0x80 : 0) | (std::is_signed<T>::value ? 0x40 : 0) |
+                              sizeof(T));
+}
+
+template <typename T> void put(std::vector<uint8_t> &out, T v) {
+  const uint8_t *p{reinterpret_cast<const uint8_t *>(&v)};
+  out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T> T get(const uint8_t *&p, const uint8_t *end) {
+  if (static_cast<size_t>(end - p) < sizeof(T)) { throw std::runtime_error("load: truncated data"); }
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+  return v;
+}
+
+inline void put_varint(std::vector<uint8_t> &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+inline uint64_t get_varint(const uint8_t *&p, const uint8_t *end) {
+  uint64_t v{0};
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (p == end) { break; }
+    const uint8_t b{*p++};
+    v |= static_cast<uint64_t>(b & 0x7F) << shift;
+    if (!(b & 0x80)) { return v; }
+  }
+  throw std::runtime_error("load: corrupt varint");
+}
+
+inline uint64_t zigzag(uint64_t v) { return (v << 1) ^ (0 - (v >> 63)); }
+inline uint64_t unzigzag(uint64_t v) { return (v >> 1) ^ (0 - (v & 1)); }
+
+// msb first bit stream
+class BitWriter {
+private:
+  std::vector<uint8_t> &out_;
+  uint8_t cur_;
+  int used_;
+
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out_(out), cur_{0}, used_{0} {}
+  BitWriter(const BitWriter &) = delete;
+  BitWriter &operator=(const BitWriter &) = delete;
+  // the low count bits of v
+  void write(uint64_t v, int count) {
+    while (count > 0) {
+      const int room{8 - used_};
+      const int take{std::min(room, count)};
+      const uint8_t bits{static_cast<uint8_t>((v >> (count - take)) & ((1u << take) - 1))};
+      cur_ = static_cast<uint8_t>(cur_ | (bits << (room - take)));
+      used_ += take;
+      count -= take;
+      if (used_ == 8) {
+        out_.push_back(cur_);
+        cur_  = 0;
+        used_ = 0;
+      }
+    }
+  }
+  void flush() {
+    if (used_) { out_.push_back(cur_); }
+    cur_  = 0;
+    used_ = 0;
+  }
+};
+
+class BitReader {
+private:
+  const uint8_t *p_;
+  const uint8_t *end_;
+  uint8_t cur_;
+  int left_;
+
+public:
+  BitReader(const uint8_t *p, const uint8_t *end) : p_{p}, end_{end}, cur_{0}, left_{0} {}
+  BitReader(const BitReader &) = delete;
+  BitReader &operator=(const BitReader &) = delete;
+  uint64_t read(int count) {
+    uint64_t v{0};
+    while (count > 0) {
+      if (left_ == 0) {
+        if (p_ == end_) { throw std::runtime_error("load: truncated bit stream"); }
+        cur_  = *p_++;
+        left_ = 8;
+      }
+      const int take{std::min(left_, count)};
+      v = (v << take) | ((cur_ >> (left_ - take)) & ((1u << take) - 1));
+      left_ -= take;
+      count -= take;
+    }
+    return v;
+  }
+};
+
+// delta of delta, integers only
+template <typename T> void encode_delta(const T *x, size_t n, std::vector<uint8_t> &out) {
+  uint64_t prev{0}, prev_delta{0};
+  for (size_t i = 0; i < n; ++i) {
+    // unsigned arithmetic wraps, so any step decodes exactly
+    const uint64_t v{static_cast<uint64_t>(static_cast<int64_t>(x[i]))};
+    const uint64_t delta{v - prev};
+    put_varint(out, zigzag(delta - prev_delta));
+    prev       = v;
+    prev_delta = delta;
+  }
+}
+
+template <typename T> void decode_delta(const uint8_t *p, const uint8_t *end, T *x, size_t n) {
+  uint64_t prev{0}, prev_delta{0};
+  for (size_t i = 0; i < n; ++i) {
+    prev_delta += unzigzag(get_varint(p, end));
+    prev += prev_delta;
+    x[i] = static_cast<T>(static_cast<int64_t>(prev));
+  }
+}
+
+// gorilla xor compression of doubles
+//  '0': same value as before
+//  '10' + bits: the xor fits in the previous window of meaningful bits
+//  '11' + 5 bits leading zeros + 6 bits length (0 for 64) + bits: a new window
+inline void encode_gorilla(const double *x, size_t n, std::vector<uint8_t> &out) {
+  if (n == 0) { return; }
+  BitWriter w(out);
+  uint64_t prev;
+  std::memcpy(&prev, x, sizeof(prev));
+  w.write(prev, 64);
+  int lead{-1}, trail{0};
+  for (size_t i = 1; i < n; ++i) {
+    uint64_t v;
+    std::memcpy(&v, x + i, sizeof(v));
+    const uint64_t d{v ^ prev};
+    prev = v;
+    if (d == 0) {
+      w.write(0, 1);
+      continue;
+    }
+    const int l{std::min(__builtin_clzll(d), 31)}, t{__builtin_ctzll(d)};
+    if (lead >= 0 && l >= lead && t >= trail) {
+      w.write(2, 2);
+      w.write(d >> trail, 64 - lead - trail);
+    } else {
+      const int sig{64 - l - t};
+      w.write(3, 2);
+      w.write(static_cast<uint64_t>(l), 5);
+      w.write(static_cast<uint64_t>(sig & 63), 6);
+      w.write(d >> t, sig);
+      lead  = l;
+      trail = t;
+    }
+  }
+  w.flush();
+}
+
+inline void decode_gorilla(const uint8_t *p, const uint8_t *end, double *x, size_t n) {
+  if (n == 0) { return; }
+  BitReader r(p, end);
+  uint64_t prev{r.read(64)};
+  std::memcpy(x, &prev, sizeof(prev));
+  int lead{0}, trail{0};
+  for (size_t i = 1; i < n; ++i) {
+    if (r.read(1)) {
+      if (r.read(1)) {
+        lead          = static_cast<int>(r.read(5));
+        const int sig{static_cast<int>(r.read(6))};
+        trail         = 64 - lead - (sig ? sig : 64);
+        if (trail < 0) { throw std::runtime_error("load: corrupt gorilla block"); }
+      }
+      prev ^= r.read(64 - lead - trail) << trail;
+    }
+    std::memcpy(x + i, &prev, sizeof(prev));
+  }
+}
+
+// the codec actually used for a block of T
+template <typename T> Codec applicable_codec(Codec c) {
+  if (c == Codec::delta && std::is_integral<T>::value) { return c; }
+  if (c == Codec::gorilla && std::is_same<T, double>::value) { return c; }
+  return Codec::raw;
+}
+
+// the non raw codecs, tag dispatched so each type only instantiates the ones it can use
+template <typename T> void encode_values(Codec c, const T *x, size_t n, std::vector<uint8_t> &out, std::true_type) {
+  (void)c;
+  encode_delta(x, n, out);
+}
+inline void encode_values(Codec, const double *x, size_t n, std::vector<uint8_t> &out, std::false_type) {
+  encode_gorilla(x, n, out);
+}
+template <typename T> void encode_values(Codec, const T *, size_t, std::vector<uint8_t> &, std::false_type) {}
+
+template <typename T>
+void decode_values(Codec c, const uint8_t *p, const uint8_t *end, T *x, size_t n, std::true_type) {
+  if (c != Codec::delta) { throw std::runtime_error("load: codec does not apply to the stored type"); }
+  decode_delta(p, end, x, n);
+}
+inline void decode_values(Codec c, const uint8_t *p, const uint8_t *end, double *x, size_t n, std::false_type) {
+  if (c != Codec::gorilla) { throw std::runtime_error("load: codec does not apply to the stored type"); }
+  decode_gorilla(p, end, x, n);
+}
+template <typename T> void decode_values(Codec, const uint8_t *, const uint8_t *, T *, size_t, std::false_type) {
+  throw std::runtime_error("load: codec does not apply to the stored type");
+}
+
+inline void write_block_header(std::ostream &os, Codec codec, uint8_t flags, uint64_t count, uint64_t bytes,
+                               uint32_t crc) {
+  std::vector<uint8_t> h;
+  put(h, static_cast<uint8_t>(codec));
+  put(h, flags);
+  put(h, count);
+  put(h, bytes);
+  put(h, crc);
+  os.write(reinterpret_cast<const char *>(h.data()), static_cast<std::streamsize>(h.size()));
+}
+
+// writes n values of x, with bitmap (if given) ahead of them
+template <typename T> void write_block(std::ostream &os, const T *x, size_t n, Codec codec, const std::vector<uint8_t> *bitmap) {
+  codec = applicable_codec<T>(codec);
+  const uint8_t flags{bitmap ? na_bitmap_flag : uint8_t(0)};
+  if (codec == Codec::raw && !bitmap) {
+    // straight from the column memory
+    const size_t bytes{n * sizeof(T)};
+    write_block_header(os, codec, flags, n, bytes, crc32(x, bytes));
+    os.write(reinterpret_cast<const char *>(x), static_cast<std::streamsize>(bytes));
+    return;
+  }
+  std::vector<uint8_t> payload;
+  if (bitmap) { payload = *bitmap; }
+  if (codec == Codec::raw) {
+    const uint8_t *p{reinterpret_cast<const uint8_t *>(x)};
+    payload.insert(payload.end(), p, p + n * sizeof(T));
+  } else {
+    encode_values(codec, x, n, payload, std::is_integral<T>());
+  }
+  write_block_header(os, codec, flags, n, payload.size(), crc32(payload.data(), payload.size()));
+  os.write(reinterpret_cast<const char *>(payload.data()), static_cast<std::streamsize>(payload.size()));
+}
+
+// pointer to n contiguous values read from the block, from the iterator itself when it walks contiguous memory
+template <typename T, typename ITER> class BlockTarget {
+private:
+  ITER dst_;
+  std::vector<T> buf_;
+  T *p_;
+
+  T *init(size_t n, std::true_type) { return n ? to_pointer(dst_) : nullptr; }
+  T *init(size_t n, std::false_type) {
+    buf_.resize(n);
+    return buf_.data();
+  }
+  void done(size_t, std::true_type) {}
+  void done(size_t n, std::false_type) { std::copy_n(buf_.begin(), n, dst_); }
+
+public:
+  typedef std::integral_constant<bool, is_contiguous_iterator<ITER>::value> contiguous;
+  BlockTarget(ITER dst, size_t n) : dst_(dst), buf_(), p_{init(n, contiguous())} {}
+  BlockTarget(const BlockTarget &) = delete;
+  BlockTarget &operator=(const BlockTarget &) = delete;
+  T *data() { return p_; }
+  void finish(size_t n) { done(n, contiguous()); }
+};
+
+// reads a block of nrow values into dst, NA rows of a bitmap get na
+// with mask given the block must have a bitmap, and mask is set to the rows it doesn't mark NA
+template <typename T, typename ITER>
+void read_block(std::istream &is, ITER dst, size_t nrow, T na, bool allow_bitmap, ValidityMask *mask = nullptr) {
+  std::vector<uint8_t> h(2 + 8 + 8 + 4);
+  if (!is.read(reinterpret_cast<char *>(h.data()), static_cast<std::streamsize>(h.size()))) {
+    throw std::runtime_error("load: truncated block header");
+  }
+  const uint8_t *p{h.data()}, *end{h.data() + h.size()};
+  const Codec codec{static_cast<Codec>(get<uint8_t>(p, end))};
+  const uint8_t flags{get<uint8_t>(p, end)};
+  const uint64_t count{get<uint64_t>(p, end)};
+  const uint64_t bytes{get<uint64_t>(p, end)};
+  const uint32_t crc{get<uint32_t>(p, end)};
+  const bool bitmap{(flags & na_bitmap_flag) != 0};
+  if (bitmap && !allow_bitmap) { throw std::runtime_error("load: unexpected NA bitmap"); }
+  if (mask && !bitmap) { throw std::runtime_error("load: masked series without NA bitmap"); }
+  if (bitmap ? count > nrow : count != nrow) { throw std::runtime_error("load: block does not match the series size"); }
+  if (codec == Codec::raw && bytes != (bitmap ? (nrow + 7) / 8 : 0) + count * sizeof(T)) {
+    throw std::runtime_error("load: corrupt raw block");
+  }
+
+  BlockTarget<T, ITER> target(dst, nrow);
+  T *out{target.data()};
+  if (codec == Codec::raw && !bitmap) {
+    // one read into the column
+    if (!is.read(reinterpret_cast<char *>(out), static_cast<std::streamsize>(bytes))) {
+      throw std::runtime_error("load: truncated block");
+    }
+    if (crc32(out, bytes) != crc) { throw std::runtime_error("load: checksum mismatch"); }
+    target.finish(nrow);
+    return;
+  }
+
+  std::vector<uint8_t> payload(bytes);
+  if (!is.read(reinterpret_cast<char *>(payload.data()), static_cast<std::streamsize>(bytes))) {
+    throw std::runtime_error("load: truncated block");
+  }
+  if (crc32(payload.data(), payload.size()) != crc) { throw std::runtime_error("load: checksum mismatch"); }
+  const uint8_t *vp{payload.data()}, *vend{payload.data() + payload.size()};
+  if (bitmap) {
+    if (payload.size() < (nrow + 7) / 8) { throw std::runtime_error("load: truncated NA bitmap"); }
+    vp += (nrow + 7) / 8;
+  }
+  if (codec == Codec::raw) {
+    if (count) { std::memcpy(out, vp, count * sizeof(T)); }
+  } else {
+    decode_values(codec, vp, vend, out, count, std::is_integral<T>());
+  }
+  if (bitmap) {
+    // spread the values out to their rows, from the back so nothing is overwritten before it's moved
+    size_t k{count};
+    if (mask) { *mask = ValidityMask(nrow); }
+    for (size_t r = nrow; r-- > 0;) {
+      if (payload[r / 8] & (1u << (r % 8))) {
+        out[r] = na;
+        if (mask) { mask->set(r, false); }
+      } else {
+        if (k == 0) { throw std::runtime_error("load: NA bitmap does not match the values"); }
+        out[r] = out[--k];
+      }
+    }
+    if (k != 0) { throw std::runtime_error("load: NA bitmap does not match the values"); }
+  }
+  target.finish(nrow);
+}
+
+// contiguous copy of [beg, beg + n) for writing, the iterator's own memory when it can be used as is
+template <typename T, typename ITER> const T *block_source(ITER beg, size_t n, std::vector<T> &buf, std::true_type) {
+  (void)buf;
+  return n ? to_pointer(beg) : nullptr;
+}
+template <typename T, typename ITER> const T *block_source(ITER beg, size_t n, std::vector<T> &buf, std::false_type) {
+  buf.assign(beg, std::next(beg, static_cast<std::ptrdiff_t>(n)));
+  return buf.data();
+}
+
+} // namespace detail
+
+// writes ts to os
+template <typename TS> void save(std::ostream &os, const TS &ts, const SaveOptions &opts = SaveOptions()) {
+  typedef typename TS::value_type V;
+  typedef typename std::iterator_traits<typename TS::const_index_iterator>::value_type IDX;
+  typedef typename TS::const_index_iterator index_iterator;
+  typedef typename TS::const_data_iterator data_iterator;
+  const size_t nrow{static_cast<size_t>(ts.nrow())}, ncol{static_cast<size_t>(ts.ncol())};
+  if (!opts.columns.empty() && opts.columns.size() != ncol) {
+    throw std::logic_error("save: codecs must be given for every column.");
+  }
+
+  std::vector<uint8_t> h(detail::serial_magic, detail::serial_magic + 4);
+  detail::put(h, detail::serial_version);
+  detail::put(h, detail::serial_type_code<IDX>());
+  detail::put(h, detail::serial_type_code<V>());
+  const bool masked{detail::has_validity(ts)};
+  detail::put(h, masked ? detail::masked_flag : uint16_t(0));
+  detail::put(h, static_cast<uint64_t>(nrow));
+  detail::put(h, static_cast<uint64_t>(ncol));
+  const std::vector<std::string> names(ts.getColnames());
+  detail::put(h, static_cast<uint32_t>(names.size()));
+  for (const auto &n : names) {
+    detail::put(h, static_cast<uint32_t>(n.size()));
+    h.insert(h.end(), n.begin(), n.end());
+  }
+  detail::put(h, detail::crc32(h.data(), h.size()));
+  os.write(reinterpret_cast<const char *>(h.data()), static_cast<std::streamsize>(h.size()));
+
+  std::vector<IDX> idx_buf;
+  detail::write_block(os,
+                      detail::block_source(ts.index_begin(), nrow, idx_buf,
+                                           std::integral_constant<bool, is_contiguous_iterator<index_iterator>::value>()),
+                      nrow, opts.index, nullptr);
+
+  std::vector<V> buf, present;
+  std::vector<uint8_t> bitmap;
+  for (size_t c = 0; c < ncol; ++c) {
+    const Codec codec{opts.columns.empty() ? opts.values : opts.columns[c]};
+    const V *x{detail::block_source(ts.col_begin(static_cast<decltype(ts.ncol())>(c)), nrow, buf,
+                                    std::integral_constant<bool, is_contiguous_iterator<data_iterator>::value>())};
+    if (!opts.na_bitmap && !masked) {
+      detail::write_block(os, x, nrow, codec, nullptr);
+      continue;
+    }
+    const ValidityMask valid(masked ? column_validity(ts, c) : ValidityMask());
+    bitmap.assign((nrow + 7) / 8, 0);
+    present.clear();
+    for (size_t r = 0; r < nrow; ++r) {
+      if (masked ? !valid.test(r) : series_traits<TS>::ISNA(x[r])) {
+        bitmap[r / 8] = static_cast<uint8_t>(bitmap[r / 8] | (1u << (r % 8)));
+      } else {
+        present.push_back(x[r]);
+      }
+    }
+    detail::write_block(os, present.data(), present.size(), codec, &bitmap);
+  }
+  if (!os) { throw std::runtime_error("save: write failed"); }
+}
+
+template <typename TS> void save(const std::string &path, const TS &ts, const SaveOptions &opts = SaveOptions()) {
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os) { throw std::runtime_error("save: can't open " + path); }
+  save(os, ts, opts);
+}
+
+// reads a series of type TS from is, the index and value types must be the ones it was saved with
+template <typename TS> TS load(std::istream &is) {
+  typedef typename TS::value_type V;
+  typedef typename std::iterator_traits<typename TS::const_index_iterator>::value_type IDX;
+  typedef decltype(std::declval<TS>().ncol()) DIM;
+
+  // fixed part of the header, then the colnames
+  std::vector<uint8_t> h(4 + 4 + 1 + 1 + 2 + 8 + 8 + 4);
+  if (!is.read(reinterpret_cast<char *>(h.data()), static_cast<std::streamsize>(h.size()))) {
+    throw std::runtime_error("load: truncated header");
+  }
+  if (!std::equal(detail::serial_magic, detail::serial_magic + 4, h.begin())) {
+    throw std::runtime_error("load: not a serialized series");
+  }
+  const uint8_t *p{h.data() + 4}, *end{h.data() + h.size()};
+  const uint32_t version{detail::get<uint32_t>(p, end)};
+  if (version != detail::serial_version) { throw std::runtime_error("load: unsupported format version"); }
+  const uint8_t idx_code{detail::get<uint8_t>(p, end)}, val_code{detail::get<uint8_t>(p, end)};
+  if (idx_code != detail::serial_type_code<IDX>() || val_code != detail::serial_type_code<V>()) {
+    throw std::runtime_error("load: index or value type does not match");
+  }
+  const bool masked{(detail::get<uint16_t>(p, end) & detail::masked_flag) != 0};
+  const uint64_t nrow{detail::get<uint64_t>(p, end)}, ncol{detail::get<uint64_t>(p, end)};
+  const uint32_t nnames{detail::get<uint32_t>(p, end)};
+  if (nnames > ncol) { throw std::runtime_error("load: corrupt colnames"); }
+
+  // the colnames are read as bytes, within max_colname_bytes, and only made into strings once the checksum matches
+  std::vector<uint8_t> raw_names;
+  for (uint32_t i = 0; i < nnames; ++i) {
+    uint32_t len;
+    if (!is.read(reinterpret_cast<char *>(&len), sizeof(len))) { throw std::runtime_error("load: truncated colnames"); }
+    const size_t at{raw_names.size()};
+    if (at + sizeof(len) + len > detail::max_colname_bytes) { throw std::runtime_error("load: colnames too long"); }
+    raw_names.resize(at + sizeof(len) + len);
+    std::memcpy(&raw_names[at], &len, sizeof(len));
+    if (len && !is.read(reinterpret_cast<char *>(&raw_names[at + sizeof(len)]), len)) {
+      throw std::runtime_error("load: truncated colnames");
+    }
+  }
+  uint32_t stored;
+  if (!is.read(reinterpret_cast<char *>(&stored), sizeof(stored))) { throw std::runtime_error("load: truncated header"); }
+  if (stored != detail::crc32(raw_names.data(), raw_names.size(), detail::crc32(h.data(), h.size()))) {
+    throw std::runtime_error("load: header checksum mismatch");
+  }
+  std::vector<std::string> names;
+  const uint8_t *np{raw_names.data()}, *nend{raw_names.data() + raw_names.size()};
+  for (uint32_t i = 0; i < nnames; ++i) {
+    const uint32_t len{detail::get<uint32_t>(np, nend)};
+    names.emplace_back(reinterpret_cast<const char *>(np), len);
+    np += len;
+  }
+
+  TS ts(static_cast<DIM>(nrow), static_cast<DIM>(ncol));
+  if (!names.empty()) { ts.setColnames(names); }
+  detail::read_block<IDX>(is, ts.index_begin(), nrow, IDX(), false);
+  std::vector<ValidityMask> masks(masked ? ncol : 0);
+  for (uint64_t c = 0; c < ncol; ++c) {
+    detail::read_block<V>(is, ts.col_begin(static_cast<DIM>(c)), nrow, series_traits<TS>::template NA<V>(), true,
+                          masked ? &masks[c] : nullptr);
+  }
+  if (masked) { detail::set_series_masks(ts, std::move(masks)); }
+  return ts;
+}
+
+template <typename TS> TS load(const std::string &path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is) { throw std::runtime_error("load: can't open " + path); }
+  return load<TS>(is);
+}
+
+} // namespace tslib
@@ -0,0 +1,393 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include <tslib/functors.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TSLIB_SIMD_X86 1
+#define TSLIB_TARGET_SSE __attribute__((target("sse4.1")))
+#define TSLIB_TARGET_AVX2 __attribute__((target("avx2")))
+#define TSLIB_TARGET_AVX512 __attribute__((target("avx512f,avx512dq")))
+#endif
+
+namespace tslib {
+namespace simd {
+
+// NA aware arithmetic kernels over contiguous columns
+//
+// floating point columns use NaN as NA (as RNT does), so plain vector arithmetic propagates it without a branch
+// int64 columns use a sentinel NA value, the kernels compare both operands against it and blend the sentinel
+// back into the lanes where either operand was NA
+
+// arithmetic operations the kernels know about
+enum class Op { add, sub, mul, div };
+
+// instruction sets in increasing width
+enum class ISA { scalar = 0, sse = 1, avx2 = 2, avx512 = 3 };
+
+// maps the functors in functors.hpp onto kernel ops
+// functors without a specialization always take the generic path
+template <template <typename, typename> class Pred> class functor_op {
+public:
+  static const bool supported = false;
+};
+
+template <> class functor_op<PlusFunctor> {
+public:
+  static const bool supported = true;
+  static const Op op          = Op::add;
+};
+
+template <> class functor_op<MinusFunctor> {
+public:
+  static const bool supported = true;
+  static const Op op          = Op::sub;
+};
+
+template <> class functor_op<MultiplyFunctor> {
+public:
+  static const bool supported = true;
+  static const Op op          = Op::mul;
+};
+
+template <> class functor_op<DivideFunctor> {
+public:
+  static const bool supported = true;
+  static const Op op          = Op::div;
+};
+
+// value types that have kernels
+template <typename T> class kernel_type {
+public:
+  static const bool value =
+      std::is_same<T, double>::value || std::is_same<T, float>::value || std::is_same<T, std::int64_t>::value;
+};
+
+// the kernels can only honour an NA value they know how to recognise
+// for floating point that means the NA has to be a NaN, for integers any sentinel works
+template <typename T> typename std::enable_if<std::is_floating_point<T>::value, bool>::type compatible_na(T na) {
+  return std::isnan(na);
+}
+template <typename T> typename std::enable_if<!std::is_floating_point<T>::value, bool>::type compatible_na(T) {
+  return true;
+}
+
+// widest instruction set supported by the running cpu
+inline ISA detect_isa() {
+#ifdef TSLIB_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) { return ISA::avx512; }
+  if (__builtin_cpu_supports("avx2")) { return ISA::avx2; }
+  if (__builtin_cpu_supports("sse4.1")) { return ISA::sse; }
+#endif
+  return ISA::scalar;
+}
+
+namespace detail {
+inline ISA &isa_setting() {
+  static ISA isa{detect_isa()};
+  return isa;
+}
+} // namespace detail
+
+// instruction set the kernels currently dispatch to
+inline ISA active_isa() { return detail::isa_setting(); }
+
+// restrict the kernels to a narrower instruction set (eg for testing)
+// can never go wider than what the cpu supports, returns the setting that took effect
+inline ISA set_isa(ISA isa) {
+  detail::isa_setting() = std::min(isa, detect_isa());
+  return detail::isa_setting();
+}
+
+namespace detail {
+
+// scalar versions of the ops, used for the tails and the scalar fallback
+template <Op op, typename T> inline typename std::enable_if<std::is_floating_point<T>::value, T>::type apply(T x, T y) {
+  return op == Op::add ? x + y : op == Op::sub ? x - y : op == Op::mul ? x * y : x / y;
+}
+
+// integer lanes wrap instead of overflowing, the NA lanes get computed and then thrown away
+template <Op op, typename T> inline typename std::enable_if<std::is_integral<T>::value, T>::type apply(T x, T y) {
+  typedef typename std::make_unsigned<T>::type UT;
+  return op == Op::add   ? static_cast<T>(static_cast<UT>(x) + static_cast<UT>(y))
+         : op == Op::sub ? static_cast<T>(static_cast<UT>(x) - static_cast<UT>(y))
+         : op == Op::mul ? static_cast<T>(static_cast<UT>(x) * static_cast<UT>(y))
+                         : x / y;
+}
+
+template <Op op, typename T> inline void binary_scalar_fp(const T *x, const T *y, T *out, size_t n) {
+  for (size_t i = 0; i < n; ++i) { out[i] = apply<op>(x[i], y[i]); }
+}
+
+template <Op op, typename T> inline void scalar_scalar_fp(T *x, T s, size_t n) {
+  for (size_t i = 0; i < n; ++i) { x[i] = apply<op>(x[i], s); }
+}
+
+template <Op op, typename T> inline void binary_scalar_int(const T *x, const T *y, T *out, size_t n, T na) {
+  for (size_t i = 0; i < n; ++i) { out[i] = x[i] == na || y[i] == na ? na : apply<op>(x[i], y[i]); }
+}
+
+template <Op op, typename T> inline void scalar_scalar_int(T *x, T s, size_t n, T na) {
+  for (size_t i = 0; i < n; ++i) { x[i] = x[i] == na ? na : apply<op>(x[i], s); }
+}
+
+#ifdef TSLIB_SIMD_X86
+
+// vector versions of the ops
+template <Op op> TSLIB_TARGET_SSE inline __m128d vop(__m128d a, __m128d b) {
+  return op == Op::add ? _mm_add_pd(a, b) : op == Op::sub ? _mm_sub_pd(a, b) : op == Op::mul ? _mm_mul_pd(a, b) : _mm_div_pd(a, b);
+}
+template <Op op> TSLIB_TARGET_SSE inline __m128 vop(__m128 a, __m128 b) {
+  return op == Op::add ? _mm_add_ps(a, b) : op == Op::sub ? _mm_sub_ps(a, b) : op == Op::mul ? _mm_mul_ps(a, b) : _mm_div_ps(a, b);
+}
+template <Op op> TSLIB_TARGET_AVX2 inline __m256d vop(__m256d a, __m256d b) {
+  return op == Op::add   ? _mm256_add_pd(a, b)
+         : op == Op::sub ? _mm256_sub_pd(a, b)
+         : op == Op::mul ? _mm256_mul_pd(a, b)
+                         : _mm256_div_pd(a, b);
+}
+template <Op op> TSLIB_TARGET_AVX2 inline __m256 vop(__m256 a, __m256 b) {
+  return op == Op::add   ? _mm256_add_ps(a, b)
+         : op == Op::sub ? _mm256_sub_ps(a, b)
+         : op == Op::mul ? _mm256_mul_ps(a, b)
+                         : _mm256_div_ps(a, b);
+}
+template <Op op> TSLIB_TARGET_AVX512 inline __m512d vop(__m512d a, __m512d b) {
+  return op == Op::add   ? _mm512_add_pd(a, b)
+         : op == Op::sub ? _mm512_sub_pd(a, b)
+         : op == Op::mul ? _mm512_mul_pd(a, b)
+                         : _mm512_div_pd(a, b);
+}
+template <Op op> TSLIB_TARGET_AVX512 inline __m512 vop(__m512 a, __m512 b) {
+  return op == Op::add   ? _mm512_add_ps(a, b)
+         : op == Op::sub ? _mm512_sub_ps(a, b)
+         : op == Op::mul ? _mm512_mul_ps(a, b)
+                         : _mm512_div_ps(a, b);
+}
+
+// 64 bit integer lanes: sse and avx2 have no 64 bit multiply, those ops stay scalar
+template <Op op> TSLIB_TARGET_SSE inline __m128i vop(__m128i a, __m128i b) {
+  return op == Op::add ? _mm_add_epi64(a, b) : _mm_sub_epi64(a, b);
+}
+template <Op op> TSLIB_TARGET_AVX2 inline __m256i vop(__m256i a, __m256i b) {
+  return op == Op::add ? _mm256_add_epi64(a, b) : _mm256_sub_epi64(a, b);
+}
+template <Op op> TSLIB_TARGET_AVX512 inline __m512i vop(__m512i a, __m512i b) {
+  return op == Op::add ? _mm512_add_epi64(a, b) : op == Op::sub ? _mm512_sub_epi64(a, b) : _mm512_mullo_epi64(a, b);
+}
+
+// floating point loops, one set per instruction set and width
+#define TSLIB_FP_KERNELS(TARGET, SUFFIX, T, REG, W, LOADU, STOREU, SET1)                                             \
+  template <Op op> TARGET inline void binary_##SUFFIX(const T *x, const T *y, T *out, size_t n) {                      \
+    size_t i = 0;                                                                                                     \
+    for (; i + W <= n; i += W) { STOREU(out + i, vop<op>(LOADU(x + i), LOADU(y + i))); }                              \
+    for (; i < n; ++i) { out[i] = apply<op>(x[i], y[i]); }                                                            \
+  }                                                                                                                   \
+  template <Op op> TARGET inline void scalar_##SUFFIX(T *x, T s, size_t n) {                                          \
+    const REG sv = SET1(s);                                                                                           \
+    size_t i     = 0;                                                                                                 \
+    for (; i + W <= n; i += W) { STOREU(x + i, vop<op>(LOADU(x + i), sv)); }                                          \
+    for (; i < n; ++i) { x[i] = apply<op>(x[i], s); }                                                                 \
+  }
+
+TSLIB_FP_KERNELS(TSLIB_TARGET_SSE, sse_f64, double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd)
+TSLIB_FP_KERNELS(TSLIB_TARGET_SSE, sse_f32, float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps)
+TSLIB_FP_KERNELS(TSLIB_TARGET_AVX2, avx2_f64, double, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd)
+TSLIB_FP_KERNELS(TSLIB_TARGET_AVX2, avx2_f32, float, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps)
+TSLIB_FP_KERNELS(TSLIB_TARGET_AVX512, avx512_f64, double, __m512d, 8, _mm512_loadu_pd, _mm512_storeu_pd,
+                 _mm512_set1_pd)
+TSLIB_FP_KERNELS(TSLIB_TARGET_AVX512, avx512_f32, float, __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps,
+                 _mm512_set1_ps)
+
+#undef TSLIB_FP_KERNELS
+
+// int64 loops: compare both operands with the NA sentinel and blend it back into those lanes
+template <Op op>
+TSLIB_TARGET_SSE inline void binary_sse_i64(const std::int64_t *x, const std::int64_t *y, std::int64_t *out, size_t n,
+                                            std::int64_t na) {
+  const __m128i nav = _mm_set1_epi64x(na);
+  size_t i          = 0;
+  for (; i + 2 <= n; i += 2) {
+    const __m128i a    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+    const __m128i b    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i));
+    const __m128i mask = _mm_or_si128(_mm_cmpeq_epi64(a, nav), _mm_cmpeq_epi64(b, nav));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_blendv_epi8(vop<op>(a, b), nav, mask));
+  }
+  binary_scalar_int<op>(x + i, y + i, out + i, n - i, na);
+}
+
+template <Op op> TSLIB_TARGET_SSE inline void scalar_sse_i64(std::int64_t *x, std::int64_t s, size_t n, std::int64_t na) {
+  const __m128i nav = _mm_set1_epi64x(na), sv = _mm_set1_epi64x(s);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(x + i), _mm_blendv_epi8(vop<op>(a, sv), nav, _mm_cmpeq_epi64(a, nav)));
+  }
+  scalar_scalar_int<op>(x + i, s, n - i, na);
+}
+
+template <Op op>
+TSLIB_TARGET_AVX2 inline void binary_avx2_i64(const std::int64_t *x, const std::int64_t *y, std::int64_t *out, size_t n,
+                                              std::int64_t na) {
+  const __m256i nav = _mm256_set1_epi64x(na);
+  size_t i          = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256i a    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+    const __m256i b    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + i));
+    const __m256i mask = _mm256_or_si256(_mm256_cmpeq_epi64(a, nav), _mm256_cmpeq_epi64(b, nav));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_blendv_epi8(vop<op>(a, b), nav, mask));
+  }
+  binary_scalar_int<op>(x + i, y + i, out + i, n - i, na);
+}
+
+template <Op op>
+TSLIB_TARGET_AVX2 inline void scalar_avx2_i64(std::int64_t *x, std::int64_t s, size_t n, std::int64_t na) {
+  const __m256i nav = _mm256_set1_epi64x(na), sv = _mm256_set1_epi64x(s);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(x + i),
+                        _mm256_blendv_epi8(vop<op>(a, sv), nav, _mm256_cmpeq_epi64(a, nav)));
+  }
+  scalar_scalar_int<op>(x + i, s, n - i, na);
+}
+
+template <Op op>
+TSLIB_TARGET_AVX512 inline void binary_avx512_i64(const std::int64_t *x, const std::int64_t *y, std::int64_t *out,
+                                                  size_t n, std::int64_t na) {
+  const __m512i nav = _mm512_set1_epi64(na);
+  size_t i          = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m512i a     = _mm512_loadu_si512(x + i);
+    const __m512i b     = _mm512_loadu_si512(y + i);
+    const __mmask8 mask = _mm512_cmpeq_epi64_mask(a, nav) | _mm512_cmpeq_epi64_mask(b, nav);
+    _mm512_storeu_si512(out + i, _mm512_mask_blend_epi64(mask, vop<op>(a, b), nav));
+  }
+  binary_scalar_int<op>(x + i, y + i, out + i, n - i, na);
+}
+
+template <Op op>
+TSLIB_TARGET_AVX512 inline void scalar_avx512_i64(std::int64_t *x, std::int64_t s, size_t n, std::int64_t na) {
+  const __m512i nav = _mm512_set1_epi64(na), sv = _mm512_set1_epi64(s);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m512i a = _mm512_loadu_si512(x + i);
+    _mm512_storeu_si512(x + i, _mm512_mask_blend_epi64(_mm512_cmpeq_epi64_mask(a, nav), vop<op>(a, sv), nav));
+  }
+  scalar_scalar_int<op>(x + i, s, n - i, na);
+}
+
+#endif // TSLIB_SIMD_X86
+
+} // namespace detail
+
+// out[i] = x[i] op y[i], NA if either side is NA
+// out may alias x or y
+template <Op op> inline void binary(const double *x, const double *y, double *out, size_t n, double) {
+  switch (active_isa()) {
+#ifdef TSLIB_SIMD_X86
+  case ISA::avx512: return detail::binary_avx512_f64<op>(x, y, out, n);
+  case ISA::avx2: return detail::binary_avx2_f64<op>(x, y, out, n);
+  case ISA::sse: return detail::binary_sse_f64<op>(x, y, out, n);
+#endif
+  default: return detail::binary_scalar_fp<op>(x, y, out, n);
+  }
+}
+
+template <Op op> inline void binary(const float *x, const float *y, float *out, size_t n, float) {
+  switch (active_isa()) {
+#ifdef TSLIB_SIMD_X86
+  case ISA::avx512: return detail::binary_avx512_f32<op>(x, y, out, n);
+  case ISA::avx2: return detail::binary_avx2_f32<op>(x, y, out, n);
+  case ISA::sse: return detail::binary_sse_f32<op>(x, y, out, n);
+#endif
+  default: return detail::binary_scalar_fp<op>(x, y, out, n);
+  }
+}
+
+template <Op op>
+inline void binary(const std::int64_t *x, const std::int64_t *y, std::int64_t *out, size_t n, std::int64_t na) {
+  const bool vectorizable{op == Op::add || op == Op::sub};
+  switch (active_isa()) {
+#ifdef TSLIB_SIMD_X86
+  case ISA::avx512:
+    if (op != Op::div) { return detail::binary_avx512_i64<op>(x, y, out, n, na); }
+    break;
+  case ISA::avx2:
+    if (vectorizable) { return detail::binary_avx2_i64<op>(x, y, out, n, na); }
+    break;
+  case ISA::sse:
+    if (vectorizable) { return detail::binary_sse_i64<op>(x, y, out, n, na); }
+    break;
+#endif
+  default: break;
+  }
+  detail::binary_scalar_int<op>(x, y, out, n, na);
+}
+
+// x[i] = x[i] op s, NA elements of x stay NA
+template <Op op> inline void scalar(double *x, double s, size_t n, double) {
+  switch (active_isa()) {
+#ifdef TSLIB_SIMD_X86
+  case ISA::avx512: return detail::scalar_avx512_f64<op>(x, s, n);
+  case ISA::avx2: return detail::scalar_avx2_f64<op>(x, s, n);
+  case ISA::sse: return detail::scalar_sse_f64<op>(x, s, n);
+#endif
+  default: return detail::scalar_scalar_fp<op>(x, s, n);
+  }
+}
+
+template <Op op> inline void scalar(float *x, float s, size_t n, float) {
+  switch (active_isa()) {
+#ifdef TSLIB_SIMD_X86
+  case ISA::avx512: return detail::scalar_avx512_f32<op>(x, s, n);
+  case ISA::avx2: return detail::scalar_avx2_f32<op>(x, s, n);
+  case ISA::sse: return detail::scalar_sse_f32<op>(x, s, n);
+#endif
+  default: return detail::scalar_scalar_fp<op>(x, s, n);
+  }
+}
+
+template <Op op> inline void scalar(std::int64_t *x, std::int64_t s, size_t n, std::int64_t na) {
+  const bool vectorizable{op == Op::add || op == Op::sub};
+  switch (active_isa()) {
+#ifdef TSLIB_SIMD_X86
+  case ISA::avx512:
+    if (op != Op::div) { return detail::scalar_avx512_i64<op>(x, s, n, na); }
+    break;
+  case ISA::avx2:
+    if (vectorizable) { return detail::scalar_avx2_i64<op>(x, s, n, na); }
+    break;
+  case ISA::sse:
+    if (vectorizable) { return detail::scalar_sse_i64<op>(x, s, n, na); }
+    break;
+#endif
+  default: break;
+  }
+  detail::scalar_scalar_int<op>(x, s, n, na);
+}
+
+} // namespace simd
+} // namespace tslib
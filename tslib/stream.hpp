@@ -0,0 +1,312 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <tslib/rolling.hpp>
+#include <tslib/tseries.hpp>
+
+namespace tslib {
+
+// incremental evaluation over series that grow at the end
+//
+// a node refers to its inputs and remembers how far into them it has got, update(out) turns the rows appended
+// since the last call into rows appended to out, whose backend has append(idx, const V *row) (eg AppendBackend)
+// the rows are the same, bit for bit, as a full recompute (binary_opp, lag_copy, rolling) gives: every value goes
+// through the same arithmetic, and rolling accumulators see the same pushes and pops in the same order
+// the position in an input is found again from the last index value used, so inputs may drop rows off the front
+// (ring mode) as long as they keep the rows a node still needs: the last n for a lag, the window for rolling
+// indexes must be strictly increasing, the node is meant to be updated from the thread appending to its inputs
+
+namespace detail {
+
+// how far a node has got into a growing input
+template <typename IDX> class StreamCursor {
+private:
+  bool started_;
+  IDX last_;
+  size_t next_;
+
+public:
+  StreamCursor() : started_{false}, last_(), next_{0} {}
+
+  // finds the row after the last one consumed again, returns the number of rows dropped off the front since
+  template <typename TS> size_t sync(const TS &ts) {
+    if (!started_) { return 0; }
+    const auto idx = ts.index_begin();
+    if (next_ <= static_cast<size_t>(ts.nrow()) && idx[next_ - 1] == last_) { return 0; }
+    const size_t pos{static_cast<size_t>(std::upper_bound(idx, ts.index_end(), last_) - idx)};
+    if (pos > next_) { throw std::logic_error("stream: input index went back"); }
+    const size_t dropped{next_ - pos};
+    next_ = pos;
+    return dropped;
+  }
+  void consume(IDX x) {
+    started_ = true;
+    last_    = x;
+    ++next_;
+  }
+  // position of the first row not consumed
+  size_t next() const { return next_; }
+};
+
+// append reads a value for every column of out from the row a node fills, so the widths have to agree
+template <typename OUT> void stream_check_width(const OUT &out, size_t ncol) {
+  if (static_cast<size_t>(out.ncol()) != ncol) {
+    throw std::logic_error("stream: the output must have as many columns as the node gives.");
+  }
+}
+
+template <typename OUT, typename TS> void stream_colnames(OUT &out, const TS &ts) {
+  if (!out.hasColnames() && ts.hasColnames()) { out.setColnames(ts.getColnames()); }
+}
+
+} // namespace detail
+
+// lhs Pred rhs on the rows where the indexes meet, as binary_opp
+template <template <typename, typename> class Pred, typename L, typename R> class StreamingBinary {
+private:
+  typedef typename L::value_type U;
+  typedef typename R::value_type V;
+  typedef typename Pred<U, V>::RT RV;
+  typedef typename std::iterator_traits<typename L::const_index_iterator>::value_type IDX;
+
+  const L &lhs_;
+  const R &rhs_;
+  detail::StreamCursor<IDX> l_, r_;
+  std::vector<typename L::const_data_iterator> lcols_;
+  std::vector<typename R::const_data_iterator> rcols_;
+  std::vector<RV> row_;
+
+public:
+  StreamingBinary(const L &lhs, const R &rhs)
+      : lhs_(lhs), rhs_(rhs), l_(), r_(), lcols_(), rcols_(),
+        row_(static_cast<size_t>(std::max<decltype(lhs.ncol())>(lhs.ncol(), rhs.ncol()))) {
+    if (lhs.ncol() != rhs.ncol() && lhs.ncol() != 1 && rhs.ncol() != 1) {
+      throw std::logic_error("Number of colums must match. or one time series must be a single column.");
+    }
+  }
+
+  // appends the new rows to out, returns how many
+  template <typename OUT> size_t update(OUT &out) {
+    static_assert(std::is_same<typename OUT::value_type, RV>::value, "output holds the result type of Pred");
+    detail::stream_check_width(out, row_.size());
+    l_.sync(lhs_);
+    r_.sync(rhs_);
+    const size_t ln{static_cast<size_t>(lhs_.nrow())}, rn{static_cast<size_t>(rhs_.nrow())};
+    if (l_.next() >= ln || r_.next() >= rn) { return 0; }
+    const size_t ncol{row_.size()};
+    // appends invalidate iterators, so they are taken again on every update
+    lcols_.clear();
+    rcols_.clear();
+    for (size_t c = 0; c < ncol; ++c) {
+      lcols_.push_back(lhs_.col_begin(lhs_.ncol() == 1 ? 0 : static_cast<decltype(lhs_.ncol())>(c)));
+      rcols_.push_back(rhs_.col_begin(rhs_.ncol() == 1 ? 0 : static_cast<decltype(rhs_.ncol())>(c)));
+    }
+    detail::stream_colnames(out, lhs_.getColnamesSize() >= rhs_.getColnamesSize() ? lhs_ : rhs_);
+
+    const auto lidx = lhs_.index_begin();
+    const auto ridx = rhs_.index_begin();
+    Pred<U, V> pred;
+    size_t added{0};
+    while (l_.next() < ln && r_.next() < rn) {
+      const IDX a{lidx[l_.next()]}, b{ridx[r_.next()]};
+      if (a < b) {
+        l_.consume(a);
+      } else if (b < a) {
+        r_.consume(b);
+      } else {
+        for (size_t c = 0; c < ncol; ++c) {
+          const U x{lcols_[c][l_.next()]};
+          const V y{rcols_[c][r_.next()]};
+          row_[c] = series_traits<L>::ISNA(x) || series_traits<R>::ISNA(y) ? series_traits<OUT>::template NA<RV>()
+                                                                           : pred(x, y);
+        }
+        out.getBackend().append(a, row_.data());
+        l_.consume(a);
+        r_.consume(b);
+        ++added;
+      }
+    }
+    return added;
+  }
+};
+
+// the values of ts moved n rows down its index, as lag_copy
+template <typename TS> class StreamingLag {
+private:
+  typedef typename TS::value_type V;
+  typedef typename std::iterator_traits<typename TS::const_index_iterator>::value_type IDX;
+
+  const TS &ts_;
+  size_t n_;
+  detail::StreamCursor<IDX> cursor_;
+  // rows consumed since the start
+  size_t seen_;
+  std::vector<typename TS::const_data_iterator> cols_;
+  std::vector<V> row_;
+
+public:
+  StreamingLag(const TS &ts, size_t n)
+      : ts_(ts), n_{n}, cursor_(), seen_{0}, cols_(), row_(static_cast<size_t>(ts.ncol())) {}
+
+  template <typename OUT> size_t update(OUT &out) {
+    detail::stream_check_width(out, row_.size());
+    cursor_.sync(ts_);
+    const size_t nrow{static_cast<size_t>(ts_.nrow())};
+    if (cursor_.next() >= nrow) { return 0; }
+    cols_.clear();
+    for (size_t c = 0; c < row_.size(); ++c) { cols_.push_back(ts_.col_begin(static_cast<decltype(ts_.ncol())>(c))); }
+    detail::stream_colnames(out, ts_);
+
+    const auto idx = ts_.index_begin();
+    size_t added{0};
+    for (; cursor_.next() < nrow; ++seen_) {
+      const size_t i{cursor_.next()};
+      const IDX x{idx[i]};
+      if (seen_ >= n_) {
+        if (i < n_) { throw std::logic_error("stream: the input dropped rows the lag needs"); }
+        for (size_t c = 0; c < row_.size(); ++c) { row_[c] = cols_[c][i - n_]; }
+        out.getBackend().append(x, row_.data());
+        ++added;
+      }
+      cursor_.consume(x);
+    }
+    return added;
+  }
+};
+
+// window of the rows less than span days back, as CalendarWindow, with the starts found as rows arrive
+class CalendarSpan {
+private:
+  double span_;
+
+public:
+  explicit CalendarSpan(double span) : span_{span} {
+    if (!(span > 0)) { throw std::logic_error("rolling: calendar window span must be positive."); }
+  }
+  double span() const { return span_; }
+};
+
+namespace detail {
+
+// start of the window ending at row i (pos in the input, abs counted from the first row streamed), given the
+// current start lo (abs), base is the abs number of the input's first row
+template <typename TS> size_t stream_window_start(const RowWindow &w, const TS &, size_t, size_t abs, size_t, size_t) {
+  return w.start(abs);
+}
+template <typename TS>
+size_t stream_window_start(const CalendarSpan &w, const TS &ts, size_t pos, size_t, size_t lo, size_t base) {
+  const auto idx = ts.index_begin();
+  while (lo < base || series_traits<TS>::daily_distance(idx[pos], idx[lo - base]) >= w.span()) {
+    if (lo < base) { throw std::logic_error("stream: the input dropped rows the window needs"); }
+    ++lo;
+  }
+  return lo;
+}
+
+} // namespace detail
+
+// accumulator ACC over a window of every column, as rolling
+// the accumulators carry over from one update to the next, only the new rows are pushed
+template <template <typename> class ACC, typename TS, typename WINDOW> class StreamingRolling {
+private:
+  typedef typename TS::value_type V;
+  typedef typename ACC<V>::result_type RT;
+  typedef typename std::iterator_traits<typename TS::const_index_iterator>::value_type IDX;
+
+  const TS &ts_;
+  WINDOW window_;
+  size_t need_;
+  detail::StreamCursor<IDX> cursor_;
+  // abs numbers count rows from the first one streamed: the next row, the first row in the input, the window start
+  size_t seen_;
+  size_t base_;
+  size_t lo_;
+  std::vector<ACC<V>> accs_;
+  std::vector<typename TS::const_data_iterator> cols_;
+  std::vector<RT> row_;
+
+public:
+  StreamingRolling(const TS &ts, const WINDOW &window, size_t min_periods)
+      : ts_(ts), window_(window), need_{std::max(min_periods, size_t{ACC<V>::min_count})}, cursor_(), seen_{0},
+        base_{0}, lo_{0}, accs_(static_cast<size_t>(ts.ncol())), cols_(), row_(static_cast<size_t>(ts.ncol())) {}
+
+  template <typename OUT> size_t update(OUT &out) {
+    static_assert(std::is_same<typename OUT::value_type, RT>::value, "output holds the result type of ACC");
+    detail::stream_check_width(out, row_.size());
+    base_ += cursor_.sync(ts_);
+    const size_t nrow{static_cast<size_t>(ts_.nrow())};
+    if (cursor_.next() >= nrow) { return 0; }
+    const size_t ncol{row_.size()};
+    cols_.clear();
+    for (size_t c = 0; c < ncol; ++c) { cols_.push_back(ts_.col_begin(static_cast<decltype(ts_.ncol())>(c))); }
+    detail::stream_colnames(out, ts_);
+
+    const auto idx = ts_.index_begin();
+    size_t added{0};
+    for (; cursor_.next() < nrow; ++seen_, ++added) {
+      const size_t i{cursor_.next()};
+      for (size_t c = 0; c < ncol; ++c) {
+        const V x{cols_[c][i]};
+        if (!series_traits<TS>::ISNA(x)) { accs_[c].push(seen_, x); }
+      }
+      for (const size_t start = detail::stream_window_start<TS>(window_, ts_, i, seen_, lo_, base_); lo_ < start;
+           ++lo_) {
+        if (lo_ < base_) { throw std::logic_error("stream: the input dropped rows the window needs"); }
+        for (size_t c = 0; c < ncol; ++c) {
+          const V old{cols_[c][lo_ - base_]};
+          if (!series_traits<TS>::ISNA(old)) { accs_[c].pop(lo_, old); }
+        }
+      }
+      for (size_t c = 0; c < ncol; ++c) {
+        row_[c] = accs_[c].count() >= need_ ? accs_[c].value() : series_traits<TS>::template NA<RT>();
+      }
+      const IDX x{idx[i]};
+      out.getBackend().append(x, row_.data());
+      cursor_.consume(x);
+    }
+    return added;
+  }
+};
+
+// node makers
+
+template <template <typename, typename> class Pred, typename L, typename R>
+StreamingBinary<Pred, L, R> stream_binary(const L &lhs, const R &rhs) {
+  return StreamingBinary<Pred, L, R>(lhs, rhs);
+}
+
+template <typename TS> StreamingLag<TS> stream_lag(const TS &ts, size_t n) { return StreamingLag<TS>(ts, n); }
+
+// rolling over the last n rows, NA until the window is full
+template <template <typename> class ACC, typename TS> StreamingRolling<ACC, TS, RowWindow> stream_rolling(const TS &ts, size_t n) {
+  return StreamingRolling<ACC, TS, RowWindow>(ts, RowWindow(n), n);
+}
+
+// rolling over the rows less than span days back, NA until min_periods values are available
+template <template <typename> class ACC, typename TS>
+StreamingRolling<ACC, TS, CalendarSpan> stream_rolling_calendar(const TS &ts, double span, size_t min_periods = 1) {
+  return StreamingRolling<ACC, TS, CalendarSpan>(ts, CalendarSpan(span), min_periods);
+}
+
+} // namespace tslib
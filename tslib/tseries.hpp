@@ -15,18 +15,60 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>. //
 ///////////////////////////////////////////////////////////////////////////
 #pragma once
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <stdexcept>
 #include <string>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include <tslib/execution.hpp>
 #include <tslib/functors.hpp>
+#include <tslib/instrument.hpp>
 #include <tslib/intersection.map.hpp>
+#include <tslib/iterator.traits.hpp>
+#include <tslib/simd.kernels.hpp>
+#include <tslib/validity.hpp>
 
 namespace tslib {
 
+namespace detail {
+// true when Pred over values of type T stored behind ITER can run through the simd kernels
+template <template <typename, typename> class Pred, typename T, typename ITER> class use_kernel {
+public:
+  static const bool value =
+      simd::functor_op<Pred>::supported && simd::kernel_type<T>::value && is_contiguous_iterator<ITER>::value;
+};
+
+// false when the NT policy says values of type T never hold NA (has_NA), the NA tests on them compile away
+// policies without has_NA are taken to have NA
+template <template <typename> class NT, typename T> class nullable {
+private:
+  template <typename P> static std::integral_constant<bool, P::has_NA> test(int);
+  template <typename> static std::true_type test(long);
+
+public:
+  static const bool value = decltype(test<NT<T>>(0))::value;
+};
+
+template <template <typename> class NT, typename T> inline bool is_na(T x) {
+  if constexpr (nullable<NT, T>::value) {
+    return NT<T>::ISNA(x);
+  } else {
+    return false;
+  }
+}
+} // namespace detail
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+class TSeriesView;
+
 // date class is a template class
 // class backend is typically the vector backend in the vector.backend.hpp
 // DatePolicy is usually the GregorianDate
@@ -40,6 +82,8 @@ private:
   BACKEND<IDX, V, DIM> tsdata_;
 
 public:
+  // type of the values in the series
+  typedef V value_type;
   // define typenames for the backend's iterators for the index and the data
   typedef typename BACKEND<IDX, V, DIM>::const_index_iterator const_index_iterator;
   typedef typename BACKEND<IDX, V, DIM>::index_iterator index_iterator;
@@ -48,6 +92,10 @@ public:
   // define row iterators to navigate the "matrix"
   typedef typename std::vector<const_data_iterator> const_row_iterator;
   typedef typename std::vector<data_iterator> row_iterator;
+  // the backend type
+  typedef BACKEND<IDX, V, DIM> backend_type;
+  // non-owning view of a series, see TSeriesView
+  typedef TSeriesView<IDX, V, DIM, BACKEND, DatePolicy, NT> view_type;
 
   // ctors
 
@@ -55,8 +103,29 @@ public:
   TSeries(const TSeries &T) : tsdata_(T.tsdata_) {}
   // constructor when backend class is given. Copy the backend vector
   TSeries(BACKEND<IDX, V, DIM> &tsdata) : tsdata_{tsdata} {}
+  // constructor taking over a backend, eg one mapped from a file
+  TSeries(BACKEND<IDX, V, DIM> &&tsdata) : tsdata_{std::move(tsdata)} {}
   // constructor providing dimensions in order to create the backend vector
   TSeries(DIM nrow, DIM ncol) : tsdata_{nrow, ncol} {}
+  // constructor copying the rows and columns of a view into a new backend
+  // the columns are copied with the given execution policy
+  TSeries(const view_type &v, ExecutionPolicy &policy = default_execution()) : tsdata_{v.nrow(), v.ncol()} {
+    std::copy(v.index_begin(), v.index_end(), index_begin());
+    setColnames(v.getColnames());
+    for_each_block(policy, nrow(), ncol(), sizeof(V), [&](size_t i, size_t r0, size_t r1) {
+      typename view_type::const_data_iterator src_beg{v.col_begin(static_cast<DIM>(i))};
+      data_iterator dst_beg{col_begin(static_cast<DIM>(i))};
+      std::advance(src_beg, r0);
+      std::advance(dst_beg, r0);
+      std::copy_n(src_beg, r1 - r0, dst_beg);
+    });
+    // a view of a masked series gives a masked copy, so a valid value equal to the NA sentinel stays valid
+    if (v.hasValidity()) {
+      std::vector<ValidityMask> masks;
+      for (DIM i = 0; i < ncol(); ++i) { masks.push_back(v.validity(i)); }
+      detail::set_series_masks(*this, std::move(masks));
+    }
+  }
   // disable move constructor
   TSeries(TSeries &&) = default;
 
@@ -64,6 +133,7 @@ public:
 
   // get the backend vector
   const BACKEND<IDX, V, DIM> &getBackend() const { return tsdata_; }
+  BACKEND<IDX, V, DIM> &getBackend() { return tsdata_; }
   // get the colnames of the backend vector
   const std::vector<std::string> getColnames() const { return tsdata_.getColnames(); }
   // get the number of column names in the backend vector
@@ -107,102 +177,505 @@ public:
     return ans;
   }
 
-  // returns a time series with a lag
-  // const qualified so that it will not modify the class
-  // passes in a lag number
-  TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> lag(DIM n) const {
+  // views
+  // these don't copy anything, the view refers to this series and must not outlive it
+  // on a temporary there is nothing to refer to, so they return an owning copy instead
 
-    // if ur lag is bigger than the number of rows, throw error
-    if (n >= nrow()) { throw std::logic_error("lag: n > nrow of time series."); }
-    // create a time series with dimensions of num rows - lag and same number of columns
-    // removes forward NAs
-    TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> ans(nrow() - n, ncol());
+  // view of the whole series
+  view_type view() const { return view_type(*this); }
 
-    // copy over dates
+  // returns a time series with a lag
+  // the index starts n rows in and the values start at the top, removing forward NAs
+  view_type lag(DIM n) const & { return view().lag(n); }
+  TSeries lag(DIM n) && { return lag_copy(n); }
+  // same thing as an owning series, the columns are copied with the given execution policy
+  TSeries lag_copy(DIM n, ExecutionPolicy &policy = default_execution()) const { return TSeries(view().lag(n), policy); }
 
-    // get the first row
-    const_index_iterator beg{index_begin()};
-    // advance the first iterator n times
-    std::advance(beg, n);
-    // copy from this into the new time series
-    std::copy(beg, index_end(), ans.index_begin());
+  // the rows with from <= index <= to
+  view_type window(IDX from, IDX to) const & { return view().window(from, to); }
+  TSeries window(IDX from, IDX to) && { return TSeries(view().window(from, to)); }
 
-    // copy colnames
-    ans.setColnames(getColnames());
-
-    // for each column
-    for (DIM i = 0; i < ncol(); ++i) {
-      // get starting and ending iterators for the column
-      const_data_iterator src_beg{col_begin(i)};
-      const_data_iterator src_end{col_end(i)};
-      // create a data iterator to be the ans time series iterator at the start of the column
-      data_iterator dst_beg{ans.col_begin(i)};
-      // move the end of the iterator, go back n times
-      std::advance(src_end, -n);
-      // copy that into the ans data iterator
-      std::copy(src_beg, src_end, dst_beg);
-    }
-    return ans;
-  }
+  // columns [first, first + count)
+  view_type columns(DIM first, DIM count) const & { return view().columns(first, count); }
+  TSeries columns(DIM first, DIM count) && { return TSeries(view().columns(first, count)); }
+  // the listed columns, in the order given
+  view_type columns(const std::vector<DIM> &cols) const & { return view().columns(cols); }
+  TSeries columns(const std::vector<DIM> &cols) && { return TSeries(view().columns(cols)); }
 
   // operator overloards
   /* compound ops only for scalar ops, self-assignment doesn't make sense when nrow is changing */
   
-  // return a time series of common type with the operator +=
-  // why no reference to rhs
-  // what happens when there is an NA
-  template <typename S>
-  TSeries<IDX, typename std::common_type<V, S>::type, DIM, BACKEND, DatePolicy, NT> &operator+=(S rhs) {
-    // for each column
-    for (DIM i = 0; i < ncol(); ++i) {
-      // for each column iterator pair
-      for (auto iter = col_begin(i); iter != col_end(i); ++iter) {
-        // if the iterator is not an NA, then add rhs 
-        if (!NT<V>::ISNA(*iter)) { *iter += rhs; }
-      }
-    }
+  // adds the scalar to every value, the results are converted back to V
+  // NA values are left as NA
+  template <typename S> TSeries &operator+=(S rhs) {
+    scalar_opp<PlusFunctor>(rhs);
     // return this time series
     return *this;
   }
 
   // same thing but for subtract
-  template <typename S>
-  TSeries<IDX, typename std::common_type<V, S>::type, DIM, BACKEND, DatePolicy, NT> &operator-=(S rhs) {
-    for (DIM i = 0; i < ncol(); ++i) {
-      for (auto iter = col_begin(i); iter != col_end(i); ++iter) {
-        if (!NT<V>::ISNA(*iter)) { *iter -= rhs; }
-      }
-    }
+  template <typename S> TSeries &operator-=(S rhs) {
+    scalar_opp<MinusFunctor>(rhs);
     return *this;
   }
 
   // same thing but for multiply
-  template <typename S>
-  TSeries<IDX, typename std::common_type<V, S>::type, DIM, BACKEND, DatePolicy, NT> &operator*=(S rhs) {
-    for (DIM i = 0; i < ncol(); ++i) {
-      for (auto iter = col_begin(i); iter != col_end(i); ++iter) {
-        if (!NT<V>::ISNA(*iter)) { *iter *= rhs; }
-      }
-    }
+  template <typename S> TSeries &operator*=(S rhs) {
+    scalar_opp<MultiplyFunctor>(rhs);
     return *this;
   }
 
   // same thing but for divide
-  template <typename S>
-  TSeries<IDX, typename std::common_type<V, S>::type, DIM, BACKEND, DatePolicy, NT> &operator/=(S rhs) {
-    for (DIM i = 0; i < ncol(); ++i) {
-      for (auto iter = col_begin(i); iter != col_end(i); ++iter) {
-        if (!NT<V>::ISNA(*iter)) { *iter /= rhs; }
+  template <typename S> TSeries &operator/=(S rhs) {
+    scalar_opp<DivideFunctor>(rhs);
+    return *this;
+  }
+
+  // f applied to every value that is not NA in a single pass, the results are converted back to V
+  // on an rvalue the values are updated in place, so a chain like ((x * a) + b).log() allocates once
+  // see tslib/pipeline.hpp to run several transforms in the one pass
+  template <typename F> TSeries apply(F f) const & {
+    TSeries res(*this);
+    res.transform(f);
+    return res;
+  }
+  template <typename F> TSeries apply(F f) && {
+    transform(f);
+    return std::move(*this);
+  }
+
+  // natural log, NA for values that are not positive
+  TSeries log() const & { return apply(log_step()); }
+  TSeries log() && { return std::move(*this).apply(log_step()); }
+
+private:
+  static auto log_step() {
+    return [](V x) { return x > 0 ? std::log(static_cast<double>(x)) : std::numeric_limits<double>::quiet_NaN(); };
+  }
+
+  // sets x to f(x) converted back to V, a NaN result makes x NA and gives false
+  template <typename F> static bool transform_value(const F &f, V &x) {
+    const auto y = f(x);
+    if constexpr (std::is_floating_point<decltype(y)>::value) {
+      if (std::isnan(y)) {
+        x = NT<V>::NA();
+        return false;
       }
     }
-    return *this;
+    x = static_cast<V>(y);
+    return true;
+  }
+
+  template <typename F> void transform(const F &f) {
+    typedef std::integral_constant<bool, detail::keeps_masks<TSeries>::value> maskable;
+    if (detail::series_mask(*this, 0)) { return masked_transform(f, maskable()); }
+    const V na{NT<V>::NA()};
+    for_each_block(default_execution(), nrow(), ncol(), sizeof(V), [&](size_t i, size_t r0, size_t r1) {
+      data_iterator iter{col_begin(static_cast<DIM>(i))};
+      std::advance(iter, r0);
+      if constexpr (is_contiguous_iterator<data_iterator>::value && std::is_floating_point<V>::value) {
+        // floating point can't trap on an NA, so f runs on every value without a branch and the NAs are kept after
+        V *x{r1 > r0 ? to_pointer(iter) : nullptr};
+        for (size_t r = 0; r < r1 - r0; ++r) {
+          const V y{static_cast<V>(f(x[r]))};
+          x[r] = detail::is_na<NT>(x[r]) ? x[r] : std::isnan(y) ? na : y;
+        }
+      } else {
+        for (size_t r = r0; r < r1; ++r, ++iter) {
+          V x{*iter};
+          if (!detail::is_na<NT>(x)) {
+            transform_value(f, x);
+            *iter = x;
+          }
+        }
+      }
+    });
+  }
+
+  // backends without masks never get here
+  template <typename F> void masked_transform(const F &, std::false_type) {}
+
+  // columns with validity masks: the mask says which rows are NA, whatever value they hold
+  // rows whose result is NA are cleared from the mask, NA rows are left alone
+  template <typename F> void masked_transform(const F &f, std::true_type) {
+    const size_t ncols{static_cast<size_t>(ncol())};
+    policy_for(default_execution(), static_cast<size_t>(nrow()) * ncols).parallel_for(ncols, [&](size_t i) {
+      const data_iterator col{col_begin(static_cast<DIM>(i))};
+      ValidityMask &mask{getBackend().validity(static_cast<DIM>(i))};
+      // blocks() has already read the words it hands out, so clearing a bit in them on the way is safe
+      auto row = [&](size_t r) {
+        V x{col[r]};
+        if (!transform_value(f, x)) { mask.set(r, false); }
+        col[r] = x;
+      };
+      mask.blocks(
+          [&](size_t b, size_t e) {
+            for (size_t r = b; r < e; ++r) { row(r); }
+          },
+          [](size_t, size_t) {},
+          [&](size_t b, size_t e, std::uint64_t word) {
+            for (size_t r = b; r < e; ++r) {
+              if ((word >> (r - b)) & 1) { row(r); }
+            }
+          });
+    });
+  }
+
+  // the kernels only apply when the scalar can be converted to V without changing the result
+  template <template <typename, typename> class Pred, typename S>
+  using scalar_kernel = std::integral_constant<bool, detail::use_kernel<Pred, V, data_iterator>::value &&
+                                                         detail::nullable<NT, V>::value &&
+                                                         std::is_same<typename std::common_type<V, S>::type, V>::value>;
+
+  // applies Pred with the scalar to every value that is not NA
+  template <template <typename, typename> class Pred, typename S> void scalar_opp(S rhs) {
+    typedef std::integral_constant<bool, detail::keeps_masks<TSeries>::value> maskable;
+    if (detail::series_mask(*this, 0)) { return masked_scalar_opp<Pred>(rhs, maskable()); }
+    scalar_opp<Pred>(rhs, scalar_kernel<Pred, S>());
+  }
+
+  // backends without masks never get here
+  template <template <typename, typename> class Pred, typename S> void masked_scalar_opp(S, std::false_type) {}
+
+  // columns with validity masks, runs of valid rows are updated without looking at the values
+  // a floating point result that is NaN (0 / 0.0) clears its row from the mask
+  template <template <typename, typename> class Pred, typename S> void masked_scalar_opp(S rhs, std::true_type) {
+    const size_t ncols{static_cast<size_t>(ncol())};
+    policy_for(default_execution(), static_cast<size_t>(nrow()) * ncols).parallel_for(ncols, [&](size_t i) {
+      Pred<V, S> pred;
+      const data_iterator col{col_begin(static_cast<DIM>(i))};
+      ValidityMask &mask{getBackend().validity(static_cast<DIM>(i))};
+      // blocks() has already read the words it hands out, so clearing a bit in them on the way is safe
+      auto row = [&](size_t r) {
+        col[r] = pred(col[r], rhs);
+        if (std::is_floating_point<V>::value && NT<V>::ISNA(col[r])) { mask.set(r, false); }
+      };
+      mask.blocks(
+          [&](size_t b, size_t e) {
+            for (size_t r = b; r < e; ++r) { row(r); }
+          },
+          [](size_t, size_t) {},
+          [&](size_t b, size_t e, std::uint64_t word) {
+            for (size_t r = b; r < e; ++r) {
+              if ((word >> (r - b)) & 1) { row(r); }
+            }
+          });
+    });
+  }
+
+  // generic version, applies the functor to every element that is not NA
+  template <template <typename, typename> class Pred, typename S> void scalar_opp(S rhs, std::false_type) {
+    // for each block of each column
+    for_each_block(default_execution(), nrow(), ncol(), sizeof(V), [&](size_t i, size_t r0, size_t r1) {
+      Pred<V, S> pred;
+      data_iterator iter{col_begin(static_cast<DIM>(i))};
+      std::advance(iter, r0);
+      for (size_t r = r0; r < r1; ++r, ++iter) {
+        // if the iterator is not an NA, then apply the functor
+        if (!detail::is_na<NT>(*iter)) { *iter = pred(*iter, rhs); }
+      }
+    });
+  }
+
+  // vectorized version over the raw column memory
+  template <template <typename, typename> class Pred, typename S> void scalar_opp(S rhs, std::true_type) {
+    const V na{NT<V>::NA()};
+    // the kernels can't recognise this NA, use the generic loop
+    if (!simd::compatible_na(na)) { return scalar_opp<Pred>(rhs, std::false_type()); }
+    if (nrow() == 0) { return; }
+    for_each_block(default_execution(), nrow(), ncol(), sizeof(V), [&](size_t i, size_t r0, size_t r1) {
+      simd::scalar<simd::functor_op<Pred>::op>(to_pointer(col_begin(static_cast<DIM>(i))) + r0, static_cast<V>(rhs),
+                                               r1 - r0, na);
+    });
   }
 };
 
-// ostream << operator overload, needs an ostream as well as a time series
+// non-owning view of a TSeries: a range of its rows and a selection of its columns
+// views are cheap to make and copy, lag, window and columns on a view give another view of the same source
+// the index and the values can start at different rows of the source, which is how a lag is expressed
+// construct a TSeries from a view to get an owning copy
 template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
           template <typename> class DatePolicy, template <typename> class NT>
-std::ostream &operator<<(std::ostream &os, const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &ts) {
+class TSeriesView {
+public:
+  typedef TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> series_type;
+  typedef V value_type;
+  typedef typename series_type::const_index_iterator const_index_iterator;
+  typedef typename series_type::const_data_iterator const_data_iterator;
+  typedef typename std::vector<const_data_iterator> const_row_iterator;
+
+private:
+  const series_type *src_;
+  // first row of the source index and of the source values
+  DIM index_offset_, data_offset_;
+  DIM nrow_;
+  // the columns are [col_first_, col_first_ + ncol_) of the source unless cols_ lists them
+  DIM col_first_, ncol_;
+  std::vector<DIM> cols_;
+
+  TSeriesView(const series_type *src, DIM index_offset, DIM data_offset, DIM nrow, DIM col_first, DIM ncol,
+              std::vector<DIM> cols)
+      : src_{src}, index_offset_{index_offset}, data_offset_{data_offset}, nrow_{nrow}, col_first_{col_first},
+        ncol_{ncol}, cols_(std::move(cols)) {}
+
+  // column of the source behind column i of the view
+  DIM source_col(DIM i) const { return cols_.empty() ? col_first_ + i : cols_[i]; }
+
+public:
+  // view of the whole series
+  explicit TSeriesView(const series_type &src)
+      : TSeriesView(&src, 0, 0, src.nrow(), 0, src.ncol(), std::vector<DIM>()) {}
+  TSeriesView(const TSeriesView &) = default;
+  TSeriesView &operator=(const TSeriesView &) = default;
+
+  // the series this is a view of
+  const series_type &source() const { return *src_; }
+  // row of the source index this view's index starts at
+  const DIM index_offset() const { return index_offset_; }
+
+  const DIM nrow() const { return nrow_; }
+  const DIM ncol() const { return ncol_; }
+
+  // colnames of the selected columns
+  const std::vector<std::string> getColnames() const {
+    if (!src_->hasColnames()) { return std::vector<std::string>(); }
+    const std::vector<std::string> names(src_->getColnames());
+    std::vector<std::string> ans;
+    for (DIM i = 0; i < ncol_; ++i) { ans.push_back(names[source_col(i)]); }
+    return ans;
+  }
+  const DIM getColnamesSize() const { return src_->hasColnames() ? ncol_ : 0; }
+  const bool hasColnames() const { return getColnamesSize() > 0 ? true : false; }
+
+  // true when the source keeps validity masks
+  const bool hasValidity() const { return detail::series_mask(*src_, 0) != nullptr; }
+  // rows of the source mask of column i this view covers, only when hasValidity()
+  ValidityMask validity(DIM i) const {
+    return detail::series_mask(*src_, static_cast<size_t>(source_col(i)))
+        ->slice(static_cast<size_t>(data_offset_), static_cast<size_t>(nrow_));
+  }
+
+  const_index_iterator index_begin() const {
+    const_index_iterator ans{src_->index_begin()};
+    std::advance(ans, index_offset_);
+    return ans;
+  }
+  const_index_iterator index_end() const {
+    const_index_iterator ans{index_begin()};
+    std::advance(ans, nrow_);
+    return ans;
+  }
+
+  const_data_iterator col_begin(DIM i) const {
+    const_data_iterator ans{src_->col_begin(source_col(i))};
+    std::advance(ans, data_offset_);
+    return ans;
+  }
+  const_data_iterator col_end(DIM i) const {
+    const_data_iterator ans{col_begin(i)};
+    std::advance(ans, nrow_);
+    return ans;
+  }
+
+  // row iterator, base 0
+  const_row_iterator getRow(DIM n) const {
+    const_row_iterator ans(ncol());
+    for (DIM i = 0; i < ncol(); ++i) {
+      ans[i] = col_begin(i);
+      std::advance(ans[i], n);
+    }
+    return ans;
+  }
+
+  // view lagged by n rows
+  TSeriesView lag(DIM n) const {
+    if (n >= nrow_) { throw std::logic_error("lag: n > nrow of time series."); }
+    return TSeriesView(src_, index_offset_ + n, data_offset_, nrow_ - n, col_first_, ncol_, cols_);
+  }
+
+  // the rows with from <= index <= to, found by binary search
+  TSeriesView window(IDX from, IDX to) const {
+    const const_index_iterator beg{std::lower_bound(index_begin(), index_end(), from)};
+    const const_index_iterator end{std::upper_bound(beg, index_end(), to)};
+    const DIM first{static_cast<DIM>(std::distance(index_begin(), beg))};
+    const DIM n{static_cast<DIM>(std::distance(beg, end))};
+    return TSeriesView(src_, index_offset_ + first, data_offset_ + first, n, col_first_, ncol_, cols_);
+  }
+
+  // columns [first, first + count) of this view
+  TSeriesView columns(DIM first, DIM count) const {
+    if (first + count > ncol_) { throw std::logic_error("columns: column out of range."); }
+    if (cols_.empty()) {
+      return TSeriesView(src_, index_offset_, data_offset_, nrow_, col_first_ + first, count, std::vector<DIM>());
+    }
+    return TSeriesView(src_, index_offset_, data_offset_, nrow_, 0, count,
+                       std::vector<DIM>(cols_.begin() + first, cols_.begin() + first + count));
+  }
+
+  // the listed columns of this view, in the order given
+  TSeriesView columns(const std::vector<DIM> &cols) const {
+    std::vector<DIM> mapped;
+    for (DIM c : cols) {
+      if (c >= ncol_) { throw std::logic_error("columns: column out of range."); }
+      mapped.push_back(source_col(c));
+    }
+    return TSeriesView(src_, index_offset_, data_offset_, nrow_, 0, static_cast<DIM>(mapped.size()), mapped);
+  }
+};
+
+// compile time information about a TSeries type, used by code that is generic over series
+//  series_type is the owning series, a TSeries even for views
+//  date_policy is DatePolicy<IDX>
+//  rebind<T> is the same kind of series holding values of type T
+//  NA and ISNA go through the series' numeric traits
+template <typename TS> class series_traits {
+public:
+  static const bool value = false;
+};
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+class series_traits<TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>> {
+public:
+  static const bool value = true;
+  // the owning series type
+  typedef TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> series_type;
+  // the date policy of the index
+  typedef DatePolicy<IDX> date_policy;
+  template <typename T> using rebind = TSeries<IDX, T, DIM, BACKEND, DatePolicy, NT>;
+  // the same series on another backend
+  template <template <typename, typename, typename> class B>
+  using rebind_backend = TSeries<IDX, V, DIM, B, DatePolicy, NT>;
+  template <typename T> static T NA() { return NT<T>::NA(); }
+  template <typename T> static bool ISNA(T x) { return NT<T>::ISNA(x); }
+  static double daily_distance(IDX x, IDX y) { return DatePolicy<IDX>::daily_distance(x, y); }
+};
+
+// a view has the traits of the series it looks at, rebind gives owning series
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+class series_traits<TSeriesView<IDX, V, DIM, BACKEND, DatePolicy, NT>>
+    : public series_traits<TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>> {};
+
+template <typename TS> class is_view {
+public:
+  static const bool value = false;
+};
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+class is_view<TSeriesView<IDX, V, DIM, BACKEND, DatePolicy, NT>> {
+public:
+  static const bool value = true;
+};
+
+// mask of column c, the stored one when the backend keeps masks, otherwise built from the NA values
+template <typename TS> ValidityMask column_validity(const TS &ts, size_t c) {
+  if (const ValidityMask *m = detail::series_mask(ts, c)) { return *m; }
+  const auto nc = static_cast<decltype(ts.ncol())>(c);
+  return ValidityMask::from_values(ts.col_begin(nc), static_cast<size_t>(ts.nrow()),
+                                   [](const typename TS::value_type x) { return series_traits<TS>::ISNA(x); });
+}
+
+// a view of a masked series reads the rows of the source mask it covers
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+ValidityMask column_validity(const TSeriesView<IDX, V, DIM, BACKEND, DatePolicy, NT> &v, size_t c) {
+  if (v.hasValidity()) { return v.validity(static_cast<DIM>(c)); }
+  return ValidityMask::from_values(v.col_begin(static_cast<DIM>(c)), static_cast<size_t>(v.nrow()),
+                                   [](const V x) { return NT<V>::ISNA(x); });
+}
+
+namespace detail {
+
+// the series whose index s reads, and the row of that index s starts at
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &index_owner(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &s) {
+  return s;
+}
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+size_t index_row(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &) {
+  return 0;
+}
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &
+index_owner(const TSeriesView<IDX, V, DIM, BACKEND, DatePolicy, NT> &v) {
+  return v.source();
+}
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+size_t index_row(const TSeriesView<IDX, V, DIM, BACKEND, DatePolicy, NT> &v) {
+  return static_cast<size_t>(v.index_offset());
+}
+
+// the backend shares the index storage of src
+template <typename RES, typename S, typename DIM>
+RES on_index(const S &src, size_t offset, DIM nrow, DIM ncol, std::true_type) {
+  return RES(typename RES::backend_type(src.getBackend(), offset, nrow, ncol));
+}
+
+// the backend has its own index, copy the rows into it
+template <typename RES, typename S, typename DIM>
+RES on_index(const S &src, size_t offset, DIM nrow, DIM ncol, std::false_type) {
+  RES res(nrow, ncol);
+  auto beg{src.index_begin()};
+  std::advance(beg, offset);
+  std::copy_n(beg, nrow, res.index_begin());
+  return res;
+}
+
+// series of type RES with ncol columns on rows [offset, offset + nrow) of the index of s
+// backends that can be constructed on the index of another backend share it, the others get a copy
+template <typename RES, typename S, typename DIM> RES on_index(const S &s, size_t offset, DIM nrow, DIM ncol) {
+  const auto &owner = index_owner(s);
+  typedef typename std::decay<decltype(owner)>::type owner_type;
+  return on_index<RES>(owner, index_row(s) + offset, nrow, ncol,
+                       std::is_constructible<typename RES::backend_type, const typename owner_type::backend_type &,
+                                             size_t, DIM, DIM>());
+}
+
+// gives res the colnames of s, sharing them when both backends can
+template <typename RES, typename S>
+auto copy_colnames(RES &res, const S &s, int) -> decltype(res.getBackend().shareColnames(s.getBackend())) {
+  return res.getBackend().shareColnames(s.getBackend());
+}
+template <typename RES, typename S> bool copy_colnames(RES &res, const S &s, long) {
+  return res.setColnames(s.getColnames());
+}
+template <typename RES, typename S> bool copy_colnames(RES &res, const S &s) { return copy_colnames(res, s, 0); }
+
+// adds the rows and storage of a result to an instrumentation scope
+// the NAs are only counted when the counters are compiled in
+template <typename RES> void record_result(instrument::Scope &scope, const RES &res) {
+  typedef typename RES::value_type V;
+  typedef typename std::iterator_traits<typename RES::const_index_iterator>::value_type IDX;
+  const size_t nrow{static_cast<size_t>(res.nrow())}, ncol{static_cast<size_t>(res.ncol())};
+  scope.rows_out(nrow);
+  scope.bytes_allocated(nrow * (sizeof(IDX) + ncol * sizeof(V)));
+  if (instrument::enabled) {
+    size_t na{0};
+    for (size_t c = 0; c < ncol; ++c) {
+      if (const ValidityMask *m = series_mask(res, c)) {
+        na += m->na_count();
+        continue;
+      }
+      na += static_cast<size_t>(std::count_if(res.col_begin(static_cast<decltype(res.ncol())>(c)),
+                                              res.col_end(static_cast<decltype(res.ncol())>(c)),
+                                              [](const V x) { return series_traits<RES>::ISNA(x); }));
+    }
+    scope.na_out(na);
+  }
+}
+
+} // namespace detail
+
+namespace detail {
+// prints a series or a view, one row per line
+template <typename IDX, typename V, template <typename> class DatePolicy, template <typename> class NT, typename TS>
+std::ostream &print_series(std::ostream &os, const TS &ts) {
   // get the column names from the time series
   std::vector<std::string> cnames(ts.getColnames());
 
@@ -215,10 +688,10 @@ std::ostream &operator<<(std::ostream &os, const TSeries<IDX, V, DIM, BACKEND, D
   }
 
   // set const iterators for the index's start and end
-  typename TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>::const_index_iterator idx{ts.index_begin()};
-  typename TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>::const_index_iterator idx_end{ts.index_end()};
+  typename TS::const_index_iterator idx{ts.index_begin()};
+  typename TS::const_index_iterator idx_end{ts.index_end()};
   // vector of first row of iterators of the df
-  typename TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>::const_row_iterator row_iter(ts.getRow(0));
+  typename TS::const_row_iterator row_iter(ts.getRow(0));
 
   // as long as the start iterator does not equal the end, increment it
   for (; idx != idx_end; ++idx) {
@@ -242,79 +715,645 @@ std::ostream &operator<<(std::ostream &os, const TSeries<IDX, V, DIM, BACKEND, D
   }
   return os;
 }
+} // namespace detail
 
-// template function binary_opp that takes in 2 time series
-// class pred seems to be the functor
+// ostream << operator overload, needs an ostream as well as a time series
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+std::ostream &operator<<(std::ostream &os, const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &ts) {
+  return detail::print_series<IDX, V, DatePolicy, NT>(os, ts);
+}
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+std::ostream &operator<<(std::ostream &os, const TSeriesView<IDX, V, DIM, BACKEND, DatePolicy, NT> &v) {
+  return detail::print_series<IDX, V, DatePolicy, NT>(os, v);
+}
+
+namespace detail {
+
+// Pred over n contiguous values, with the NA tests only for value types that can hold NA
+template <template <typename, typename> class Pred, template <typename> class NT, typename U, typename V, typename RV>
+void raw_binary(const U *__restrict lhs, const V *__restrict rhs, RV *__restrict res, size_t n) {
+  Pred<U, V> pred;
+  if constexpr (!nullable<NT, U>::value && !nullable<NT, V>::value) {
+    for (size_t k = 0; k < n; ++k) { res[k] = pred(lhs[k], rhs[k]); }
+  } else {
+    const RV na{NT<RV>::NA()};
+    for (size_t k = 0; k < n; ++k) {
+      res[k] = is_na<NT>(lhs[k]) || is_na<NT>(rhs[k]) ? na : pred(lhs[k], rhs[k]);
+    }
+  }
+}
+
+// Pred over K columns at once for the rowmap entries [k0, k1), so the rowmap is read once for all of them
+// K is known at compile time and the loop over the columns unrolls
+template <size_t K, template <typename, typename> class Pred, template <typename> class NT, typename U, typename V,
+          typename RV>
+void rowmap_columns(const U *const *lhs_cols, const V *const *rhs_cols, RV *const *res_cols,
+                    const std::pair<size_t, size_t> *rowmap, size_t k0, size_t k1) {
+  Pred<U, V> pred;
+  const RV na{NT<RV>::NA()};
+  const U *lhs[K];
+  const V *rhs[K];
+  RV *res[K];
+  std::copy_n(lhs_cols, K, lhs);
+  std::copy_n(rhs_cols, K, rhs);
+  std::copy_n(res_cols, K, res);
+  for (size_t k = k0; k < k1; ++k) {
+    const size_t i{rowmap[k].first}, j{rowmap[k].second};
+    for (size_t c = 0; c < K; ++c) {
+      const U lhs_val{lhs[c][i]};
+      const V rhs_val{rhs[c][j]};
+      if constexpr (!nullable<NT, U>::value && !nullable<NT, V>::value) {
+        res[c][k] = pred(lhs_val, rhs_val);
+      } else {
+        res[c][k] = is_na<NT>(lhs_val) || is_na<NT>(rhs_val) ? na : pred(lhs_val, rhs_val);
+      }
+    }
+  }
+}
+
+// columns handled together by rowmap_columns
+const size_t rowmap_group{4};
+
+// true when the columns of L, R and RES are plain arrays
+template <typename L, typename R, typename RES> class contiguous_operands {
+public:
+  static const bool value = is_contiguous_iterator<typename L::const_data_iterator>::value &&
+                            is_contiguous_iterator<typename R::const_data_iterator>::value &&
+                            is_contiguous_iterator<typename RES::data_iterator>::value;
+};
+
+// true when Pred can go through the simd kernels: one value type everywhere, contiguous columns, and an NA the
+// kernels can blend (types without NA take the raw loops, which the compiler vectorizes without the blend)
+template <template <typename, typename> class Pred, template <typename> class NT, typename U, typename V, typename RV,
+          typename L, typename R, typename RES>
+class binary_kernel {
+public:
+  static const bool value = std::is_same<U, RV>::value && std::is_same<V, RV>::value && nullable<NT, RV>::value &&
+                            use_kernel<Pred, RV, typename RES::data_iterator>::value &&
+                            contiguous_operands<L, R, RES>::value;
+};
+
+// fills the columns of res with Pred applied to the rows of lhs and rhs listed in rowmap
+// in order of preference: stretches where both sides advance one row at a time through the simd kernels, raw
+// pointer loops over groups of rowmap_group columns, and one element at a time through the iterators
+template <template <typename, typename> class Pred, template <typename> class NT, typename U, typename V, typename RV,
+          typename L, typename R, typename RES>
+void rowmap_opp(const L &lhs, const R &rhs, RES &res, const std::vector<std::pair<size_t, size_t>> &rowmap,
+                ExecutionPolicy &policy) {
+  if (rowmap.empty()) { return; }
+  const size_t ncol{static_cast<size_t>(res.ncol())};
+  // a single column series is reused against every column of the other one
+  auto lhs_begin = [&](size_t c) { return lhs.col_begin(static_cast<decltype(lhs.ncol())>(lhs.ncol() == 1 ? 0 : c)); };
+  auto rhs_begin = [&](size_t c) { return rhs.col_begin(static_cast<decltype(rhs.ncol())>(rhs.ncol() == 1 ? 0 : c)); };
+  auto res_begin = [&](size_t c) { return res.col_begin(static_cast<decltype(res.ncol())>(c)); };
+
+  if constexpr (binary_kernel<Pred, NT, U, V, RV, L, R, RES>::value) {
+    const RV na{NT<RV>::NA()};
+    if (simd::compatible_na(na)) {
+      // short runs are not worth a kernel call
+      const size_t min_run{8};
+      const auto runs(contiguous_runs(rowmap));
+      policy_for(policy, rowmap.size() * ncol).parallel_for(ncol, [&](size_t c) {
+        const RV *lhs_col{to_pointer(lhs_begin(c))}, *rhs_col{to_pointer(rhs_begin(c))};
+        RV *res_col{to_pointer(res_begin(c))};
+        for (auto run : runs) {
+          const auto m(rowmap[run.first]);
+          if (run.second >= min_run) {
+            simd::binary<simd::functor_op<Pred>::op>(lhs_col + m.first, rhs_col + m.second, res_col + run.first,
+                                                     run.second, na);
+          } else {
+            rowmap_columns<1, Pred, NT, U, V, RV>(&lhs_col, &rhs_col, &res_col, rowmap.data(), run.first,
+                                                  run.first + run.second);
+          }
+        }
+      });
+      return;
+    }
+  }
+
+  if constexpr (contiguous_operands<L, R, RES>::value) {
+    // groups of columns are split into blocks of rows when there are too few groups to go round
+    const size_t ngroups{(ncol + rowmap_group - 1) / rowmap_group};
+    for_each_block(policy, rowmap.size(), ngroups, sizeof(RV) * rowmap_group, [&](size_t g, size_t k0, size_t k1) {
+      const U *lhs_cols[rowmap_group];
+      const V *rhs_cols[rowmap_group];
+      RV *res_cols[rowmap_group];
+      const size_t c0{g * rowmap_group}, width{std::min(rowmap_group, ncol - c0)};
+      for (size_t c = 0; c < width; ++c) {
+        lhs_cols[c] = to_pointer(lhs_begin(c0 + c));
+        rhs_cols[c] = to_pointer(rhs_begin(c0 + c));
+        res_cols[c] = to_pointer(res_begin(c0 + c));
+      }
+      switch (width) {
+      case 4: return rowmap_columns<4, Pred, NT, U, V, RV>(lhs_cols, rhs_cols, res_cols, rowmap.data(), k0, k1);
+      case 3: return rowmap_columns<3, Pred, NT, U, V, RV>(lhs_cols, rhs_cols, res_cols, rowmap.data(), k0, k1);
+      case 2: return rowmap_columns<2, Pred, NT, U, V, RV>(lhs_cols, rhs_cols, res_cols, rowmap.data(), k0, k1);
+      default: return rowmap_columns<1, Pred, NT, U, V, RV>(lhs_cols, rhs_cols, res_cols, rowmap.data(), k0, k1);
+      }
+    });
+  } else {
+    // the columns are independent, so they are shared out across the policy's threads
+    policy_for(policy, rowmap.size() * ncol).parallel_for(ncol, [&](size_t c) {
+      Pred<U, V> pred;
+      const auto lhs_col{lhs_begin(c)};
+      const auto rhs_col{rhs_begin(c)};
+      auto res_col{res_begin(c)};
+      for (auto m : rowmap) {
+        const U lhs_val{lhs_col[m.first]};
+        const V rhs_val{rhs_col[m.second]};
+        // the result is NA if either value is NA, or the functor's result
+        *res_col = is_na<NT>(lhs_val) || is_na<NT>(rhs_val) ? NT<RV>::NA() : pred(lhs_val, rhs_val);
+        ++res_col;
+      }
+    });
+  }
+}
+
+// fills the columns of res with Pred applied to lhs rows starting at lhs_off and rhs rows starting at rhs_off
+// used when the indexes line up without a rowmap (see classify_alignment), so both sides are plain streams
+// blocks go through the simd kernels when they can, then raw pointer loops, then the iterators
+template <template <typename, typename> class Pred, template <typename> class NT, typename U, typename V, typename RV,
+          typename L, typename R, typename RES>
+void span_opp(const L &lhs, const R &rhs, RES &res, size_t lhs_off, size_t rhs_off, ExecutionPolicy &policy) {
+  if (res.nrow() == 0) { return; }
+  auto lhs_begin = [&](size_t c) { return lhs.col_begin(static_cast<decltype(lhs.ncol())>(lhs.ncol() == 1 ? 0 : c)); };
+  auto rhs_begin = [&](size_t c) { return rhs.col_begin(static_cast<decltype(rhs.ncol())>(rhs.ncol() == 1 ? 0 : c)); };
+  auto res_begin = [&](size_t c) { return res.col_begin(static_cast<decltype(res.ncol())>(c)); };
+
+  if constexpr (binary_kernel<Pred, NT, U, V, RV, L, R, RES>::value) {
+    const RV na{NT<RV>::NA()};
+    if (simd::compatible_na(na)) {
+      for_each_block(policy, res.nrow(), res.ncol(), sizeof(RV), [&](size_t c, size_t r0, size_t r1) {
+        simd::binary<simd::functor_op<Pred>::op>(to_pointer(lhs_begin(c)) + lhs_off + r0,
+                                                 to_pointer(rhs_begin(c)) + rhs_off + r0,
+                                                 to_pointer(res_begin(c)) + r0, r1 - r0, na);
+      });
+      return;
+    }
+  }
+
+  for_each_block(policy, res.nrow(), res.ncol(), sizeof(RV), [&](size_t c, size_t r0, size_t r1) {
+    if constexpr (contiguous_operands<L, R, RES>::value) {
+      raw_binary<Pred, NT, U, V, RV>(to_pointer(lhs_begin(c)) + lhs_off + r0, to_pointer(rhs_begin(c)) + rhs_off + r0,
+                                     to_pointer(res_begin(c)) + r0, r1 - r0);
+    } else {
+      Pred<U, V> pred;
+      auto lhs_col{lhs_begin(c)}, rhs_col{rhs_begin(c)};
+      auto res_col{res_begin(c)};
+      std::advance(lhs_col, lhs_off + r0);
+      std::advance(rhs_col, rhs_off + r0);
+      std::advance(res_col, r0);
+      for (size_t k = r0; k < r1; ++k, ++lhs_col, ++rhs_col, ++res_col) {
+        const U lhs_val{*lhs_col};
+        const V rhs_val{*rhs_col};
+        *res_col = is_na<NT>(lhs_val) || is_na<NT>(rhs_val) ? NT<RV>::NA() : pred(lhs_val, rhs_val);
+      }
+    }
+  });
+}
+
+// version for columns that keep validity masks (see tslib/validity.hpp)
+// res_masks[c] is valid where both inputs are, only the rows it marks valid call Pred, with no NA tests
+// a floating point result that is NaN (0 / 0.0) where both inputs are valid is cleared from res_masks[c]
+// lhs_row(k) and rhs_row(k) are the input rows of result row k
+template <template <typename, typename> class Pred, template <typename> class NT, typename U, typename V, typename RV,
+          typename L, typename R, typename RES, typename LROW, typename RROW>
+void masked_opp(const L &lhs, const R &rhs, RES &res, std::vector<ValidityMask> &res_masks, LROW lhs_row,
+                RROW rhs_row, ExecutionPolicy &policy) {
+  const size_t ncol{static_cast<size_t>(res.ncol())};
+  const RV na{NT<RV>::NA()};
+  policy_for(policy, static_cast<size_t>(res.nrow()) * ncol).parallel_for(ncol, [&](size_t c) {
+    Pred<U, V> pred;
+    const auto nc = static_cast<decltype(res.ncol())>(c);
+    const auto lhs_col{lhs.col_begin(lhs.ncol() == 1 ? 0 : nc)};
+    const auto rhs_col{rhs.col_begin(rhs.ncol() == 1 ? 0 : nc)};
+    const auto res_col{res.col_begin(nc)};
+    ValidityMask &mask{res_masks[c]};
+    // blocks() has already read the words it hands out, so clearing a bit in them on the way is safe
+    const auto clear_nans = [&](size_t b, size_t e) {
+      if (!std::is_floating_point<RV>::value) { return; }
+      for (size_t k = b; k < e; ++k) {
+        if (NT<RV>::ISNA(res_col[k])) { mask.set(k, false); }
+      }
+    };
+    mask.blocks(
+        [&](size_t b, size_t e) {
+          for (size_t k = b; k < e; ++k) { res_col[k] = pred(lhs_col[lhs_row(k)], rhs_col[rhs_row(k)]); }
+          clear_nans(b, e);
+        },
+        [&](size_t b, size_t e) { std::fill(res_col + b, res_col + e, na); },
+        [&](size_t b, size_t e, std::uint64_t word) {
+          if (std::is_floating_point<RV>::value) {
+            // floating point can't trap on whatever the NA rows hold, so compute every row without branches
+            // and put the NAs back after
+            for (size_t k = b; k < e; ++k) { res_col[k] = pred(lhs_col[lhs_row(k)], rhs_col[rhs_row(k)]); }
+            const std::uint64_t rows{e - b == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << (e - b)) - 1};
+            for (std::uint64_t nas = ~word & rows; nas; nas &= nas - 1) { res_col[b + __builtin_ctzll(nas)] = na; }
+            clear_nans(b, e);
+          } else {
+            for (size_t k = b; k < e; ++k) {
+              res_col[k] = (word >> (k - b)) & 1 ? pred(lhs_col[lhs_row(k)], rhs_col[rhs_row(k)]) : na;
+            }
+          }
+        });
+  });
+}
+
+// masks of the columns of s, built from the NA values when s doesn't keep them (eg a view)
+template <typename S> std::vector<ValidityMask> operand_masks(const S &s) {
+  std::vector<ValidityMask> res;
+  for (size_t c = 0; c < static_cast<size_t>(s.ncol()); ++c) { res.push_back(column_validity(s, c)); }
+  return res;
+}
+
+// masks of the result of a binary operation, one AND per word when the rows line up
+template <typename L, typename R>
+std::vector<ValidityMask> combine_masks(const L &lhs, const R &rhs, size_t ncol, const AlignmentInfo &align,
+                                        const std::vector<std::pair<size_t, size_t>> &rowmap) {
+  const std::vector<ValidityMask> lhs_masks(operand_masks(lhs)), rhs_masks(operand_masks(rhs));
+  std::vector<ValidityMask> res;
+  for (size_t c = 0; c < ncol; ++c) {
+    const ValidityMask &l{lhs_masks[lhs.ncol() == 1 ? 0 : c]}, &r{rhs_masks[rhs.ncol() == 1 ? 0 : c]};
+    if (align.kind == Alignment::general) {
+      ValidityMask m(rowmap.size(), false);
+      for (size_t k = 0; k < rowmap.size(); ++k) { m.set(k, l.test(rowmap[k].first) && r.test(rowmap[k].second)); }
+      res.push_back(std::move(m));
+    } else {
+      res.push_back(l.slice(align.x_offset, align.length));
+      res.back() &= r.slice(align.y_offset, align.length);
+    }
+  }
+  return res;
+}
+
+// binary_opp through the validity masks when lhs or rhs has them, returns false otherwise
+// the side without masks gets them built from its NA values, so a masked series keeps its full value range
+template <template <typename, typename> class Pred, template <typename> class NT, typename U, typename V, typename RV,
+          typename L, typename R, typename RES>
+bool masked_binary_opp(const L &lhs, const R &rhs, RES &res, const AlignmentInfo &align,
+                       const std::vector<std::pair<size_t, size_t>> &rowmap, ExecutionPolicy &policy, std::true_type) {
+  if (!has_validity(lhs) && !has_validity(rhs)) { return false; }
+  std::vector<ValidityMask> masks(combine_masks(lhs, rhs, static_cast<size_t>(res.ncol()), align, rowmap));
+  if (align.kind == Alignment::general) {
+    masked_opp<Pred, NT, U, V, RV>(lhs, rhs, res, masks, [&rowmap](size_t k) { return rowmap[k].first; },
+                                   [&rowmap](size_t k) { return rowmap[k].second; }, policy);
+  } else {
+    const size_t x_off{align.x_offset}, y_off{align.y_offset};
+    masked_opp<Pred, NT, U, V, RV>(lhs, rhs, res, masks, [x_off](size_t k) { return x_off + k; },
+                                   [y_off](size_t k) { return y_off + k; }, policy);
+  }
+  set_series_masks(res, std::move(masks));
+  return true;
+}
+
+template <template <typename, typename> class Pred, template <typename> class NT, typename U, typename V, typename RV,
+          typename L, typename R, typename RES>
+bool masked_binary_opp(const L &, const R &, RES &, const AlignmentInfo &,
+                       const std::vector<std::pair<size_t, size_t>> &, ExecutionPolicy &, std::false_type) {
+  return false;
+}
+
+} // namespace detail
+
+namespace detail {
+
+// true when lhs and rhs are series and at least one of them is a view
+template <typename L, typename R> class view_operands {
+public:
+  static const bool value =
+      series_traits<L>::value && series_traits<R>::value && (is_view<L>::value || is_view<R>::value);
+};
+
+// binary_opp for anything that reads like a series, a TSeries or a TSeriesView
+// the last two arguments are only there to deduce the owning series types of lhs and rhs
 template <template <typename, typename> class Pred, typename IDX, typename U, typename V, typename DIM,
           template <typename, typename, typename> class BACKEND, template <typename> class DatePolicy,
-          template <typename> class NT>
-auto binary_opp(const TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &lhs,
-                const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &rhs) {
-  
+          template <typename> class NT, typename L, typename R>
+auto binary_opp_impl(const L &lhs, const R &rhs, ExecutionPolicy &policy,
+                     const TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> *,
+                     const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> *) {
   // define common type of the 2 time series
   typedef typename std::common_type<U, V>::type RV;
-  // create class Pred (functor)
-  Pred<U, V> pred;
+
+  instrument::Scope scope("binary_opp");
+  scope.rows_in(static_cast<size_t>(lhs.nrow() + rhs.nrow()));
 
   // make sure number of columns match and that there must be at least 1 column
   if (lhs.ncol() != rhs.ncol() && lhs.ncol() != 1 && rhs.ncol() != 1) {
     throw std::logic_error("Number of colums must match. or one time series must be a single column.");
   }
-  // gets a vector of pairs showing the intrsection points where the values in the pairs are the distance from the beginning
-  const auto rowmap{intersection_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end())};
-  // print the number of intersections
-  std::cout << rowmap.size() << std::endl;
-  // for each record in the map, print it out
-  for (auto m : rowmap) { std::cout << m.first << ":" << m.second << std::endl; }
+  // identical indexes and sub-range indexes can be streamed directly, only the general case needs a rowmap
+  const AlignmentInfo align(classify_alignment(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end()));
+  std::vector<std::pair<size_t, size_t>> rowmap;
+  if (align.kind == Alignment::general) {
+    // gets a vector of pairs showing the intrsection points where the values in the pairs are the distance from the beginning
+    rowmap = intersection_map(lhs.index_begin(), lhs.index_end(), rhs.index_begin(), rhs.index_end());
+  }
+  const size_t res_nrow{align.kind == Alignment::general ? rowmap.size() : align.length};
+  scope.matches(res_nrow);
 
   // FIXME: use Pred<U,V>::RT to define the return type
 
-  // create a time series that uses the functors type with the number of rows being the size of the row map and the ncol being the max number of columns
-  TSeries<IDX, typename Pred<U, V>::RT, DIM, BACKEND, DatePolicy, NT> res(rowmap.size(), std::max(lhs.ncol(), rhs.ncol()));
+  // create a time series that uses the functors type with the number of rows being the size of the intersection and the ncol being the max number of columns
+  // without a rowmap the result index is a block of the lhs index, which is shared when the backend allows it
+  typedef TSeries<IDX, typename Pred<U, V>::RT, DIM, BACKEND, DatePolicy, NT> result_type;
+  const DIM res_ncol{std::max(lhs.ncol(), rhs.ncol())};
+  result_type res(align.kind == Alignment::general
+                      ? result_type(static_cast<DIM>(res_nrow), res_ncol)
+                      : detail::on_index<result_type>(lhs, align.x_offset, static_cast<DIM>(res_nrow), res_ncol));
 
   // set colnames from larger of two args but prefer lhs
   if (lhs.getColnamesSize() >= rhs.getColnamesSize()) {
     // if lhs has more than or the same amount of colnames than the right, 
     // use the lhs names as the column names
-    res.setColnames(lhs.getColnames());
+    detail::copy_colnames(res, lhs);
   } else if (rhs.hasColnames()) {
     // if not true above and rhs has column names, then set the col names to right hand side
-    res.setColnames(rhs.getColnames());
+    detail::copy_colnames(res, rhs);
   }
 
-  // set index vector from lhs 
-  auto idx{res.index_begin()};
-  // get the const index vector for the lhs begin
-  const auto lhs_idx{lhs.index_begin()};
-  for (auto m : rowmap) {
-    // for every record in the map, find the index
-    *idx = lhs_idx[m.first];
-    // increment the iterator in idx to move to the next index point
-    idx++;
-  }
-
-  // for all the columns
-  for (DIM nc = 0; nc < res.ncol(); ++nc) {
-    // get the 2 column iterators at the beginning
-    // don't think there is a check in place if nc goes out of range of the columns
-    const auto lhs_col{lhs.col_begin(nc)}, rhs_col{rhs.col_begin(nc)};
-    // get the iterator for the resulting time series at the appropriate column
+  // fill the columns, through the simd kernels when the value types allow it
+  if (align.kind == Alignment::general) {
+    // set index vector from lhs
+    auto idx{res.index_begin()};
+    // get the const index vector for the lhs begin
+    const auto lhs_idx{lhs.index_begin()};
+    for (auto m : rowmap) {
+      // for every record in the map, find the index
+      *idx = lhs_idx[m.first];
+      // increment the iterator in idx to move to the next index point
+      idx++;
+    }
+  }
+
+  // when either side keeps validity masks the result gets the AND of both sides' masks and the values are not
+  // tested for NA
+  typedef std::integral_constant<bool, detail::keeps_masks<result_type>::value> maskable;
+  if (detail::masked_binary_opp<Pred, NT, U, V, RV>(lhs, rhs, res, align, rowmap, policy, maskable())) {
+    detail::record_result(scope, res);
+    return res;
+  }
+
+  if (align.kind != Alignment::general) {
+    detail::span_opp<Pred, NT, U, V, RV>(lhs, rhs, res, align.x_offset, align.y_offset, policy);
+    detail::record_result(scope, res);
+    return res;
+  }
+
+  detail::rowmap_opp<Pred, NT, U, V, RV>(lhs, rhs, res, rowmap, policy);
+  detail::record_result(scope, res);
+  return res;
+}
+
+
+} // namespace detail
+
+// template function binary_opp that takes in 2 time series
+// class pred seems to be the functor
+// the columns are computed with the given execution policy
+template <template <typename, typename> class Pred, typename IDX, typename U, typename V, typename DIM,
+          template <typename, typename, typename> class BACKEND, template <typename> class DatePolicy,
+          template <typename> class NT>
+auto binary_opp(const TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &lhs,
+                const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &rhs,
+                ExecutionPolicy &policy = default_execution()) {
+  return detail::binary_opp_impl<Pred>(lhs, rhs, policy, &lhs, &rhs);
+}
+
+// same thing when either side is a view, the views are read in place
+template <template <typename, typename> class Pred, typename L, typename R,
+          typename std::enable_if<detail::view_operands<L, R>::value, int>::type = 0>
+auto binary_opp(const L &lhs, const R &rhs, ExecutionPolicy &policy = default_execution()) {
+  return detail::binary_opp_impl<Pred>(lhs, rhs, policy,
+                                       static_cast<const typename series_traits<L>::series_type *>(nullptr),
+                                       static_cast<const typename series_traits<R>::series_type *>(nullptr));
+}
+
+namespace detail {
+
+// column of s that pairs with column nc of the result, single column series are broadcast
+template <typename S, typename DIM> auto nary_col(const S &s, DIM nc) { return s.col_begin(s.ncol() == 1 ? 0 : nc); }
+
+template <typename... B> bool any_of(B... flags) {
+  const bool all[] = {false, flags...};
+  for (bool f : all) {
+    if (f) { return true; }
+  }
+  return false;
+}
+
+template <typename F, typename RES, template <typename> class NT, size_t... I, typename... S>
+void nary_fill(F f, RES &res, const MultiIntersection &rows, std::index_sequence<I...>, const S &... series) {
+  typedef typename RES::value_type RV;
+  for (decltype(res.ncol()) nc = 0; nc < res.ncol(); ++nc) {
+    const auto cols = std::make_tuple(nary_col(series, nc)...);
     auto res_col{res.col_begin(nc)};
+    for (size_t k = 0; k < rows.size(); ++k, ++res_col) {
+      const auto vals = std::make_tuple(std::get<I>(cols)[rows.rows[I][k]]...);
+      *res_col = any_of(NT<typename S::value_type>::ISNA(std::get<I>(vals))...) ? NT<RV>::NA()
+                                                                                : f(std::get<I>(vals)...);
+    }
+  }
+}
 
-    // for every record
-    for (auto m : rowmap) {
-      // get the values from the left and right hand side
-      U lhs_val{lhs_col[m.first]};
-      V rhs_val{rhs_col[m.second]};
-      // have the resultant iterator be NA if either values are NA, or the functor's result
-      *res_col = NT<V>::ISNA(lhs_val) || NT<U>::ISNA(rhs_val) ? NT<RV>::NA() : pred(lhs_val, rhs_val);
-      // increment the iterator
-      ++res_col;
+} // namespace detail
+
+// applies an n-ary functor across several series in one pass
+// the series are aligned with a single multi-way intersection of their indexes and the result is the only allocation
+// f is called as f(v1, v2, ...) with one value from each series, the result is NA if any of them is NA
+// all series must have the same number of columns, or a single column that is used against every column
+template <typename F, typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename... VS>
+auto nary_opp(F f, const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &first,
+              const TSeries<IDX, VS, DIM, BACKEND, DatePolicy, NT> &... rest) {
+  typedef decltype(f(std::declval<V>(), std::declval<VS>()...)) RV;
+  typedef TSeries<IDX, RV, DIM, BACKEND, DatePolicy, NT> result_type;
+  typedef typename TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>::const_index_iterator index_iterator;
+
+  const DIM ncols[] = {first.ncol(), rest.ncol()...};
+  const DIM ncol{*std::max_element(std::begin(ncols), std::end(ncols))};
+  for (DIM n : ncols) {
+    if (n != ncol && n != 1) {
+      throw std::logic_error("Number of colums must match. or one time series must be a single column.");
     }
   }
+
+  const std::vector<std::pair<index_iterator, index_iterator>> ranges{
+      std::make_pair(first.index_begin(), first.index_end()), std::make_pair(rest.index_begin(), rest.index_end())...};
+  instrument::Scope scope("nary_opp");
+  for (const auto &r : ranges) { scope.rows_in(static_cast<size_t>(std::distance(r.first, r.second))); }
+  const MultiIntersection rows(multi_intersection_map(ranges));
+  scope.matches(rows.size());
+
+  result_type res(rows.size(), ncol);
+  // colnames from the first series that has a full set
+  const std::vector<std::vector<std::string>> names{first.getColnames(), rest.getColnames()...};
+  for (const auto &n : names) {
+    if (res.setColnames(n)) { break; }
+  }
+
+  auto idx{res.index_begin()};
+  for (size_t k = 0; k < rows.size(); ++k, ++idx) { *idx = first.index_begin()[rows.rows[0][k]]; }
+
+  detail::nary_fill<F, result_type, NT>(f, res, rows, std::make_index_sequence<1 + sizeof...(VS)>(), first, rest...);
+  detail::record_result(scope, res);
   return res;
 }
 
+// same thing for a runtime number of series with the same value type
+// f is called as f(values, n) where values points at one value from each of the n series
+template <typename F, typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+auto nary_opp(F f, const std::vector<const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> *> &series) {
+  typedef TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> series_type;
+  typedef decltype(f(std::declval<const V *>(), size_t())) RV;
+  typedef TSeries<IDX, RV, DIM, BACKEND, DatePolicy, NT> result_type;
+  typedef typename series_type::const_index_iterator index_iterator;
+  typedef typename series_type::const_data_iterator data_iterator;
+
+  if (series.empty()) { throw std::logic_error("nary_opp: no series given."); }
+  DIM ncol{0};
+  for (auto s : series) { ncol = std::max(ncol, s->ncol()); }
+  std::vector<std::pair<index_iterator, index_iterator>> ranges;
+  for (auto s : series) {
+    if (s->ncol() != ncol && s->ncol() != 1) {
+      throw std::logic_error("Number of colums must match. or one time series must be a single column.");
+    }
+    ranges.push_back(std::make_pair(s->index_begin(), s->index_end()));
+  }
+  instrument::Scope scope("nary_opp");
+  for (const auto &r : ranges) { scope.rows_in(static_cast<size_t>(std::distance(r.first, r.second))); }
+  const MultiIntersection rows(multi_intersection_map(ranges));
+  scope.matches(rows.size());
+  const size_t k{series.size()};
+
+  result_type res(rows.size(), ncol);
+  // colnames from the first series that has a full set
+  for (auto s : series) {
+    if (res.setColnames(s->getColnames())) { break; }
+  }
+
+  auto idx{res.index_begin()};
+  for (size_t r = 0; r < rows.size(); ++r, ++idx) { *idx = series[0]->index_begin()[rows.rows[0][r]]; }
+
+  // one gathered row of values, reused for every output element
+  std::vector<V> vals(k);
+  std::vector<data_iterator> cols(k);
+  for (DIM nc = 0; nc < ncol; ++nc) {
+    for (size_t i = 0; i < k; ++i) { cols[i] = detail::nary_col(*series[i], nc); }
+    auto res_col{res.col_begin(nc)};
+    for (size_t r = 0; r < rows.size(); ++r, ++res_col) {
+      bool na{false};
+      for (size_t i = 0; i < k; ++i) {
+        vals[i] = cols[i][rows.rows[i][r]];
+        na      = na || NT<V>::ISNA(vals[i]);
+      }
+      *res_col = na ? NT<RV>::NA() : f(vals.data(), k);
+    }
+  }
+  detail::record_result(scope, res);
+  return res;
+}
+
+namespace detail {
+
+// binary_opp computed into the values of out, an rvalue operand, instead of a new series
+// OUT_LHS says whether out is the left operand of Pred
+// only done when the result would be out: same value type, the index of out is a block of the index of the other
+// side starting at its first row, and the other side has one column or as many as out
+// returns false, leaving out untouched, otherwise or when either side keeps validity masks
+template <template <typename, typename> class Pred, bool OUT_LHS, typename IDX, typename O, typename I, typename DIM,
+          template <typename, typename, typename> class BACKEND, template <typename> class DatePolicy,
+          template <typename> class NT>
+bool inplace_opp(TSeries<IDX, O, DIM, BACKEND, DatePolicy, NT> &out,
+                 const TSeries<IDX, I, DIM, BACKEND, DatePolicy, NT> &in, ExecutionPolicy &policy) {
+  typedef TSeries<IDX, O, DIM, BACKEND, DatePolicy, NT> OUT;
+  typedef TSeries<IDX, I, DIM, BACKEND, DatePolicy, NT> IN;
+  typedef typename std::conditional<OUT_LHS, O, I>::type U;
+  typedef typename std::conditional<OUT_LHS, I, O>::type V;
+  if constexpr (!std::is_same<typename Pred<U, V>::RT, O>::value) {
+    return false;
+  } else {
+    if (out.ncol() < in.ncol() || (in.ncol() != 1 && in.ncol() != out.ncol())) { return false; }
+    if (series_mask(out, 0) || series_mask(in, 0)) { return false; }
+    const OUT &res{out};
+    const AlignmentInfo align(classify_alignment(res.index_begin(), res.index_end(), in.index_begin(), in.index_end()));
+    if (align.kind == Alignment::general || align.x_offset != 0 || align.length != static_cast<size_t>(out.nrow())) {
+      return false;
+    }
+    instrument::Scope scope("binary_opp_inplace");
+    scope.rows_in(static_cast<size_t>(out.nrow() + in.nrow()));
+    scope.matches(align.length);
+    // the lhs colnames win unless the rhs has more, as in binary_opp
+    if (OUT_LHS ? in.getColnamesSize() > out.getColnamesSize() : in.getColnamesSize() >= out.getColnamesSize()) {
+      if (in.hasColnames()) { copy_colnames(out, in); }
+    }
+    if (out.nrow() == 0) { return true; }
+
+    auto in_begin = [&](size_t c) { return in.col_begin(static_cast<DIM>(in.ncol() == 1 ? 0 : c)); };
+    if constexpr (binary_kernel<Pred, NT, U, V, O, OUT, IN, OUT>::value) {
+      const O na{NT<O>::NA()};
+      if (simd::compatible_na(na)) {
+        // the kernels read both operands of a row before writing it, so out can also be an input
+        for_each_block(policy, out.nrow(), out.ncol(), sizeof(O), [&](size_t c, size_t r0, size_t r1) {
+          O *x{to_pointer(out.col_begin(static_cast<DIM>(c))) + r0};
+          const O *y{to_pointer(in_begin(c)) + align.y_offset + r0};
+          simd::binary<simd::functor_op<Pred>::op>(OUT_LHS ? x : y, OUT_LHS ? y : x, x, r1 - r0, na);
+        });
+        record_result(scope, out);
+        return true;
+      }
+    }
+    for_each_block(policy, out.nrow(), out.ncol(), sizeof(O), [&](size_t c, size_t r0, size_t r1) {
+      Pred<U, V> pred;
+      auto x{out.col_begin(static_cast<DIM>(c))};
+      auto y{in_begin(c)};
+      std::advance(x, r0);
+      std::advance(y, align.y_offset + r0);
+      for (size_t k = r0; k < r1; ++k, ++x, ++y) {
+        const O a{*x};
+        const I b{*y};
+        if (is_na<NT>(a) || is_na<NT>(b)) {
+          *x = NT<O>::NA();
+        } else if constexpr (OUT_LHS) {
+          *x = pred(a, b);
+        } else {
+          *x = pred(b, a);
+        }
+      }
+    });
+    record_result(scope, out);
+    return true;
+  }
+}
+
+// binary operators with an rvalue operand, lhs or rhs is an rvalue when L or R is not a reference type
+// the result goes into the storage of the rvalue when inplace_opp can do it
+template <template <typename, typename> class Pred, typename L, typename R> auto rvalue_opp(L &&lhs, R &&rhs) {
+  typedef decltype(binary_opp<Pred>(lhs, rhs)) result_type;
+  if constexpr (!std::is_reference<L>::value && std::is_same<result_type, L>::value) {
+    if (inplace_opp<Pred, true>(lhs, rhs, default_execution())) { return result_type(std::move(lhs)); }
+  }
+  if constexpr (!std::is_reference<R>::value && std::is_same<result_type, R>::value) {
+    if (inplace_opp<Pred, false>(rhs, lhs, default_execution())) { return result_type(std::move(rhs)); }
+  }
+  return binary_opp<Pred>(lhs, rhs);
+}
+
+// scalars that can be applied to a series of V without changing its value type
+template <typename V, typename S> class scalar_operand {
+public:
+  static const bool value =
+      std::is_arithmetic<S>::value &&
+      std::is_same<typename std::common_type<V, typename std::conditional<std::is_arithmetic<S>::value, S, V>::type>::type,
+                   V>::value;
+};
+
+} // namespace detail
+
 // overloaded operators for standard functors
 template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
           template <typename> class DatePolicy, template <typename> class NT>
@@ -348,4 +1387,200 @@ operator/(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs,
   return binary_opp<DivideFunctor>(lhs, rhs);
 }
 
+// the same operators when either side is a view
+template <typename L, typename R, typename std::enable_if<detail::view_operands<L, R>::value, int>::type = 0>
+auto operator+(const L &lhs, const R &rhs) {
+  return binary_opp<PlusFunctor>(lhs, rhs);
+}
+
+template <typename L, typename R, typename std::enable_if<detail::view_operands<L, R>::value, int>::type = 0>
+auto operator-(const L &lhs, const R &rhs) {
+  return binary_opp<MinusFunctor>(lhs, rhs);
+}
+
+template <typename L, typename R, typename std::enable_if<detail::view_operands<L, R>::value, int>::type = 0>
+auto operator*(const L &lhs, const R &rhs) {
+  return binary_opp<MultiplyFunctor>(lhs, rhs);
+}
+
+template <typename L, typename R, typename std::enable_if<detail::view_operands<L, R>::value, int>::type = 0>
+auto operator/(const L &lhs, const R &rhs) {
+  return binary_opp<DivideFunctor>(lhs, rhs);
+}
+
+// rvalue operands: when the alignment allows it the result is written into the storage of a temporary
+// so chains like (x * y) + z allocate once
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator+(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs,
+          const TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &rhs) {
+  return detail::rvalue_opp<PlusFunctor>(std::move(lhs), rhs);
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator+(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs,
+          TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &&rhs) {
+  return detail::rvalue_opp<PlusFunctor>(lhs, std::move(rhs));
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator+(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs,
+          TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &&rhs) {
+  return detail::rvalue_opp<PlusFunctor>(std::move(lhs), std::move(rhs));
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator-(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs,
+          const TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &rhs) {
+  return detail::rvalue_opp<MinusFunctor>(std::move(lhs), rhs);
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator-(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs,
+          TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &&rhs) {
+  return detail::rvalue_opp<MinusFunctor>(lhs, std::move(rhs));
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator-(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs,
+          TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &&rhs) {
+  return detail::rvalue_opp<MinusFunctor>(std::move(lhs), std::move(rhs));
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator*(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs,
+          const TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &rhs) {
+  return detail::rvalue_opp<MultiplyFunctor>(std::move(lhs), rhs);
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator*(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs,
+          TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &&rhs) {
+  return detail::rvalue_opp<MultiplyFunctor>(lhs, std::move(rhs));
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator*(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs,
+          TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &&rhs) {
+  return detail::rvalue_opp<MultiplyFunctor>(std::move(lhs), std::move(rhs));
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator/(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs,
+          const TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &rhs) {
+  return detail::rvalue_opp<DivideFunctor>(std::move(lhs), rhs);
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator/(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs,
+          TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &&rhs) {
+  return detail::rvalue_opp<DivideFunctor>(lhs, std::move(rhs));
+}
+
+template <typename IDX, typename V, typename U, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT>
+TSeries<IDX, typename std::common_type<V, U>::type, DIM, BACKEND, DatePolicy, NT>
+operator/(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs,
+          TSeries<IDX, U, DIM, BACKEND, DatePolicy, NT> &&rhs) {
+  return detail::rvalue_opp<DivideFunctor>(std::move(lhs), std::move(rhs));
+}
+
+// series and scalar, the compound operator on a copy, or on the series itself when it is an rvalue
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename S,
+          typename std::enable_if<detail::scalar_operand<V, S>::value, int>::type = 0>
+TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>
+operator+(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs, S rhs) {
+  TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> res(lhs);
+  res += rhs;
+  return res;
+}
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename S,
+          typename std::enable_if<detail::scalar_operand<V, S>::value, int>::type = 0>
+TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>
+operator+(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs, S rhs) {
+  lhs += rhs;
+  return std::move(lhs);
+}
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename S,
+          typename std::enable_if<detail::scalar_operand<V, S>::value, int>::type = 0>
+TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>
+operator-(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs, S rhs) {
+  TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> res(lhs);
+  res -= rhs;
+  return res;
+}
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename S,
+          typename std::enable_if<detail::scalar_operand<V, S>::value, int>::type = 0>
+TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>
+operator-(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs, S rhs) {
+  lhs -= rhs;
+  return std::move(lhs);
+}
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename S,
+          typename std::enable_if<detail::scalar_operand<V, S>::value, int>::type = 0>
+TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>
+operator*(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs, S rhs) {
+  TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> res(lhs);
+  res *= rhs;
+  return res;
+}
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename S,
+          typename std::enable_if<detail::scalar_operand<V, S>::value, int>::type = 0>
+TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>
+operator*(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs, S rhs) {
+  lhs *= rhs;
+  return std::move(lhs);
+}
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename S,
+          typename std::enable_if<detail::scalar_operand<V, S>::value, int>::type = 0>
+TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>
+operator/(const TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &lhs, S rhs) {
+  TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> res(lhs);
+  res /= rhs;
+  return res;
+}
+
+template <typename IDX, typename V, typename DIM, template <typename, typename, typename> class BACKEND,
+          template <typename> class DatePolicy, template <typename> class NT, typename S,
+          typename std::enable_if<detail::scalar_operand<V, S>::value, int>::type = 0>
+TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT>
+operator/(TSeries<IDX, V, DIM, BACKEND, DatePolicy, NT> &&lhs, S rhs) {
+  lhs /= rhs;
+  return std::move(lhs);
+}
+
 } // namespace tslib
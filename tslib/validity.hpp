@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright (C) 2016  Whit Armstrong                                    //
+//                                                                       //
+// This program is free software: you can redistribute it and/or modify  //
+// it under the terms of the GNU General Public License as published by  //
+// the Free Software Foundation, either version 3 of the License, or     //
+// (at your option) any later version.                                   //
+//                                                                       //
+// This program is distributed in the hope that it will be useful,       //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of        //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         //
+// GNU General Public License for more details.                          //
+//                                                                       //
+// You should have received a copy of the GNU General Public License     //
+// along with this program.  If not, see <http://www.gnu.org/licenses/>. //
+///////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tslib {
+
+// validity bitmap of one column, bit i is set when row i holds a value and clear when it is NA
+//
+// bits are packed 64 rows to a word, row i is bit i % 64 of word i / 64, the bits past size() are always clear
+// a backend can keep one mask per column next to the values (see BasicVectorBackend), the operations that know
+// about masks then combine columns a word at a time, skip whole blocks that are all valid or all NA and count NAs
+// with popcount instead of testing every value against the NA sentinel
+class ValidityMask {
+private:
+  std::vector<std::uint64_t> words_;
+  size_t size_;
+
+  static size_t words_for(size_t n) { return (n + 63) / 64; }
+  // word w with every row in it valid
+  std::uint64_t full_word(size_t w) const {
+    return w + 1 == words_.size() && size_ % 64 ? (std::uint64_t(1) << (size_ % 64)) - 1 : ~std::uint64_t(0);
+  }
+  // clears the bits past size_ in the last word
+  void trim() {
+    if (size_ % 64) { words_.back() &= full_word(words_.size() - 1); }
+  }
+
+public:
+  ValidityMask() : words_{}, size_{0} {}
+  // mask of n rows, all valid or all NA
+  explicit ValidityMask(size_t n, bool valid = true) : words_(words_for(n), valid ? ~std::uint64_t(0) : 0), size_{n} {
+    trim();
+  }
+
+  // mask of the n values from beg, isna(x) tells whether a value is NA
+  template <typename ITER, typename P> static ValidityMask from_values(ITER beg, size_t n, P isna) {
+    ValidityMask res(n, false);
+    for (size_t w = 0; w < res.words_.size(); ++w) {
+      std::uint64_t word{0};
+      const size_t m{std::min<size_t>(64, n - w * 64)};
+      for (size_t b = 0; b < m; ++b, ++beg) { word |= static_cast<std::uint64_t>(!isna(*beg)) << b; }
+      res.words_[w] = word;
+    }
+    return res;
+  }
+
+  size_t size() const { return size_; }
+  size_t nwords() const { return words_.size(); }
+  const std::uint64_t *words() const { return words_.data(); }
+  std::uint64_t *words() { return words_.data(); }
+
+  bool test(size_t i) const { return (words_[i / 64] >> (i % 64)) & 1; }
+  void set(size_t i, bool valid) {
+    const std::uint64_t bit{std::uint64_t(1) << (i % 64)};
+    words_[i / 64] = valid ? words_[i / 64] | bit : words_[i / 64] & ~bit;
+  }
+
+  // number of valid rows
+  size_t count() const {
+    size_t n{0};
+    for (std::uint64_t w : words_) { n += static_cast<size_t>(__builtin_popcountll(w)); }
+    return n;
+  }
+  size_t na_count() const { return size_ - count(); }
+  bool all() const { return count() == size_; }
+
+  // the n rows from offset, as a mask of their own
+  ValidityMask slice(size_t offset, size_t n) const {
+    ValidityMask res(n, false);
+    const size_t first{offset / 64}, shift{offset % 64};
+    for (size_t w = 0; w < res.words_.size(); ++w) {
+      std::uint64_t word{words_[first + w] >> shift};
+      if (shift && first + w + 1 < words_.size()) { word |= words_[first + w + 1] << (64 - shift); }
+      res.words_[w] = word;
+    }
+    res.trim();
+    return res;
+  }
+
+  // valid where both are valid, the masks must have the same size
+  ValidityMask &operator&=(const ValidityMask &m) {
+    for (size_t w = 0; w < words_.size(); ++w) { words_[w] &= m.words_[w]; }
+    return *this;
+  }
+
+  // calls f(i) for every valid row, in order
+  template <typename F> void for_each_valid(F f) const {
+    for (size_t w = 0; w < words_.size(); ++w) {
+      for (std::uint64_t word = words_[w]; word; word &= word - 1) {
+        f(w * 64 + static_cast<size_t>(__builtin_ctzll(word)));
+      }
+    }
+  }
+
+  // walks rows [0, size()) in blocks of 64
+  //  valid(b, e): rows [b, e) are all valid, runs of full words are passed as one range
+  //  na(b, e): rows [b, e) are all NA
+  //  mixed(b, e, word): anything else, row b + k is valid when bit k of word is set
+  template <typename VALID, typename NA, typename MIXED> void blocks(VALID valid, NA na, MIXED mixed) const {
+    size_t w{0};
+    while (w < words_.size()) {
+      const size_t b{w * 64}, e{std::min(b + 64, size_)};
+      const std::uint64_t word{words_[w]};
+      if (word == full_word(w)) {
+        size_t end_w{w + 1};
+        while (end_w < words_.size() && words_[end_w] == full_word(end_w)) { ++end_w; }
+        valid(b, std::min(end_w * 64, size_));
+        w = end_w;
+      } else {
+        if (word == 0) {
+          na(b, e);
+        } else {
+          mixed(b, e, word);
+        }
+        ++w;
+      }
+    }
+  }
+};
+
+namespace detail {
+
+// true when the backend of S can keep validity masks
+template <typename S> class keeps_masks {
+private:
+  template <typename T>
+  static auto test(int) -> decltype(std::declval<const T &>().getBackend().validity(0), std::true_type());
+  template <typename> static std::false_type test(long);
+
+public:
+  static const bool value = decltype(test<S>(0))::value;
+};
+
+// mask of column c of a series whose backend keeps validity masks, nullptr for any other series or view
+template <typename S>
+auto series_mask(const S &s, size_t c, int) -> decltype(&s.getBackend().validity(0), (const ValidityMask *)nullptr) {
+  return s.getBackend().hasValidity() ? &s.getBackend().validity(static_cast<decltype(s.ncol())>(c)) : nullptr;
+}
+template <typename S> const ValidityMask *series_mask(const S &, size_t, long) { return nullptr; }
+template <typename S> const ValidityMask *series_mask(const S &s, size_t c) { return series_mask(s, c, 0); }
+
+// true when s keeps validity masks, or is a view of a series that does
+template <typename S> auto has_validity(const S &s, int) -> decltype(s.hasValidity()) { return s.hasValidity(); }
+template <typename S> bool has_validity(const S &s, long) { return series_mask(s, 0, 0) != nullptr; }
+template <typename S> bool has_validity(const S &s) { return has_validity(s, 0); }
+
+// gives a series its masks, false when its backend can't keep them
+template <typename S>
+auto set_series_masks(S &s, std::vector<ValidityMask> &&masks, int)
+    -> decltype(s.getBackend().setValidity(std::move(masks))) {
+  return s.getBackend().setValidity(std::move(masks));
+}
+template <typename S> bool set_series_masks(S &, std::vector<ValidityMask> &&, long) { return false; }
+template <typename S> bool set_series_masks(S &s, std::vector<ValidityMask> &&masks) {
+  return set_series_masks(s, std::move(masks), 0);
+}
+
+} // namespace detail
+
+} // namespace tslib